@@ -27,6 +27,7 @@
 #include <media/AudioRecord.h>
 #include <dlfcn.h>
 #include <math.h>
+#include <pthread.h>
 extern "C" {
 #ifdef QCOM_CSDCLIENT_ENABLED
 static int (*csd_disable_device)();
@@ -113,6 +114,16 @@ ALSADevice::ALSADevice() {
     mProxyParams.mCaptureBuffer = NULL;
     mProxyParams.mProxyState = proxy_params::EProxyClosed;
     mProxyParams.mProxyPcmHandle = NULL;
+    mProxyParams.mWakeups = 0;
+    mProxyParams.mSyncs = 0;
+    mProxyParams.mSlipping = false;
+    mProxyParams.mSlipFrames = 0;
+    mProxyParams.mOverflows = 0;
+    mProxyParams.mOverflowFrames = 0;
+    mProxyParams.mLatencySum = 0;
+    mProxyParams.mLatencyCount = 0;
+    mProxyParams.mLatencyMax = 0;
+    memset(&mSwitchStats, 0, sizeof(mSwitchStats));
 
     ALOGD("ALSA module opened");
 }
@@ -239,14 +250,7 @@ status_t ALSADevice::setHardwareParams(alsa_handle_t *handle)
     uint32_t codec_id = 0;
 
     ALOGD("handle->format: 0x%x", handle->format);
-    if ((!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_DL)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_DL)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL))) {
+    if (isCompressedUseCase(handle->useCaseId)) {
         ALOGV("Tunnel mode detected...");
         //get the list of codec supported by hardware
         if (ioctl(handle->handle->fd, SNDRV_COMPRESS_GET_CAPS, &compr_cap)) {
@@ -260,12 +264,8 @@ status_t ALSADevice::setHardwareParams(alsa_handle_t *handle)
         }
         else if (handle->format == AUDIO_FORMAT_AMR_WB) {
           codec_id = get_compressed_format("AMR_WB");
-          if ((!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED)) ||
-              (!strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED)) ||
-              (!strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL)) ||
-              (!strcmp(handle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL)) ||
-              (!strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_DL)) ||
-              (!strcmp(handle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_DL))) {
+          if (isCompressedUseCase(handle->useCaseId) &&
+              !isMmapUseCase(handle->useCaseId)) {
               compr_params.codec.options.generic.reserved[0] = 8; /*band mode - 23.85 kbps*/
               compr_params.codec.options.generic.reserved[1] = 0; /*dtx mode - disable*/
           }
@@ -316,10 +316,7 @@ status_t ALSADevice::setHardwareParams(alsa_handle_t *handle)
 
 #ifdef QCOM_SSR_ENABLED
     if (channels == 6) {
-        if (!strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC, strlen(SND_USE_CASE_VERB_HIFI_REC))
-            || !strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, strlen(SND_USE_CASE_VERB_HIFI_REC_COMPRESSED))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+        if (isHiFiRecUseCase(handle->useCaseId)) {
             channels = 4;
             reqBuffSize = DEFAULT_IN_BUFFER_SIZE*4;
             ALOGV("HWParams: Use 4 channels in kernel for 5.1(%s) recording reqBuffSize:%d", handle->useCase,reqBuffSize);
@@ -328,10 +325,7 @@ status_t ALSADevice::setHardwareParams(alsa_handle_t *handle)
 #endif
 
     param_init(params);
-    if ((!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_LPA)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL))) {
+    if (isMmapUseCase(handle->useCaseId)) {
         param_set_mask(params, SNDRV_PCM_HW_PARAM_ACCESS,
                        SNDRV_PCM_ACCESS_MMAP_INTERLEAVED);
     }
@@ -349,14 +343,7 @@ status_t ALSADevice::setHardwareParams(alsa_handle_t *handle)
             || handle->format == AUDIO_FORMAT_EVRCWB
 #endif
             ) {
-            if ((strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) &&
-                (strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL)) &&
-                (strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED)) &&
-                (strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL)) &&
-                (strcmp(handle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL)) &&
-                (strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_DL)) &&
-                (strcmp(handle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_DL)) &&
-                (strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+            if (!isCompressedUseCase(handle->useCaseId)) {
               format = SNDRV_PCM_FORMAT_SPECIAL;
               ALOGW("setting format to SNDRV_PCM_FORMAT_SPECIAL");
             }
@@ -370,10 +357,7 @@ status_t ALSADevice::setHardwareParams(alsa_handle_t *handle)
     param_set_int(params, SNDRV_PCM_HW_PARAM_PERIOD_BYTES, reqBuffSize);
     //Setting number of periods to 4. If the system is loaded and record
     // obtain buffer is seen increase PCM_RECORD_PERIOD_COUNT to a value between 4-16.
-    if (!strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC,
-            strlen(SND_USE_CASE_VERB_HIFI_REC)) ||
-            !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC,
-            strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))) {
+    if (isHiFiRecUseCase(handle->useCaseId)) {
         param_set_int(params, SNDRV_PCM_HW_PARAM_PERIODS, PCM_RECORD_PERIOD_COUNT);
     }
     param_set_int(params, SNDRV_PCM_HW_PARAM_SAMPLE_BITS, 16);
@@ -402,10 +386,10 @@ status_t ALSADevice::setHardwareParams(alsa_handle_t *handle)
     handle->handle->rate = handle->sampleRate;
     handle->handle->channels = handle->channels;
     handle->periodSize = handle->handle->period_size;
-    if (strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC) &&
-        strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED) &&
-        strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC) &&
-        strcmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED) &&
+    if ((handle->useCaseId != SND_UCM_ID_VERB_HIFI_REC) &&
+        (handle->useCaseId != SND_UCM_ID_VERB_HIFI_REC_COMPRESSED) &&
+        (handle->useCaseId != SND_UCM_ID_MOD_CAPTURE_MUSIC) &&
+        (handle->useCaseId != SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED) &&
         (6 != handle->channels)) {
         //Do not update buffersize for 5.1 recording
         if (handle->format == AUDIO_FORMAT_AMR_WB &&
@@ -436,10 +420,7 @@ status_t ALSADevice::setSoftwareParams(alsa_handle_t *handle)
 
 #ifdef QCOM_SSR_ENABLED
     if (channels == 6) {
-        if (!strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC, strlen(SND_USE_CASE_VERB_HIFI_REC))
-            || !strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, strlen(SND_USE_CASE_VERB_HIFI_REC_COMPRESSED))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+        if (isHiFiRecUseCase(handle->useCaseId)) {
             ALOGV("SWParams: Use 4 channels in kernel for 5.1(%s) recording ", handle->useCase);
             channels = 4;
         }
@@ -447,10 +428,10 @@ status_t ALSADevice::setSoftwareParams(alsa_handle_t *handle)
 #endif
 
     // Get the current software parameters
-    params->tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+    // Timestamp every hw pointer update for render position reporting
+    params->tstamp_mode = SNDRV_PCM_TSTAMP_ENABLE;
     params->period_step = 1;
-    if(((!strcmp(handle->useCase,SND_USE_CASE_MOD_PLAY_VOIP)) ||
-        (!strcmp(handle->useCase,SND_USE_CASE_VERB_IP_VOICECALL)))){
+    if (isVoipUseCase(handle->useCaseId)) {
           ALOGV("setparam:  start & stop threshold for Voip ");
           params->avail_min = handle->channels - 1 ? periodSize/4 : periodSize/2;
           params->start_threshold = periodSize/2;
@@ -473,15 +454,70 @@ status_t ALSADevice::setSoftwareParams(alsa_handle_t *handle)
     return NO_ERROR;
 }
 
+//UCM changes queued by a device switch before an early flush
+#define UCM_BATCH_SIZE 32
+
+/* Collects the UCM changes of a device switch and applies them with
+ * snd_use_case_set_batch(), so the switch takes card_lock once instead of
+ * once per verb, modifier and device change. Queued values must stay
+ * valid until they are flushed.
+ */
+class UcmBatch {
+public:
+    UcmBatch(snd_use_case_mgr_t *ucMgr)
+        : mUcMgr(ucMgr), mCount(0), mApplied(0), mFlushes(0), mUs(0) {}
+    ~UcmBatch() { flush(); }
+
+    void set(const char *identifier, const char *value)
+    {
+        if (mCount == UCM_BATCH_SIZE)
+            flush();
+        mOps[mCount].identifier = identifier;
+        mOps[mCount].value = value;
+        mCount++;
+    }
+
+    void flush()
+    {
+        if (!mCount)
+            return;
+        nsecs_t start = systemTime();
+        int err = snd_use_case_set_batch(mUcMgr, mOps, mCount);
+        if (err < 0)
+            ALOGW("UCM batch of %d changes, first error %d", mCount, err);
+        mUs += (systemTime() - start) / 1000;
+        mApplied += mCount;
+        mFlushes++;
+        mCount = 0;
+    }
+
+    uint32_t applied() const { return mApplied; }
+    uint32_t flushes() const { return mFlushes; }
+    int64_t  us() const { return mUs; }
+
+private:
+    snd_use_case_mgr_t *mUcMgr;
+    snd_use_case_op_t   mOps[UCM_BATCH_SIZE];
+    int                 mCount;
+    uint32_t            mApplied;
+    uint32_t            mFlushes;
+    int64_t             mUs;
+};
+
 void ALSADevice::switchDevice(alsa_handle_t *handle, uint32_t devices, uint32_t mode)
 {
     const char **mods_list;
-    use_case_t useCaseNode;
     unsigned usecase_type = 0;
     bool inCallDevSwitch = false;
-    char *rxDevice, *txDevice, ident[70], *use_case = NULL;
-    int err = 0, index, mods_size;
+    bool rxDeroute = false, txDeroute = false, verbDeroute = false;
+    const char *rxDevice, *txDevice;
+    char ident[70];
+    const char *use_case = NULL;
+    char prevRxDevice[MAX_STR_LEN], prevTxDevice[MAX_STR_LEN];
+    int err = 0, index, mods_size, verb_id;
     int rx_dev_id, tx_dev_id;
+    nsecs_t start = systemTime();
+    UcmBatch batch(handle->ucMgr);
     ALOGV("%s: device %#x mode:%d", __FUNCTION__, devices, mode);
 
     if ((mode == AUDIO_MODE_IN_CALL)  || (mode == AUDIO_MODE_IN_COMMUNICATION)) {
@@ -557,10 +593,7 @@ void ALSADevice::switchDevice(alsa_handle_t *handle, uint32_t devices, uint32_t
     }
 #ifdef QCOM_SSR_ENABLED
     if ((devices & AudioSystem::DEVICE_IN_BUILTIN_MIC) && ( 6 == handle->channels)) {
-        if (!strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC, strlen(SND_USE_CASE_VERB_HIFI_REC))
-            || !strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, strlen(SND_USE_CASE_VERB_HIFI_REC_COMPRESSED))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+        if (isHiFiRecUseCase(handle->useCaseId)) {
             ALOGV(" switchDevice , use ssr devices for channels:%d usecase:%s",handle->channels,handle->useCase);
             setFlags(SSRQMIC_FLAG);
         }
@@ -594,72 +627,103 @@ void ALSADevice::switchDevice(alsa_handle_t *handle, uint32_t devices, uint32_t
     }
 #endif
 
-    snd_use_case_get(handle->ucMgr, "_verb", (const char **)&use_case);
+#ifdef QCOM_ACDB_ENABLED
+    /* Select the EC ref device for the new Tx device up front: it has to be
+     * in place before the Rx/Tx devices come up, which happens when the
+     * _verb/_enamod use cases are routed again at the end of the batch */
+    if (((devices & AudioSystem::DEVICE_IN_BUILTIN_MIC) || (devices & AudioSystem::DEVICE_IN_BACK_MIC))
+        && (mInChannels == 1)) {
+        ALOGD("switchDevice:use device %x for channels:%d usecase:%s",devices,handle->channels,handle->useCase);
+        int ec_acdbid;
+        const char *ec_dev;
+        char *ec_rx_dev;
+        memset(&ident,0,sizeof(ident));
+        strlcpy(ident, "ACDBID/", sizeof(ident));
+        strlcat(ident, (txDevice != NULL) ? txDevice : mCurTxUCMDevice, sizeof(ident));
+        tx_dev_id = snd_use_case_get(handle->ucMgr, ident, NULL);
+        if (acdb_loader_get_ecrx_device) {
+            ec_acdbid = acdb_loader_get_ecrx_device(tx_dev_id);
+            ec_dev = getUCMDeviceFromAcdbId(ec_acdbid);
+            if (ec_dev) {
+                memset(&ident,0,sizeof(ident));
+                strlcpy(ident, "EC_REF_RXMixerCTL/", sizeof(ident));
+                strlcat(ident, ec_dev, sizeof(ident));
+                snd_use_case_get(handle->ucMgr, ident, (const char **)&ec_rx_dev);
+                ALOGD("SwitchDevice: ec_ref_rx_acdbid:%d ec_dev:%s ec_rx_dev:%s", ec_acdbid, ec_dev, ec_rx_dev);
+                if (ec_rx_dev) {
+                    setEcrxDevice(ec_rx_dev);
+                    free(ec_rx_dev);
+                }
+            }
+        } else {
+            ALOGE("acdb_loader_get_ecrx_device is NULL");
+        }
+    }
+#endif
+
+    /* Everything from here to the re-route of the use cases is queued on
+     * the batch and applied as one UCM transition */
+    verb_id = snd_use_case_get_verb_id(handle->ucMgr);
+    use_case = snd_use_case_id_to_name(verb_id);
     mods_size = snd_use_case_get_list(handle->ucMgr, "_enamods", &mods_list);
     if (rxDevice != NULL) {
         if ((strncmp(mCurRxUCMDevice, "None", 4)) &&
             (mSSRComplete || (strncmp(rxDevice, mCurRxUCMDevice, MAX_STR_LEN)) || (inCallDevSwitch == true))) {
-            if ((use_case != NULL) && (strncmp(use_case, SND_USE_CASE_VERB_INACTIVE,
-                strlen(SND_USE_CASE_VERB_INACTIVE)))) {
+            rxDeroute = true;
+            if ((verb_id != SND_UCM_ID_NONE) && (verb_id != SND_UCM_ID_VERB_INACTIVE)) {
                 usecase_type = getUseCaseType(use_case);
                 if (usecase_type & USECASE_TYPE_RX) {
                     ALOGD("Deroute use case %s type is %d\n", use_case, usecase_type);
-                    strlcpy(useCaseNode.useCase, use_case, MAX_STR_LEN);
-                    snd_use_case_set(handle->ucMgr, "_verb", SND_USE_CASE_VERB_INACTIVE);
-                    mUseCaseList.push_front(useCaseNode);
+                    batch.set("_verb", SND_USE_CASE_VERB_INACTIVE);
+                    verbDeroute = true;
                 }
             }
-            if (mods_size) {
-                for(index = 0; index < mods_size; index++) {
-                    usecase_type = getUseCaseType(mods_list[index]);
-                    if (usecase_type & USECASE_TYPE_RX) {
-                        ALOGD("Deroute use case %s type is %d\n", mods_list[index], usecase_type);
-                        strlcpy(useCaseNode.useCase, mods_list[index], MAX_STR_LEN);
-                        snd_use_case_set(handle->ucMgr, "_dismod", mods_list[index]);
-                        mUseCaseList.push_back(useCaseNode);
-                    }
+            for (index = 0; index < mods_size; index++) {
+                usecase_type = getUseCaseType(mods_list[index]);
+                if (usecase_type & USECASE_TYPE_RX) {
+                    ALOGD("Deroute use case %s type is %d\n", mods_list[index], usecase_type);
+                    batch.set("_dismod", mods_list[index]);
                 }
             }
-            snd_use_case_set(handle->ucMgr, "_disdev", mCurRxUCMDevice);
+            strlcpy(prevRxDevice, mCurRxUCMDevice, sizeof(prevRxDevice));
+            batch.set("_disdev", prevRxDevice);
         }
     }
     if (txDevice != NULL) {
         if ((strncmp(mCurTxUCMDevice, "None", 4)) &&
             (mSSRComplete || (strncmp(txDevice, mCurTxUCMDevice, MAX_STR_LEN)) || (inCallDevSwitch == true))) {
-            if ((use_case != NULL) && (strncmp(use_case, SND_USE_CASE_VERB_INACTIVE,
-                strlen(SND_USE_CASE_VERB_INACTIVE)))) {
+            txDeroute = true;
+            if ((verb_id != SND_UCM_ID_NONE) && (verb_id != SND_UCM_ID_VERB_INACTIVE)) {
                 usecase_type = getUseCaseType(use_case);
                 if ((usecase_type & USECASE_TYPE_TX) && (!(usecase_type & USECASE_TYPE_RX))) {
                     ALOGD("Deroute use case %s type is %d\n", use_case, usecase_type);
-                    strlcpy(useCaseNode.useCase, use_case, MAX_STR_LEN);
-                    snd_use_case_set(handle->ucMgr, "_verb", SND_USE_CASE_VERB_INACTIVE);
-                    mUseCaseList.push_front(useCaseNode);
+                    batch.set("_verb", SND_USE_CASE_VERB_INACTIVE);
+                    verbDeroute = true;
                 }
             }
-            if (mods_size) {
-                for(index = 0; index < mods_size; index++) {
-                    usecase_type = getUseCaseType(mods_list[index]);
-                    if ((usecase_type & USECASE_TYPE_TX) && (!(usecase_type & USECASE_TYPE_RX))) {
-                        ALOGD("Deroute use case %s type is %d\n", mods_list[index], usecase_type);
-                        strlcpy(useCaseNode.useCase, mods_list[index], MAX_STR_LEN);
-                        snd_use_case_set(handle->ucMgr, "_dismod", mods_list[index]);
-                        mUseCaseList.push_back(useCaseNode);
-                    }
+            for (index = 0; index < mods_size; index++) {
+                usecase_type = getUseCaseType(mods_list[index]);
+                if ((usecase_type & USECASE_TYPE_TX) && (!(usecase_type & USECASE_TYPE_RX))) {
+                    ALOGD("Deroute use case %s type is %d\n", mods_list[index], usecase_type);
+                    batch.set("_dismod", mods_list[index]);
                 }
             }
-            snd_use_case_set(handle->ucMgr, "_disdev", mCurTxUCMDevice);
+            strlcpy(prevTxDevice, mCurTxUCMDevice, sizeof(prevTxDevice));
+            batch.set("_disdev", prevTxDevice);
        }
     }
 
     ALOGV("%s,rxDev:%s, txDev:%s, curRxDev:%s, curTxDev:%s\n", __FUNCTION__, rxDevice, txDevice, mCurRxUCMDevice, mCurTxUCMDevice);
 
     if (rxDevice != NULL) {
-        snd_use_case_set(handle->ucMgr, "_enadev", rxDevice);
+        batch.set("_enadev", rxDevice);
         strlcpy(mCurRxUCMDevice, rxDevice, sizeof(mCurRxUCMDevice));
     }
     if (txDevice != NULL) {
-       snd_use_case_set(handle->ucMgr, "_enadev", txDevice);
-       strlcpy(mCurTxUCMDevice, txDevice, sizeof(mCurTxUCMDevice));
+       batch.set("_enadev", txDevice);
+       //txDevice may be the current device itself
+       if (txDevice != mCurTxUCMDevice)
+           strlcpy(mCurTxUCMDevice, txDevice, sizeof(mCurTxUCMDevice));
     }
 #ifdef QCOM_CSDCLIENT_ENABLED
     if (isPlatformFusion3() && (inCallDevSwitch == true)) {
@@ -683,6 +747,7 @@ void ALSADevice::switchDevice(alsa_handle_t *handle, uint32_t devices, uint32_t
         /* Parallelize codec configuration on APQ with CSD voice call
          * sequence on MDM. This will reduce in call device switch delay
          */
+        batch.flush();
         if (csd_enable_device_config == NULL) {
             ALOGE("csd_enable_device_config is NULL");
         } else {
@@ -695,56 +760,26 @@ void ALSADevice::switchDevice(alsa_handle_t *handle, uint32_t devices, uint32_t
 #endif
 
         ALOGD("switchDevice: mCurTxUCMDevivce %s mCurRxDevDevice %s", mCurTxUCMDevice, mCurRxUCMDevice);
-        /* Enable the EC ref device before enabling the Rx/Tx devices */
-        /* Enabling the Rx/Tx devices is being happened while enabling _verb/_enamod usecases */
 
-#ifdef QCOM_ACDB_ENABLED
-    if (((devices & AudioSystem::DEVICE_IN_BUILTIN_MIC) || (devices & AudioSystem::DEVICE_IN_BACK_MIC))
-        && (mInChannels == 1)) {
-        ALOGD("switchDevice:use device %x for channels:%d usecase:%s",devices,handle->channels,handle->useCase);
-        int ec_acdbid;
-        char *ec_dev;
-        char *ec_rx_dev;
-        memset(&ident,0,sizeof(ident));
-        strlcpy(ident, "ACDBID/", sizeof(ident));
-        strlcat(ident, mCurTxUCMDevice, sizeof(ident));
-        tx_dev_id = snd_use_case_get(handle->ucMgr, ident, NULL);
-        if (acdb_loader_get_ecrx_device) {
-            ec_acdbid = acdb_loader_get_ecrx_device(tx_dev_id);
-            ec_dev = getUCMDeviceFromAcdbId(ec_acdbid);
-            if (ec_dev) {
-                memset(&ident,0,sizeof(ident));
-                strlcpy(ident, "EC_REF_RXMixerCTL/", sizeof(ident));
-                strlcat(ident, ec_dev, sizeof(ident));
-                snd_use_case_get(handle->ucMgr, ident, (const char **)&ec_rx_dev);
-                ALOGD("SwitchDevice: ec_ref_rx_acdbid:%d ec_dev:%s ec_rx_dev:%s", ec_acdbid, ec_dev, ec_rx_dev);
-                if (ec_rx_dev) {
-                    setEcrxDevice(ec_rx_dev);
-                    free(ec_rx_dev);
-                }
-                free(ec_dev);
-            }
-        } else {
-            ALOGE("acdb_loader_get_ecrx_device is NULL");
-        }
+    //Route the derouted use cases again, verb first
+    if (verbDeroute) {
+        ALOGD("Route use case %s\n", use_case);
+        batch.set("_verb", use_case);
     }
-#endif
-
-    for(ALSAUseCaseList::iterator it = mUseCaseList.begin(); it != mUseCaseList.end(); ++it) {
-        ALOGD("Route use case %s\n", it->useCase);
-        if ((use_case != NULL) && (strncmp(use_case, SND_USE_CASE_VERB_INACTIVE,
-            strlen(SND_USE_CASE_VERB_INACTIVE))) && (!strncmp(use_case, it->useCase, MAX_UC_LEN))) {
-            snd_use_case_set(handle->ucMgr, "_verb", it->useCase);
-        } else {
-            snd_use_case_set(handle->ucMgr, "_enamod", it->useCase);
+    for (index = 0; rxDeroute && index < mods_size; index++) {
+        if (getUseCaseType(mods_list[index]) & USECASE_TYPE_RX) {
+            ALOGD("Route use case %s\n", mods_list[index]);
+            batch.set("_enamod", mods_list[index]);
         }
     }
-    if (!mUseCaseList.empty())
-        mUseCaseList.clear();
-    if (use_case != NULL) {
-        free(use_case);
-        use_case = NULL;
+    for (index = 0; txDeroute && index < mods_size; index++) {
+        usecase_type = getUseCaseType(mods_list[index]);
+        if ((usecase_type & USECASE_TYPE_TX) && (!(usecase_type & USECASE_TYPE_RX))) {
+            ALOGD("Route use case %s\n", mods_list[index]);
+            batch.set("_enamod", mods_list[index]);
+        }
     }
+    batch.flush();
 #ifdef QCOM_FM_ENABLED
     if (rxDevice != NULL) {
         setFmVolume(mFmVolume);
@@ -772,14 +807,31 @@ void ALSADevice::switchDevice(alsa_handle_t *handle, uint32_t devices, uint32_t
     }
 #endif
 
-    if (rxDevice != NULL) {
-        free(rxDevice);
-        rxDevice = NULL;
-    }
-    if (txDevice != NULL) {
-        free(txDevice);
-        txDevice = NULL;
-    }
+    mSwitchStats.count++;
+    mSwitchStats.lastUs = (systemTime() - start) / 1000;
+    if (mSwitchStats.lastUs > mSwitchStats.maxUs)
+        mSwitchStats.maxUs = mSwitchStats.lastUs;
+    mSwitchStats.totalUs += mSwitchStats.lastUs;
+    mSwitchStats.ucmUs += batch.us();
+    mSwitchStats.ucmChanges += batch.applied();
+    mSwitchStats.ucmBatches += batch.flushes();
+    ALOGV("%s: took %lld us, %u UCM changes in %u batches taking %lld us", __FUNCTION__,
+          (long long)mSwitchStats.lastUs, batch.applied(), batch.flushes(),
+          (long long)batch.us());
+}
+
+void ALSADevice::dump(int fd)
+{
+    char buffer[256];
+
+    snprintf(buffer, sizeof(buffer),
+             "Device switches: %u, last %lld us, max %lld us, total %lld us\n"
+             "  UCM: %u changes in %u batches, %lld us\n",
+             mSwitchStats.count, (long long)mSwitchStats.lastUs,
+             (long long)mSwitchStats.maxUs, (long long)mSwitchStats.totalUs,
+             mSwitchStats.ucmChanges, mSwitchStats.ucmBatches,
+             (long long)mSwitchStats.ucmUs);
+    ::write(fd, buffer, strlen(buffer));
 }
 
 // ----------------------------------------------------------------------------
@@ -816,23 +868,25 @@ status_t ALSADevice::open(alsa_handle_t *handle)
     // The PCM stream is opened in blocking mode, per ALSA defaults.  The
     // AudioFlinger seems to assume blocking mode too, so asynchronous mode
     // should not be used.
-    if ((!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_LPA)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL))) {
+    if (isMmapUseCase(handle->useCaseId)) {
         ALOGV("LPA/tunnel use case");
         flags |= PCM_MMAP;
         flags |= DEBUG_ON;
-    } else if ((!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI2)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_MUSIC2)) ||
-        (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_MUSIC))) {
-        ALOGV("Music case");
-        flags = PCM_OUT;
     } else {
-        flags = PCM_IN;
+        switch (handle->useCaseId) {
+        case SND_UCM_ID_VERB_HIFI:
+        case SND_UCM_ID_VERB_HIFI2:
+        case SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC:
+        case SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC:
+        case SND_UCM_ID_MOD_PLAY_MUSIC2:
+        case SND_UCM_ID_MOD_PLAY_MUSIC:
+            ALOGV("Music case");
+            flags = PCM_OUT;
+            break;
+        default:
+            flags = PCM_IN;
+            break;
+        }
     }
 
     if (handle->channels == 1) {
@@ -842,10 +896,7 @@ status_t ALSADevice::open(alsa_handle_t *handle)
         flags |= PCM_QUAD;
     } else if (handle->channels == 6 ) {
 #ifdef QCOM_SSR_ENABLED
-        if (!strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC, strlen(SND_USE_CASE_VERB_HIFI_REC))
-            || !strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, strlen(SND_USE_CASE_VERB_HIFI_REC_COMPRESSED))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+        if (isHiFiRecUseCase(handle->useCaseId)) {
             flags |= PCM_QUAD;
         } else
 #endif
@@ -1018,102 +1069,126 @@ status_t ALSADevice::startVoipCall(alsa_handle_t *handle)
      return NO_ERROR;
 }
 
-status_t ALSADevice::startVoiceCall(alsa_handle_t *handle, uint32_t vsid)
-{
-    char* devName = NULL;
-    unsigned flags = 0;
-    int err = NO_ERROR;
+/* Capture side of a voice call, opened on a helper thread while the
+ * playback side comes up on the caller.
+ */
+struct voice_tx_open {
+    ALSADevice    *device;
+    alsa_handle_t *handle;
+    struct pcm    *pcm;
+    int64_t        us;
+};
 
-    ALOGD("startVoiceCall: handle %p", handle);
-    // ASoC multicomponent requires a valid path (frontend/backend) for
-    // the device to be opened
+void *ALSADevice::voiceTxOpenThread(void *arg)
+{
+    struct voice_tx_open *op = (struct voice_tx_open *)arg;
+    char *devName = NULL;
+    nsecs_t start = systemTime();
 
-    flags = PCM_OUT | PCM_MONO;
-    if (deviceName(handle, flags, &devName) < 0) {
+    if ((op->device->deviceName(op->handle, PCM_IN | PCM_MONO, &devName) < 0) ||
+        (devName == NULL)) {
         ALOGE("Failed to get pcm device node");
-        return NO_INIT;
-    }
-    if (devName != NULL) {
-        handle->handle = pcm_open(flags, (char*)devName);
     } else {
-         ALOGE("Failed to get pcm device node");
-         return NO_INIT;
+        op->pcm = pcm_open(PCM_IN | PCM_MONO, devName);
     }
+    free(devName);
+    op->us = (systemTime() - start) / 1000;
+    return NULL;
+}
 
-    if (!handle->handle || (handle->handle->fd < 0)) {
-        ALOGE("startVoiceCall: could not open PCM device");
-        goto Error;
-    }
+status_t ALSADevice::startVoicePcm(alsa_handle_t *handle, unsigned flags)
+{
+    int err;
 
     handle->handle->flags = flags;
     err = setHardwareParams(handle);
     if(err != NO_ERROR) {
         ALOGE("startVoiceCall: setHardwareParams failed");
-        goto Error;
+        return err;
     }
 
     err = setSoftwareParams(handle);
     if(err != NO_ERROR) {
         ALOGE("startVoiceCall: setSoftwareParams failed");
-        goto Error;
+        return err;
     }
 
     err = pcm_prepare(handle->handle);
     if(err != NO_ERROR) {
         ALOGE("startVoiceCall: pcm_prepare failed");
-        goto Error;
+        return err;
     }
 
     if (ioctl(handle->handle->fd, SNDRV_PCM_IOCTL_START)) {
         ALOGE("startVoiceCall:SNDRV_PCM_IOCTL_START failed\n");
-        goto Error;
+        return -errno;
     }
+    return NO_ERROR;
+}
 
-    // Store the PCM playback device pointer in rxHandle
-    handle->rxHandle = handle->handle;
-    if (devName) {
-        free(devName);
-        devName = NULL;
+status_t ALSADevice::startVoiceCall(alsa_handle_t *handle, uint32_t vsid)
+{
+    char* devName = NULL;
+    unsigned flags = 0;
+    int err = NO_ERROR;
+    struct voice_tx_open txOpen;
+    pthread_t txThread;
+    bool txThreadStarted;
+    nsecs_t start = systemTime();
+
+    ALOGD("startVoiceCall: handle %p", handle);
+    // ASoC multicomponent requires a valid path (frontend/backend) for
+    // the device to be opened
+
+    // Only the capture open overlaps the playback bring-up: its hw params
+    // follow the buffer size the playback PCM settles on, and the capture
+    // PCM is still started after the playback one
+    txOpen.device = this;
+    txOpen.handle = handle;
+    txOpen.pcm = NULL;
+    txOpen.us = 0;
+    txThreadStarted = !pthread_create(&txThread, (const pthread_attr_t *) NULL,
+                                      voiceTxOpenThread, &txOpen);
+    if (!txThreadStarted) {
+        ALOGW("startVoiceCall: opening the capture PCM serially");
     }
 
-    // Open PCM capture device
-    flags = PCM_IN | PCM_MONO;
-    if (deviceName(handle, flags, &devName) < 0) {
+    flags = PCM_OUT | PCM_MONO;
+    if ((deviceName(handle, flags, &devName) < 0) || (devName == NULL)) {
         ALOGE("Failed to get pcm device node");
         goto Error;
     }
-    if (devName != NULL) {
-        handle->handle = pcm_open(flags, (char*)devName);
-    } else {
-         ALOGE("Failed to get pcm device node");
-         return NO_INIT;
-    }
+    handle->handle = pcm_open(flags, (char*)devName);
+
     if (!handle->handle || (handle->handle->fd < 0)) {
-        free(devName);
+        ALOGE("startVoiceCall: could not open PCM device");
         goto Error;
     }
 
-    handle->handle->flags = flags;
-    err = setHardwareParams(handle);
-    if(err != NO_ERROR) {
-        ALOGE("startVoiceCall: setHardwareParams failed");
+    if (startVoicePcm(handle, flags) != NO_ERROR) {
         goto Error;
     }
 
-    err = setSoftwareParams(handle);
-    if(err != NO_ERROR) {
-        ALOGE("startVoiceCall: setSoftwareParams failed");
-        goto Error;
-    }
+    // Store the PCM playback device pointer in rxHandle
+    handle->rxHandle = handle->handle;
+    handle->handle = 0;
 
-    err = pcm_prepare(handle->handle);
-    if(err != NO_ERROR) {
-        ALOGE("startVoiceCall: pcm_prepare failed");
+    // Open PCM capture device
+    flags = PCM_IN | PCM_MONO;
+    if (txThreadStarted) {
+        pthread_join(txThread, NULL);
+        txThreadStarted = false;
+    } else {
+        voiceTxOpenThread(&txOpen);
+    }
+    handle->handle = txOpen.pcm;
+    txOpen.pcm = NULL;
+    if (!handle->handle || (handle->handle->fd < 0)) {
+        ALOGE("startVoiceCall: could not open capture PCM device");
         goto Error;
     }
 
-    if (ioctl(handle->handle->fd, SNDRV_PCM_IOCTL_START)) {
-        ALOGE("startVoiceCall:SNDRV_PCM_IOCTL_START failed\n");
+    if (startVoicePcm(handle, flags) != NO_ERROR) {
         goto Error;
     }
 
@@ -1131,6 +1206,8 @@ status_t ALSADevice::startVoiceCall(alsa_handle_t *handle, uint32_t vsid)
     }
 #endif
 
+    ALOGV("startVoiceCall: vsid %x up in %lld us, capture open took %lld us",
+          vsid, (long long)((systemTime() - start) / 1000), (long long)txOpen.us);
     if (devName) {
         free(devName);
         devName = NULL;
@@ -1139,6 +1216,12 @@ status_t ALSADevice::startVoiceCall(alsa_handle_t *handle, uint32_t vsid)
 
 Error:
     ALOGE("startVoiceCall: Failed to initialize ALSA device '%s'", devName);
+    if (txThreadStarted) {
+        pthread_join(txThread, NULL);
+    }
+    if (txOpen.pcm) {
+        pcm_close(txOpen.pcm);
+    }
     if (devName) {
         free(devName);
         devName = NULL;
@@ -1309,12 +1392,12 @@ status_t ALSADevice::close(alsa_handle_t *handle, uint32_t vsid)
     ALOGD("close: handle %p h %p", handle, h);
     if (h) {
 #ifdef QCOM_CSDCLIENT_ENABLED
-        if ((!strcmp(handle->useCase, SND_USE_CASE_VERB_VOICECALL) ||
-             !strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_VOICE)) ||
-            (!strcmp(handle->useCase, SND_USE_CASE_VERB_VOLTE) ||
-             !strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_VOLTE)) ||
-            (!strcmp(handle->useCase, SND_USE_CASE_VERB_VOICE2) ||
-             !strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_VOICE2)) &&
+        if ((handle->useCaseId == SND_UCM_ID_VERB_VOICECALL ||
+             handle->useCaseId == SND_UCM_ID_MOD_PLAY_VOICE) ||
+            (handle->useCaseId == SND_UCM_ID_VERB_VOLTE ||
+             handle->useCaseId == SND_UCM_ID_MOD_PLAY_VOLTE) ||
+            (handle->useCaseId == SND_UCM_ID_VERB_VOICE2 ||
+             handle->useCaseId == SND_UCM_ID_MOD_PLAY_VOICE2) &&
             isPlatformFusion3()) {
             if (csd_stop_voice == NULL) {
                 ALOGE("csd_client_disable_device is NULL");
@@ -1327,8 +1410,8 @@ status_t ALSADevice::close(alsa_handle_t *handle, uint32_t vsid)
         }
 #endif
 
-        if ((!strcmp(handle->useCase, SND_USE_CASE_VERB_DIGITAL_RADIO)) ||
-            (!strcmp(handle->useCase, SND_USE_CASE_MOD_PLAY_FM))) {
+        if ((handle->useCaseId == SND_UCM_ID_VERB_DIGITAL_RADIO) ||
+            (handle->useCaseId == SND_UCM_ID_MOD_PLAY_FM)) {
             mIsFmEnabled = false;
         }
 
@@ -1403,91 +1486,55 @@ status_t ALSADevice::route(alsa_handle_t *handle, uint32_t devices, int mode)
 int ALSADevice::getUseCaseType(const char *useCase)
 {
     ALOGV("use case is %s\n", useCase);
-    if (!strncmp(useCase, SND_USE_CASE_VERB_HIFI,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_HIFI)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_HIFI2,
-            MAX_LEN(useCase, SND_USE_CASE_VERB_HIFI2)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_HIFI_LOW_POWER)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_HIFI_TUNNEL,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_HIFI2,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_HIFI2)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_DIGITAL_RADIO,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_DIGITAL_RADIO)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_MUSIC,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_MUSIC)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_MUSIC2,
-            MAX_LEN(useCase, SND_USE_CASE_MOD_PLAY_MUSIC2)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_MUSIC2,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_MUSIC2)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_LPA,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_LPA)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_TUNNEL,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_TUNNEL)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_FM,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_FM))) {
+    return getUseCaseType(snd_use_case_name_to_id(useCase));
+}
+
+int ALSADevice::getUseCaseType(int useCaseId)
+{
+    switch (useCaseId) {
+    case SND_UCM_ID_VERB_HIFI:
+    case SND_UCM_ID_VERB_HIFI2:
+    case SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC:
+    case SND_UCM_ID_VERB_HIFI_LOW_POWER:
+    case SND_UCM_ID_VERB_HIFI_TUNNEL:
+    case SND_UCM_ID_VERB_DIGITAL_RADIO:
+    case SND_UCM_ID_MOD_PLAY_MUSIC:
+    case SND_UCM_ID_MOD_PLAY_MUSIC2:
+    case SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC:
+    case SND_UCM_ID_MOD_PLAY_LPA:
+    case SND_UCM_ID_MOD_PLAY_TUNNEL:
+    case SND_UCM_ID_MOD_PLAY_FM:
         return USECASE_TYPE_RX;
-    } else if (!strncmp(useCase, SND_USE_CASE_VERB_HIFI_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_HIFI_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_HIFI_LOWLATENCY_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED,
-            MAX_LEN(useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_FM_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_FM_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_FM_A2DP_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_FM_A2DP_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_CAPTURE_MUSIC)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_LOWLATENCY_MUSIC,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_CAPTURE_LOWLATENCY_MUSIC)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_FM,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_CAPTURE_FM)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_A2DP_FM,
-            MAX_LEN(useCase, SND_USE_CASE_MOD_CAPTURE_A2DP_FM)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED,
-            MAX_LEN(useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+    case SND_UCM_ID_VERB_HIFI_REC:
+    case SND_UCM_ID_VERB_HIFI_LOWLATENCY_REC:
+    case SND_UCM_ID_VERB_HIFI_REC_COMPRESSED:
+    case SND_UCM_ID_VERB_FM_REC:
+    case SND_UCM_ID_VERB_FM_A2DP_REC:
+    case SND_UCM_ID_MOD_CAPTURE_MUSIC:
+    case SND_UCM_ID_MOD_CAPTURE_LOWLATENCY_MUSIC:
+    case SND_UCM_ID_MOD_CAPTURE_FM:
+    case SND_UCM_ID_MOD_CAPTURE_A2DP_FM:
+    case SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED:
         return USECASE_TYPE_TX;
-    } else if (!strncmp(useCase, SND_USE_CASE_VERB_VOICECALL,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_VOICECALL)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_IP_VOICECALL,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_IP_VOICECALL)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_UL_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_UL_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_DL_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_DL_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_UL_DL_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_UL_DL_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_INCALL_REC,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_INCALL_REC)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_VOICE,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_VOICE)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_VOIP,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_PLAY_VOIP)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_UL,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_CAPTURE_VOICE_UL)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_DL,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_CAPTURE_VOICE_DL)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_UL_DL,
-            MAX_LEN(useCase,SND_USE_CASE_MOD_CAPTURE_VOICE_UL_DL)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_CAPTURE_VOICE,
-            MAX_LEN(useCase, SND_USE_CASE_MOD_CAPTURE_VOICE)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_VOICE2,
-            MAX_LEN(useCase, SND_USE_CASE_VERB_VOICE2)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_VOICE2,
-            MAX_LEN(useCase, SND_USE_CASE_MOD_PLAY_VOICE2)) ||
-        !strncmp(useCase, SND_USE_CASE_VERB_VOLTE,
-            MAX_LEN(useCase,SND_USE_CASE_VERB_VOLTE)) ||
-        !strncmp(useCase, SND_USE_CASE_MOD_PLAY_VOLTE,
-            MAX_LEN(useCase, SND_USE_CASE_MOD_PLAY_VOLTE))) {
+    case SND_UCM_ID_VERB_VOICECALL:
+    case SND_UCM_ID_VERB_IP_VOICECALL:
+    case SND_UCM_ID_VERB_UL_REC:
+    case SND_UCM_ID_VERB_DL_REC:
+    case SND_UCM_ID_VERB_UL_DL_REC:
+    case SND_UCM_ID_VERB_INCALL_REC:
+    case SND_UCM_ID_MOD_PLAY_VOICE:
+    case SND_UCM_ID_MOD_PLAY_VOIP:
+    case SND_UCM_ID_MOD_CAPTURE_VOICE_UL:
+    case SND_UCM_ID_MOD_CAPTURE_VOICE_DL:
+    case SND_UCM_ID_MOD_CAPTURE_VOICE_UL_DL:
+    case SND_UCM_ID_MOD_CAPTURE_VOICE:
+    case SND_UCM_ID_VERB_VOICE2:
+    case SND_UCM_ID_MOD_PLAY_VOICE2:
+    case SND_UCM_ID_VERB_VOLTE:
+    case SND_UCM_ID_MOD_PLAY_VOLTE:
         return (USECASE_TYPE_RX | USECASE_TYPE_TX);
-    } else {
-        ALOGV("unknown use case %s\n", useCase);
+    default:
+        ALOGV("unknown use case %d\n", useCaseId);
         return 0;
     }
 }
@@ -1495,22 +1542,19 @@ int ALSADevice::getUseCaseType(const char *useCase)
 void ALSADevice::disableDevice(alsa_handle_t *handle)
 {
     unsigned usecase_type = 0;
-    int i, mods_size;
-    char *useCase;
+    int i, mods_size, verb_id;
     const char **mods_list;
 
-    snd_use_case_get(handle->ucMgr, "_verb", (const char **)&useCase);
-    if (useCase != NULL) {
-        if (!strncmp(useCase, handle->useCase, MAX_UC_LEN)) {
+    verb_id = snd_use_case_get_verb_id(handle->ucMgr);
+    if (verb_id != SND_UCM_ID_NONE) {
+        if (verb_id == handle->useCaseId) {
             snd_use_case_set(handle->ucMgr, "_verb", SND_USE_CASE_VERB_INACTIVE);
         } else {
             snd_use_case_set(handle->ucMgr, "_dismod", handle->useCase);
         }
-        free(useCase);
-        snd_use_case_get(handle->ucMgr, "_verb", (const char **)&useCase);
-        if (strncmp(useCase, SND_USE_CASE_VERB_INACTIVE,
-               strlen(SND_USE_CASE_VERB_INACTIVE)))
-            usecase_type |= getUseCaseType(useCase);
+        verb_id = snd_use_case_get_verb_id(handle->ucMgr);
+        if ((verb_id != SND_UCM_ID_NONE) && (verb_id != SND_UCM_ID_VERB_INACTIVE))
+            usecase_type |= getUseCaseType(verb_id);
         mods_size = snd_use_case_get_list(handle->ucMgr, "_enamods", &mods_list);
         ALOGV("Number of modifiers %d\n", mods_size);
         if (mods_size) {
@@ -1527,29 +1571,28 @@ void ALSADevice::disableDevice(alsa_handle_t *handle)
     } else {
         ALOGE("Invalid state, no valid use case found to disable");
     }
-    free(useCase);
 }
 
-char *ALSADevice::getUCMDeviceFromAcdbId(int acdb_id)
+const char *ALSADevice::getUCMDeviceFromAcdbId(int acdb_id)
 {
      switch(acdb_id) {
         case DEVICE_HANDSET_RX_ACDB_ID:
-             return strdup(SND_USE_CASE_DEV_HANDSET);
+             return SND_USE_CASE_DEV_HANDSET;
         case DEVICE_SPEAKER_MONO_RX_ACDB_ID:
         case DEVICE_SPEAKER_RX_ACDB_ID:
-             return strdup(SND_USE_CASE_DEV_SPEAKER);
+             return SND_USE_CASE_DEV_SPEAKER;
         case DEVICE_HEADSET_RX_ACDB_ID:
-             return strdup(SND_USE_CASE_DEV_HEADPHONES);
+             return SND_USE_CASE_DEV_HEADPHONES;
         case DEVICE_TTY_HEADSET_MONO_RX_ACDB_ID:
-             return strdup(SND_USE_CASE_DEV_TTY_HEADSET_RX);
+             return SND_USE_CASE_DEV_TTY_HEADSET_RX;
         case DEVICE_ANC_HEADSET_STEREO_RX_ACDB_ID:
-             return strdup(SND_USE_CASE_DEV_ANC_HEADSET);
+             return SND_USE_CASE_DEV_ANC_HEADSET;
         default:
              return NULL;
      }
 }
 
-char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
+const char *ALSADevice::getUCMDevice(uint32_t devices, int input, const char *rxDevice)
 {
     if (!input) {
         ALOGV("getUCMDevice for output device: devices:%x is input device:%d",devices,input);
@@ -1563,102 +1606,102 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
 #endif
              )) {
              if (mDevSettingsFlag & TTY_VCO) {
-                 return strdup(SND_USE_CASE_DEV_TTY_HEADSET_RX);
+                 return SND_USE_CASE_DEV_TTY_HEADSET_RX;
              } else if (mDevSettingsFlag & TTY_FULL) {
-                 return strdup(SND_USE_CASE_DEV_TTY_FULL_RX);
+                 return SND_USE_CASE_DEV_TTY_FULL_RX;
              } else if (mDevSettingsFlag & TTY_HCO) {
-                 return strdup(SND_USE_CASE_DEV_TTY_HANDSET_RX); /* HANDSET RX */
+                 return SND_USE_CASE_DEV_TTY_HANDSET_RX; /* HANDSET RX */
              }
         } else if (devices & AudioSystem::DEVICE_OUT_ALL_A2DP &&
                    devices & AudioSystem::DEVICE_OUT_SPEAKER) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX_SPEAKER);
+            return SND_USE_CASE_DEV_PROXY_RX_SPEAKER;
         } else if (devices & AudioSystem::DEVICE_OUT_ALL_A2DP) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX);
+            return SND_USE_CASE_DEV_PROXY_RX;
         } else if (devices & AUDIO_DEVICE_OUT_ALL_USB &&
                    devices & AudioSystem::DEVICE_OUT_SPEAKER) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX_SPEAKER);
+            return SND_USE_CASE_DEV_PROXY_RX_SPEAKER;
         } else if (devices & AUDIO_DEVICE_OUT_ALL_USB) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX);
+            return SND_USE_CASE_DEV_PROXY_RX;
         } else if ((devices & AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET ||
                     devices & AudioSystem::DEVICE_OUT_DGTL_DOCK_HEADSET) &&
                     devices & AudioSystem::DEVICE_OUT_SPEAKER) {
-             return strdup(SND_USE_CASE_DEV_USB_PROXY_RX_SPEAKER); /* USB PROXY RX + SPEAKER */
+             return SND_USE_CASE_DEV_USB_PROXY_RX_SPEAKER; /* USB PROXY RX + SPEAKER */
         } else if ((devices & AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET) ||
                   (devices & AudioSystem::DEVICE_OUT_DGTL_DOCK_HEADSET)) {
-             return strdup(SND_USE_CASE_DEV_USB_PROXY_RX); /* PROXY RX */
+             return SND_USE_CASE_DEV_USB_PROXY_RX; /* PROXY RX */
 #ifdef QCOM_PROXY_DEVICE_ENABLED
         } else if( (devices & AudioSystem::DEVICE_OUT_SPEAKER) &&
                    (devices & AudioSystem::DEVICE_OUT_PROXY) &&
                    ((devices & AudioSystem::DEVICE_OUT_WIRED_HEADSET) ||
                     (devices & AudioSystem::DEVICE_OUT_WIRED_HEADPHONE) ) ) {
             if (mDevSettingsFlag & ANC_FLAG) {
-                return strdup(SND_USE_CASE_DEV_PROXY_RX_SPEAKER_ANC_HEADSET);
+                return SND_USE_CASE_DEV_PROXY_RX_SPEAKER_ANC_HEADSET;
             } else {
-                return strdup(SND_USE_CASE_DEV_PROXY_RX_SPEAKER_HEADSET);
+                return SND_USE_CASE_DEV_PROXY_RX_SPEAKER_HEADSET;
             }
 #endif
         } else if ((devices & AudioSystem::DEVICE_OUT_SPEAKER) &&
             ((devices & AudioSystem::DEVICE_OUT_WIRED_HEADSET) ||
             (devices & AudioSystem::DEVICE_OUT_WIRED_HEADPHONE))) {
             if (mDevSettingsFlag & ANC_FLAG) {
-                return strdup(SND_USE_CASE_DEV_SPEAKER_ANC_HEADSET); /* COMBO SPEAKER+ANC HEADSET RX */
+                return SND_USE_CASE_DEV_SPEAKER_ANC_HEADSET; /* COMBO SPEAKER+ANC HEADSET RX */
             } else {
-                return strdup(SND_USE_CASE_DEV_SPEAKER_HEADSET); /* COMBO SPEAKER+HEADSET RX */
+                return SND_USE_CASE_DEV_SPEAKER_HEADSET; /* COMBO SPEAKER+HEADSET RX */
             }
         } else if ((devices & AudioSystem::DEVICE_OUT_SPEAKER) &&
             ((devices & AudioSystem::DEVICE_OUT_AUX_DIGITAL))) {
-            return strdup(SND_USE_CASE_DEV_HDMI_SPEAKER);
+            return SND_USE_CASE_DEV_HDMI_SPEAKER;
 #ifdef QCOM_ANC_HEADSET_ENABLED
         } else if ((devices & AudioSystem::DEVICE_OUT_PROXY) &&
                    ((devices & AudioSystem::DEVICE_OUT_ANC_HEADSET)||
                     (devices & AudioSystem::DEVICE_OUT_ANC_HEADPHONE)) ) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX_ANC_HEADSET);
+            return SND_USE_CASE_DEV_PROXY_RX_ANC_HEADSET;
         } else if ((devices & AudioSystem::DEVICE_OUT_SPEAKER) &&
             ((devices & AudioSystem::DEVICE_OUT_ANC_HEADSET) ||
             (devices & AudioSystem::DEVICE_OUT_ANC_HEADPHONE))) {
-            return strdup(SND_USE_CASE_DEV_SPEAKER_ANC_HEADSET); /* COMBO SPEAKER+ANC HEADSET RX */
+            return SND_USE_CASE_DEV_SPEAKER_ANC_HEADSET; /* COMBO SPEAKER+ANC HEADSET RX */
 #endif
 #ifdef QCOM_FM_ENABLED
         } else if ((devices & AudioSystem::DEVICE_OUT_SPEAKER) &&
                  (devices & AudioSystem::DEVICE_OUT_FM_TX)) {
-            return strdup(SND_USE_CASE_DEV_SPEAKER_FM_TX); /* COMBO SPEAKER+FM_TX RX */
+            return SND_USE_CASE_DEV_SPEAKER_FM_TX; /* COMBO SPEAKER+FM_TX RX */
 #endif
 #ifdef QCOM_PROXY_DEVICE_ENABLED
         } else if ((devices & AudioSystem::DEVICE_OUT_SPEAKER) &&
                  (devices & AudioSystem::DEVICE_OUT_PROXY)) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX_SPEAKER); /* COMBO SPEAKER + PROXY RX */
+            return SND_USE_CASE_DEV_PROXY_RX_SPEAKER; /* COMBO SPEAKER + PROXY RX */
         } else if ((devices & AudioSystem::DEVICE_OUT_EARPIECE) &&
                  (devices & AudioSystem::DEVICE_OUT_PROXY)) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX_HANDSET); /* COMBO EARPIECE + PROXY RX */
+            return SND_USE_CASE_DEV_PROXY_RX_HANDSET; /* COMBO EARPIECE + PROXY RX */
 #endif
         } else if (devices & AudioSystem::DEVICE_OUT_EARPIECE) {
             if (mCallMode == AUDIO_MODE_IN_CALL ||
                 mCallMode == AUDIO_MODE_IN_COMMUNICATION) {
                 if (shouldUseHandsetAnc(mDevSettingsFlag, mInChannels)) {
-                    return strdup(SND_USE_CASE_DEV_ANC_HANDSET); /* ANC Handset RX */
+                    return SND_USE_CASE_DEV_ANC_HANDSET; /* ANC Handset RX */
                 } else {
-                    return strdup(SND_USE_CASE_DEV_VOC_EARPIECE); /* Voice HANDSET RX */
+                    return SND_USE_CASE_DEV_VOC_EARPIECE; /* Voice HANDSET RX */
                 }
             } else {
-                return strdup(SND_USE_CASE_DEV_EARPIECE); /* HANDSET RX */
+                return SND_USE_CASE_DEV_EARPIECE; /* HANDSET RX */
             }
         } else if (devices & AudioSystem::DEVICE_OUT_SPEAKER) {
-            return strdup(SND_USE_CASE_DEV_SPEAKER); /* SPEAKER RX */
+            return SND_USE_CASE_DEV_SPEAKER; /* SPEAKER RX */
         } else if ((devices & AudioSystem::DEVICE_OUT_WIRED_HEADSET) ||
                    (devices & AudioSystem::DEVICE_OUT_WIRED_HEADPHONE)) {
             if (mDevSettingsFlag & ANC_FLAG) {
                 if (mCallMode == AUDIO_MODE_IN_CALL ||
                     mCallMode == AUDIO_MODE_IN_COMMUNICATION) {
-                    return strdup(SND_USE_CASE_DEV_VOC_ANC_HEADSET); /* Voice ANC HEADSET RX */
+                    return SND_USE_CASE_DEV_VOC_ANC_HEADSET; /* Voice ANC HEADSET RX */
                 } else {
-                    return strdup(SND_USE_CASE_DEV_ANC_HEADSET); /* ANC HEADSET RX */
+                    return SND_USE_CASE_DEV_ANC_HEADSET; /* ANC HEADSET RX */
                 }
             } else {
                 if (mCallMode == AUDIO_MODE_IN_CALL ||
                     mCallMode == AUDIO_MODE_IN_COMMUNICATION) {
-                    return strdup(SND_USE_CASE_DEV_VOC_HEADPHONE); /* Voice HEADSET RX */
+                    return SND_USE_CASE_DEV_VOC_HEADPHONE; /* Voice HEADSET RX */
                 } else {
-                    return strdup(SND_USE_CASE_DEV_HEADPHONES); /* HEADSET RX */
+                    return SND_USE_CASE_DEV_HEADPHONES; /* HEADSET RX */
                 }
             }
 #ifdef QCOM_ANC_HEADSET_ENABLED
@@ -1666,38 +1709,38 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
                    ((devices & AudioSystem::DEVICE_OUT_WIRED_HEADSET) ||
                     (devices & AudioSystem::DEVICE_OUT_WIRED_HEADPHONE))) {
             if (mDevSettingsFlag & ANC_FLAG) {
-                return strdup(SND_USE_CASE_DEV_PROXY_RX_ANC_HEADSET);
+                return SND_USE_CASE_DEV_PROXY_RX_ANC_HEADSET;
             } else {
-                return strdup(SND_USE_CASE_DEV_PROXY_RX_HEADSET);
+                return SND_USE_CASE_DEV_PROXY_RX_HEADSET;
             }
         } else if ((devices & AudioSystem::DEVICE_OUT_ANC_HEADSET) ||
                    (devices & AudioSystem::DEVICE_OUT_ANC_HEADPHONE)) {
             if (mCallMode == AUDIO_MODE_IN_CALL ||
                 mCallMode == AUDIO_MODE_IN_COMMUNICATION) {
-                return strdup(SND_USE_CASE_DEV_VOC_ANC_HEADSET); /* Voice ANC HEADSET RX */
+                return SND_USE_CASE_DEV_VOC_ANC_HEADSET; /* Voice ANC HEADSET RX */
             } else {
-                return strdup(SND_USE_CASE_DEV_ANC_HEADSET); /* ANC HEADSET RX */
+                return SND_USE_CASE_DEV_ANC_HEADSET; /* ANC HEADSET RX */
             }
 #endif
         } else if ((devices & AudioSystem::DEVICE_OUT_BLUETOOTH_SCO) ||
                   (devices & AudioSystem::DEVICE_OUT_BLUETOOTH_SCO_HEADSET) ||
                   (devices & AudioSystem::DEVICE_OUT_BLUETOOTH_SCO_CARKIT)) {
             if (mBtscoSamplerate == BTSCO_RATE_16KHZ)
-                return strdup(SND_USE_CASE_DEV_BTSCO_WB_RX); /* BTSCO RX*/
+                return SND_USE_CASE_DEV_BTSCO_WB_RX; /* BTSCO RX*/
             else
-                return strdup(SND_USE_CASE_DEV_BTSCO_NB_RX); /* BTSCO RX*/
+                return SND_USE_CASE_DEV_BTSCO_NB_RX; /* BTSCO RX*/
         } else if (devices & AudioSystem::DEVICE_OUT_AUX_DIGITAL) {
-            return strdup(SND_USE_CASE_DEV_HDMI); /* HDMI RX */
+            return SND_USE_CASE_DEV_HDMI; /* HDMI RX */
 #ifdef QCOM_PROXY_DEVICE_ENABLED
         } else if (devices & AudioSystem::DEVICE_OUT_PROXY) {
-            return strdup(SND_USE_CASE_DEV_PROXY_RX); /* PROXY RX */
+            return SND_USE_CASE_DEV_PROXY_RX; /* PROXY RX */
 #endif
 #ifdef QCOM_FM_ENABLED
         } else if (devices & AudioSystem::DEVICE_OUT_FM_TX) {
-            return strdup(SND_USE_CASE_DEV_FM_TX); /* FM Tx */
+            return SND_USE_CASE_DEV_FM_TX; /* FM Tx */
 #endif
         } else if (devices & AudioSystem::DEVICE_OUT_DEFAULT) {
-            return strdup(SND_USE_CASE_DEV_SPEAKER); /* SPEAKER RX */
+            return SND_USE_CASE_DEV_SPEAKER; /* SPEAKER RX */
         } else {
             ALOGD("No valid output device: %u", devices);
         }
@@ -1711,29 +1754,29 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
 #endif
              )) {
              if (mDevSettingsFlag & TTY_HCO) {
-                 return strdup(SND_USE_CASE_DEV_TTY_HEADSET_TX);
+                 return SND_USE_CASE_DEV_TTY_HEADSET_TX;
              } else if (mDevSettingsFlag & TTY_FULL) {
-                 return strdup(SND_USE_CASE_DEV_TTY_FULL_TX);
+                 return SND_USE_CASE_DEV_TTY_FULL_TX;
              } else if (mDevSettingsFlag & TTY_VCO) {
                  if (!strncmp(mMicType, "analog", 6)) {
-                     return strdup(SND_USE_CASE_DEV_TTY_HANDSET_ANALOG_TX);
+                     return SND_USE_CASE_DEV_TTY_HANDSET_ANALOG_TX;
                  } else {
-                     return strdup(SND_USE_CASE_DEV_TTY_HANDSET_TX);
+                     return SND_USE_CASE_DEV_TTY_HANDSET_TX;
                  }
              }
         } else if (devices & AudioSystem::DEVICE_IN_BUILTIN_MIC) {
             if (!strncmp(mMicType, "analog", 6)) {
-                return strdup(SND_USE_CASE_DEV_HANDSET); /* HANDSET TX */
+                return SND_USE_CASE_DEV_HANDSET; /* HANDSET TX */
             } else {
                 if ((mDevSettingsFlag & DMIC_FLAG) && (mInChannels == 1)) {
 #ifdef USES_FLUENCE_INCALL
                     if(callMode == AUDIO_MODE_IN_CALL) {
                         if (fluence_mode == FLUENCE_MODE_ENDFIRE) {
-                            return strdup(SND_USE_CASE_DEV_DUAL_MIC_ENDFIRE); /* DUALMIC EF TX */
+                            return SND_USE_CASE_DEV_DUAL_MIC_ENDFIRE; /* DUALMIC EF TX */
                         } else if (fluence_mode == FLUENCE_MODE_BROADSIDE) {
-                            return strdup(SND_USE_CASE_DEV_DUAL_MIC_BROADSIDE); /* DUALMIC BS TX */
+                            return SND_USE_CASE_DEV_DUAL_MIC_BROADSIDE; /* DUALMIC BS TX */
                         } else {
-                            return strdup(SND_USE_CASE_DEV_HANDSET); /* BUILTIN-MIC TX */
+                            return SND_USE_CASE_DEV_HANDSET; /* BUILTIN-MIC TX */
                         }
                     }
 #else
@@ -1745,13 +1788,13 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
                         (strlen(SND_USE_CASE_DEV_SPEAKER)+1)))) {
                         if (mFluenceMode == FLUENCE_MODE_ENDFIRE) {
                             if (mIsSglte == false) {
-                                return strdup(SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_ENDFIRE); /* DUALMIC EF TX */
+                                return SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_ENDFIRE; /* DUALMIC EF TX */
                             }
                             else {
-                                return strdup(SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_ENDFIRE_SGLTE); /* DUALMIC EF TX */
+                                return SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_ENDFIRE_SGLTE; /* DUALMIC EF TX */
                             }
                         } else if (mFluenceMode == FLUENCE_MODE_BROADSIDE) {
-                            return strdup(SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_BROADSIDE); /* DUALMIC BS TX */
+                            return SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_BROADSIDE; /* DUALMIC BS TX */
                         }
                     } else {
                         if (mFluenceMode == FLUENCE_MODE_ENDFIRE) {
@@ -1760,16 +1803,16 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
                                     !strncmp(rxDevice, SND_USE_CASE_DEV_ANC_HANDSET,
                                         strlen(SND_USE_CASE_DEV_ANC_HANDSET) + 1)) {
                                     /* if using ANC_HANDSET, already in-call */
-                                    return strdup(SND_USE_CASE_DEV_AANC_DMIC_ENDFIRE); /* DUALMIC AANC TX */
+                                    return SND_USE_CASE_DEV_AANC_DMIC_ENDFIRE; /* DUALMIC AANC TX */
                                 } else {
-                                    return strdup(SND_USE_CASE_DEV_DUAL_MIC_ENDFIRE); /* DUALMIC EF TX */
+                                    return SND_USE_CASE_DEV_DUAL_MIC_ENDFIRE; /* DUALMIC EF TX */
                                 }
                             }
                             else {
-                                return strdup(SND_USE_CASE_DEV_DUAL_MIC_ENDFIRE_SGLTE); /* DUALMIC EF TX */
+                                return SND_USE_CASE_DEV_DUAL_MIC_ENDFIRE_SGLTE; /* DUALMIC EF TX */
                             }
                         } else if (mFluenceMode == FLUENCE_MODE_BROADSIDE) {
-                            return strdup(SND_USE_CASE_DEV_DUAL_MIC_BROADSIDE); /* DUALMIC BS TX */
+                            return SND_USE_CASE_DEV_DUAL_MIC_BROADSIDE; /* DUALMIC BS TX */
                         }
                     }
 #endif
@@ -1781,17 +1824,17 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
                         !strncmp(mCurRxUCMDevice, SND_USE_CASE_DEV_SPEAKER,
                         (strlen(SND_USE_CASE_DEV_SPEAKER)+1)))) {
                             if (mIsSglte == false) {
-                                return strdup(SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_STEREO); /* DUALMIC EF TX */
+                                return SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_STEREO; /* DUALMIC EF TX */
                             }
                             else {
-                                return strdup(SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_STEREO_SGLTE); /* DUALMIC EF TX */
+                                return SND_USE_CASE_DEV_SPEAKER_DUAL_MIC_STEREO_SGLTE; /* DUALMIC EF TX */
                             }
                     } else {
                             if (mIsSglte == false) {
-                                return strdup(SND_USE_CASE_DEV_DUAL_MIC_HANDSET_STEREO); /* DUALMIC EF TX */
+                                return SND_USE_CASE_DEV_DUAL_MIC_HANDSET_STEREO; /* DUALMIC EF TX */
                             }
                             else {
-                                return strdup(SND_USE_CASE_DEV_DUAL_MIC_HANDSET_STEREO_SGLTE); /* DUALMIC EF TX */
+                                return SND_USE_CASE_DEV_DUAL_MIC_HANDSET_STEREO_SGLTE; /* DUALMIC EF TX */
                             }
                     }
                 } else if ((mDevSettingsFlag & QMIC_FLAG) && (mInChannels == 1)) {
@@ -1801,55 +1844,55 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
                         ((rxDevice == NULL) &&
                         !strncmp(mCurRxUCMDevice, SND_USE_CASE_DEV_SPEAKER,
                         (strlen(SND_USE_CASE_DEV_SPEAKER)+1)))) {
-                            return strdup(SND_USE_CASE_DEV_QUAD_MIC); /* QUADMIC TX */
+                            return SND_USE_CASE_DEV_QUAD_MIC; /* QUADMIC TX */
                     } else {
                         if ((rxDevice != NULL) &&
                             !strncmp(rxDevice, SND_USE_CASE_DEV_ANC_HANDSET,
                                 strlen(SND_USE_CASE_DEV_ANC_HANDSET) + 1)) {
                             /* if using ANC_HANDSET, already in-call */
-                            return strdup(SND_USE_CASE_DEV_AANC_LINE); /* AANC LINE TX */
+                            return SND_USE_CASE_DEV_AANC_LINE; /* AANC LINE TX */
                         } else {
-                            return strdup(SND_USE_CASE_DEV_LINE);
+                            return SND_USE_CASE_DEV_LINE;
                         }
                     }
                 }
 #ifdef QCOM_SSR_ENABLED
                 else if ((mDevSettingsFlag & QMIC_FLAG) && (mInChannels > 1)) {
-                    return strdup(SND_USE_CASE_DEV_SSR_QUAD_MIC);
+                    return SND_USE_CASE_DEV_SSR_QUAD_MIC;
                 } else if ((mDevSettingsFlag & SSRQMIC_FLAG) && (mInChannels > 1)){
                     ALOGV("return SSRQMIC_FLAG: 0x%x devices:0x%x",mDevSettingsFlag,devices);
                     // Mapping for quad mic input device.
-                    return strdup(SND_USE_CASE_DEV_SSR_QUAD_MIC); /* SSR Quad MIC */
+                    return SND_USE_CASE_DEV_SSR_QUAD_MIC; /* SSR Quad MIC */
                 }
 #endif
 #ifdef SEPERATED_AUDIO_INPUT
                 if(mInput_source == AUDIO_SOURCE_VOICE_RECOGNITION) {
-                    return strdup(SND_USE_CASE_DEV_VOICE_RECOGNITION ); /* VOICE RECOGNITION TX */
+                    return SND_USE_CASE_DEV_VOICE_RECOGNITION ; /* VOICE RECOGNITION TX */
                 }
 #endif
                 else {
                     if ((rxDevice != NULL) &&
                         !strncmp(rxDevice, SND_USE_CASE_DEV_ANC_HANDSET,
                             strlen(SND_USE_CASE_DEV_ANC_HANDSET) + 1)) {
-                        return strdup(SND_USE_CASE_DEV_AANC_LINE); /* AANC LINE TX */
+                        return SND_USE_CASE_DEV_AANC_LINE; /* AANC LINE TX */
                     } else {
-                        return strdup(SND_USE_CASE_DEV_LINE); /* BUILTIN-MIC TX */
+                        return SND_USE_CASE_DEV_LINE; /* BUILTIN-MIC TX */
                     }
                 }
             }
         } else if (devices & AudioSystem::DEVICE_IN_AUX_DIGITAL) {
-            return strdup(SND_USE_CASE_DEV_HDMI_TX); /* HDMI TX */
+            return SND_USE_CASE_DEV_HDMI_TX; /* HDMI TX */
         } else if ((devices & AudioSystem::DEVICE_IN_WIRED_HEADSET)) {
-            return strdup(SND_USE_CASE_DEV_HEADSET); /* HEADSET TX */
+            return SND_USE_CASE_DEV_HEADSET; /* HEADSET TX */
 #ifdef QCOM_ANC_HEADSET_ENABLED
         } else if (devices & AudioSystem::DEVICE_IN_ANC_HEADSET) {
-            return strdup(SND_USE_CASE_DEV_HEADSET); /* HEADSET TX */
+            return SND_USE_CASE_DEV_HEADSET; /* HEADSET TX */
 #endif
         } else if (devices & AudioSystem::DEVICE_IN_BLUETOOTH_SCO_HEADSET) {
              if (mBtscoSamplerate == BTSCO_RATE_16KHZ)
-                 return strdup(SND_USE_CASE_DEV_BTSCO_WB_TX); /* BTSCO TX*/
+                 return SND_USE_CASE_DEV_BTSCO_WB_TX; /* BTSCO TX*/
              else
-                 return strdup(SND_USE_CASE_DEV_BTSCO_NB_TX); /* BTSCO TX*/
+                 return SND_USE_CASE_DEV_BTSCO_NB_TX; /* BTSCO TX*/
 #ifdef QCOM_USBAUDIO_ENABLED
         } else if (devices & AudioSystem::DEVICE_IN_ANLG_DOCK_HEADSET) {
             if ((mCallMode == AUDIO_MODE_IN_CALL) ||
@@ -1857,52 +1900,52 @@ char* ALSADevice::getUCMDevice(uint32_t devices, int input, char *rxDevice)
                 if ((rxDevice != NULL) &&
                    (!strncmp(rxDevice, SND_USE_CASE_DEV_USB_PROXY_RX,
                     (strlen(SND_USE_CASE_DEV_USB_PROXY_RX)+1)))) {
-                    return strdup(SND_USE_CASE_DEV_USB_PROXY_TX); /* USB PROXY TX */
+                    return SND_USE_CASE_DEV_USB_PROXY_TX; /* USB PROXY TX */
                 } else if ((rxDevice != NULL) &&
                    (!strncmp(rxDevice, SND_USE_CASE_DEV_PROXY_RX,
                     (strlen(SND_USE_CASE_DEV_PROXY_RX)+1)))) {
-                    return strdup(SND_USE_CASE_DEV_PROXY_TX); /* PROXY TX */
+                    return SND_USE_CASE_DEV_PROXY_TX; /* PROXY TX */
                 } else {
-                    return strdup(SND_USE_CASE_DEV_USB_PROXY_TX); /* USB PROXY TX */
+                    return SND_USE_CASE_DEV_USB_PROXY_TX; /* USB PROXY TX */
                 }
             } else {
-                return strdup(SND_USE_CASE_DEV_USB_PROXY_TX); /* USB PROXY TX */
+                return SND_USE_CASE_DEV_USB_PROXY_TX; /* USB PROXY TX */
             }
 #endif
 #ifdef QCOM_PROXY_DEVICE_ENABLED
         } else if (devices & AudioSystem::DEVICE_IN_PROXY) {
-            return strdup(SND_USE_CASE_DEV_PROXY_TX); /* PROXY TX */
+            return SND_USE_CASE_DEV_PROXY_TX; /* PROXY TX */
 #endif
         } else if ((devices & AudioSystem::DEVICE_IN_COMMUNICATION) ||
                    (devices & AudioSystem::DEVICE_IN_VOICE_CALL)) {
             /* Nothing to be done, use current active device */
             if (strncmp(mCurTxUCMDevice, "None", 4)) {
-                return strdup(mCurTxUCMDevice);
+                return mCurTxUCMDevice;
             }
 #ifdef QCOM_FM_ENABLED
         } else if ((devices & AudioSystem::DEVICE_IN_FM_RX) ||
                    (devices & AudioSystem::DEVICE_IN_FM_RX_A2DP)) {
             /* Nothing to be done, use current tx device or set dummy device */
             if (strncmp(mCurTxUCMDevice, "None", 4)) {
-                return strdup(mCurTxUCMDevice);
+                return mCurTxUCMDevice;
             } else {
-                return strdup(SND_USE_CASE_DEV_DUMMY_TX);
+                return SND_USE_CASE_DEV_DUMMY_TX;
             }
 #endif
         } else if ((devices & AudioSystem::DEVICE_IN_AMBIENT) ||
                    (devices & AudioSystem::DEVICE_IN_BACK_MIC)) {
             ALOGI("No proper mapping found with UCM device list, setting default");
             if (!strncmp(mMicType, "analog", 6)) {
-                return strdup(SND_USE_CASE_DEV_HANDSET); /* HANDSET TX */
+                return SND_USE_CASE_DEV_HANDSET; /* HANDSET TX */
             } else {
 #ifdef SEPERATED_AUDIO_INPUT
                 if (callMode == AUDIO_MODE_IN_CALL) {
-                    return strdup(SND_USE_CASE_DEV_VOC_LINE); /* Voice BUILTIN-MIC TX */
+                    return SND_USE_CASE_DEV_VOC_LINE; /* Voice BUILTIN-MIC TX */
                 } else if(mInput_source == AUDIO_SOURCE_CAMCORDER) {
-                    return strdup(SND_USE_CASE_DEV_CAMCORDER_TX ); /* CAMCORDER TX */
+                    return SND_USE_CASE_DEV_CAMCORDER_TX ; /* CAMCORDER TX */
                 } else
 #endif
-                    return strdup(SND_USE_CASE_DEV_LINE); /* BUILTIN-MIC TX */
+                    return SND_USE_CASE_DEV_LINE; /* BUILTIN-MIC TX */
             }
         } else {
             ALOGD("No valid input device: %u", devices);
@@ -2371,6 +2414,7 @@ void ALSADevice::resetProxyVariables() {
     mProxyParams.mAvail = 0;
     mProxyParams.mFrames = 0;
     mProxyParams.mX.frames = 0;
+    mProxyParams.mSlipping = false;
     if(mProxyParams.mPfdProxy[1].fd != -1) {
         sys_close::lib_close(mProxyParams.mPfdProxy[1].fd);
         mProxyParams.mPfdProxy[1].fd = -1;
@@ -2380,20 +2424,46 @@ void ALSADevice::resetProxyVariables() {
 ssize_t  ALSADevice::readFromProxy(void **captureBuffer , ssize_t *bufferSize) {
 
     status_t err = NO_ERROR;
-    int err_poll = 0;
-    initProxyParams();
-    err = startProxy();
-    if(err) {
-        ALOGE("ReadFromProxy-startProxy returned err = %d", err);
+    void *data = NULL;
+    ssize_t size = 0;
+
+    err = acquireProxyFrames(&data, &size);
+    if(err != NO_ERROR) {
+        *captureBuffer = NULL;
+        *bufferSize = 0;
+        return err;
+    }
+
+    if(mProxyParams.mCaptureBuffer == NULL)
+        mProxyParams.mCaptureBuffer =  malloc(mProxyParams.mCaptureBufferSize);
+
+    memcpy(mProxyParams.mCaptureBuffer, (char *)data, size);
+
+    err = releaseProxyFrames(size);
+    if(err != NO_ERROR) {
         *captureBuffer = NULL;
         *bufferSize = 0;
         return err;
     }
+    *captureBuffer = mProxyParams.mCaptureBuffer;
+    *bufferSize = size;
+    return err;
+}
+
+/* Brings mAvail up to date, sleeping in poll until at least avail_min
+ * frames have been captured. The sync also hands back to the driver
+ * everything released since the previous call.
+ */
+status_t ALSADevice::waitForProxyFrames() {
+
+    status_t err = NO_ERROR;
+    int err_poll = 0;
     struct pcm * capture_handle = (struct pcm *)mProxyParams.mProxyPcmHandle;
 
     while(!mProxyParams.mExitRead) {
         ALOGV("Calling sync_ptr(proxy");
         err = sync_ptr(capture_handle);
+        mProxyParams.mSyncs++;
         if(err == EPIPE) {
                ALOGE("Failed in sync_ptr \n");
                /* we failed to make our window -- try to restart */
@@ -2412,6 +2482,7 @@ ssize_t  ALSADevice::readFromProxy(void **captureBuffer , ssize_t *bufferSize) {
                       mProxyParams.mAvail,  mProxyParams.mFrames,(int)capture_handle->sw_p->avail_min);
         if (mProxyParams.mAvail < capture_handle->sw_p->avail_min) {
             err_poll = poll(mProxyParams.mPfdProxy, NUM_FDS, TIMEOUT_INFINITE);
+            mProxyParams.mWakeups++;
             if (mProxyParams.mPfdProxy[1].revents & POLLIN) {
                 ALOGV("Event on userspace fd");
             }
@@ -2437,72 +2508,155 @@ ssize_t  ALSADevice::readFromProxy(void **captureBuffer , ssize_t *bufferSize) {
     }
     if(err != NO_ERROR) {
         ALOGE("Reading from proxy failed = err = %d", err);
-        *captureBuffer = NULL;
-        *bufferSize = 0;
-        return err;
     }
+    return err;
+}
 
-    //Copy only if we have data
-    if(mProxyParams.mAvail > 0) {
-        /* if we have reached high watermark, flush data */
-        if(mProxyParams.mAvail > AFE_PROXY_HIGH_WATER_MARK_FRAME_COUNT) {
-            /* throw out everything over here */
-            ALOGE("available buffers in proxy %d has reached high water mark %d, throw it out ", mProxyParams.mAvail, AFE_PROXY_HIGH_WATER_MARK_FRAME_COUNT);
-            capture_handle->sync_ptr->c.control.appl_ptr += mProxyParams.mAvail;
-            capture_handle->sync_ptr->flags = 0;
-            err = sync_ptr(capture_handle);
-            if(err == EPIPE) {
-                ALOGV("Failed in sync_ptr \n");
-                capture_handle->running = 0;
-                err = sync_ptr(capture_handle);
-            }
-            err = FAILED_TRANSACTION;
-            *captureBuffer = NULL;
-            *bufferSize = 0;
-            return err;
-        }
-        if (mProxyParams.mX.frames > mProxyParams.mAvail) {
-            mProxyParams.mFrames = mProxyParams.mAvail;
-            ALOGE("Error mProxyParams.mFrames = %d", mProxyParams.mFrames);
-            /* Always copy only the data thats available */
-            /* case when we wake up with lesser no of bytes than 1 period */
-        } else {
-            mProxyParams.mFrames = mProxyParams.mX.frames;
+/* Keeps the capture latency bounded without throwing away whole chunks.
+ * Above AFE_PROXY_SLIP_START_FRAMES one frame per period is folded into
+ * its neighbour (~1300ppm), which soaks up clock drift and slow sinks
+ * inaudibly until the backlog is back under AFE_PROXY_SLIP_STOP_FRAMES.
+ * Only when the backlog gets close to the end of the ring, and the DSP
+ * would start overwriting it, is the excess dropped outright.
+ */
+void ALSADevice::trimProxyLatency(long toWrap) {
+
+    struct pcm * capture_handle = (struct pcm *)mProxyParams.mProxyPcmHandle;
+    long ringFrames = capture_handle->buffer_size / (AFE_PROXY_CHANNEL_COUNT*2);
+    long hardLimit = ringFrames - AFE_PROXY_PERIOD_FRAMES;
+
+    if (hardLimit > AFE_PROXY_HIGH_WATER_MARK_FRAME_COUNT)
+        hardLimit = AFE_PROXY_HIGH_WATER_MARK_FRAME_COUNT;
+
+    if ((long)mProxyParams.mAvail > hardLimit) {
+        long keep = (hardLimit > AFE_PROXY_SLIP_START_FRAMES) ?
+                AFE_PROXY_SLIP_START_FRAMES : hardLimit / 2;
+        unsigned drop = mProxyParams.mAvail - keep;
+        ALOGE("proxy backlog %d frames over limit %ld, dropping %d frames",
+              mProxyParams.mAvail, hardLimit, drop);
+        capture_handle->sync_ptr->c.control.appl_ptr += drop;
+        mProxyParams.mAvail -= drop;
+        mProxyParams.mOverflows++;
+        mProxyParams.mOverflowFrames += drop;
+        //The span computed by the caller is stale now
+        return;
+    }
+
+    if (mProxyParams.mAvail > AFE_PROXY_SLIP_START_FRAMES) {
+        mProxyParams.mSlipping = true;
+    } else if (mProxyParams.mAvail <= AFE_PROXY_SLIP_STOP_FRAMES) {
+        mProxyParams.mSlipping = false;
+    }
+
+    if (mProxyParams.mSlipping && toWrap >= 2) {
+        int16_t *frame = (int16_t *)dst_address(capture_handle);
+        for (int ch = 0; ch < AFE_PROXY_CHANNEL_COUNT; ch++) {
+            frame[AFE_PROXY_CHANNEL_COUNT + ch] =
+                    (frame[ch] + frame[AFE_PROXY_CHANNEL_COUNT + ch]) / 2;
         }
-        void *data  = dst_address(capture_handle);
-        //TODO: Return a pointer to AudioHardware
-        if(mProxyParams.mCaptureBuffer == NULL)
-            mProxyParams.mCaptureBuffer =  malloc(mProxyParams.mCaptureBufferSize);
-
-        memcpy(mProxyParams.mCaptureBuffer, (char *)data,
-               mProxyParams.mFrames*2*2);
-
-        capture_handle->sync_ptr->c.control.appl_ptr += mProxyParams.mFrames;
-        capture_handle->sync_ptr->flags = 0;
-        *bufferSize = (mProxyParams.mFrames*2*2);
-        mProxyParams.mFrames -= mProxyParams.mFrames;
-        ALOGV("Calling sync_ptr for proxy after sync with MFrames is %d", mProxyParams.mFrames);
-        err = sync_ptr(capture_handle);
-        if(err == EPIPE) {
-            ALOGV("Failed in sync_ptr \n");
-            capture_handle->running = 0;
-            err = sync_ptr(capture_handle);
+        capture_handle->sync_ptr->c.control.appl_ptr += 1;
+        mProxyParams.mAvail -= 1;
+        mProxyParams.mSlipFrames++;
+    }
+}
+
+/* Waits for at least one period of capture data on the proxy and returns a
+ * pointer to it inside the proxy mmap region, so the caller can consume the
+ * samples in place. The region stays owned by the caller until
+ * releaseProxyFrames() advances appl_ptr past it. The returned span never
+ * crosses the end of the ring buffer, so it may be shorter than a period.
+ * The driver is only asked for new frames once the ones it reported last
+ * time have been handed out.
+ */
+ssize_t  ALSADevice::acquireProxyFrames(void **data, ssize_t *size) {
+
+    status_t err = NO_ERROR;
+    *data = NULL;
+    *size = 0;
+    initProxyParams();
+    struct pcm * capture_handle = (struct pcm *)mProxyParams.mProxyPcmHandle;
+    if (!capture_handle->start) {
+        err = startProxy();
+        if(err) {
+            ALOGE("acquireProxyFrames-startProxy returned err = %d", err);
+            return err;
         }
-        if(err != NO_ERROR ) {
-            ALOGE("Error: Sync ptr end returned %d", err);
-            *captureBuffer = NULL;
-            *bufferSize = 0;
+        mProxyParams.mAvail = 0;
+    }
+
+    if (mProxyParams.mAvail < (unsigned)mProxyParams.mX.frames) {
+        err = waitForProxyFrames();
+        if(err != NO_ERROR) {
             return err;
         }
-        *captureBuffer = mProxyParams.mCaptureBuffer;
+    }
+
+    if(mProxyParams.mAvail == 0) {
+        /* If we dont have data to hand out just return 0 */
+        ALOGE("Error Nothing available from Proxy");
+        return FAILED_TRANSACTION;
+    }
+
+    long ringFrames = capture_handle->buffer_size / (AFE_PROXY_CHANNEL_COUNT*2);
+    long toWrap = ringFrames -
+            (long)(capture_handle->sync_ptr->c.control.appl_ptr % ringFrames);
+    trimProxyLatency(toWrap);
+    toWrap = ringFrames -
+            (long)(capture_handle->sync_ptr->c.control.appl_ptr % ringFrames);
+
+    mProxyParams.mLatencySum += mProxyParams.mAvail;
+    mProxyParams.mLatencyCount++;
+    if (mProxyParams.mAvail > mProxyParams.mLatencyMax)
+        mProxyParams.mLatencyMax = mProxyParams.mAvail;
+
+    if (mProxyParams.mX.frames > mProxyParams.mAvail) {
+        mProxyParams.mFrames = mProxyParams.mAvail;
+        ALOGV("mProxyParams.mFrames = %d", mProxyParams.mFrames);
+        /* Always hand out only the data thats available */
+        /* case when we wake up with lesser no of bytes than 1 period */
     } else {
-        /* If we dont have data to copy just return 0 */
-        *captureBuffer = NULL;
-        *bufferSize = 0;
-        err = FAILED_TRANSACTION;
-        ALOGE("Error Nothing copied from Proxy");
+        mProxyParams.mFrames = mProxyParams.mX.frames;
     }
-    return err;
+
+    /* Clamp to the contiguous part of the ring; the rest is picked up on
+     * the next call once appl_ptr has wrapped.
+     */
+    if (mProxyParams.mFrames > toWrap)
+        mProxyParams.mFrames = toWrap;
+
+    *data = dst_address(capture_handle);
+    *size = mProxyParams.mFrames*AFE_PROXY_CHANNEL_COUNT*2;
+    return NO_ERROR;
+}
+
+/* Hands size bytes obtained from acquireProxyFrames() back. The new
+ * appl_ptr reaches the driver with the next sync in waitForProxyFrames().
+ */
+status_t ALSADevice::releaseProxyFrames(ssize_t size) {
+
+    struct pcm * capture_handle = (struct pcm *)mProxyParams.mProxyPcmHandle;
+    long frames = size/(AFE_PROXY_CHANNEL_COUNT*2);
+
+    capture_handle->sync_ptr->c.control.appl_ptr += frames;
+    capture_handle->sync_ptr->flags = 0;
+    mProxyParams.mAvail -= frames;
+    mProxyParams.mFrames = 0;
+    return NO_ERROR;
+}
+
+void ALSADevice::logProxyStats() {
+
+    ALOGD("Proxy reader: %d syncs, latency avg %d max %d frames, %d frames slipped, "
+          "%d overflows (%d frames dropped)",
+          mProxyParams.mSyncs,
+          mProxyParams.mLatencyCount ?
+              (int)(mProxyParams.mLatencySum / mProxyParams.mLatencyCount) : 0,
+          mProxyParams.mLatencyMax, mProxyParams.mSlipFrames,
+          mProxyParams.mOverflows, mProxyParams.mOverflowFrames);
+    mProxyParams.mSyncs = 0;
+    mProxyParams.mLatencySum = 0;
+    mProxyParams.mLatencyCount = 0;
+    mProxyParams.mLatencyMax = 0;
 }
 
 void ALSADevice::initProxyParams() {
@@ -2718,6 +2872,8 @@ bool ALSADevice::resumeProxy() {
            capture_handle != NULL) {
        ALOGV("pcm_prepare from Resume");
        capture_handle->start = 0;
+       mProxyParams.mAvail = 0;
+       mProxyParams.mSlipping = false;
        err = pcm_prepare(capture_handle);
        if(err != OK) {
            ALOGE("IGNORE: PCM Prepare - capture failed err = %d", err);
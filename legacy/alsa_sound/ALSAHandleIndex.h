@@ -0,0 +1,167 @@
+/* ALSAHandleIndex.h
+
+  Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef ANDROID_ALSA_HANDLE_INDEX_H
+#define ANDROID_ALSA_HANDLE_INDEX_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+//More handles than the HAL usually has open at once, the index grows past it
+#define ALSA_INDEX_HANDLES 32
+
+namespace android_audio_legacy
+{
+
+/* Lookup index over the handles kept in AudioHardwareALSA::mDeviceList.
+ * The list keeps owning the handles, since streams hold pointers into it;
+ * the index keeps the same handles in list order plus the first handle of
+ * every interned use case id, so a use case is found without walking the
+ * list and comparing names. T needs an int useCaseId member, ids outside
+ * [0, IDS) are kept in order but can not be looked up by id.
+ *
+ * Handles are added once they are in the list and removed before they are
+ * erased, add only fails when the index can not grow. A listed handle that
+ * changes use case must be rekeyed. Callers serialize with
+ * AudioHardwareALSA::mLock.
+ */
+template <typename T, int IDS>
+class ALSAHandleIndex {
+public:
+    ALSAHandleIndex() : mHandles(NULL), mCapacity(0) { clear(); }
+    ~ALSAHandleIndex() { free(mHandles); }
+
+    void clear()
+    {
+        mCount = 0;
+        memset(mFirst, 0, sizeof(mFirst));
+    }
+
+    int add(T *handle)
+    {
+        if (mCount == mCapacity) {
+            int capacity = mCapacity ? mCapacity * 2 : ALSA_INDEX_HANDLES;
+            T **handles = (T **)realloc(mHandles, capacity * sizeof(T *));
+            if (!handles)
+                return -ENOMEM;
+            mHandles = handles;
+            mCapacity = capacity;
+        }
+        mHandles[mCount++] = handle;
+        if (valid(handle->useCaseId) && !mFirst[handle->useCaseId])
+            mFirst[handle->useCaseId] = handle;
+        return 0;
+    }
+
+    void remove(T *handle)
+    {
+        int pos = position(handle);
+        if (pos < 0)
+            return;
+        mCount--;
+        memmove(&mHandles[pos], &mHandles[pos + 1], (mCount - pos) * sizeof(T *));
+        relink(handle->useCaseId);
+    }
+
+    //Call after a listed handle's use case changed from oldId
+    void rekey(T *handle, int oldId)
+    {
+        if (oldId == handle->useCaseId || position(handle) < 0)
+            return;
+        relink(oldId);
+        relink(handle->useCaseId);
+    }
+
+    //First handle, in list order, with the given use case
+    T *find(int useCaseId) const
+    {
+        return valid(useCaseId) ? mFirst[useCaseId] : NULL;
+    }
+
+    T *findAny(const int *ids, int count) const
+    {
+        T *found = NULL;
+        for (int i = 0; i < count; i++)
+            found = earlier(found, find(ids[i]));
+        return found;
+    }
+
+    //Whichever of two handles comes first in list order, NULL is last
+    T *earlier(T *a, T *b) const
+    {
+        if (!a || !b)
+            return a ? a : b;
+        return position(a) <= position(b) ? a : b;
+    }
+
+    bool contains(const T *handle) const { return position(handle) >= 0; }
+    int  size() const { return mCount; }
+    T   *at(int index) const { return mHandles[index]; }
+    T   *last() const { return mCount ? mHandles[mCount - 1] : NULL; }
+
+private:
+    static bool valid(int id) { return id >= 0 && id < IDS; }
+
+    int position(const T *handle) const
+    {
+        for (int i = 0; i < mCount; i++) {
+            if (mHandles[i] == handle)
+                return i;
+        }
+        return -1;
+    }
+
+    //Handles sharing a use case are rare, so the first one is found again
+    //by a scan of pointers rather than by keeping per id chains
+    void relink(int id)
+    {
+        if (!valid(id))
+            return;
+        mFirst[id] = NULL;
+        for (int i = 0; i < mCount; i++) {
+            if (mHandles[i]->useCaseId == id) {
+                mFirst[id] = mHandles[i];
+                break;
+            }
+        }
+    }
+
+    //The index owns its array, copying would free it twice
+    ALSAHandleIndex(const ALSAHandleIndex &);
+    ALSAHandleIndex &operator=(const ALSAHandleIndex &);
+
+    T  **mHandles;
+    int  mCapacity;
+    int  mCount;
+    T   *mFirst[IDS];
+};
+
+};        // namespace android_audio_legacy
+#endif    // ANDROID_ALSA_HANDLE_INDEX_H
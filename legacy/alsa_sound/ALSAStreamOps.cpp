@@ -48,7 +48,16 @@ namespace android_audio_legacy
 
 ALSAStreamOps::ALSAStreamOps(AudioHardwareALSA *parent, alsa_handle_t *handle) :
     mParent(parent),
-    mHandle(handle)
+    mHandle(handle),
+    mXrunRetries(0),
+    mRecoveries(0),
+    mResumes(0),
+    mReopens(0),
+    mLastXrunError(0),
+    mLastRecoveryUs(0),
+    mMaxRecoveryUs(0),
+    mLastReopenUs(0),
+    mMaxReopenUs(0)
 {
 }
 
@@ -56,8 +65,7 @@ ALSAStreamOps::~ALSAStreamOps()
 {
     Mutex::Autolock autoLock(mParent->mLock);
 
-    if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-       (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+    if(isVoipUseCase(mHandle->useCaseId)) {
           if(mParent->mVoipInStreamCount^mParent->mVoipOutStreamCount) {
               ALOGD("ALSAStreamOps::close() Ignore");
               return ;
@@ -67,13 +75,9 @@ ALSAStreamOps::~ALSAStreamOps()
     }
     close();
 
-    for(ALSAHandleList::iterator it = mParent->mDeviceList.begin();
-            it != mParent->mDeviceList.end(); ++it) {
-            if (mHandle == &(*it)) {
-                it->useCase[0] = 0;
-                mParent->mDeviceList.erase(it);
-                break;
-            }
+    if (mParent->mHandleIndex.contains(mHandle)) {
+        mHandle->useCase[0] = 0;
+        mParent->removeHandle_l(mHandle);
     }
 }
 
@@ -286,8 +290,7 @@ String8 ALSAStreamOps::getParameters(const String8& keys)
     else {
         key = String8(VOIPCHECK_KEY);
         if (param.get(key, value) == NO_ERROR) {
-            if((!strncmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL, strlen(SND_USE_CASE_VERB_IP_VOICECALL))) ||
-               (!strncmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP, strlen(SND_USE_CASE_MOD_PLAY_VOIP))))
+            if(isVoipUseCase(mHandle->useCaseId))
                 param.addInt(key, true);
             else
                 param.addInt(key, false);
@@ -457,23 +460,12 @@ void ALSAStreamOps::close()
 {
     ALOGD("close");
 
-    bool found = false;
-    for(ALSAHandleList::iterator it = mParent->mDeviceList.begin();
-            it != mParent->mDeviceList.end(); ++it) {
-        if (mHandle == &(*it)) {
-            found = true;
-            ALOGD("close() : Found mHandle %p, proceeding to close", mHandle);
-            break;
-        }
-    }
-
-    if(!found) {
+    if(!mParent->mHandleIndex.contains(mHandle)) {
         ALOGW("close() : mHandle NOT found %p, exiting close", mHandle);
         return;
     }
 
-    if((!strncmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL, strlen(SND_USE_CASE_VERB_IP_VOICECALL))) ||
-       (!strncmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP, strlen(SND_USE_CASE_MOD_PLAY_VOIP)))) {
+    if(isVoipUseCase(mHandle->useCaseId)) {
        mParent->mVoipMicMute = false;
        mParent->mVoipBitRate = 0;
        mParent->mVoipInStreamCount = 0;
@@ -498,4 +490,63 @@ status_t ALSAStreamOps::open(int mode)
     return mParent->mALSADevice->open(mHandle);
 }
 
+//
+// Xrun recovery runs on the stream's own thread without mParent->mLock,
+// the same way pcm_read/pcm_write do. Only a reopen, which may have to
+// route again after an SSR, takes the lock.
+//
+bool ALSAStreamOps::recoverXrun(struct pcm *pcm, int err)
+{
+    nsecs_t start = systemTime();
+    int status;
+
+    mLastXrunError = err;
+    if (pcm == NULL || mParent->mALSADevice->mSSRComplete) {
+        return false;
+    }
+    if (++mXrunRetries > XRUN_RECOVERY_ATTEMPTS) {
+        ALOGW("recoverXrun: %d failed transfers in a row, reopening", mXrunRetries - 1);
+        return false;
+    }
+    status = pcm_recover(pcm, err);
+    if (status) {
+        ALOGW("recoverXrun: error %d not recovered in place (%d)", err, status);
+        return false;
+    }
+    if (err == -ESTRPIPE) {
+        mResumes++;
+    } else {
+        mRecoveries++;
+    }
+    mLastRecoveryUs = ns2us(systemTime() - start);
+    if (mLastRecoveryUs > mMaxRecoveryUs) {
+        mMaxRecoveryUs = mLastRecoveryUs;
+    }
+    ALOGD("recoverXrun: error %d recovered in %lld us", err, (long long)mLastRecoveryUs);
+    return true;
+}
+
+void ALSAStreamOps::reopenDone(nsecs_t start)
+{
+    mReopens++;
+    mXrunRetries = 0;
+    mLastReopenUs = ns2us(systemTime() - start);
+    if (mLastReopenUs > mMaxReopenUs) {
+        mMaxReopenUs = mLastReopenUs;
+    }
+}
+
+void ALSAStreamOps::dumpRecovery(int fd)
+{
+    char buffer[256];
+
+    snprintf(buffer, sizeof(buffer),
+             "Xrun recovery: %u prepared, %u resumed, %u reopened, last error %d\n"
+             "  in place last %lld us max %lld us, reopen last %lld us max %lld us\n",
+             mRecoveries, mResumes, mReopens, mLastXrunError,
+             (long long)mLastRecoveryUs, (long long)mMaxRecoveryUs,
+             (long long)mLastReopenUs, (long long)mMaxReopenUs);
+    ::write(fd, buffer, strlen(buffer));
+}
+
 }       // namespace androidi_audio_legacy
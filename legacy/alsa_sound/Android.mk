@@ -88,6 +88,9 @@ LOCAL_SRC_FILES := \
   ALSAStreamOps.cpp             \
   audio_hw_hal.cpp              \
   AudioUsbALSA.cpp              \
+  AudioUsbAsrc.cpp              \
+  AudioVoipJitterBuffer.cpp     \
+  AudioCompressFrameReader.cpp  \
   AudioUtil.cpp                 \
   ALSADevice.cpp
 
@@ -211,4 +214,46 @@ LOCAL_C_INCLUDES += hardware/libhardware_legacy/audio
 include $(BUILD_SHARED_LIBRARY)
 endif
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= usb_asrc_test.cpp AudioUsbAsrc.cpp
+LOCAL_MODULE:= usb_asrc_test
+LOCAL_SHARED_LIBRARIES:= libc
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= voip_jitter_test.cpp AudioVoipJitterBuffer.cpp
+LOCAL_MODULE:= voip_jitter_test
+LOCAL_SHARED_LIBRARIES:= libc
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= amrwb_reader_test.cpp AudioCompressFrameReader.cpp
+LOCAL_MODULE:= amrwb_reader_test
+LOCAL_SHARED_LIBRARIES:= libc
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= handle_index_test.cpp
+LOCAL_MODULE:= handle_index_test
+LOCAL_SHARED_LIBRARIES:= libc
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= param_dispatch_test.cpp
+LOCAL_MODULE:= param_dispatch_test
+LOCAL_SHARED_LIBRARIES:= libc
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= session_ring_test.cpp
+LOCAL_MODULE:= session_ring_test
+LOCAL_SHARED_LIBRARIES:= libc
+LOCAL_MODULE_TAGS:= debug
+include $(BUILD_EXECUTABLE)
+
 endif
@@ -0,0 +1,130 @@
+/* AudioCompressFrameReader.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AudioCompressFrameReader.h"
+
+namespace android_audio_legacy
+{
+
+AudioCompressFrameReader::AudioCompressFrameReader()
+{
+    mPeriod = NULL;
+    mPeriodSize = 0;
+    mHeaderSize = 0;
+    mPending = NULL;
+    mPendingSize = 0;
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+AudioCompressFrameReader::~AudioCompressFrameReader()
+{
+    free(mPeriod);
+}
+
+int AudioCompressFrameReader::init(size_t periodSize, size_t headerSize)
+{
+    if (headerSize < 2 * sizeof(uint32_t) || periodSize <= headerSize)
+        return -EINVAL;
+
+    free(mPeriod);
+    //Word aligned, the header is read in place
+    mPeriod = (uint8_t *)malloc(periodSize);
+    if (!mPeriod) {
+        mPeriodSize = 0;
+        return -ENOMEM;
+    }
+    mPeriodSize = periodSize;
+    mHeaderSize = headerSize;
+    memset(&mStats, 0, sizeof(mStats));
+    reset();
+    return 0;
+}
+
+void AudioCompressFrameReader::reset()
+{
+    mPending = NULL;
+    mPendingSize = 0;
+}
+
+size_t AudioCompressFrameReader::parsePeriod(size_t bytes)
+{
+    const uint32_t *header = (const uint32_t *)mPeriod;
+    size_t offset, size;
+
+    mStats.periods++;
+    reset();
+    if (bytes > mPeriodSize)
+        bytes = mPeriodSize;
+    if (bytes < mHeaderSize || !header[0]) {
+        mStats.emptyPeriods++;
+        return 0;
+    }
+
+    offset = mHeaderSize + header[1];
+    if (offset >= bytes) {
+        mStats.emptyPeriods++;
+        return 0;
+    }
+    size = header[0];
+    if (size > bytes - offset) {
+        size = bytes - offset;
+        mStats.clipped++;
+    }
+    mPending = mPeriod + offset;
+    mPendingSize = size;
+    return size;
+}
+
+size_t AudioCompressFrameReader::emitFrame(uint8_t *out, size_t size)
+{
+    size_t len = mPendingSize;
+
+    if (!len)
+        return 0;
+    if (len > size) {
+        len = size;
+        mStats.clipped++;
+    }
+    memcpy(out, mPending, len);
+    mStats.frames++;
+    mStats.bytes += len;
+    reset();
+    return len;
+}
+
+void AudioCompressFrameReader::getStats(AudioCompressFrameStats *stats) const
+{
+    *stats = mStats;
+}
+
+};        // namespace android_audio_legacy
@@ -0,0 +1,87 @@
+/* AudioCompressFrameReader.h
+
+  Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef ANDROID_AUDIO_COMPRESS_FRAME_READER_H
+#define ANDROID_AUDIO_COMPRESS_FRAME_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace android_audio_legacy
+{
+
+struct AudioCompressFrameStats {
+    uint64_t periods;       //periods captured
+    uint64_t frames;        //frames handed to the caller
+    uint64_t bytes;         //payload bytes handed to the caller
+    uint32_t emptyPeriods;  //periods without a frame
+    uint32_t clipped;       //frames cut to the period or the caller buffer
+};
+
+/* Parses compressed capture periods as delivered by the compress capture
+ * driver: each period carries one frame, preceded by a header whose
+ * first word is the frame size and whose second word is the offset of
+ * the payload behind the header. Periods are captured into a private
+ * buffer and the payload is copied out once, straight to its final
+ * place in the caller's buffer. A frame that does not fit the caller's
+ * buffer stays pending until the next read.
+ */
+class AudioCompressFrameReader {
+public:
+    AudioCompressFrameReader();
+    ~AudioCompressFrameReader();
+
+    int      init(size_t periodSize, size_t headerSize);
+    bool     initialized() const { return mPeriod != NULL; }
+    //Drops a pending frame, e.g. on standby
+    void     reset();
+
+    //Buffer to capture the next period into, valid when no frame is pending
+    uint8_t* periodBuffer() { return mPeriod; }
+    size_t   periodSize() const { return mPeriodSize; }
+    //Parses a period captured into periodBuffer(), returns the frame size
+    size_t   parsePeriod(size_t bytes);
+
+    size_t   pendingSize() const { return mPendingSize; }
+    //Copies the pending frame to out, clipped to size; returns bytes copied
+    size_t   emitFrame(uint8_t *out, size_t size);
+
+    void     getStats(AudioCompressFrameStats *stats) const;
+
+private:
+    uint8_t* mPeriod;
+    size_t   mPeriodSize;
+    size_t   mHeaderSize;
+    const uint8_t* mPending;
+    size_t   mPendingSize;
+    AudioCompressFrameStats mStats;
+};
+
+};        // namespace android_audio_legacy
+#endif    // ANDROID_AUDIO_COMPRESS_FRAME_READER_H
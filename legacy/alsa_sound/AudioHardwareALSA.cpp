@@ -112,6 +112,12 @@ AudioHardwareALSA::AudioHardwareALSA() :
     mVolteCallState = CALL_INACTIVE;
     mVoice2CallState = CALL_INACTIVE;
     mVSID = 0;
+    initVoiceSession(0, VOICE_SESSION_VSID, SND_USE_CASE_VERB_VOICECALL,
+                     SND_USE_CASE_MOD_PLAY_VOICE, &mVoiceCallState);
+    initVoiceSession(1, VOLTE_SESSION_VSID, SND_USE_CASE_VERB_VOLTE,
+                     SND_USE_CASE_MOD_PLAY_VOLTE, &mVolteCallState);
+    initVoiceSession(2, VOICE2_SESSION_VSID, SND_USE_CASE_VERB_VOICE2,
+                     SND_USE_CASE_MOD_PLAY_VOICE2, &mVoice2CallState);
     mIsFmActive = 0;
     mDevSettingsFlag = 0;
     mCSMicMute = false;
@@ -140,6 +146,7 @@ AudioHardwareALSA::AudioHardwareALSA() :
     mUsbDevice = NULL;
     mUsbStream = NULL;
     mExtOutStream = NULL;
+    mExtOutBufferSize = 0;
     mResampler = NULL;
     mExtOutActiveUseCases = USECASE_NONE;
     mIsExtOutEnabled = false;
@@ -389,7 +396,7 @@ AudioHardwareALSA::~AudioHardwareALSA()
     for(ALSAHandleList::iterator it = mDeviceList.begin();
             it != mDeviceList.end();) {
         it->useCase[0] = 0;
-        it = mDeviceList.erase(it);
+        it = removeHandle_l(it);
     }
     if (mResampler) {
         release_resampler(mResampler);
@@ -524,315 +531,349 @@ bool AudioHardwareALSA::isAnyCallActive() {
 }
 
 
+const AudioHardwareALSA::ParamDispatch::Entry AudioHardwareALSA::sParamHandlers[] = {
+#ifdef QCOM_ADSP_SSR_ENABLED
+    { AudioParameter::keyADSPStatus,  AUDIO_PARAM_STRING, &AudioHardwareALSA::setAdspStatusParam },
+#endif
+    { TTY_MODE_KEY,                   AUDIO_PARAM_STRING, &AudioHardwareALSA::setTtyModeParam },
+#ifdef QCOM_FLUENCE_ENABLED
+    { AudioParameter::keyFluenceType, AUDIO_PARAM_STRING, &AudioHardwareALSA::setFluenceTypeParam },
+#endif
+#ifdef QCOM_CSDCLIENT_ENABLED
+    { INCALLMUSIC_KEY,                AUDIO_PARAM_STRING, &AudioHardwareALSA::setIncallMusicParam },
+#endif
+#ifdef QCOM_ANC_HEADSET_ENABLED
+    { ANC_KEY,                        AUDIO_PARAM_STRING, &AudioHardwareALSA::setAncParam },
+#endif
+    { AudioParameter::keyRouting,     AUDIO_PARAM_INT,    &AudioHardwareALSA::setRoutingParam },
+    { BT_SAMPLERATE_KEY,              AUDIO_PARAM_INT,    &AudioHardwareALSA::setBtSampleRateParam },
+    { BTHEADSET_VGS,                  AUDIO_PARAM_STRING, &AudioHardwareALSA::setBtHeadsetVgsParam },
+    { WIDEVOICE_KEY,                  AUDIO_PARAM_STRING, &AudioHardwareALSA::setWideVoiceParam },
+    { "a2dp_connected",               AUDIO_PARAM_STRING, &AudioHardwareALSA::setA2dpConnectedParam },
+    { "A2dpSuspended",                AUDIO_PARAM_STRING, &AudioHardwareALSA::setA2dpSuspendedParam },
+    { AUDIO_PARAMETER_KEY_FM_VOLUME,  AUDIO_PARAM_FLOAT,  &AudioHardwareALSA::setFmVolumeParam },
+    { "a2dp_sink_address",            AUDIO_PARAM_STRING, &AudioHardwareALSA::setA2dpSinkAddressParam },
+    { "usb_connected",                AUDIO_PARAM_STRING, &AudioHardwareALSA::setUsbConnectedParam },
+    { "card",                         AUDIO_PARAM_STRING, &AudioHardwareALSA::setUsbCardParam },
+    { VOIPRATE_KEY,                   AUDIO_PARAM_STRING, &AudioHardwareALSA::setVoipRateParam },
+    { FENS_KEY,                       AUDIO_PARAM_STRING, &AudioHardwareALSA::setFensParam },
+#ifdef QCOM_FM_ENABLED
+    { AudioParameter::keyHandleFm,    AUDIO_PARAM_INT,    &AudioHardwareALSA::setHandleFmParam },
+#endif
+    { ST_KEY,                         AUDIO_PARAM_STRING, &AudioHardwareALSA::setSlowTalkParam },
+    //Also consumes CALL_STATE_KEY
+    { VSID_KEY,                       AUDIO_PARAM_INT,    &AudioHardwareALSA::setVsidParam },
+};
+
+const AudioHardwareALSA::ParamDispatch AudioHardwareALSA::sParamDispatch(
+        AudioHardwareALSA::sParamHandlers,
+        sizeof(AudioHardwareALSA::sParamHandlers) / sizeof(AudioHardwareALSA::sParamHandlers[0]));
+
 status_t AudioHardwareALSA::setParameters(const String8& keyValuePairs)
 {
-    AudioParameter param = AudioParameter(keyValuePairs);
-    String8 key;
-    String8 value;
-    float fm_volume;
-    status_t status = NO_ERROR;
-    int device;
-    int btRate;
-    int state;
-    enum call_state  call_state = CALL_INVALID;
-    uint32_t vsid = 0;
+    AudioParamList params(keyValuePairs.string());
 
     ALOGV("%s() ,%s", __func__, keyValuePairs.string());
 
+    if (params.truncated())
+        ALOGW("%s() more than %d pairs, ignoring the rest", __func__, AUDIO_PARAM_MAX_PAIRS);
+
+    return sParamDispatch.dispatch(this, params) ? BAD_VALUE : NO_ERROR;
+}
+
 #ifdef QCOM_ADSP_SSR_ENABLED
-    key = String8(AudioParameter::keyADSPStatus);
-    if (param.get(key, value) == NO_ERROR) {
-       if (value == "ONLINE") {
-           ALOGV("ADSP online set SSRcomplete");
-           mALSADevice->mSSRComplete = true;
-           return status;
-       }
-       else if (value == "OFFLINE") {
-           ALOGV("ADSP online re-set SSRcomplete");
-           mALSADevice->mSSRComplete = false;
-           if ( mRouteAudioToExtOut==true) {
-               ALOGV("ADSP offline close EXT output");
-               uint32_t activeUsecase = getExtOutActiveUseCases_l();
-               stopPlaybackOnExtOut_l(activeUsecase);
-           }
-           return status;
-       }
+int AudioHardwareALSA::setAdspStatusParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (!strcmp(value.str, "ONLINE")) {
+        ALOGV("ADSP online set SSRcomplete");
+        mALSADevice->mSSRComplete = true;
+        return AUDIO_PARAM_STOP;
+    } else if (!strcmp(value.str, "OFFLINE")) {
+        ALOGV("ADSP online re-set SSRcomplete");
+        mALSADevice->mSSRComplete = false;
+        if ( mRouteAudioToExtOut==true) {
+            ALOGV("ADSP offline close EXT output");
+            uint32_t activeUsecase = getExtOutActiveUseCases_l();
+            stopPlaybackOnExtOut_l(activeUsecase);
+        }
+        return AUDIO_PARAM_STOP;
     }
+    return AUDIO_PARAM_UNHANDLED;
+}
 #endif
 
-    key = String8(TTY_MODE_KEY);
-    if (param.get(key, value) == NO_ERROR) {
-        mDevSettingsFlag &= TTY_CLEAR;
-        if (value == "full" || value == "tty_full") {
-            mDevSettingsFlag |= TTY_FULL;
-        } else if (value == "hco" || value == "tty_hco") {
-            mDevSettingsFlag |= TTY_HCO;
-        } else if (value == "vco" || value == "tty_vco") {
-            mDevSettingsFlag |= TTY_VCO;
-        } else {
-            mDevSettingsFlag |= TTY_OFF;
-        }
-        ALOGI("Changed TTY Mode=%s", value.string());
-        mALSADevice->setFlags(mDevSettingsFlag);
-        if(mMode != AUDIO_MODE_IN_CALL){
-           return NO_ERROR;
-        }
-        doRouting(0,NULL);
-        param.remove(key);
+int AudioHardwareALSA::setTtyModeParam(const AudioParamValue &value, AudioParamList &params)
+{
+    const char *mode = value.str;
+
+    mDevSettingsFlag &= TTY_CLEAR;
+    if (!strcmp(mode, "full") || !strcmp(mode, "tty_full")) {
+        mDevSettingsFlag |= TTY_FULL;
+    } else if (!strcmp(mode, "hco") || !strcmp(mode, "tty_hco")) {
+        mDevSettingsFlag |= TTY_HCO;
+    } else if (!strcmp(mode, "vco") || !strcmp(mode, "tty_vco")) {
+        mDevSettingsFlag |= TTY_VCO;
+    } else {
+        mDevSettingsFlag |= TTY_OFF;
+    }
+    ALOGI("Changed TTY Mode=%s", mode);
+    mALSADevice->setFlags(mDevSettingsFlag);
+    if(mMode != AUDIO_MODE_IN_CALL){
+       return AUDIO_PARAM_STOP;
     }
+    doRouting(0,NULL);
+    return AUDIO_PARAM_HANDLED;
+}
+
 #ifdef QCOM_FLUENCE_ENABLED
-    key = String8(AudioParameter::keyFluenceType);
-    if (param.get(key, value) == NO_ERROR) {
-        if (value == "quadmic") {
-            //Allow changing fluence type to "quadmic" only when fluence type is fluencepro
-            if (0 == strncmp("fluencepro", mFluenceKey, sizeof("fluencepro"))) {
-                mDevSettingsFlag |= QMIC_FLAG;
-                mDevSettingsFlag &= (~DMIC_FLAG);
-                ALOGV("Fluence quadMic feature Enabled");
-            }
-        } else if (value == "dualmic") {
-            //Allow changing fluence type to "dualmic" only when fluence type is fluencepro or fluence
-            if (0 == strncmp("fluencepro", mFluenceKey, sizeof("fluencepro")) ||
-                0 == strncmp("fluence", mFluenceKey, sizeof("fluence"))) {
-                mDevSettingsFlag |= DMIC_FLAG;
-                mDevSettingsFlag &= (~QMIC_FLAG);
-                ALOGV("Fluence dualmic feature Enabled");
-            }
-        } else if (value == "none") {
+int AudioHardwareALSA::setFluenceTypeParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (!strcmp(value.str, "quadmic")) {
+        //Allow changing fluence type to "quadmic" only when fluence type is fluencepro
+        if (0 == strncmp("fluencepro", mFluenceKey, sizeof("fluencepro"))) {
+            mDevSettingsFlag |= QMIC_FLAG;
             mDevSettingsFlag &= (~DMIC_FLAG);
+            ALOGV("Fluence quadMic feature Enabled");
+        }
+    } else if (!strcmp(value.str, "dualmic")) {
+        //Allow changing fluence type to "dualmic" only when fluence type is fluencepro or fluence
+        if (0 == strncmp("fluencepro", mFluenceKey, sizeof("fluencepro")) ||
+            0 == strncmp("fluence", mFluenceKey, sizeof("fluence"))) {
+            mDevSettingsFlag |= DMIC_FLAG;
             mDevSettingsFlag &= (~QMIC_FLAG);
-            ALOGV("Fluence feature Disabled");
+            ALOGV("Fluence dualmic feature Enabled");
         }
-        mALSADevice->setFlags(mDevSettingsFlag);
-        doRouting(0,NULL);
-        param.remove(key);
+    } else if (!strcmp(value.str, "none")) {
+        mDevSettingsFlag &= (~DMIC_FLAG);
+        mDevSettingsFlag &= (~QMIC_FLAG);
+        ALOGV("Fluence feature Disabled");
     }
+    mALSADevice->setFlags(mDevSettingsFlag);
+    doRouting(0,NULL);
+    return AUDIO_PARAM_HANDLED;
+}
 #endif
 
 #ifdef QCOM_CSDCLIENT_ENABLED
-    if (mFusion3Platform) {
-        key = String8(INCALLMUSIC_KEY);
-        if (param.get(key, value) == NO_ERROR) {
-            if (value == "true") {
-                ALOGV("Enabling Incall Music setting in the setparameter\n");
-                if (csd_start_playback == NULL) {
-                    ALOGE("csd_client_start_playback is NULL");
-                    } else {
-                        csd_start_playback(ALL_SESSION_VSID);
-                    }
-            } else {
-                ALOGV("Disabling Incall Music setting in the setparameter\n");
-                if (csd_stop_playback == NULL) {
-                    ALOGE("csd_client_stop_playback is NULL");
-                } else {
-                    csd_stop_playback(ALL_SESSION_VSID);
-                }
-            }
-            param.remove(key);
+int AudioHardwareALSA::setIncallMusicParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (!mFusion3Platform)
+        return AUDIO_PARAM_UNHANDLED;
+
+    if (!strcmp(value.str, "true")) {
+        ALOGV("Enabling Incall Music setting in the setparameter\n");
+        if (csd_start_playback == NULL) {
+            ALOGE("csd_client_start_playback is NULL");
+        } else {
+            csd_start_playback(ALL_SESSION_VSID);
+        }
+    } else {
+        ALOGV("Disabling Incall Music setting in the setparameter\n");
+        if (csd_stop_playback == NULL) {
+            ALOGE("csd_client_stop_playback is NULL");
+        } else {
+            csd_stop_playback(ALL_SESSION_VSID);
         }
     }
+    return AUDIO_PARAM_HANDLED;
+}
 #endif
 
 #ifdef QCOM_ANC_HEADSET_ENABLED
-    key = String8(ANC_KEY);
-    if (param.get(key, value) == NO_ERROR) {
-        if (value == "true") {
-            ALOGV("Enabling ANC setting in the setparameter\n");
-            mDevSettingsFlag |= ANC_FLAG;
-        } else {
-            ALOGV("Disabling ANC setting in the setparameter\n");
-            mDevSettingsFlag &= (~ANC_FLAG);
-        }
-        mALSADevice->setFlags(mDevSettingsFlag);
-        doRouting(0,NULL);
-        param.remove(key);
+int AudioHardwareALSA::setAncParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (!strcmp(value.str, "true")) {
+        ALOGV("Enabling ANC setting in the setparameter\n");
+        mDevSettingsFlag |= ANC_FLAG;
+    } else {
+        ALOGV("Disabling ANC setting in the setparameter\n");
+        mDevSettingsFlag &= (~ANC_FLAG);
     }
+    mALSADevice->setFlags(mDevSettingsFlag);
+    doRouting(0,NULL);
+    return AUDIO_PARAM_HANDLED;
+}
 #endif
 
-    key = String8(AudioParameter::keyRouting);
-    if (param.getInt(key, device) == NO_ERROR) {
-        /*
-         * When HDMI cable is unplugged/usb hs is disconnected the
-         * music playback is paused and the policy manager sends routing=0
-         * But the audioflingercontinues to write data until standby time
-         * (3sec). As the HDMI core is turned off, the write gets blocked.
-         * Avoid this by routing audio to speaker until standby.
-         */
-        if ((mALSADevice->mCurDevice == AUDIO_DEVICE_OUT_AUX_DIGITAL ||
-                mALSADevice->mCurDevice == AUDIO_DEVICE_OUT_ANLG_DOCK_HEADSET) &&
-                device == AUDIO_DEVICE_NONE) {
-            device = AUDIO_DEVICE_OUT_SPEAKER;
-        }
-        // Ignore routing if device is 0.
-        if(device) {
-            doRouting(device,NULL);
-        }
-        param.remove(key);
-    }
+int AudioHardwareALSA::setRoutingParam(const AudioParamValue &value, AudioParamList &params)
+{
+    int device = value.i;
+
+    /*
+     * When HDMI cable is unplugged/usb hs is disconnected the
+     * music playback is paused and the policy manager sends routing=0
+     * But the audioflingercontinues to write data until standby time
+     * (3sec). As the HDMI core is turned off, the write gets blocked.
+     * Avoid this by routing audio to speaker until standby.
+     */
+    if ((mALSADevice->mCurDevice == AUDIO_DEVICE_OUT_AUX_DIGITAL ||
+            mALSADevice->mCurDevice == AUDIO_DEVICE_OUT_ANLG_DOCK_HEADSET) &&
+            device == AUDIO_DEVICE_NONE) {
+        device = AUDIO_DEVICE_OUT_SPEAKER;
+    }
+    // Ignore routing if device is 0.
+    if(device) {
+        doRouting(device,NULL);
+    }
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8(BT_SAMPLERATE_KEY);
-    if (param.getInt(key, btRate) == NO_ERROR) {
-        mALSADevice->setBtscoRate(btRate);
-        param.remove(key);
-    }
+int AudioHardwareALSA::setBtSampleRateParam(const AudioParamValue &value, AudioParamList &params)
+{
+    mALSADevice->setBtscoRate(value.i);
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8(BTHEADSET_VGS);
-    if (param.get(key, value) == NO_ERROR) {
-        if (value == "on") {
-            mBluetoothVGS = true;
-        } else {
-            mBluetoothVGS = false;
-        }
-        param.remove(key);
-    }
+int AudioHardwareALSA::setBtHeadsetVgsParam(const AudioParamValue &value, AudioParamList &params)
+{
+    mBluetoothVGS = !strcmp(value.str, "on");
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8(WIDEVOICE_KEY);
-    if (param.get(key, value) == NO_ERROR) {
-        bool flag = false;
-        if (value == "true") {
-            flag = true;
-        }
+int AudioHardwareALSA::setWideVoiceParam(const AudioParamValue &value, AudioParamList &params)
+{
+    bool flag = !strcmp(value.str, "true");
 
-        if(mALSADevice) {
-            mALSADevice->enableWideVoice(flag, ALL_SESSION_VSID);
-        }
-        param.remove(key);
+    if(mALSADevice) {
+        mALSADevice->enableWideVoice(flag, ALL_SESSION_VSID);
     }
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8("a2dp_connected");
-    if (param.get(key, value) == NO_ERROR) {
-        if (value == "true") {
-            status_t err = openExtOutput(AudioSystem::DEVICE_OUT_ALL_A2DP);
-        } else {
-            status_t err = closeExtOutput(AudioSystem::DEVICE_OUT_ALL_A2DP);
-        }
-        param.remove(key);
+int AudioHardwareALSA::setA2dpConnectedParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (!strcmp(value.str, "true")) {
+        status_t err = openExtOutput(AudioSystem::DEVICE_OUT_ALL_A2DP);
+    } else {
+        status_t err = closeExtOutput(AudioSystem::DEVICE_OUT_ALL_A2DP);
     }
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8("A2dpSuspended");
-    if (param.get(key, value) == NO_ERROR) {
-        if (mA2dpDevice != NULL) {
-            mA2dpDevice->set_parameters(mA2dpDevice,keyValuePairs);
-            if(value=="true"){
-                 uint32_t activeUsecase = getExtOutActiveUseCases_l();
-                 status_t err = suspendPlaybackOnExtOut_l(activeUsecase);
-            }
+int AudioHardwareALSA::setA2dpSuspendedParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (mA2dpDevice != NULL) {
+        mA2dpDevice->set_parameters(mA2dpDevice, params.string());
+        if (!strcmp(value.str, "true")) {
+             uint32_t activeUsecase = getExtOutActiveUseCases_l();
+             status_t err = suspendPlaybackOnExtOut_l(activeUsecase);
         }
-        param.remove(key);
     }
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8(AUDIO_PARAMETER_KEY_FM_VOLUME);
+int AudioHardwareALSA::setFmVolumeParam(const AudioParamValue &value, AudioParamList &params)
+{
+    float fm_volume = value.f;
 
-    if (param.getFloat(key, fm_volume) == NO_ERROR) {
-        if (fm_volume < 0.0) {
-            ALOGW("set Fm Volume(%f) under 0.0, assuming 0.0\n", fm_volume);
-            fm_volume = 0.0;
-        } else if (fm_volume > 1.0) {
-            ALOGW("set Fm Volume(%f) over 1.0, assuming 1.0\n", fm_volume);
-            fm_volume = 1.0;
-        }
-        fm_volume = lrint((fm_volume * 0x2000) + 0.5);
+    if (fm_volume < 0.0) {
+        ALOGW("set Fm Volume(%f) under 0.0, assuming 0.0\n", fm_volume);
+        fm_volume = 0.0;
+    } else if (fm_volume > 1.0) {
+        ALOGW("set Fm Volume(%f) over 1.0, assuming 1.0\n", fm_volume);
+        fm_volume = 1.0;
+    }
+    fm_volume = lrint((fm_volume * 0x2000) + 0.5);
 
-        ALOGV("set Fm Volume(%f)\n", fm_volume);
-        ALOGV("Setting FM volume to %d (available range is 0 to 0x2000)\n", fm_volume);
+    ALOGV("set Fm Volume(%f)\n", fm_volume);
+    ALOGV("Setting FM volume to %d (available range is 0 to 0x2000)\n", fm_volume);
 
-        mALSADevice->setFmVolume(fm_volume);
-        param.remove(key);
-    }
+    mALSADevice->setFmVolume(fm_volume);
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8("a2dp_sink_address");
-    if (param.get(key, value) == NO_ERROR) {
-        if (mA2dpStream != NULL) {
-            mA2dpStream->common.set_parameters(&mA2dpStream->common,keyValuePairs);
-        }
-        param.remove(key);
+int AudioHardwareALSA::setA2dpSinkAddressParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (mA2dpStream != NULL) {
+        mA2dpStream->common.set_parameters(&mA2dpStream->common, params.string());
     }
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8("usb_connected");
-    if (param.get(key, value) == NO_ERROR) {
-        if (value == "true") {
-            status_t err = openExtOutput(AUDIO_DEVICE_OUT_ALL_USB);
-        } else {
-            status_t err = closeExtOutput(AUDIO_DEVICE_OUT_ALL_USB);
-        }
-        param.remove(key);
+int AudioHardwareALSA::setUsbConnectedParam(const AudioParamValue &value, AudioParamList &params)
+{
+    if (!strcmp(value.str, "true")) {
+        status_t err = openExtOutput(AUDIO_DEVICE_OUT_ALL_USB);
+    } else {
+        status_t err = closeExtOutput(AUDIO_DEVICE_OUT_ALL_USB);
     }
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8("card");
-    if (param.get(key, value) == NO_ERROR) {
-        if (mUsbStream != NULL) {
-            ALOGV("mUsbStream->common.set_parameters");
-            mUsbStream->common.set_parameters(&mUsbStream->common,keyValuePairs);
-        }
-        param.remove(key);
+int AudioHardwareALSA::setUsbCardParam(const AudioParamValue &value, AudioParamList &params)
+{
+#ifdef QCOM_USBAUDIO_ENABLED
+    //A USB card was (re)attached, its altsettings may differ
+    mAudioUsbALSA->invalidateCaps();
+#endif
+    if (mUsbStream != NULL) {
+        ALOGV("mUsbStream->common.set_parameters");
+        mUsbStream->common.set_parameters(&mUsbStream->common, params.string());
     }
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8(VOIPRATE_KEY);
-    if (param.get(key, value) == NO_ERROR) {
-            mVoipBitRate = atoi(value);
-        param.remove(key);
-    }
+int AudioHardwareALSA::setVoipRateParam(const AudioParamValue &value, AudioParamList &params)
+{
+    mVoipBitRate = atoi(value.str);
+    return AUDIO_PARAM_HANDLED;
+}
 
-    key = String8(FENS_KEY);
-    if (param.get(key, value) == NO_ERROR) {
-        bool flag = false;
-        if (value == "true") {
-            flag = true;
-        }
-        if(mALSADevice) {
-            mALSADevice->enableFENS(flag, ALL_SESSION_VSID);
-        }
-        param.remove(key);
+int AudioHardwareALSA::setFensParam(const AudioParamValue &value, AudioParamList &params)
+{
+    bool flag = !strcmp(value.str, "true");
+
+    if(mALSADevice) {
+        mALSADevice->enableFENS(flag, ALL_SESSION_VSID);
     }
+    return AUDIO_PARAM_HANDLED;
+}
 
 #ifdef QCOM_FM_ENABLED
-    key = String8(AudioParameter::keyHandleFm);
-    if (param.getInt(key, device) == NO_ERROR) {
-        // Ignore if device is 0
-        if(device) {
-            handleFm(device);
-        }
-        param.remove(key);
+int AudioHardwareALSA::setHandleFmParam(const AudioParamValue &value, AudioParamList &params)
+{
+    // Ignore if device is 0
+    if(value.i) {
+        handleFm(value.i);
     }
+    return AUDIO_PARAM_HANDLED;
+}
 #endif
 
-    key = String8(ST_KEY);
-    if (param.get(key, value) == NO_ERROR) {
-        bool flag = false;
-        if (value == "true") {
-            flag = true;
-        }
-        if(mALSADevice) {
-            mALSADevice->enableSlowTalk(flag, ALL_SESSION_VSID);
-        }
-        param.remove(key);
-    }
-
-    key = String8(VSID_KEY);
-    if (param.getInt(key, (int &)vsid) == NO_ERROR) {
-        param.remove(key);
-        key = String8(CALL_STATE_KEY);
-        if (param.getInt(key, (int &)call_state) == NO_ERROR) {
-            param.remove(key);
-            if (isAnyCallActive() || (call_state == CALL_ACTIVE) ||((call_state == CALL_INACTIVE) && mVSID == vsid)) {
-                mVSID = vsid;
-                mCallState = call_state;
-                ALOGD("%s() vsid:%x, callstate:%x", __func__, mVSID, call_state);
-            }
-            if(isAnyCallActive()
-#ifdef QCOM_MULTI_VOICE_SESSION_ENABLED
-               || mMode == AUDIO_MODE_IN_CALL
-#endif
-              )
-               doRouting(0,NULL);
-        }
-        param.remove(key);
-    }
+int AudioHardwareALSA::setSlowTalkParam(const AudioParamValue &value, AudioParamList &params)
+{
+    bool flag = !strcmp(value.str, "true");
 
-    if (param.size()) {
-        status = BAD_VALUE;
+    if(mALSADevice) {
+        mALSADevice->enableSlowTalk(flag, ALL_SESSION_VSID);
     }
-    return status;
+    return AUDIO_PARAM_HANDLED;
+}
+
+int AudioHardwareALSA::setVsidParam(const AudioParamValue &value, AudioParamList &params)
+{
+    uint32_t vsid = (uint32_t)value.i;
+    int call_state;
+    int i = params.find(CALL_STATE_KEY);
+
+    if (i < 0)
+        return AUDIO_PARAM_HANDLED;
+    params.consume(i);
+    if (!AudioParamList::parseInt(params.value(i), &call_state))
+        return AUDIO_PARAM_HANDLED;
+
+    if (isAnyCallActive() || (call_state == CALL_ACTIVE) ||((call_state == CALL_INACTIVE) && mVSID == vsid)) {
+        mVSID = vsid;
+        mCallState = call_state;
+        ALOGD("%s() vsid:%x, callstate:%x", __func__, mVSID, call_state);
+    }
+    if(isAnyCallActive()
+#ifdef QCOM_MULTI_VOICE_SESSION_ENABLED
+       || mMode == AUDIO_MODE_IN_CALL
+#endif
+      )
+       doRouting(0,NULL);
+    return AUDIO_PARAM_HANDLED;
 }
 
 String8 AudioHardwareALSA::getParameters(const String8& keys)
@@ -1037,6 +1078,7 @@ status_t AudioHardwareALSA::doRouting(int device, char* useCase)
                 ALOGD("USB UNPLUGGED, setting musbPlaybackState to 0");
                 closeUSBRecording();
                 closeUSBPlayback();
+                mAudioUsbALSA->invalidateCaps();
         } else if((device & AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET)||
                   (device & AudioSystem::DEVICE_OUT_DGTL_DOCK_HEADSET)){
                     ALOGD("Routing everything to prox now");
@@ -1057,41 +1099,41 @@ status_t AudioHardwareALSA::doRouting(int device, char* useCase)
                             closeUSBPlayback();
                     }
                     mALSADevice->route(&(*it), device, newMode);
-                    for(it = mDeviceList.begin(); it != mDeviceList.end(); ++it) {
-                         if((!strcmp(it->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER)) ||
-                            (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_LPA))) {
+                    for (int i = 0; i < mHandleIndex.size(); i++) {
+                         int id = mHandleIndex.at(i)->useCaseId;
+                         if((id == SND_UCM_ID_VERB_HIFI_LOW_POWER) ||
+                            (id == SND_UCM_ID_MOD_PLAY_LPA)) {
                                  ALOGV("doRouting: LPA device switch to proxy");
                                  startUsbPlaybackIfNotStarted();
                                  musbPlaybackState |= USBPLAYBACKBIT_LPA;
                                  break;
-                         } else if((!strcmp(it->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-                                   (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL))) {
+                         } else if((id == SND_UCM_ID_VERB_HIFI_TUNNEL) ||
+                                   (id == SND_UCM_ID_MOD_PLAY_TUNNEL)) {
                                     ALOGD("doRouting: Tunnel Player device switch to proxy");
                                     startUsbPlaybackIfNotStarted();
                                     musbPlaybackState |= USBPLAYBACKBIT_TUNNEL;
                                     break;
-                         } else if((!strcmp(it->useCase, SND_USE_CASE_VERB_VOICECALL)) ||
-                                   (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_VOICE)) ||
-                                   (!strcmp(it->useCase, SND_USE_CASE_VERB_VOLTE)) ||
-                                   (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_VOLTE))) {
+                         } else if((id == SND_UCM_ID_VERB_VOICECALL) ||
+                                   (id == SND_UCM_ID_MOD_PLAY_VOICE) ||
+                                   (id == SND_UCM_ID_VERB_VOLTE) ||
+                                   (id == SND_UCM_ID_MOD_PLAY_VOLTE)) {
                                     ALOGV("doRouting: VOICE device switch to proxy");
                                     startUsbRecordingIfNotStarted();
                                     startUsbPlaybackIfNotStarted();
                                     musbPlaybackState |= USBPLAYBACKBIT_VOICECALL;
                                     musbRecordingState |= USBPLAYBACKBIT_VOICECALL;
                                     break;
-                        }else if((!strcmp(it->useCase, SND_USE_CASE_VERB_DIGITAL_RADIO)) ||
-                                 (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_FM))) {
+                        }else if((id == SND_UCM_ID_VERB_DIGITAL_RADIO) ||
+                                 (id == SND_UCM_ID_MOD_PLAY_FM)) {
                                     ALOGV("doRouting: FM device switch to proxy");
                                     startUsbPlaybackIfNotStarted();
                                     musbPlaybackState |= USBPLAYBACKBIT_FM;
                                     break;
-                        }else if((!strcmp(it->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-                                 (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_VOIP)) ||
-                                 (!strcmp(it->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC) &&
-                                 (newMode == AudioSystem::MODE_IN_COMMUNICATION)) ||
-                                 (!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_REC,
-                                 strlen(SND_USE_CASE_VERB_HIFI_REC)) &&
+                        }else if(isVoipUseCase(id) ||
+                                 ((id == SND_UCM_ID_MOD_CAPTURE_MUSIC ||
+                                   id == SND_UCM_ID_VERB_HIFI_REC ||
+                                   id == SND_UCM_ID_VERB_HIFI_REC2 ||
+                                   id == SND_UCM_ID_VERB_HIFI_REC_COMPRESSED) &&
                                  (newMode == AudioSystem::MODE_IN_COMMUNICATION))) {
                                     ALOGV("doRouting: VOIP device switch to proxy");
                                     startUsbRecordingIfNotStarted();
@@ -1108,21 +1150,20 @@ status_t AudioHardwareALSA::doRouting(int device, char* useCase)
             ALSAHandleList::iterator it = mDeviceList.end();
             it--;
             status_t err = NO_ERROR;
-            uint32_t activeUsecase = useCaseStringToEnum(it->useCase);
+            uint32_t activeUsecase = useCaseIdToEnum(it->useCaseId);
 
-            //If required usecase is not null, go through mDeviceList to find last matching alsa_handle_t.
+            //If required usecase is not null, use the handle of that usecase instead.
             //For FM we don't open an output stream. Hence required usecase shouldn't be considered.
+            alsa_handle_t *handle = &(*it);
             if ( (useCase != NULL) && (activeUsecase != USECASE_FM) ) {
-                for(ALSAHandleList::iterator it2 = mDeviceList.begin(); it2 != mDeviceList.end(); it2++) {
-                    if (!strcmp(useCase, it2->useCase)) {
-                            it = it2;
-                            ALOGV("found matching required usecase:%s device:%x",it->useCase,it->devices);
-                            activeUsecase = useCaseStringToEnum(it->useCase);
-                            break;
-                        }
+                alsa_handle_t *required = findHandle_l(useCase);
+                if (required) {
+                    handle = required;
+                    ALOGV("found matching required usecase:%s device:%x",handle->useCase,handle->devices);
+                    activeUsecase = useCaseIdToEnum(handle->useCaseId);
                 }
             }
-            ALOGV("Dorouting updated usecase:%s device:%x activeUsecase",it->useCase, it->devices, activeUsecase);
+            ALOGV("Dorouting updated usecase:%s device:%x activeUsecase",handle->useCase, handle->devices, activeUsecase);
             if (!((device & AudioSystem::DEVICE_OUT_ALL_A2DP) &&
                   (mCurRxDevice & AUDIO_DEVICE_OUT_ALL_USB))) {
                 if ((activeUsecase == USECASE_HIFI_LOW_POWER) ||
@@ -1134,7 +1175,7 @@ status_t AudioHardwareALSA::doRouting(int device, char* useCase)
                             stopPlaybackOnExtOut_l(activeUsecase);
                             mRouteAudioToExtOut = true;
                         }
-                        mALSADevice->route(&(*it),(uint32_t)device, newMode);
+                        mALSADevice->route(handle,(uint32_t)device, newMode);
                     }
                     err = startPlaybackOnExtOut_l(activeUsecase);
                 } else {
@@ -1144,14 +1185,15 @@ status_t AudioHardwareALSA::doRouting(int device, char* useCase)
                             (isExtOutDevice(device))) {
                             activeUsecase = getExtOutActiveUseCases_l();
                             stopPlaybackOnExtOut_l(activeUsecase);
-                            mALSADevice->route(&(*it),(uint32_t)device, newMode);
+                            mALSADevice->route(handle,(uint32_t)device, newMode);
                             mRouteAudioToExtOut = true;
                             startPlaybackOnExtOut_l(activeUsecase);
                         } else {
-                           mALSADevice->route(&(*it),(uint32_t)device, newMode);
-                           for(ALSAHandleList::iterator it2 = mDeviceList.begin(); it2 != mDeviceList.end(); it2++) {
-                                if ((it2->handle || it2->rxHandle) && !(getExtOutActiveUseCases_l() && it2->useCase)) {
-                                    startPlaybackOnExtOut_l(useCaseStringToEnum(it2->useCase));
+                           mALSADevice->route(handle,(uint32_t)device, newMode);
+                           for (int i = 0; i < mHandleIndex.size(); i++) {
+                                alsa_handle_t *h = mHandleIndex.at(i);
+                                if ((h->handle || h->rxHandle) && !(getExtOutActiveUseCases_l() && h->useCase)) {
+                                    startPlaybackOnExtOut_l(useCaseIdToEnum(h->useCaseId));
                                     break;
                                 }
                            }
@@ -1164,7 +1206,7 @@ status_t AudioHardwareALSA::doRouting(int device, char* useCase)
                 if(err) {
                     ALOGW("startPlaybackOnExtOut_l for hardware output failed err = %d", err);
                     stopPlaybackOnExtOut_l(activeUsecase);
-                    mALSADevice->route(&(*it),(uint32_t)mCurRxDevice, newMode);
+                    mALSADevice->route(handle,(uint32_t)mCurRxDevice, newMode);
                     return err;
                 }
             }
@@ -1200,15 +1242,11 @@ status_t AudioHardwareALSA::doRouting(int device, char* useCase)
 
 void AudioHardwareALSA::setInChannels(int device)
 {
-     ALSAHandleList::iterator it;
-
      if (device & AudioSystem::DEVICE_IN_BUILTIN_MIC) {
-         for(it = mDeviceList.begin(); it != mDeviceList.end(); ++it) {
-             if (!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_REC,
-                 strlen(SND_USE_CASE_VERB_HIFI_REC)) ||
-                 !strncmp(it->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC,
-                 strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))) {
-                 mALSADevice->setInChannels(it->channels);
+         for (int i = 0; i < mHandleIndex.size(); i++) {
+             alsa_handle_t *handle = mHandleIndex.at(i);
+             if (isHiFiRecUseCase(handle->useCaseId)) {
+                 mALSADevice->setInChannels(handle->channels);
                  return;
              }
          }
@@ -1308,8 +1346,7 @@ AudioHardwareALSA::openOutputStream(uint32_t devices,
         bool voipstream_active = false;
         for(it = mDeviceList.begin();
             it != mDeviceList.end(); ++it) {
-                if((!strcmp(it->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-                   (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+                if(isVoipUseCase(it->useCaseId)) {
                     ALOGD("openOutput:  it->rxHandle %d it->handle %d",it->rxHandle,it->handle);
                     voipstream_active = true;
                     if(mVoipOutStreamCount >= 2)
@@ -1350,15 +1387,14 @@ AudioHardwareALSA::openOutputStream(uint32_t devices,
           alsa_handle.rxHandle = 0;
           alsa_handle.ucMgr = mUcMgr;
           mALSADevice->setVoipConfig(getVoipMode(*format), mVoipBitRate);
-          char *use_case;
-          snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
-          if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-              strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_IP_VOICECALL, sizeof(alsa_handle.useCase));
+          int verb_id;
+          verb_id = snd_use_case_get_verb_id(mUcMgr);
+          if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+              setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_IP_VOICECALL);
           } else {
-              strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_VOIP, sizeof(alsa_handle.useCase));
+              setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_VOIP);
           }
-          free(use_case);
-          mDeviceList.push_back(alsa_handle);
+          addHandle_l(alsa_handle);
           it = mDeviceList.end();
           it--;
           ALOGV("openoutput: mALSADevice->route useCase %s mCurDevice %d mVoipOutStreamCount %d mode %d", it->useCase,mCurDevice,mVoipOutStreamCount, mode());
@@ -1381,7 +1417,7 @@ AudioHardwareALSA::openOutputStream(uint32_t devices,
            } else{
               mALSADevice->route(&(*it), mCurDevice, AUDIO_MODE_IN_COMMUNICATION);
           }
-          if(!strcmp(it->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) {
+          if(it->useCaseId == SND_UCM_ID_VERB_IP_VOICECALL) {
               snd_use_case_set(mUcMgr, "_verb", SND_USE_CASE_VERB_IP_VOICECALL);
           } else {
               snd_use_case_set(mUcMgr, "_enamod", SND_USE_CASE_MOD_PLAY_VOIP);
@@ -1463,15 +1499,14 @@ AudioHardwareALSA::openOutputStream(uint32_t devices,
         alsa_handle.ucMgr = mUcMgr;
         ALOGD("alsa_handle.channels %d alsa_handle.sampleRate %d",alsa_handle.channels,alsa_handle.sampleRate);
 
-        char *use_case;
-        snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
-        if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI2 , sizeof(alsa_handle.useCase));
+        int verb_id;
+        verb_id = snd_use_case_get_verb_id(mUcMgr);
+        if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI2);
         } else {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_MUSIC2, sizeof(alsa_handle.useCase));
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_MUSIC2);
         }
-        free(use_case);
-        mDeviceList.push_back(alsa_handle);
+        addHandle_l(alsa_handle);
         ALSAHandleList::iterator it = mDeviceList.end();
         it--;
         out = new AudioStreamOutALSA(this, &(*it));
@@ -1500,37 +1535,36 @@ AudioHardwareALSA::openOutputStream(uint32_t devices,
 #endif
       alsa_handle.isFastOutput = false;
 
-      char *use_case;
-      snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
+      int verb_id;
+      verb_id = snd_use_case_get_verb_id(mUcMgr);
 
 #ifdef QCOM_OUTPUT_FLAGS_ENABLED
       if (flags & AUDIO_OUTPUT_FLAG_FAST) {
           alsa_handle.bufferSize = PLAYBACK_LOW_LATENCY_BUFFER_SIZE;
           alsa_handle.latency = PLAYBACK_LOW_LATENCY;
           alsa_handle.isFastOutput = true;
-          if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-               strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC, sizeof(alsa_handle.useCase));
+          if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+               setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC);
           } else {
-               strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC, sizeof(alsa_handle.useCase));
+               setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC);
           }
       } else
 #endif
       {
-          if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-               strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI, sizeof(alsa_handle.useCase));
+          if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+               setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI);
           } else {
-               strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_MUSIC, sizeof(alsa_handle.useCase));
+               setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_MUSIC);
           }
       }
-      free(use_case);
-      mDeviceList.push_back(alsa_handle);
+      addHandle_l(alsa_handle);
       ALSAHandleList::iterator it = mDeviceList.end();
       it--;
       ALOGD("useCase %s", it->useCase);
       mALSADevice->route(&(*it), devices, mode());
 #ifdef QCOM_OUTPUT_FLAGS_ENABLED
       if (flags & AUDIO_OUTPUT_FLAG_FAST) {
-          if(!strcmp(it->useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC)) {
+          if(it->useCaseId == SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC) {
              snd_use_case_set(mUcMgr, "_verb", SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC);
           } else {
              snd_use_case_set(mUcMgr, "_enamod", SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC);
@@ -1538,7 +1572,7 @@ AudioHardwareALSA::openOutputStream(uint32_t devices,
       } else
 #endif
       {
-          if(!strcmp(it->useCase, SND_USE_CASE_VERB_HIFI)) {
+          if(it->useCaseId == SND_UCM_ID_VERB_HIFI) {
              snd_use_case_set(mUcMgr, "_verb", SND_USE_CASE_VERB_HIFI);
           } else {
              snd_use_case_set(mUcMgr, "_enamod", SND_USE_CASE_MOD_PLAY_MUSIC);
@@ -1594,24 +1628,23 @@ AudioHardwareALSA::openOutputSession(uint32_t devices,
     alsa_handle.rxHandle = 0;
     alsa_handle.ucMgr = mUcMgr;
 
-    char *use_case;
+    int verb_id;
     if(sessionId == TUNNEL_SESSION_ID) {
-        snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
-        if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI_TUNNEL, sizeof(alsa_handle.useCase));
+        verb_id = snd_use_case_get_verb_id(mUcMgr);
+        if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI_TUNNEL);
         } else {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_TUNNEL, sizeof(alsa_handle.useCase));
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_TUNNEL);
         }
     } else {
-        snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
-        if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER, sizeof(alsa_handle.useCase));
+        verb_id = snd_use_case_get_verb_id(mUcMgr);
+        if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI_LOW_POWER);
         } else {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_LPA, sizeof(alsa_handle.useCase));
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_LPA);
         }
     }
-    free(use_case);
-    mDeviceList.push_back(alsa_handle);
+    addHandle_l(alsa_handle);
     ALSAHandleList::iterator it = mDeviceList.end();
     it--;
     ALOGD("useCase %s", it->useCase);
@@ -1630,14 +1663,14 @@ AudioHardwareALSA::openOutputSession(uint32_t devices,
         mALSADevice->route(&(*it), devices, mode());
     }
     if(sessionId == TUNNEL_SESSION_ID) {
-        if(!strcmp(it->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) {
+        if(it->useCaseId == SND_UCM_ID_VERB_HIFI_TUNNEL) {
             snd_use_case_set(mUcMgr, "_verb", SND_USE_CASE_VERB_HIFI_TUNNEL);
         } else {
             snd_use_case_set(mUcMgr, "_enamod", SND_USE_CASE_MOD_PLAY_TUNNEL);
         }
     }
     else {
-        if(!strcmp(it->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER)) {
+        if(it->useCaseId == SND_UCM_ID_VERB_HIFI_LOW_POWER) {
             snd_use_case_set(mUcMgr, "_verb", SND_USE_CASE_VERB_HIFI_LOW_POWER);
         } else {
             snd_use_case_set(mUcMgr, "_enamod", SND_USE_CASE_MOD_PLAY_LPA);
@@ -1666,7 +1699,7 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
                                    AudioSystem::audio_in_acoustics acoustics)
 {
     Mutex::Autolock autoLock(mLock);
-    char *use_case;
+    int verb_id;
     int newMode = mode();
     uint32_t route_devices;
 
@@ -1686,8 +1719,7 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
         bool voipstream_active = false;
         for(it = mDeviceList.begin();
             it != mDeviceList.end(); ++it) {
-                if((!strcmp(it->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-                   (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+                if(isVoipUseCase(it->useCaseId)) {
                     ALOGD("openInput:  it->rxHandle %p it->handle %p",it->rxHandle,it->handle);
                     voipstream_active = true;
                     if(mVoipInStreamCount >= 2)
@@ -1728,14 +1760,13 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
            alsa_handle.rxHandle = 0;
            alsa_handle.ucMgr = mUcMgr;
           mALSADevice->setVoipConfig(getVoipMode(*format), mVoipBitRate);
-           snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
-           if ((use_case != NULL) && (strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-                strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_VOIP, sizeof(alsa_handle.useCase));
+           verb_id = snd_use_case_get_verb_id(mUcMgr);
+           if ((verb_id != SND_UCM_ID_NONE) && (verb_id != SND_UCM_ID_VERB_INACTIVE)) {
+                setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_VOIP);
            } else {
-                strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_IP_VOICECALL, sizeof(alsa_handle.useCase));
+                setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_IP_VOICECALL);
            }
-           free(use_case);
-           mDeviceList.push_back(alsa_handle);
+           addHandle_l(alsa_handle);
            it = mDeviceList.end();
            it--;
            ALOGD("mCurrDevice: %d", mCurDevice);
@@ -1755,7 +1786,7 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
            {
                mALSADevice->route(&(*it),mCurDevice, AUDIO_MODE_IN_COMMUNICATION);
            }
-           if(!strcmp(it->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) {
+           if(it->useCaseId == SND_UCM_ID_VERB_IP_VOICECALL) {
                snd_use_case_set(mUcMgr, "_verb", SND_USE_CASE_VERB_IP_VOICECALL);
            } else {
                snd_use_case_set(mUcMgr, "_enamod", SND_USE_CASE_MOD_PLAY_VOIP);
@@ -1809,9 +1840,9 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
         alsa_handle.latency = RECORD_LATENCY;
         alsa_handle.rxHandle = 0;
         alsa_handle.ucMgr = mUcMgr;
-        snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
+        verb_id = snd_use_case_get_verb_id(mUcMgr);
 
-        if ((use_case != NULL) && (strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
+        if ((verb_id != SND_UCM_ID_NONE) && (verb_id != SND_UCM_ID_VERB_INACTIVE)) {
             if ((devices == AudioSystem::DEVICE_IN_VOICE_CALL) &&
                 (newMode == AUDIO_MODE_IN_CALL)) {
                 ALOGD("openInputStream: into incall recording, channels %d", *channels);
@@ -1820,29 +1851,23 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
                     (*channels & AUDIO_CHANNEL_IN_VOICE_DNLINK)) {
                     if (mFusion3Platform) {
                         mALSADevice->setVocRecMode(INCALL_REC_STEREO);
-                        strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_VOICE,
-                                sizeof(alsa_handle.useCase));
+                        setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_VOICE);
                     } else {
                         if (*format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL);
                         } else {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_UL_DL,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_VOICE_UL_DL);
                         }
                     }
                 } else if (*channels & AUDIO_CHANNEL_IN_VOICE_DNLINK) {
                     if (mFusion3Platform) {
                         mALSADevice->setVocRecMode(INCALL_REC_MONO);
-                        strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_VOICE,
-                                sizeof(alsa_handle.useCase));
+                        setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_VOICE);
                     } else {
                         if (*format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_DL,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_DL);
                         } else {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_DL,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_VOICE_DL);
                         }
                     }
                 } else if (*channels & AUDIO_CHANNEL_IN_VOICE_UPLINK) {
@@ -1850,29 +1875,27 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
                        /* Use normal audio recording for Fusion3 target, this behavior
                           will be changed in Fusion4
                         */
-                       strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC,
-                               sizeof(SND_USE_CASE_MOD_CAPTURE_MUSIC));
+                       setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_MUSIC);
                    } else {
-                       strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_UL,
-                               sizeof(SND_USE_CASE_MOD_CAPTURE_VOICE_UL));
+                       setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_VOICE_UL);
                    }
                }
 #ifdef QCOM_FM_ENABLED
             } else if((devices == AudioSystem::DEVICE_IN_FM_RX)) {
-                strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_FM, sizeof(alsa_handle.useCase));
+                setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_FM);
             } else if(devices == AudioSystem::DEVICE_IN_FM_RX_A2DP) {
-                strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_A2DP_FM, sizeof(alsa_handle.useCase));
+                setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_A2DP_FM);
 #endif
             } else {
                 char value[128];
                 property_get("persist.audio.lowlatency.rec",value,"0");
                 if (!strcmp("true", value)) {
-                    strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_LOWLATENCY_MUSIC, sizeof(alsa_handle.useCase));
+                    setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_LOWLATENCY_MUSIC);
                 } else if (*format == AUDIO_FORMAT_AMR_WB) {
                     ALOGV("Format AMR_WB, open compressed capture");
-                    strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, sizeof(alsa_handle.useCase));
+                    setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED);
                 } else {
-                    strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, sizeof(alsa_handle.useCase));
+                    setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_CAPTURE_MUSIC);
                 }
             }
         } else {
@@ -1884,60 +1907,51 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
                     (*channels & AUDIO_CHANNEL_IN_VOICE_DNLINK)) {
                     if (mFusion3Platform) {
                         mALSADevice->setVocRecMode(INCALL_REC_STEREO);
-                        strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_INCALL_REC,
-                                sizeof(alsa_handle.useCase));
+                        setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_INCALL_REC);
                     } else {
                         if (*format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL);
                         } else {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_UL_DL_REC,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_UL_DL_REC);
                         }
                     }
                 } else if (*channels & AUDIO_CHANNEL_IN_VOICE_DNLINK) {
                     if (mFusion3Platform) {
                         mALSADevice->setVocRecMode(INCALL_REC_MONO);
-                        strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_INCALL_REC,
-                                sizeof(alsa_handle.useCase));
+                        setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_INCALL_REC);
                     } else {
                         if (*format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_DL,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_DL);
                         } else {
-                            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_DL_REC,
-                                    sizeof(alsa_handle.useCase));
+                            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_DL_REC);
                         }
                     }
                 } else if (*channels & AUDIO_CHANNEL_IN_VOICE_UPLINK) {
                    if (mFusion3Platform) {
-                       strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI_REC,
-                               sizeof(SND_USE_CASE_VERB_HIFI_REC));
+                       setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI_REC);
                    } else {
-                       strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_UL_REC,
-                               sizeof(SND_USE_CASE_VERB_UL_REC));
+                       setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_UL_REC);
                    }
                 }
 #ifdef QCOM_FM_ENABLED
             } else if(devices == AudioSystem::DEVICE_IN_FM_RX) {
-                strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_FM_REC, sizeof(alsa_handle.useCase));
+                setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_FM_REC);
             } else if (devices == AudioSystem::DEVICE_IN_FM_RX_A2DP) {
-                strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_FM_A2DP_REC, sizeof(alsa_handle.useCase));
+                setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_FM_A2DP_REC);
 #endif
             } else {
                 char value[128];
                 property_get("persist.audio.lowlatency.rec",value,"0");
                 if (!strcmp("true", value)) {
-                    strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_REC, sizeof(alsa_handle.useCase));
+                    setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI_LOWLATENCY_REC);
                 } else if (*format == AUDIO_FORMAT_AMR_WB) {
-                    strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, sizeof(alsa_handle.useCase));
+                    setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI_REC_COMPRESSED);
                 } else {
-                    strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_HIFI_REC, sizeof(alsa_handle.useCase));
+                    setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_HIFI_REC);
                 }
             }
         }
-        free(use_case);
-        mDeviceList.push_back(alsa_handle);
+        addHandle_l(alsa_handle);
         ALSAHandleList::iterator it = mDeviceList.end();
         it--;
         //update channel info before do routing
@@ -1985,18 +1999,14 @@ AudioHardwareALSA::openInputStream(uint32_t devices,
         if(sampleRate) {
             it->sampleRate = *sampleRate;
         }
-        if (!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_REC, strlen(SND_USE_CASE_VERB_HIFI_REC))
-            || !strncmp(it->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))) {
+        if (isHiFiRecUseCase(it->useCaseId)) {
             ALOGV("OpenInoutStream: getInputBufferSize sampleRate:%d format:%d, channels:%d", it->sampleRate,*format,it->channels);
             it->bufferSize = getInputBufferSize(it->sampleRate,*format,it->channels);
         }
 
 #ifdef QCOM_SSR_ENABLED
         if (6 == it->channels) {
-            if (!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_REC, strlen(SND_USE_CASE_VERB_HIFI_REC))
-                || !strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, strlen(SND_USE_CASE_VERB_HIFI_REC_COMPRESSED))
-                || !strncmp(it->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))
-                || !strncmp(it->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+            if (isHiFiRecUseCase(it->useCaseId)) {
                 //Check if SSR is supported by reading system property
                 char ssr_enabled[PROP_VALUE_MAX] = "false";
                 property_get("ro.qc.sdk.audio.ssr",ssr_enabled,"0");
@@ -2076,6 +2086,31 @@ status_t AudioHardwareALSA::getMicMute(bool *state)
 
 status_t AudioHardwareALSA::dump(int fd, const Vector<String16>& args)
 {
+    char buffer[256];
+
+    if (mALSADevice) {
+        mALSADevice->dump(fd);
+    }
+    for (int i = 0; i < VOICE_SESSION_COUNT; i++) {
+        struct voice_session *session = &mVoiceSessions[i];
+        snprintf(buffer, sizeof(buffer),
+                 "Voice session %x: state %d\n"
+                 "  setups %u, last %lld us, max %lld us\n"
+                 "  hold/resume %u, last %lld us, max %lld us\n"
+                 "  teardowns %u, last %lld us\n",
+                 session->vsid, *session->callState,
+                 session->setups, (long long)session->lastSetupUs,
+                 (long long)session->maxSetupUs,
+                 session->swaps, (long long)session->lastSwapUs,
+                 (long long)session->maxSwapUs,
+                 session->teardowns, (long long)session->lastTeardownUs);
+        ::write(fd, buffer, strlen(buffer));
+    }
+#ifdef QCOM_USBAUDIO_ENABLED
+    if (mAudioUsbALSA) {
+        mAudioUsbALSA->dump(fd);
+    }
+#endif
     return NO_ERROR;
 }
 
@@ -2122,15 +2157,14 @@ void AudioHardwareALSA::handleFm(int device)
         // Start FM Radio on current active device
         unsigned long bufferSize = FM_BUFFER_SIZE;
         alsa_handle_t alsa_handle;
-        char *use_case;
+        int verb_id;
         ALOGV("Start FM");
-        snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
-        if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_VERB_DIGITAL_RADIO, sizeof(alsa_handle.useCase));
+        verb_id = snd_use_case_get_verb_id(mUcMgr);
+        if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_VERB_DIGITAL_RADIO);
         } else {
-            strlcpy(alsa_handle.useCase, SND_USE_CASE_MOD_PLAY_FM, sizeof(alsa_handle.useCase));
+            setHandleUseCase(&alsa_handle, SND_UCM_ID_MOD_PLAY_FM);
         }
-        free(use_case);
 
         for (size_t b = 1; (bufferSize & ~b) != 0; b <<= 1)
         bufferSize &= ~b;
@@ -2145,7 +2179,7 @@ void AudioHardwareALSA::handleFm(int device)
         alsa_handle.rxHandle = 0;
         alsa_handle.ucMgr = mUcMgr;
         mIsFmActive = 1;
-        mDeviceList.push_back(alsa_handle);
+        addHandle_l(alsa_handle);
         ALSAHandleList::iterator it = mDeviceList.end();
         it--;
 
@@ -2176,13 +2210,13 @@ void AudioHardwareALSA::handleFm(int device)
             }
         }
         mALSADevice->route(&(*it), (uint32_t)device, newMode);
-        if(!strcmp(it->useCase, SND_USE_CASE_VERB_DIGITAL_RADIO)) {
+        if(it->useCaseId == SND_UCM_ID_VERB_DIGITAL_RADIO) {
             snd_use_case_set(mUcMgr, "_verb", SND_USE_CASE_VERB_DIGITAL_RADIO);
         } else {
             snd_use_case_set(mUcMgr, "_enamod", SND_USE_CASE_MOD_PLAY_FM);
         }
         mALSADevice->startFm(&(*it));
-        activeUsecase = useCaseStringToEnum(it->useCase);
+        activeUsecase = useCaseIdToEnum(it->useCaseId);
 #ifdef QCOM_USBAUDIO_ENABLED
         if((device & AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET)||
            (device & AudioSystem::DEVICE_OUT_DGTL_DOCK_HEADSET)){
@@ -2204,16 +2238,13 @@ void AudioHardwareALSA::handleFm(int device)
     } else if (!(device & AUDIO_DEVICE_OUT_FM) && mIsFmActive == 1) {
         //i Stop FM Radio
         ALOGV("Stop FM");
-        for(ALSAHandleList::iterator it = mDeviceList.begin();
-            it != mDeviceList.end(); ++it) {
-            if((!strcmp(it->useCase, SND_USE_CASE_VERB_DIGITAL_RADIO)) ||
-              (!strcmp(it->useCase, SND_USE_CASE_MOD_PLAY_FM))) {
-                mALSADevice->close(&(*it));
-                activeUsecase = useCaseStringToEnum(it->useCase);
-                //mALSADevice->route(&(*it), (uint32_t)device, newMode);
-                mDeviceList.erase(it);
-                break;
-            }
+        static const int fmIds[] = { SND_UCM_ID_VERB_DIGITAL_RADIO, SND_UCM_ID_MOD_PLAY_FM };
+        alsa_handle_t *handle = mHandleIndex.findAny(fmIds, 2);
+        if (handle) {
+            mALSADevice->close(handle);
+            activeUsecase = useCaseIdToEnum(handle->useCaseId);
+            //mALSADevice->route(handle, (uint32_t)device, newMode);
+            removeHandle_l(handle);
         }
         mIsFmActive = 0;
 #ifdef QCOM_USBAUDIO_ENABLED
@@ -2246,19 +2277,13 @@ void AudioHardwareALSA::disableVoiceCall(int mode, int device, uint32_t vsid)
             return;
     }
 
-    for(ALSAHandleList::iterator it = mDeviceList.begin();
-         it != mDeviceList.end(); ++it) {
-        if((!strncmp(it->useCase, verb,
-                     MAX(strlen(verb), strlen(it->useCase)))) ||
-           (!strncmp(it->useCase, modifier,
-                     MAX(strlen(modifier), strlen(it->useCase))))) {
-            ALOGV("Disabling voice call vsid:%x", vsid);
-            mALSADevice->setInChannels(0);
-            mALSADevice->close(&(*it), vsid);
-            mALSADevice->route(&(*it), (uint32_t)device, mode);
-            mDeviceList.erase(it);
-            break;
-        }
+    alsa_handle_t *handle = getALSADeviceHandleForVSID(vsid);
+    if (handle) {
+        ALOGV("Disabling voice call vsid:%x", vsid);
+        mALSADevice->setInChannels(0);
+        mALSADevice->close(handle, vsid);
+        mALSADevice->route(handle, (uint32_t)device, mode);
+        removeHandle_l(handle);
     }
 
 #ifdef QCOM_USBAUDIO_ENABLED
@@ -2278,7 +2303,7 @@ status_t  AudioHardwareALSA::enableVoiceCall(int mode, int device, uint32_t vsid
     status_t status;
     unsigned long bufferSize = DEFAULT_VOICE_BUFFER_SIZE;
     alsa_handle_t alsa_handle;
-    char *use_case;
+    int verb_id;
     char *verb = getUcmVerbForVSID(vsid);
     char *modifier = getUcmModForVSID(vsid);
 
@@ -2289,13 +2314,12 @@ status_t  AudioHardwareALSA::enableVoiceCall(int mode, int device, uint32_t vsid
             return NO_INIT;
     }
 
-    snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
-    if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-        strlcpy(alsa_handle.useCase, verb, sizeof(alsa_handle.useCase));
+    verb_id = snd_use_case_get_verb_id(mUcMgr);
+    if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+        setHandleUseCase(&alsa_handle, verb);
     } else {
-        strlcpy(alsa_handle.useCase, modifier, sizeof(alsa_handle.useCase));
+        setHandleUseCase(&alsa_handle, modifier);
     }
-    free(use_case);
 
     if (device == AUDIO_DEVICE_OUT_BLUETOOTH_A2DP) {
         ALOGE("Returning error as BTA2DP device is not compatible for Voice call");
@@ -2314,7 +2338,7 @@ status_t  AudioHardwareALSA::enableVoiceCall(int mode, int device, uint32_t vsid
     alsa_handle.latency = VOICE_LATENCY;
     alsa_handle.rxHandle = 0;
     alsa_handle.ucMgr = mUcMgr;
-    mDeviceList.push_back(alsa_handle);
+    addHandle_l(alsa_handle);
     ALSAHandleList::iterator it = mDeviceList.end();
     it--;
     setInChannels(device);
@@ -2335,7 +2359,7 @@ status_t  AudioHardwareALSA::enableVoiceCall(int mode, int device, uint32_t vsid
     }
     else {
         ALOGE("AudioHardwareAlsa: voice call setup was unsuccesfull");
-        mDeviceList.erase(it);
+        removeHandle_l(it);
         return NO_INIT;
     }
 
@@ -2352,78 +2376,101 @@ status_t  AudioHardwareALSA::enableVoiceCall(int mode, int device, uint32_t vsid
     return NO_ERROR;
 }
 
-char *AudioHardwareALSA::getUcmVerbForVSID(uint32_t vsid)
+void AudioHardwareALSA::initVoiceSession(int index, uint32_t vsid, char *verb,
+                                         char *modifier, int *callState)
 {
-    char *verb = NULL;
-
-    switch (vsid) {
-       case VOLTE_SESSION_VSID:
-           verb = SND_USE_CASE_VERB_VOLTE;
-           break;
-
-       case VOICE2_SESSION_VSID:
-           verb = SND_USE_CASE_VERB_VOICE2;
-           break;
-
-       case VOICE_SESSION_VSID:
-           verb = SND_USE_CASE_VERB_VOICECALL;
-           break;
+    struct voice_session *session = &mVoiceSessions[index];
 
-        default:
-            ALOGE("%s: Invalid vsid:%x", __func__, vsid);
+    memset(session, 0, sizeof(*session));
+    session->vsid = vsid;
+    session->verb = verb;
+    session->modifier = modifier;
+    session->callState = callState;
+}
 
+struct AudioHardwareALSA::voice_session *AudioHardwareALSA::getVoiceSession(uint32_t vsid)
+{
+    for (int i = 0; i < VOICE_SESSION_COUNT; i++) {
+        if (mVoiceSessions[i].vsid == vsid) {
+            return &mVoiceSessions[i];
+        }
     }
+    ALOGE("%s: Invalid vsid:%x", __func__, vsid);
+    return NULL;
+}
 
-    return verb;
+char *AudioHardwareALSA::getUcmVerbForVSID(uint32_t vsid)
+{
+    struct voice_session *session = getVoiceSession(vsid);
+
+    return session ? session->verb : NULL;
 }
 
 char *AudioHardwareALSA::getUcmModForVSID(uint32_t vsid)
 {
-    char *mod = NULL;
+    struct voice_session *session = getVoiceSession(vsid);
 
-    switch (vsid) {
-    case VOLTE_SESSION_VSID:
-        mod = SND_USE_CASE_MOD_PLAY_VOLTE;
-        break;
+    return session ? session->modifier : NULL;
+}
 
-    case VOICE2_SESSION_VSID:
-        mod = SND_USE_CASE_MOD_PLAY_VOICE2;
-        break;
+int *AudioHardwareALSA::getCallStateForVSID(uint32_t vsid)
+{
+    struct voice_session *session = getVoiceSession(vsid);
 
-    case VOICE_SESSION_VSID:
-        mod = SND_USE_CASE_MOD_PLAY_VOICE;
-        break;
+    return session ? session->callState : NULL;
+}
 
-    default:
-        ALOGE("%s: Invalid vsid:%x", __func__, vsid);
+alsa_handle_t *AudioHardwareALSA::addHandle_l(const alsa_handle_t &handle)
+{
+    mDeviceList.push_back(handle);
+    ALSAHandleList::iterator it = mDeviceList.end();
+    it--;
+    //An unindexed handle is never closed, so there is no failing softly
+    if (mHandleIndex.add(&(*it))) {
+        LOG_ALWAYS_FATAL("addHandle_l: failed to index %s", it->useCase);
     }
+    return &(*it);
+}
 
-    return mod;
+ALSAHandleList::iterator AudioHardwareALSA::removeHandle_l(ALSAHandleList::iterator it)
+{
+    mHandleIndex.remove(&(*it));
+    return mDeviceList.erase(it);
 }
 
-int *AudioHardwareALSA::getCallStateForVSID(uint32_t vsid)
+void AudioHardwareALSA::removeHandle_l(alsa_handle_t *handle)
 {
-    int *callState = NULL;
+    for (ALSAHandleList::iterator it = mDeviceList.begin();
+         it != mDeviceList.end(); ++it) {
+        if (&(*it) == handle) {
+            removeHandle_l(it);
+            return;
+        }
+    }
+}
 
-    switch (vsid) {
-    case VOLTE_SESSION_VSID:
-        callState = &mVolteCallState;
-        break;
+void AudioHardwareALSA::setUseCase_l(alsa_handle_t *handle, int useCaseId)
+{
+    int oldId = handle->useCaseId;
 
-    case VOICE2_SESSION_VSID:
-        callState = &mVoice2CallState;
-        break;
+    setHandleUseCase(handle, useCaseId);
+    mHandleIndex.rekey(handle, oldId);
+}
 
-    case VOICE_SESSION_VSID:
-        callState = &mVoiceCallState;
-        break;
+alsa_handle_t *AudioHardwareALSA::findHandle_l(const char *useCase)
+{
+    int useCaseId = snd_use_case_name_to_id(useCase);
 
-    default:
-       ALOGE("%s: Invalid vsid:%x", __func__, vsid);
-       callState = NULL;
+    if (useCaseId != SND_UCM_ID_NONE) {
+        return mHandleIndex.find(useCaseId);
     }
-
-    return callState;
+    // Names outside the interned table can only be matched by name
+    for (int i = 0; i < mHandleIndex.size(); i++) {
+        if (!strcmp(mHandleIndex.at(i)->useCase, useCase)) {
+            return mHandleIndex.at(i);
+        }
+    }
+    return NULL;
 }
 
 alsa_handle_t *AudioHardwareALSA::getALSADeviceHandleForVSID(uint32_t vsid)
@@ -2431,7 +2478,6 @@ alsa_handle_t *AudioHardwareALSA::getALSADeviceHandleForVSID(uint32_t vsid)
     alsa_handle_t *handle = NULL;
     char *ucmVerbForCall = getUcmVerbForVSID(vsid);
     char *ucmModForCall =  getUcmModForVSID(vsid);
-    ALSAHandleList::iterator vt_it;
 
     if (ucmVerbForCall == NULL || ucmModForCall == NULL ) {
         ALOGE("%s: Error, ucmVerbForCall=%p or ucmModForCall=%p is NULL",
@@ -2440,16 +2486,9 @@ alsa_handle_t *AudioHardwareALSA::getALSADeviceHandleForVSID(uint32_t vsid)
         return handle;
     }
 
-    for(vt_it = mDeviceList.begin();
-         vt_it != mDeviceList.end(); ++vt_it) {
-        if((!strncmp(vt_it->useCase, ucmVerbForCall,
-                     MAX(strlen(ucmVerbForCall), strlen(vt_it->useCase)))) ||
-           (!strncmp(vt_it->useCase, ucmModForCall,
-                     MAX(strlen(ucmModForCall), strlen(vt_it->useCase))))) {
-            handle = (alsa_handle_t *)(&(*vt_it));
-            break;
-        }
-    }
+    // Whichever of the verb and modifier handles was opened first
+    handle = mHandleIndex.earlier(findHandle_l(ucmVerbForCall),
+                                  findHandle_l(ucmModForCall));
 
     return handle;
 }
@@ -2459,9 +2498,13 @@ bool AudioHardwareALSA::routeCall(int device, int newMode, uint32_t vsid)
     bool isRouted = false;
     alsa_handle_t *handle = NULL;
     int err = 0;
-    int *curCallState = getCallStateForVSID(vsid);
+    struct voice_session *session = getVoiceSession(vsid);
+    int *curCallState = session ? session->callState : NULL;
     int newCallState = mCallState;
+    int prevCallState;
     status_t status;
+    nsecs_t start = systemTime();
+    int64_t us;
 
     if (curCallState == NULL) {
         ALOGE("%s(): Error, mCurCallState=%p is NULL",
@@ -2469,6 +2512,7 @@ bool AudioHardwareALSA::routeCall(int device, int newMode, uint32_t vsid)
 
         return isRouted;
     }
+    prevCallState = *curCallState;
 
     ALOGV("%s: CurCallState=%x newCallState=%x, vsid =%x",
           __func__, *curCallState, newCallState, vsid);
@@ -2567,38 +2611,46 @@ bool AudioHardwareALSA::routeCall(int device, int newMode, uint32_t vsid)
            break;
     }
 
+    if (isRouted) {
+        us = (systemTime() - start) / 1000;
+        if (prevCallState == CALL_INACTIVE) {
+            session->setups++;
+            session->lastSetupUs = us;
+            if (us > session->maxSetupUs)
+                session->maxSetupUs = us;
+        } else if (*curCallState == CALL_INACTIVE) {
+            session->teardowns++;
+            session->lastTeardownUs = us;
+        } else {
+            session->swaps++;
+            session->lastSwapUs = us;
+            if (us > session->maxSwapUs)
+                session->maxSwapUs = us;
+        }
+        ALOGV("%s: vsid:%x state %x -> %x in %lld us", __func__, vsid,
+              prevCallState, *curCallState, (long long)us);
+    }
+
     return isRouted;
 }
 
 #ifdef QCOM_TUNNEL_LPA_ENABLED
 void AudioHardwareALSA::pauseIfUseCaseTunnelOrLPA() {
-    for (ALSAHandleList::iterator it = mDeviceList.begin();
-           it != mDeviceList.end(); it++) {
-        if((!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL,
-                strlen(SND_USE_CASE_VERB_HIFI_TUNNEL))) ||
-            (!strncmp(it->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL,
-                strlen(SND_USE_CASE_MOD_PLAY_TUNNEL))) ||
-            (!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER,
-                strlen(SND_USE_CASE_VERB_HIFI_LOW_POWER))) ||
-            (!strncmp(it->useCase, SND_USE_CASE_MOD_PLAY_LPA,
-                strlen(SND_USE_CASE_MOD_PLAY_LPA)))) {
-                it->session->pause_l();
+    for (int i = 0; i < mHandleIndex.size(); i++) {
+        alsa_handle_t *handle = mHandleIndex.at(i);
+        if (useCaseIdToEnum(handle->useCaseId) &
+            (USECASE_HIFI_TUNNEL | USECASE_HIFI_LOW_POWER)) {
+                handle->session->pause_l();
         }
     }
 }
 
 void AudioHardwareALSA::resumeIfUseCaseTunnelOrLPA() {
-    for (ALSAHandleList::iterator it = mDeviceList.begin();
-           it != mDeviceList.end(); it++) {
-        if((!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL,
-                strlen(SND_USE_CASE_VERB_HIFI_TUNNEL))) ||
-            (!strncmp(it->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL,
-                strlen(SND_USE_CASE_MOD_PLAY_TUNNEL))) ||
-            (!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER,
-                strlen(SND_USE_CASE_VERB_HIFI_LOW_POWER))) ||
-            (!strncmp(it->useCase, SND_USE_CASE_MOD_PLAY_LPA,
-                strlen(SND_USE_CASE_MOD_PLAY_LPA)))) {
-                it->session->resume_l();
+    for (int i = 0; i < mHandleIndex.size(); i++) {
+        alsa_handle_t *handle = mHandleIndex.at(i);
+        if (useCaseIdToEnum(handle->useCaseId) &
+            (USECASE_HIFI_TUNNEL | USECASE_HIFI_LOW_POWER)) {
+                handle->session->resume_l();
         }
     }
 }
@@ -2748,7 +2800,7 @@ status_t AudioHardwareALSA::openExtOutput(int device) {
             return err;
         }
         if(!mExtOutStream) {
-            mExtOutStream = mA2dpStream;
+            setExtOutStream_l(mA2dpStream);
         }
 #ifdef QCOM_USBAUDIO_ENABLED
     } else if (device & AudioSystem::DEVICE_OUT_ALL_USB) {
@@ -2758,7 +2810,7 @@ status_t AudioHardwareALSA::openExtOutput(int device) {
             return err;
         }
         if(!mExtOutStream) {
-            mExtOutStream = mUsbStream;
+            setExtOutStream_l(mUsbStream);
         }
 #endif
     }
@@ -2773,7 +2825,7 @@ status_t AudioHardwareALSA::closeExtOutput(int device) {
     Mutex::Autolock autolock2(mExtOutMutexWrite);
     if (device & AudioSystem::DEVICE_OUT_ALL_A2DP) {
         if(mExtOutStream == mA2dpStream)
-            mExtOutStream = NULL;
+            setExtOutStream_l(NULL);
         err= closeA2dpOutput();
         if(err) {
             ALOGE("closeA2DPOutput failed = %d",err);
@@ -2781,7 +2833,7 @@ status_t AudioHardwareALSA::closeExtOutput(int device) {
         }
     } else if (device & AUDIO_DEVICE_OUT_ALL_USB) {
         if(mExtOutStream == mUsbStream)
-            mExtOutStream = NULL;
+            setExtOutStream_l(NULL);
         err= closeUsbOutput();
         if(err) {
             ALOGE("closeUsbPOutput failed = %d",err);
@@ -2920,11 +2972,11 @@ void AudioHardwareALSA::switchExtOut(int device) {
     uint32_t sampleRate;
     Mutex::Autolock autolock1(mExtOutMutex);
     if (device & AudioSystem::DEVICE_OUT_ALL_A2DP) {
-        mExtOutStream = mA2dpStream;
+        setExtOutStream_l(mA2dpStream);
     } else if (device & AUDIO_DEVICE_OUT_ALL_USB) {
-        mExtOutStream = mUsbStream;
+        setExtOutStream_l(mUsbStream);
     } else {
-        mExtOutStream = NULL;
+        setExtOutStream_l(NULL);
     }
     if ((mExtOutStream == mUsbStream) && mExtOutStream != NULL) {
         sampleRate = mExtOutStream->common.get_sample_rate(&mExtOutStream->common);
@@ -2970,6 +3022,24 @@ status_t AudioHardwareALSA::isExtOutDevice(int device) {
             (device & AUDIO_DEVICE_OUT_ALL_USB)) ;
 }
 
+void AudioHardwareALSA::setExtOutStream_l(audio_stream_out *stream) {
+    mExtOutStream = stream;
+    mExtOutBufferSize = (stream != NULL) ?
+            stream->common.get_buffer_size(&stream->common) : 0;
+    ALOGV("setExtOutStream_l stream %p buffer size %d", stream, mExtOutBufferSize);
+}
+
+static void logExtOutStats(uint64_t bytesDelivered, uint64_t bytesCopied,
+                           uint32_t wakeups, nsecs_t elapsed)
+{
+    uint32_t copiesPerFrame = bytesDelivered ?
+            (uint32_t)((bytesCopied * 100) / bytesDelivered) : 0;
+    uint32_t wakeupsPerSec = elapsed ?
+            (uint32_t)(((uint64_t)wakeups * 1000000000LL) / elapsed) : 0;
+    ALOGD("ExtOut stats: %llu bytes delivered, %d.%02d copies/frame, %d wakeups/s",
+          (unsigned long long)bytesDelivered, copiesPerFrame / 100, copiesPerFrame % 100, wakeupsPerSec);
+}
+
 void *AudioHardwareALSA::extOutThreadWrapper(void *me) {
     static_cast<AudioHardwareALSA *>(me)->extOutThreadFunc();
     return NULL;
@@ -2989,15 +3059,26 @@ void AudioHardwareALSA::extOutThreadFunc() {
     androidSetThreadPriority(tid, ANDROID_PRIORITY_URGENT_AUDIO);
     prctl(PR_SET_NAME, (unsigned long)"ExtOutThread", 0, 0, 0);
 
-    int ionBufCount = 0;
     int32_t bytesWritten = 0;
     uint32_t numBytesRemaining = 0;
-    uint32_t bytesAvailInBuffer = 0;
-    uint32_t proxyBufferTime = 0;
+    uint32_t proxyBufferTime = mALSADevice->mProxyParams.mBufferTime;
     void  *data;
     status_t err = NO_ERROR;
     ssize_t size = 0;
+    //Resampler output for USB sinks; the resampler only ever downsamples
+    //from the proxy rate so one proxy period always fits.
     void * outbuffer= malloc(AFE_PROXY_PERIOD_SIZE);
+    if(!outbuffer) {
+        ALOGE("Failed to allocate resampler output buffer");
+        return;
+    }
+
+    //Pipeline statistics: bytes handed to the sink, bytes copied by this
+    //thread on the way and proxy wake-ups, logged every few seconds.
+    uint64_t bytesDelivered = 0;
+    uint64_t bytesCopied = 0;
+    uint32_t wakeupsStart = mALSADevice->mProxyParams.mWakeups;
+    nsecs_t statsStart = systemTime();
 
     mALSADevice->resetProxyVariables();
 
@@ -3024,14 +3105,16 @@ void AudioHardwareALSA::extOutThreadFunc() {
                 continue;
             }
         }
-        err = mALSADevice->readFromProxy(&data, &size);
+        //Samples are consumed in place from the proxy mmap region and only
+        //handed back to the driver once they have been written out.
+        err = mALSADevice->acquireProxyFrames(&data, &size);
         if(err == (status_t) FAILED_TRANSACTION) {
-            ALOGE("readFromProxy returned an error, mostly a flush or an under run continuing");
+            ALOGE("acquireProxyFrames returned an error, mostly an under run continuing");
             err = NO_ERROR;
             continue;
         }
         if(err < 0  || size <= 0) {
-            ALOGE("ALSADevice readFromProxy returned err = %d,data = %p,\
+            ALOGE("ALSADevice acquireProxyFrames returned err = %d,data = %p,\
                     size = %ld", err, data, size);
             continue;
         }
@@ -3044,7 +3127,6 @@ void AudioHardwareALSA::extOutThreadFunc() {
 #endif
         void *copyBuffer = data;
         numBytesRemaining = size;
-        proxyBufferTime = mALSADevice->mProxyParams.mBufferTime;
         {
             Mutex::Autolock autolock1(mExtOutMutex);
             if (mResampler != NULL) {
@@ -3057,33 +3139,47 @@ void AudioHardwareALSA::extOutThreadFunc() {
                                                &outFrames);
                 copyBuffer = outbuffer;
                 numBytesRemaining = outFrames*(AFE_PROXY_CHANNEL_COUNT*2);
+                bytesCopied += numBytesRemaining;
                 ALOGV("inFrames %d outFrames %d",inFrames,outFrames);
             }
         }
+        //Once resampled the proxy region is no longer needed, give it back
+        //before blocking in the sink.
+        bool released = false;
+        if (copyBuffer != data) {
+            err = mALSADevice->releaseProxyFrames(size);
+            released = true;
+        }
         while (err == OK && (numBytesRemaining  > 0) && !mKillExtOutThread
                 && mIsExtOutEnabled ) {
             {
                 mExtOutMutexWrite.lock();
                 if(mExtOutStream != NULL ) {
-                    bytesAvailInBuffer = mExtOutStream->common.get_buffer_size(&mExtOutStream->common);
-                    uint32_t writeLen = bytesAvailInBuffer > numBytesRemaining ?
-                                    numBytesRemaining : bytesAvailInBuffer;
+                    uint32_t writeLen = mExtOutBufferSize > numBytesRemaining ?
+                                    numBytesRemaining : mExtOutBufferSize;
                     ALOGV("Writing %d bytes to External Output ", writeLen);
                     bytesWritten = mExtOutStream->write(mExtOutStream,copyBuffer, writeLen);
                     mExtOutMutexWrite.unlock();
+                    if (bytesWritten > 0)
+                        bytesDelivered += bytesWritten;
                 } else {
-                    //unlock the mutex before sleep
                     mExtOutMutexWrite.unlock();
+                    //No External output to write, drop the data. The proxy
+                    //read already paces this loop at the capture rate.
                     ALOGV(" No External output to write  ");
-                    usleep(proxyBufferTime*1000);
                     bytesWritten = numBytesRemaining;
                 }
             }
-            //If the write fails make this thread sleep and let other
-            //thread (eg: stopA2DP) to acquire lock to prevent a deadlock.
+            //If the write fails back off for a proxy period on mExtOutCv so
+            //that other threads (eg: stopA2DP) can acquire the lock and
+            //wake us up early instead of deadlocking.
             if(bytesWritten < 0 || bytesWritten == 0) {
                 ALOGE("bytesWritten = %d",bytesWritten);
-                usleep(10000);
+                Mutex::Autolock autolock1(mExtOutMutex);
+                if (!mKillExtOutThread) {
+                    mExtOutCv.waitRelative(mExtOutMutex,
+                            milliseconds(proxyBufferTime ? proxyBufferTime : 10));
+                }
                 break;
             }
             //Need to check warning here - void used in arithmetic
@@ -3091,8 +3187,27 @@ void AudioHardwareALSA::extOutThreadFunc() {
             numBytesRemaining -= bytesWritten;
             ALOGV("@_@bytes To write2:%d",numBytesRemaining);
         }
+        if (!released) {
+            err = mALSADevice->releaseProxyFrames(size);
+        }
+
+        nsecs_t elapsed = systemTime() - statsStart;
+        if (elapsed >= seconds(5)) {
+            logExtOutStats(bytesDelivered, bytesCopied,
+                           mALSADevice->mProxyParams.mWakeups - wakeupsStart, elapsed);
+            mALSADevice->logProxyStats();
+            bytesDelivered = 0;
+            bytesCopied = 0;
+            wakeupsStart = mALSADevice->mProxyParams.mWakeups;
+            statsStart = systemTime();
+        }
     }
 
+    logExtOutStats(bytesDelivered, bytesCopied,
+                   mALSADevice->mProxyParams.mWakeups - wakeupsStart,
+                   systemTime() - statsStart);
+    mALSADevice->logProxyStats();
+    free(outbuffer);
     mALSADevice->resetProxyVariables();
     mExtOutThreadAlive = false;
     ALOGD("ExtOut Thread is dying");
@@ -3120,43 +3235,48 @@ void AudioHardwareALSA::clearExtOutActiveUseCases_l(uint32_t activeUsecase) {
 uint32_t AudioHardwareALSA::useCaseStringToEnum(const char *usecase)
 {
    ALOGV("useCaseStringToEnum usecase:%s",usecase);
-   uint32_t activeUsecase = USECASE_NONE;
    if (usecase == NULL) {
        ALOGE("useCaseStringToEnum: invalid input usecase return USECASE_NONE");
        return USECASE_NONE;
    }
+   return useCaseIdToEnum(snd_use_case_name_to_id(usecase));
+}
 
-   if ((!strncmp(usecase, SND_USE_CASE_VERB_HIFI_LOW_POWER,
-                    strlen(SND_USE_CASE_VERB_HIFI_LOW_POWER))) ||
-       (!strncmp(usecase, SND_USE_CASE_MOD_PLAY_LPA,
-                    strlen(SND_USE_CASE_MOD_PLAY_LPA)))) {
-       activeUsecase = USECASE_HIFI_LOW_POWER;
-   } else if ((!strncmp(usecase, SND_USE_CASE_VERB_HIFI_TUNNEL,
-                           strlen(SND_USE_CASE_VERB_HIFI_TUNNEL))) ||
-              (!strncmp(usecase, SND_USE_CASE_MOD_PLAY_TUNNEL,
-                           strlen(SND_USE_CASE_MOD_PLAY_TUNNEL)))) {
-       activeUsecase = USECASE_HIFI_TUNNEL;
-   } else if ((!strncmp(usecase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC,
-                           strlen(SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC )))||
-               (!strncmp(usecase, SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC,
-                           strlen(SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC)))) {
-       activeUsecase = USECASE_HIFI_LOWLATENCY;
-   } else if ((!strncmp(usecase, SND_USE_CASE_VERB_DIGITAL_RADIO,
-                           strlen(SND_USE_CASE_VERB_DIGITAL_RADIO))) ||
-               (!strncmp(usecase, SND_USE_CASE_MOD_PLAY_FM,
-                           strlen(SND_USE_CASE_MOD_PLAY_FM)))||
-               (!strncmp(usecase, SND_USE_CASE_VERB_FM_REC,
-                           strlen(SND_USE_CASE_VERB_FM_REC)))||
-               (!strncmp(usecase, SND_USE_CASE_MOD_CAPTURE_FM,
-                           strlen(SND_USE_CASE_MOD_CAPTURE_FM)))){
-       activeUsecase = USECASE_FM;
-    } else if ((!strncmp(usecase, SND_USE_CASE_VERB_HIFI,
-                           strlen(SND_USE_CASE_VERB_HIFI)))||
-               (!strncmp(usecase, SND_USE_CASE_MOD_PLAY_MUSIC,
-                           strlen(SND_USE_CASE_MOD_PLAY_MUSIC)))) {
-       activeUsecase = USECASE_HIFI;
-    }
-    return activeUsecase;
+uint32_t AudioHardwareALSA::useCaseIdToEnum(int useCaseId)
+{
+    switch (useCaseId) {
+    case SND_UCM_ID_VERB_HIFI_LOW_POWER:
+    case SND_UCM_ID_MOD_PLAY_LPA:
+        return USECASE_HIFI_LOW_POWER;
+    case SND_UCM_ID_VERB_HIFI_TUNNEL:
+    case SND_UCM_ID_VERB_HIFI_TUNNEL2:
+    case SND_UCM_ID_MOD_PLAY_TUNNEL:
+    case SND_UCM_ID_MOD_PLAY_TUNNEL1:
+    case SND_UCM_ID_MOD_PLAY_TUNNEL2:
+        return USECASE_HIFI_TUNNEL;
+    case SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC:
+    case SND_UCM_ID_VERB_HIFI_LOWLATENCY_REC:
+    case SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC:
+        return USECASE_HIFI_LOWLATENCY;
+    case SND_UCM_ID_VERB_DIGITAL_RADIO:
+    case SND_UCM_ID_VERB_FM_REC:
+    case SND_UCM_ID_MOD_PLAY_FM:
+    case SND_UCM_ID_MOD_CAPTURE_FM:
+        return USECASE_FM;
+    case SND_UCM_ID_VERB_HIFI:
+    case SND_UCM_ID_VERB_HIFI2:
+    case SND_UCM_ID_VERB_HIFI3:
+    case SND_UCM_ID_VERB_HIFI_REC:
+    case SND_UCM_ID_VERB_HIFI_REC2:
+    case SND_UCM_ID_VERB_HIFI_REC_COMPRESSED:
+    case SND_UCM_ID_VERB_HIFI_PSEUDO_TUNNEL:
+    case SND_UCM_ID_MOD_PLAY_MUSIC:
+    case SND_UCM_ID_MOD_PLAY_MUSIC2:
+    case SND_UCM_ID_MOD_PLAY_MUSIC3:
+        return USECASE_HIFI;
+    default:
+        return USECASE_NONE;
+    }
 }
 
 bool  AudioHardwareALSA::suspendPlaybackOnExtOut(uint32_t activeUsecase) {
@@ -33,6 +33,11 @@
 #endif
 #include <sys/poll.h>
 #include <sys/eventfd.h>
+#include "AudioVoipJitterBuffer.h"
+#include "AudioParamDispatch.h"
+#include "ALSAHandleIndex.h"
+#include "AudioCompressFrameReader.h"
+#include "AudioSessionBufferRing.h"
 
 extern "C" {
     #include <sound/asound.h>
@@ -95,8 +100,12 @@ class AudioHardwareALSA;
 #define VOIP_DEFAULT_CHANNEL_MODE  1
 #define VOIP_BUFFER_MAX_SIZE   VOIP_BUFFER_SIZE_16K
 #define VOIP_PLAYBACK_LATENCY      6400
+#define VOIP_FRAME_DURATION_US     20000
 #define VOIP_RECORD_LATENCY        6400
 
+//Consecutive failed transfers recovered in place before a stream is reopened
+#define XRUN_RECOVERY_ATTEMPTS     3
+
 #define MODE_IS127              0x2
 #define MODE_4GV_NB             0x3
 #define MODE_4GV_WB             0x4
@@ -176,6 +185,10 @@ static int USBRECBIT_FM = (1 << 3);
 #define AFE_PROXY_CHANNEL_COUNT 2
 #define AFE_PROXY_PERIOD_SIZE 3072
 #define AFE_PROXY_HIGH_WATER_MARK_FRAME_COUNT 40000
+#define AFE_PROXY_PERIOD_FRAMES (AFE_PROXY_PERIOD_SIZE/(AFE_PROXY_CHANNEL_COUNT*2))
+//Capture backlog at which the proxy reader starts and stops slipping frames
+#define AFE_PROXY_SLIP_START_FRAMES (8*AFE_PROXY_PERIOD_FRAMES)
+#define AFE_PROXY_SLIP_STOP_FRAMES (4*AFE_PROXY_PERIOD_FRAMES)
 
 #define MAX_SLEEP_RETRY 100  /*  Will check 100 times before continuing */
 #define AUDIO_INIT_SLEEP_WAIT 50 /* 50 ms */
@@ -220,6 +233,7 @@ static int USBRECBIT_FM = (1 << 3);
 #define VOICE2_SESSION_VSID 0x10DC1000
 #define VOLTE_SESSION_VSID  0x10C02000
 #define ALL_SESSION_VSID    0xFFFFFFFF
+#define VOICE_SESSION_COUNT 3
 
 static uint32_t FLUENCE_MODE_ENDFIRE   = 0;
 static uint32_t FLUENCE_MODE_BROADSIDE = 1;
@@ -244,6 +258,7 @@ struct alsa_handle_t {
     ALSADevice*         module;
     uint32_t            devices;
     char                useCase[MAX_STR_LEN];
+    int                 useCaseId;       // snd_use_case_id_t of useCase
     struct pcm *        handle;
     snd_pcm_format_t    format;
     uint32_t            channels;
@@ -260,6 +275,9 @@ struct alsa_handle_t {
 #endif
 };
 
+// Number of periods in the LPA/tunnel mmap buffer
+#define SESSION_BUFFER_COUNT 4
+
 struct output_metadata_handle_t {
     uint32_t            metadataLength;
     uint32_t            bufferLength;
@@ -267,13 +285,88 @@ struct output_metadata_handle_t {
     uint32_t            reserved[12];
 };
 
-typedef List < alsa_handle_t > ALSAHandleList;
+// Set the use case of a handle, keeping name and interned id in sync
+static inline void setHandleUseCase(alsa_handle_t *handle, int useCaseId)
+{
+    const char *name = snd_use_case_id_to_name(useCaseId);
 
-struct use_case_t {
-    char                useCase[MAX_STR_LEN];
-};
+    strlcpy(handle->useCase, name ? name : "", sizeof(handle->useCase));
+    handle->useCaseId = useCaseId;
+}
+
+static inline void setHandleUseCase(alsa_handle_t *handle, const char *useCase)
+{
+    strlcpy(handle->useCase, useCase, sizeof(handle->useCase));
+    handle->useCaseId = snd_use_case_name_to_id(useCase);
+}
+
+static inline bool isVoipUseCase(int useCaseId)
+{
+    return (useCaseId == SND_UCM_ID_VERB_IP_VOICECALL) ||
+           (useCaseId == SND_UCM_ID_MOD_PLAY_VOIP);
+}
+
+static inline bool isLpaUseCase(int useCaseId)
+{
+    return (useCaseId == SND_UCM_ID_VERB_HIFI_LOW_POWER) ||
+           (useCaseId == SND_UCM_ID_MOD_PLAY_LPA);
+}
+
+static inline bool isTunnelUseCase(int useCaseId)
+{
+    return (useCaseId == SND_UCM_ID_VERB_HIFI_TUNNEL) ||
+           (useCaseId == SND_UCM_ID_MOD_PLAY_TUNNEL);
+}
+
+// LPA and tunnel playback use MMAP access
+static inline bool isMmapUseCase(int useCaseId)
+{
+    switch (useCaseId) {
+    case SND_UCM_ID_VERB_HIFI_LOW_POWER:
+    case SND_UCM_ID_MOD_PLAY_LPA:
+    case SND_UCM_ID_VERB_HIFI_TUNNEL:
+    case SND_UCM_ID_MOD_PLAY_TUNNEL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Use cases going through the compress driver
+static inline bool isCompressedUseCase(int useCaseId)
+{
+    switch (useCaseId) {
+    case SND_UCM_ID_VERB_HIFI_TUNNEL:
+    case SND_UCM_ID_MOD_PLAY_TUNNEL:
+    case SND_UCM_ID_VERB_HIFI_REC_COMPRESSED:
+    case SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED:
+    case SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_DL:
+    case SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_DL:
+    case SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL:
+    case SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// HiFi recording use cases, these may carry 5.1 (SSR) capture
+static inline bool isHiFiRecUseCase(int useCaseId)
+{
+    switch (useCaseId) {
+    case SND_UCM_ID_VERB_HIFI_REC:
+    case SND_UCM_ID_VERB_HIFI_REC2:
+    case SND_UCM_ID_VERB_HIFI_REC_COMPRESSED:
+    case SND_UCM_ID_MOD_CAPTURE_MUSIC:
+    case SND_UCM_ID_MOD_CAPTURE_MUSIC2:
+    case SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED:
+        return true;
+    default:
+        return false;
+    }
+}
 
-typedef List < use_case_t > ALSAUseCaseList;
+typedef List < alsa_handle_t > ALSAHandleList;
 
 class ALSADevice
 {
@@ -313,8 +406,9 @@ public:
     void     setInChannels(int);
     //TODO:check if this needs to be public
     void     disableDevice(alsa_handle_t *handle);
-    char    *getUCMDeviceFromAcdbId(int acdb_id);
+    const char *getUCMDeviceFromAcdbId(int acdb_id);
     status_t getEDIDData(char *hdmiEDIDData);
+    void     dump(int fd);
 #ifdef SEPERATED_AUDIO_INPUT
     void     setInput(int);
 #endif
@@ -333,17 +427,20 @@ protected:
 private:
     void     switchDevice(alsa_handle_t *handle, uint32_t devices, uint32_t mode);
     int      getUseCaseType(const char *useCase);
+    int      getUseCaseType(int useCaseId);
     status_t setHDMIChannelCount();
     void     setChannelAlloc(int channelAlloc);
     status_t setHardwareParams(alsa_handle_t *handle);
     int      deviceName(alsa_handle_t *handle, unsigned flags, char **value);
     status_t setSoftwareParams(alsa_handle_t *handle);
+    status_t startVoicePcm(alsa_handle_t *handle, unsigned flags);
+    static void *voiceTxOpenThread(void *arg);
     status_t getMixerControl(const char *name, unsigned int &value, int index = 0);
     status_t getMixerControlExt(const char *name, unsigned **getValues, unsigned *count);
     status_t setMixerControl(const char *name, unsigned int value, int index = -1);
     status_t setMixerControl(const char *name, const char *);
     status_t setMixerControlExt(const char *name, int count, char **setValues);
-    char *   getUCMDevice(uint32_t devices, int input, char *rxDevice);
+    const char *getUCMDevice(uint32_t devices, int input, const char *rxDevice);
     status_t  start(alsa_handle_t *handle);
 
     status_t   openProxyDevice();
@@ -354,11 +451,17 @@ private:
     bool       resumeProxy();
     void       resetProxyVariables();
     ssize_t    readFromProxy(void **captureBuffer , ssize_t *bufferSize);
+    ssize_t    acquireProxyFrames(void **data, ssize_t *size);
+    status_t   releaseProxyFrames(ssize_t size);
+    void       logProxyStats();
     status_t   exitReadFromProxy();
     void       initProxyParams();
     status_t   startProxy();
 
 private:
+    status_t   waitForProxyFrames();
+    void       trimProxyLatency(long toWrap);
+
     char mMicType[25];
     char mCurRxUCMDevice[50];
     char mCurTxUCMDevice[50];
@@ -367,7 +470,6 @@ private:
     int mFmVolume;
     uint32_t mDevSettingsFlag;
     int mBtscoSamplerate;
-    ALSAUseCaseList mUseCaseList;
     void *mcsd_handle;
     void *macdb_handle;
     int mCallMode;
@@ -398,9 +500,33 @@ private:
         struct pollfd mPfdProxy[NUM_FDS];
         long mFrames;
         long mBufferTime;
+        //number of times the reader was woken up by poll
+        uint32_t mWakeups;
+        //reader statistics, latency in frames queued at acquire time
+        uint32_t mSyncs;
+        bool     mSlipping;
+        uint32_t mSlipFrames;
+        uint32_t mOverflows;
+        uint32_t mOverflowFrames;
+        uint64_t mLatencySum;
+        uint32_t mLatencyCount;
+        uint32_t mLatencyMax;
     };
     struct proxy_params mProxyParams;
 
+    //switchDevice() timing, entry to return
+    struct switch_stats {
+        uint32_t count;
+        int64_t  lastUs;
+        int64_t  maxUs;
+        int64_t  totalUs;
+        //share spent applying UCM batches
+        int64_t  ucmUs;
+        uint32_t ucmChanges;
+        uint32_t ucmBatches;
+    };
+    struct switch_stats mSwitchStats;
+
 };
 
 // ----------------------------------------------------------------------------
@@ -447,9 +573,26 @@ public:
 protected:
     friend class AudioHardwareALSA;
 
+    // Prepares or resumes the failed handle in place. Returns false when
+    // the caller has to fall back to a reopen under mParent->mLock.
+    bool                recoverXrun(struct pcm *pcm, int err);
+    void                reopenDone(nsecs_t start);
+    void                transferDone() { mXrunRetries = 0; }
+    void                dumpRecovery(int fd);
+
     AudioHardwareALSA *     mParent;
     alsa_handle_t *         mHandle;
     uint32_t                mDevices;
+
+    uint32_t                mXrunRetries;
+    uint32_t                mRecoveries;
+    uint32_t                mResumes;
+    uint32_t                mReopens;
+    int                     mLastXrunError;
+    int64_t                 mLastRecoveryUs;
+    int64_t                 mMaxRecoveryUs;
+    int64_t                 mLastReopenUs;
+    int64_t                 mMaxReopenUs;
 };
 
 // ----------------------------------------------------------------------------
@@ -498,13 +641,42 @@ public:
     // the output has exited standby
     virtual status_t    getRenderPosition(uint32_t *dspFrames);
 
+    // return the local time, in microseconds, at which the next write will
+    // be presented
+    virtual status_t    getNextWriteTimestamp(int64_t *timestamp);
+
     status_t            open(int mode);
     status_t            close();
 
 private:
-    uint32_t            mFrameCount;
+    struct pcm *        activePcm() const;
+    void                restartVoip_l();
+
+    // VoIP playout through an adaptive jitter buffer, enabled with
+    // persist.audio.voip.jitterbuf. write() queues frames and blocks
+    // while the target depth is buffered; a playout thread feeds the
+    // DSP one frame per period and conceals when the buffer runs dry.
+    ssize_t             writeVoip(const void *buffer, size_t bytes);
+    bool                startPlayout();
+    void                stopPlayout();
+    void                playoutThreadFunc();
+    static void *       playoutThreadWrapper(void *me);
+    void                dumpPlayout(int fd);
+
+    uint64_t            mFrameCount;
+    uint64_t            mRenderedFrames;
     uint32_t            mUseCase;
 
+    AudioVoipJitterBuffer * mJitter;
+    pthread_t           mPlayoutThread;
+    Mutex               mPlayoutLock;
+    Condition           mPlayoutCv;
+    bool                mKillPlayout;
+    //DSP queue behind the jitter buffer, sampled after every frame
+    int64_t             mDspDelaySumUs;
+    int64_t             mMaxDspDelayUs;
+    uint32_t            mDspDelayCount;
+
 protected:
     AudioHardwareALSA *     mParent;
 };
@@ -576,7 +748,7 @@ public:
     status_t            pause_l();
     status_t            resume_l();
 
-    void updateMetaData(size_t bytes);
+    void updateMetaData(output_metadata_handle_t *metadata, size_t bytes);
     status_t setMetaDataMode();
 
 private:
@@ -599,8 +771,12 @@ private:
     ALSADevice *     mAlsaDevice;
     snd_use_case_mgr_t *mUcMgr;
     AudioEventObserver *mObserver;
-    output_metadata_handle_t mOutputMetadataTunnel;
     uint32_t            mOutputMetadataLength;
+    //Payload bytes queued by copying vs committed in place
+    uint64_t            mBytesCopied;
+    uint64_t            mBytesInPlace;
+    uint32_t            mBuffersCopied;
+    uint32_t            mBuffersInPlace;
     uint32_t            mUseCase;
     status_t            openDevice(char *pUseCase, bool bIsUseCase, int devices);
 
@@ -619,19 +795,45 @@ private:
     void                reset();
     status_t            drainAndPostEOS_l();
 
-    //Structure to hold mem buffer information
-    class BuffersAllocated {
-    public:
-        BuffersAllocated(void *buf1, int32_t nSize) :
-        memBuf(buf1), memBufsize(nSize), bytesToWrite(0)
-        {}
-        void* memBuf;
-        int32_t memBufsize;
-        uint32_t bytesToWrite;
+    //Periods of the mmap'ed buffer, the writer queues them in place and
+    //the event thread returns them without mLock
+    AudioSessionBufferRing<SESSION_BUFFER_COUNT> mRing;
+    volatile int32_t    mWriterWaiting;
+
+    int32_t             filledCount() const { return mRing.filled(); }
+    int32_t             emptyCount() const { return mRing.empty(); }
+    void                resetBufferRing_l();
+    char*               payload(AudioSessionBuffer &buf) {
+        return (char *)buf.memBuf + mOutputMetadataLength;
+    }
+    ssize_t             write_l(const void *buffer, size_t bytes);
+
+    //Gapless tunnel playback: the next track is appended to the open
+    //compressed session instead of draining and reopening it
+    struct GaplessStats {
+        uint32_t transitions;
+        int64_t  lastGapUs;     //track boundary to first write of the next track
+        int64_t  maxGapUs;
+        int64_t  totalGapUs;
+        int64_t  lastDrainUs;   //track boundary to previous track rendered
     };
-    List<BuffersAllocated> mEmptyQueue;
-    List<BuffersAllocated> mFilledQueue;
-    List<BuffersAllocated> mBufPool;
+    uint32_t            mEncoderDelay;
+    uint32_t            mEncoderPadding;
+    bool                mMetadataPending;
+    bool                mPartialDrainPending;
+    bool                mNextTrackFirstWrite;
+    int32_t             mTrackBoundary;
+    nsecs_t             mTransitionStart;
+    GaplessStats        mGaplessStats;
+    volatile int32_t    mPartialDrainWaiting;
+    Condition           mPartialDrainCv;
+    status_t            setGaplessMetadata_l();
+    status_t            startNextTrack_l();
+    status_t            partialDrain_l();
+    void                waitForTrackBoundary_l();
+    bool                partialDrainDue() const {
+        return mPartialDrainPending && mRing.consumed() - mTrackBoundary >= 0;
+    }
 
     //Declare all the threads
     pthread_t mEventThread;
@@ -734,20 +936,32 @@ private:
     unsigned int        mFramesLost;
     AudioSystem::audio_in_acoustics mAcoustics;
 
+    // Compressed (AMR-WB) capture: strips the per period header, at most
+    // mFramesPerRead frames per read, 0 to fill the buffer
+    AudioCompressFrameReader mFrameReader;
+    uint32_t            mFramesPerRead;
+
 #ifdef QCOM_SSR_ENABLED
     // Function to read coefficients from files.
     status_t            readCoeffsFromFile();
+    // Captures 4 channel frames and returns the filtered 6 channel output.
+    ssize_t             readSurround(char *buffer, size_t bytes);
 
     FILE                *mFp_4ch;
     FILE                *mFp_6ch;
     int16_t             **mRealCoeffs;
     int16_t             **mImagCoeffs;
+    // This stream's copy of the filters, real ones first
+    int16_t             *mCoeffData;
+    int16_t             *mCoeffs[2 * COEFF_ARRAY_SIZE];
     void                *mSurroundObj;
 
     int16_t             *mSurroundInputBuffer;
     int16_t             *mSurroundOutputBuffer;
     int                 mSurroundInputBufferIdx;
-    int                 mSurroundOutputBufferIdx;
+    // Unread part of mSurroundOutputBuffer
+    int                 mSurroundOutputRead;
+    int                 mSurroundOutputFill;
 #endif
 
 protected:
@@ -867,11 +1081,13 @@ private:
     status_t     closeUsbOutput();
     status_t     stopExtOutThread();
     void         extOutThreadFunc();
+    void         setExtOutStream_l(audio_stream_out *stream);
     static void* extOutThreadWrapper(void *context);
     void         setExtOutActiveUseCases_l(uint32_t activeUsecase);
     uint32_t     getExtOutActiveUseCases_l();
     void         clearExtOutActiveUseCases_l(uint32_t activeUsecase);
     uint32_t     useCaseStringToEnum(const char *usecase);
+    uint32_t     useCaseIdToEnum(int useCaseId);
     void         switchExtOut(int device);
     int          getmCallState(uint32_t vsid, enum call_state state);
     bool         isAnyCallActive();
@@ -880,6 +1096,41 @@ private:
     char*        getUcmModForVSID(uint32_t vsid);
     alsa_handle_t* getALSADeviceHandleForVSID(uint32_t vsid);
 
+    // setParameters() key handlers, run in sParamHandlers order
+    typedef AudioParamDispatch<AudioHardwareALSA> ParamDispatch;
+    static const ParamDispatch::Entry sParamHandlers[];
+    static const ParamDispatch sParamDispatch;
+#ifdef QCOM_ADSP_SSR_ENABLED
+    int          setAdspStatusParam(const AudioParamValue &value, AudioParamList &params);
+#endif
+    int          setTtyModeParam(const AudioParamValue &value, AudioParamList &params);
+#ifdef QCOM_FLUENCE_ENABLED
+    int          setFluenceTypeParam(const AudioParamValue &value, AudioParamList &params);
+#endif
+#ifdef QCOM_CSDCLIENT_ENABLED
+    int          setIncallMusicParam(const AudioParamValue &value, AudioParamList &params);
+#endif
+#ifdef QCOM_ANC_HEADSET_ENABLED
+    int          setAncParam(const AudioParamValue &value, AudioParamList &params);
+#endif
+    int          setRoutingParam(const AudioParamValue &value, AudioParamList &params);
+    int          setBtSampleRateParam(const AudioParamValue &value, AudioParamList &params);
+    int          setBtHeadsetVgsParam(const AudioParamValue &value, AudioParamList &params);
+    int          setWideVoiceParam(const AudioParamValue &value, AudioParamList &params);
+    int          setA2dpConnectedParam(const AudioParamValue &value, AudioParamList &params);
+    int          setA2dpSuspendedParam(const AudioParamValue &value, AudioParamList &params);
+    int          setFmVolumeParam(const AudioParamValue &value, AudioParamList &params);
+    int          setA2dpSinkAddressParam(const AudioParamValue &value, AudioParamList &params);
+    int          setUsbConnectedParam(const AudioParamValue &value, AudioParamList &params);
+    int          setUsbCardParam(const AudioParamValue &value, AudioParamList &params);
+    int          setVoipRateParam(const AudioParamValue &value, AudioParamList &params);
+    int          setFensParam(const AudioParamValue &value, AudioParamList &params);
+#ifdef QCOM_FM_ENABLED
+    int          setHandleFmParam(const AudioParamValue &value, AudioParamList &params);
+#endif
+    int          setSlowTalkParam(const AudioParamValue &value, AudioParamList &params);
+    int          setVsidParam(const AudioParamValue &value, AudioParamList &params);
+
 protected:
     virtual status_t    dump(int fd, const Vector<String16>& args);
     virtual uint32_t    getVoipMode(int format);
@@ -899,6 +1150,12 @@ protected:
     void                disableVoiceCall(int mode, int device, uint32_t vsid = 0);
     status_t            enableVoiceCall(int mode, int device, uint32_t vsid = 0);
     bool                routeCall(int device, int newMode, uint32_t vsid);
+    // mDeviceList only changes through these, keeping mHandleIndex in step
+    alsa_handle_t*      addHandle_l(const alsa_handle_t &handle);
+    ALSAHandleList::iterator removeHandle_l(ALSAHandleList::iterator it);
+    void                removeHandle_l(alsa_handle_t *handle);
+    void                setUseCase_l(alsa_handle_t *handle, int useCaseId);
+    alsa_handle_t*      findHandle_l(const char *useCase);
     friend class AudioSessionOutALSA;
     friend class AudioStreamOutALSA;
     friend class AudioStreamInALSA;
@@ -907,6 +1164,7 @@ protected:
     ALSADevice*     mALSADevice;
 
     ALSAHandleList      mDeviceList;
+    ALSAHandleIndex<alsa_handle_t, SND_UCM_ID_MAX> mHandleIndex;
 
 #ifdef QCOM_USBAUDIO_ENABLED
     AudioUsbALSA        *mAudioUsbALSA;
@@ -937,6 +1195,28 @@ protected:
     int mVoice2CallState;
     int mCallState;
     uint32_t mVSID;
+
+    //Per-VSID UCM names, call state and routeCall() latencies
+    struct voice_session {
+        uint32_t vsid;
+        char     *verb;
+        char     *modifier;
+        int      *callState;
+        uint32_t setups;
+        int64_t  lastSetupUs;
+        int64_t  maxSetupUs;
+        //hold and resume of an open session
+        uint32_t swaps;
+        int64_t  lastSwapUs;
+        int64_t  maxSwapUs;
+        uint32_t teardowns;
+        int64_t  lastTeardownUs;
+    };
+    struct voice_session mVoiceSessions[VOICE_SESSION_COUNT];
+    void          initVoiceSession(int index, uint32_t vsid, char *verb,
+                                   char *modifier, int *callState);
+    voice_session *getVoiceSession(uint32_t vsid);
+
     int mIsFmActive;
     bool mBluetoothVGS;
     bool mFusion3Platform;
@@ -957,6 +1237,8 @@ protected:
     audio_stream_out   *mUsbStream;
     audio_hw_device_t  *mUsbDevice;
     audio_stream_out   *mExtOutStream;
+    //sink buffer size, refreshed whenever mExtOutStream changes
+    uint32_t            mExtOutBufferSize;
     struct resampler_itfe *mResampler;
 
 
@@ -0,0 +1,384 @@
+/* AudioParamDispatch.h
+
+  Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef ANDROID_AUDIO_PARAM_DISPATCH_H
+#define ANDROID_AUDIO_PARAM_DISPATCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Pairs in one set, anything past this is reported as unhandled
+#define AUDIO_PARAM_MAX_PAIRS   32
+//Sets up to this size are tokenized without touching the heap
+#define AUDIO_PARAM_INLINE_SIZE 256
+//Keys a dispatch table can hold, and log2 of its largest hash
+#define AUDIO_PARAM_MAX_ENTRIES 64
+#define AUDIO_PARAM_MAX_BITS    8
+
+namespace android_audio_legacy
+{
+
+static inline uint32_t audioParamHashStep(uint32_t hash, char c)
+{
+    //FNV-1a
+    return (hash ^ (uint8_t)c) * 16777619u;
+}
+
+static inline uint32_t audioParamHash(const char *key)
+{
+    uint32_t hash = 2166136261u;
+    while (*key)
+        hash = audioParamHashStep(hash, *key++);
+    return hash;
+}
+
+/* A "key1=value1;key2=value2" set split in one pass over a private copy,
+ * with the hash of every key computed on the way. Replaces AudioParameter
+ * on the hot set/get paths, which builds a String8 per key and value and
+ * another one per lookup. A repeated key is kept as given, find() returns
+ * the last one as AudioParameter would.
+ */
+class AudioParamList {
+public:
+    explicit AudioParamList(const char *kvpairs)
+        : mSource(kvpairs), mBuf(mInline), mCount(0), mTruncated(false)
+    {
+        size_t len = kvpairs ? strlen(kvpairs) : 0;
+
+        if (len >= sizeof(mInline)) {
+            mBuf = (char *)malloc(len + 1);
+            if (!mBuf) {
+                mBuf = mInline;
+                mTruncated = true;
+                len = 0;
+            }
+        }
+        if (len)
+            memcpy(mBuf, kvpairs, len);
+        mBuf[len] = '\0';
+        tokenize(len);
+    }
+
+    ~AudioParamList()
+    {
+        if (mBuf != mInline)
+            free(mBuf);
+    }
+
+    //The set as passed in, for handlers that forward it untouched
+    const char *string() const { return mSource ? mSource : ""; }
+
+    int size() const { return mCount; }
+    bool truncated() const { return mTruncated; }
+
+    const char *key(int i) const { return mPairs[i].key; }
+    const char *value(int i) const { return mPairs[i].value; }
+    uint32_t hash(int i) const { return mPairs[i].hash; }
+
+    int find(const char *key) const
+    {
+        uint32_t hash = audioParamHash(key);
+        for (int i = mCount - 1; i >= 0; i--) {
+            if (mPairs[i].hash == hash && !strcmp(mPairs[i].key, key))
+                return i;
+        }
+        return -1;
+    }
+
+    //Points the value of pair i at storage that outlives the list
+    void setValue(int i, const char *value) { mPairs[i].value = value; }
+
+    void consume(int i) { mPairs[i].consumed = true; }
+    bool consumed(int i) const { return mPairs[i].consumed; }
+
+    //Unconsumed keys, a repeated key counting once
+    int remaining() const
+    {
+        int left = mTruncated ? 1 : 0;
+        for (int i = 0; i < mCount; i++) {
+            if (!mPairs[i].consumed && find(mPairs[i].key) == i)
+                left++;
+        }
+        return left;
+    }
+
+    //Joins the pairs back into a malloc'ed "key=value;..." string, NULL if
+    //pairs were dropped so the caller forwards string() instead
+    char *toString() const
+    {
+        if (mTruncated)
+            return NULL;
+
+        size_t len = 1;
+        for (int i = 0; i < mCount; i++)
+            len += strlen(mPairs[i].key) + strlen(mPairs[i].value) + 2;
+
+        char *str = (char *)malloc(len);
+        if (!str)
+            return NULL;
+        char *p = str;
+        for (int i = 0; i < mCount; i++) {
+            size_t n;
+            if (i)
+                *p++ = ';';
+            n = strlen(mPairs[i].key);
+            memcpy(p, mPairs[i].key, n);
+            p += n;
+            *p++ = '=';
+            n = strlen(mPairs[i].value);
+            memcpy(p, mPairs[i].value, n);
+            p += n;
+        }
+        *p = '\0';
+        return str;
+    }
+
+    //Same acceptance as AudioParameter::getInt()/getFloat()
+    static bool parseInt(const char *str, int *val)
+    {
+        char *end;
+        long v = strtol(str, &end, 0);
+        if (end == str || *end != '\0')
+            return false;
+        *val = (int)v;
+        return true;
+    }
+
+    static bool parseFloat(const char *str, float *val)
+    {
+        char *end;
+        float v = strtof(str, &end);
+        if (end == str || *end != '\0')
+            return false;
+        *val = v;
+        return true;
+    }
+
+private:
+    struct Pair {
+        const char *key;
+        const char *value;
+        uint32_t    hash;
+        bool        consumed;
+    };
+
+    void tokenize(size_t len)
+    {
+        char *p = mBuf;
+        char *end = mBuf + len;
+
+        while (p < end) {
+            char *key = p;
+            const char *value = NULL;
+            uint32_t hash = 2166136261u;
+
+            while (p < end && *p != '=' && *p != ';')
+                hash = audioParamHashStep(hash, *p++);
+            if (p < end && *p == '=') {
+                *p++ = '\0';
+                value = p;
+                while (p < end && *p != ';')
+                    p++;
+            }
+            if (p < end)
+                *p++ = '\0';
+            //Empty pairs, as in "a=1;;b=2", are skipped like strtok_r does
+            if (!*key && !value)
+                continue;
+            if (mCount == AUDIO_PARAM_MAX_PAIRS) {
+                mTruncated = true;
+                break;
+            }
+            mPairs[mCount].key = key;
+            mPairs[mCount].value = value ? value : "";
+            mPairs[mCount].hash = hash;
+            mPairs[mCount].consumed = false;
+            mCount++;
+        }
+    }
+
+    const char *mSource;
+    char       *mBuf;
+    char        mInline[AUDIO_PARAM_INLINE_SIZE];
+    Pair        mPairs[AUDIO_PARAM_MAX_PAIRS];
+    int         mCount;
+    bool        mTruncated;
+};
+
+enum {
+    AUDIO_PARAM_STRING,
+    AUDIO_PARAM_INT,
+    AUDIO_PARAM_FLOAT,
+};
+
+//What a handler did with its key
+enum {
+    AUDIO_PARAM_HANDLED,        //consumed, go on with the next key
+    AUDIO_PARAM_UNHANDLED,      //left in the set, reported as unknown
+    AUDIO_PARAM_STOP,           //consumed, the rest of the set is ignored
+};
+
+struct AudioParamValue {
+    const char *str;            //always set
+    int         i;              //set for AUDIO_PARAM_INT keys
+    float       f;              //set for AUDIO_PARAM_FLOAT keys
+};
+
+/* Static key to handler table for T::setParameters(). The table is hashed
+ * once into a collision free slot array, searching for a seed that gives
+ * every key its own slot, so a lookup is one hash from the tokenizer, one
+ * slot and one strcmp. Values are parsed by type before the handler runs;
+ * a value that does not parse leaves the key unhandled, as a failed
+ * AudioParameter::getInt() did.
+ *
+ * Handlers run in table order, not in the order keys appear in the set,
+ * which keeps keys that depend on each other (and early outs) behaving as
+ * the sequential probes they replace. A handler can consume further keys
+ * of the set itself.
+ */
+template <typename T>
+class AudioParamDispatch {
+public:
+    typedef int (T::*Handler)(const AudioParamValue &value, AudioParamList &params);
+
+    struct Entry {
+        const char *key;
+        int         type;
+        Handler     handler;
+    };
+
+    AudioParamDispatch(const Entry *entries, int count)
+        : mEntries(entries), mCount(count), mSeed(0), mShift(32)
+    {
+        if (mCount > AUDIO_PARAM_MAX_ENTRIES)
+            mCount = AUDIO_PARAM_MAX_ENTRIES;
+        for (int i = 0; i < mCount; i++)
+            mHashes[i] = audioParamHash(entries[i].key);
+        build();
+    }
+
+    int lookup(const char *key, uint32_t hash) const
+    {
+        if (!mCount)
+            return -1;
+        int i = (int)mSlots[slot(hash)] - 1;
+        if (i < 0 || mHashes[i] != hash || strcmp(mEntries[i].key, key))
+            return -1;
+        return i;
+    }
+
+    //Returns the number of keys nobody handled, 0 after an early stop
+    int dispatch(T *target, AudioParamList &params) const
+    {
+        int8_t pair[AUDIO_PARAM_MAX_ENTRIES];
+        memset(pair, -1, sizeof(pair));
+
+        for (int p = 0; p < params.size(); p++) {
+            int e = lookup(params.key(p), params.hash(p));
+            if (e < 0)
+                continue;
+            //A repeated key takes the last value, the others go with it
+            if (pair[e] >= 0)
+                params.consume(pair[e]);
+            pair[e] = (int8_t)p;
+        }
+
+        for (int e = 0; e < mCount; e++) {
+            int p = pair[e];
+            AudioParamValue value;
+
+            if (p < 0 || params.consumed(p))
+                continue;
+            value.str = params.value(p);
+            value.i = 0;
+            value.f = 0;
+            if (mEntries[e].type == AUDIO_PARAM_INT &&
+                !AudioParamList::parseInt(value.str, &value.i))
+                continue;
+            if (mEntries[e].type == AUDIO_PARAM_FLOAT &&
+                !AudioParamList::parseFloat(value.str, &value.f))
+                continue;
+
+            int ret = (target->*mEntries[e].handler)(value, params);
+            if (ret == AUDIO_PARAM_UNHANDLED)
+                continue;
+            params.consume(p);
+            if (ret == AUDIO_PARAM_STOP)
+                return 0;
+        }
+        return params.remaining();
+    }
+
+private:
+    uint32_t slot(uint32_t hash) const
+    {
+        return ((hash ^ mSeed) * 2654435761u) >> mShift;
+    }
+
+    void build()
+    {
+        int bits = 1;
+        while ((1 << bits) < 2 * mCount)
+            bits++;
+
+        for (; bits <= AUDIO_PARAM_MAX_BITS; bits++) {
+            mShift = 32 - bits;
+            for (mSeed = 0; mSeed < 4096; mSeed++) {
+                if (fill())
+                    return;
+            }
+        }
+        //Not reached for any sane table; lookups then simply miss
+        memset(mSlots, 0, sizeof(mSlots));
+        mCount = 0;
+    }
+
+    bool fill()
+    {
+        memset(mSlots, 0, sizeof(mSlots));
+        for (int i = 0; i < mCount; i++) {
+            uint32_t s = slot(mHashes[i]);
+            if (mSlots[s])
+                return false;
+            mSlots[s] = (uint8_t)(i + 1);
+        }
+        return true;
+    }
+
+    const Entry *mEntries;
+    int          mCount;
+    uint32_t     mSeed;
+    uint32_t     mShift;
+    uint32_t     mHashes[AUDIO_PARAM_MAX_ENTRIES];
+    uint8_t      mSlots[1 << AUDIO_PARAM_MAX_BITS];
+};
+
+};        // namespace android_audio_legacy
+#endif    // ANDROID_AUDIO_PARAM_DISPATCH_H
@@ -40,6 +40,7 @@
 #include <math.h>
 #include <media/mediarecorder.h>
 #include <stdio.h>
+#include <sys/prctl.h>
 #include <cutils/properties.h>
 
 namespace android_audio_legacy {
@@ -189,6 +190,7 @@ uint32_t AudioPolicyManager::checkDeviceMuteStrategies(AudioOutputDescriptor *ou
     muteWaitMs *= 2;
     // wait for the PCM output buffers to empty before proceeding with the rest of the command
     if (muteWaitMs > delayMs) {
+        flushVolumes();
         muteWaitMs -= delayMs;
         usleep(muteWaitMs * 1000);
         return muteWaitMs;
@@ -242,6 +244,8 @@ status_t AudioPolicyManager::setDeviceConnectionState(audio_devices_t device,
                                                   const char *device_address)
 {
     SortedVector <audio_io_handle_t> outputs;
+    VolumeBatch batch(this);
+    nsecs_t connectStart = systemTime();
 
     ALOGV("setDeviceConnectionState() device: %x, state %d, address %s", device, state, device_address);
 
@@ -253,6 +257,10 @@ status_t AudioPolicyManager::setDeviceConnectionState(audio_devices_t device,
         return BAD_VALUE;
     }
 
+    if (audio_is_bluetooth_sco_device(device)) {
+        invalidateBtHeadsetVgs();
+    }
+
     // handle output devices
     if (audio_is_output_device(device)) {
 
@@ -290,6 +298,14 @@ status_t AudioPolicyManager::setDeviceConnectionState(audio_devices_t device,
                   outputs.size());
             // register new device as available
             mAvailableOutputDevices = (audio_devices_t)(mAvailableOutputDevices | device);
+            mStrategyCache.invalidate();
+
+            mProbeStats.lastConnectUs = (systemTime() - connectStart) / 1000;
+            if (mProbeStats.lastConnectUs > mProbeStats.maxConnectUs) {
+                mProbeStats.maxConnectUs = mProbeStats.lastConnectUs;
+            }
+            mFirstStartDevice = device;
+            mFirstStartConnectNs = connectStart;
 
             if (audio_is_a2dp_device(device)) {
                AudioParameter param;
@@ -310,6 +326,7 @@ status_t AudioPolicyManager::setDeviceConnectionState(audio_devices_t device,
                     paramStr = param.toString();
                     mA2dpDeviceAddress = String8(device_address, MAX_DEVICE_ADDRESS_LEN);
                     mA2dpSuspended = false;
+                    mStrategyCache.invalidate();
                 } else if (audio_is_bluetooth_sco_device(device)) {
                     // handle SCO device connection
                     mScoDeviceAddress = String8(device_address, MAX_DEVICE_ADDRESS_LEN);
@@ -338,12 +355,17 @@ status_t AudioPolicyManager::setDeviceConnectionState(audio_devices_t device,
             mForceDeviceChange = true;
             // remove device from available output devices
             mAvailableOutputDevices = (audio_devices_t)(mAvailableOutputDevices & ~device);
+            mStrategyCache.invalidate();
+            if (mFirstStartDevice & device) {
+                mFirstStartDevice = AUDIO_DEVICE_NONE;
+            }
 
             checkOutputsForDevice(device, state, outputs);
             if (audio_is_a2dp_device(device)) {
                 // handle A2DP device disconnection
                 mA2dpDeviceAddress = "";
                 mA2dpSuspended = false;
+                mStrategyCache.invalidate();
 
                 AudioParameter param;
                 param.add(String8("a2dp_connected"), String8("false"));
@@ -557,6 +579,7 @@ void AudioPolicyManager::setPhoneState(int state)
 {
     ALOGV("setPhoneState() state %d", state);
     audio_devices_t newDevice = AUDIO_DEVICE_NONE;
+    VolumeBatch batch(this);
     if (state < 0 || state >= AudioSystem::NUM_MODES) {
         ALOGW("setPhoneState() invalid state %d", state);
         return;
@@ -566,6 +589,7 @@ void AudioPolicyManager::setPhoneState(int state)
         ALOGW("setPhoneState() setting same state %d", state);
         return;
     }
+    invalidateBtHeadsetVgs();
 
     // if leaving call state, handle special case of active streams
     // pertaining to sonification strategy see handleIncallSonification()
@@ -579,6 +603,7 @@ void AudioPolicyManager::setPhoneState(int state)
     // store previous phone state for management of sonification strategy below
     int oldState = mPhoneState;
     mPhoneState = state;
+    mStrategyCache.invalidate();
     bool force = false;
 
     // are we entering or starting a call
@@ -664,6 +689,7 @@ void AudioPolicyManager::setPhoneState(int state)
     // pertaining to sonification strategy see handleIncallSonification()
     if (isStateInCall(state)) {
         ALOGV("setPhoneState() in call state management: new state is %d", state);
+        flushVolumes();
         for (int stream = 0; stream < AudioSystem::NUM_STREAM_TYPES; stream++) {
             handleIncallSonification(stream, true, true);
         }
@@ -682,6 +708,7 @@ void AudioPolicyManager::setPhoneState(int state)
 void AudioPolicyManager::setForceUse(AudioSystem::force_use usage, AudioSystem::forced_config config)
 {
     ALOGV("setForceUse() usage %d, config %d, mPhoneState %d", usage, config, mPhoneState);
+    VolumeBatch batch(this);
 
     bool forceVolumeReeval = false;
     switch(usage) {
@@ -693,6 +720,7 @@ void AudioPolicyManager::setForceUse(AudioSystem::force_use usage, AudioSystem::
         }
         forceVolumeReeval = true;
         mForceUse[usage] = config;
+        invalidateBtHeadsetVgs();
         break;
     case AudioSystem::FOR_MEDIA:
         if (config != AudioSystem::FORCE_HEADPHONES && config != AudioSystem::FORCE_BT_A2DP &&
@@ -736,6 +764,7 @@ void AudioPolicyManager::setForceUse(AudioSystem::force_use usage, AudioSystem::
         ALOGW("setForceUse() invalid usage %d", usage);
         break;
     }
+    mStrategyCache.invalidate();
 
     // check for device and output changes triggered by new force usage
     checkA2dpSuspend();
@@ -746,6 +775,7 @@ void AudioPolicyManager::setForceUse(AudioSystem::force_use usage, AudioSystem::
         audio_devices_t newDevice = getNewDevice(output, true /*fromCache*/);
         setOutputDevice(output, newDevice, (newDevice != AUDIO_DEVICE_NONE));
         if (forceVolumeReeval && (newDevice != AUDIO_DEVICE_NONE)) {
+            flushVolumes();
             applyStreamVolumes(output, newDevice, 0, true);
         }
     }
@@ -928,6 +958,15 @@ status_t AudioPolicyManager::startOutput(audio_io_handle_t output,
     if (outputDesc->mRefCount[stream] == 1) {
         audio_devices_t newDevice = getNewDevice(output, false /*fromCache*/);
         routing_strategy strategy = getStrategy(stream);
+        if (newDevice & mFirstStartDevice) {
+            mProbeStats.lastFirstStartUs = (systemTime() - mFirstStartConnectNs) / 1000;
+            if (mProbeStats.lastFirstStartUs > mProbeStats.maxFirstStartUs) {
+                mProbeStats.maxFirstStartUs = mProbeStats.lastFirstStartUs;
+            }
+            ALOGD("startOutput() first start on device %x, %lld ms after it connected",
+                  mFirstStartDevice, mProbeStats.lastFirstStartUs / 1000);
+            mFirstStartDevice = AUDIO_DEVICE_NONE;
+        }
         bool shouldWait = (strategy == STRATEGY_SONIFICATION) ||
                             (strategy == STRATEGY_SONIFICATION_RESPECTFUL);
         uint32_t waitMs = 0;
@@ -1303,8 +1342,9 @@ status_t AudioPolicyManager::checkOutputsForDevice(audio_devices_t device,
             return BAD_VALUE;
         }
 
-        // open outputs for matching profiles if needed. Direct outputs are also opened to
-        // query for dynamic parameters and will be closed later by setDeviceConnectionState()
+        // open outputs for matching profiles if needed. Direct outputs are not opened here,
+        // their dynamic parameters are queried by the probe thread and the output itself is
+        // opened by getOutput() when first needed
         for (ssize_t profile_index = 0; profile_index < (ssize_t)profiles.size(); profile_index++) {
             IOProfile *profile = profiles[profile_index];
 
@@ -1320,6 +1360,24 @@ status_t AudioPolicyManager::checkOutputsForDevice(audio_devices_t device,
                 continue;
             }
 
+            bool probe = (profile->mFlags & AUDIO_OUTPUT_FLAG_DIRECT) != 0;
+#ifdef QCOM_OUTPUT_FLAGS_ENABLED
+            if (profile->mFlags & (AUDIO_OUTPUT_FLAG_LPA | AUDIO_OUTPUT_FLAG_TUNNEL |
+                                   AUDIO_OUTPUT_FLAG_VOIP_RX)) {
+                probe = false;
+            }
+#endif
+            // A direct profile stays in the list while it is probed, so a probe that
+            // fails later does not fail the connection: applyProbes() only logs it
+            // and the profile is left without dynamic parameters
+            if (probe) {
+                if (profile->mSamplingRates[0] == 0 || profile->mFormats[0] == 0 ||
+                        profile->mChannelMasks[0] == 0) {
+                    queueProbe(profile, device);
+                }
+                continue;
+            }
+
             ALOGV("opening output for device %08x", device);
             desc = new AudioOutputDescriptor(profile);
             desc->mDevice = device;
@@ -1339,80 +1397,34 @@ status_t AudioPolicyManager::checkOutputsForDevice(audio_devices_t device,
             }
 #endif
             if (output != 0) {
-                if (desc->mFlags & AUDIO_OUTPUT_FLAG_DIRECT) {
-                    String8 reply;
-                    char *value;
-                    if (profile->mSamplingRates[0] == 0) {
-                        reply = mpClientInterface->getParameters(output,
-                                                String8(AUDIO_PARAMETER_STREAM_SUP_SAMPLING_RATES));
-                        ALOGV("checkOutputsForDevice() direct output sup sampling rates %s",
-                                  reply.string());
-                        value = strpbrk((char *)reply.string(), "=");
-                        if (value != NULL) {
-                            loadSamplingRates(value, profile);
-                        }
-                    }
-                    if (profile->mFormats[0] == 0) {
-                        reply = mpClientInterface->getParameters(output,
-                                                       String8(AUDIO_PARAMETER_STREAM_SUP_FORMATS));
-                        ALOGV("checkOutputsForDevice() direct output sup formats %s",
-                                  reply.string());
-                        value = strpbrk((char *)reply.string(), "=");
-                        if (value != NULL) {
-                            loadFormats(value, profile);
-                        }
-                    }
-                    if (profile->mChannelMasks[0] == 0) {
-                        reply = mpClientInterface->getParameters(output,
-                                                      String8(AUDIO_PARAMETER_STREAM_SUP_CHANNELS));
-                        ALOGV("checkOutputsForDevice() direct output sup channel masks %s",
-                                  reply.string());
-                        value = strpbrk((char *)reply.string(), "=");
-                        if (value != NULL) {
-                            loadOutChannels(value + 1, profile);
-                        }
-                    }
-                    if (((profile->mSamplingRates[0] == 0) &&
-                             (profile->mSamplingRates.size() < 2)) ||
-                         ((profile->mFormats[0] == 0) &&
-                             (profile->mFormats.size() < 2)) ||
-                         ((profile->mFormats[0] == 0) &&
-                             (profile->mChannelMasks.size() < 2))) {
-                        ALOGW("checkOutputsForDevice() direct output missing param");
-                        output = 0;
-                    } else {
-                        addOutput(output, desc);
-                    }
+                audio_io_handle_t duplicatedOutput = 0;
+                // add output descriptor
+                addOutput(output, desc);
+                // set initial stream volume for device
+                applyStreamVolumes(output, device, 0, true);
+
+                //TODO: configure audio effect output stage here
+
+                // open a duplicating output thread for the new output and the primary output
+                duplicatedOutput = mpClientInterface->openDuplicateOutput(output,
+                                                                          mPrimaryOutput);
+                if (duplicatedOutput != 0) {
+                    // add duplicated output descriptor
+                    AudioOutputDescriptor *dupOutputDesc = new AudioOutputDescriptor(NULL);
+                    dupOutputDesc->mOutput1 = mOutputs.valueFor(mPrimaryOutput);
+                    dupOutputDesc->mOutput2 = mOutputs.valueFor(output);
+                    dupOutputDesc->mSamplingRate = desc->mSamplingRate;
+                    dupOutputDesc->mFormat = desc->mFormat;
+                    dupOutputDesc->mChannelMask = desc->mChannelMask;
+                    dupOutputDesc->mLatency = desc->mLatency;
+                    addOutput(duplicatedOutput, dupOutputDesc);
+                    applyStreamVolumes(duplicatedOutput, device, 0, true);
                 } else {
-                    audio_io_handle_t duplicatedOutput = 0;
-                    // add output descriptor
-                    addOutput(output, desc);
-                    // set initial stream volume for device
-                    applyStreamVolumes(output, device, 0, true);
-
-                    //TODO: configure audio effect output stage here
-
-                    // open a duplicating output thread for the new output and the primary output
-                    duplicatedOutput = mpClientInterface->openDuplicateOutput(output,
-                                                                              mPrimaryOutput);
-                    if (duplicatedOutput != 0) {
-                        // add duplicated output descriptor
-                        AudioOutputDescriptor *dupOutputDesc = new AudioOutputDescriptor(NULL);
-                        dupOutputDesc->mOutput1 = mOutputs.valueFor(mPrimaryOutput);
-                        dupOutputDesc->mOutput2 = mOutputs.valueFor(output);
-                        dupOutputDesc->mSamplingRate = desc->mSamplingRate;
-                        dupOutputDesc->mFormat = desc->mFormat;
-                        dupOutputDesc->mChannelMask = desc->mChannelMask;
-                        dupOutputDesc->mLatency = desc->mLatency;
-                        addOutput(duplicatedOutput, dupOutputDesc);
-                        applyStreamVolumes(duplicatedOutput, device, 0, true);
-                    } else {
-                        ALOGW("checkOutputsForDevice() could not open dup output for %d and %d",
-                                mPrimaryOutput, output);
-                        mpClientInterface->closeOutput(output);
-                        mOutputs.removeItem(output);
-                        output = 0;
-                    }
+                    ALOGW("checkOutputsForDevice() could not open dup output for %d and %d",
+                            mPrimaryOutput, output);
+                    mpClientInterface->closeOutput(output);
+                    mOutputs.removeItem(output);
+                    output = 0;
                 }
             }
             if (output == 0) {
@@ -1440,6 +1452,8 @@ status_t AudioPolicyManager::checkOutputsForDevice(audio_devices_t device,
                 outputs.add(mOutputs.keyAt(i));
             }
         }
+        // drop capability probes still pending for the device before clearing the profiles
+        cancelProbes(device);
         for (size_t i = 0; i < mHwModules.size(); i++)
         {
             if (mHwModules[i]->mHandle == 0) {
@@ -1471,6 +1485,231 @@ status_t AudioPolicyManager::checkOutputsForDevice(audio_devices_t device,
     return NO_ERROR;
 }
 
+void AudioPolicyManager::queueProbe(IOProfile *profile, audio_devices_t device)
+{
+    DirectProbe *probe = new DirectProbe();
+
+    probe->profile = profile;
+    probe->module = profile->mModule->mHandle;
+    probe->device = device;
+    probe->flags = profile->mFlags;
+    probe->samplingRate = profile->mSamplingRates[0];
+    probe->format = profile->mFormats[0];
+    probe->channelMask = profile->mChannelMasks[0];
+    probe->wantRates = (profile->mSamplingRates[0] == 0);
+    probe->wantFormats = (profile->mFormats[0] == 0);
+    probe->wantChannels = (profile->mChannelMasks[0] == 0);
+    probe->queuedNs = systemTime();
+    ALOGV("queueProbe() device %x flags %x", device, probe->flags);
+
+    Mutex::Autolock autoLock(mProbeLock);
+    if (!mProbeThreadStarted) {
+        mKillProbe = false;
+        mProbeThreadStarted = !pthread_create(&mProbeThread, (const pthread_attr_t *) NULL,
+                                              probeThreadWrapper, this);
+        if (!mProbeThreadStarted) {
+            ALOGE("queueProbe() could not start the probe thread, probing in place");
+            runProbe(probe);
+            probe->started = true;
+            probe->done = true;
+        }
+    }
+    mProbes.add(probe);
+    mProbeStats.queued++;
+    mProbeCv.signal();
+}
+
+void AudioPolicyManager::cancelProbes(audio_devices_t device)
+{
+    Mutex::Autolock autoLock(mProbeLock);
+    for (size_t i = mProbes.size(); i-- > 0; ) {
+        DirectProbe *probe = mProbes[i];
+        if (!(probe->device & device) || probe->cancelled) {
+            continue;
+        }
+        mProbeStats.cancelled++;
+        // a running probe is freed by applyProbes() once it finishes
+        if (probe->started && !probe->done) {
+            probe->cancelled = true;
+            continue;
+        }
+        mProbes.removeAt(i);
+        delete probe;
+    }
+}
+
+// Loads finished probes into their profiles, first waiting for any still
+// in flight for device. Runs on the policy thread.
+void AudioPolicyManager::applyProbes(audio_devices_t device)
+{
+    Mutex::Autolock autoLock(mProbeLock);
+    if (mProbes.isEmpty()) {
+        return;
+    }
+
+    nsecs_t start = systemTime();
+    bool waited = false;
+    for (;;) {
+        bool pending = false;
+        for (size_t i = 0; i < mProbes.size(); i++) {
+            DirectProbe *probe = mProbes[i];
+            if (!probe->done && !probe->cancelled && (probe->device & device)) {
+                pending = true;
+                break;
+            }
+        }
+        if (!pending) {
+            break;
+        }
+        nsecs_t left = milliseconds(DIRECT_PROBE_WAIT_MS) - (systemTime() - start);
+        if (left <= 0) {
+            ALOGW("applyProbes() timed out waiting for the probe of device %x", device);
+            break;
+        }
+        waited = true;
+        mProbeDoneCv.waitRelative(mProbeLock, left);
+    }
+    if (waited) {
+        mProbeStats.waits++;
+        mProbeStats.lastWaitUs = (systemTime() - start) / 1000;
+        if (mProbeStats.lastWaitUs > mProbeStats.maxWaitUs) {
+            mProbeStats.maxWaitUs = mProbeStats.lastWaitUs;
+        }
+    }
+
+    for (size_t i = 0; i < mProbes.size(); ) {
+        DirectProbe *probe = mProbes[i];
+        if (!probe->done) {
+            i++;
+            continue;
+        }
+        mProbes.removeAt(i);
+        if (probe->cancelled) {
+            delete probe;
+            continue;
+        }
+
+        IOProfile *profile = probe->profile;
+        char *value;
+        mProbeStats.lastProbeUs = (probe->doneNs - probe->queuedNs) / 1000;
+        if (mProbeStats.lastProbeUs > mProbeStats.maxProbeUs) {
+            mProbeStats.maxProbeUs = mProbeStats.lastProbeUs;
+        }
+        if (!probe->opened) {
+            ALOGW("applyProbes() could not open direct output for device %x", probe->device);
+            mProbeStats.failed++;
+            delete probe;
+            continue;
+        }
+        if (probe->wantRates && profile->mSamplingRates.size() < 2) {
+            value = strpbrk((char *)probe->rates.string(), "=");
+            if (value != NULL) {
+                loadSamplingRates(value, profile);
+            }
+        }
+        if (probe->wantFormats && profile->mFormats.size() < 2) {
+            value = strpbrk((char *)probe->formats.string(), "=");
+            if (value != NULL) {
+                loadFormats(value, profile);
+            }
+        }
+        if (probe->wantChannels && profile->mChannelMasks.size() < 2) {
+            value = strpbrk((char *)probe->channels.string(), "=");
+            if (value != NULL) {
+                loadOutChannels(value + 1, profile);
+            }
+        }
+        if (((profile->mSamplingRates[0] == 0) &&
+                 (profile->mSamplingRates.size() < 2)) ||
+             ((profile->mFormats[0] == 0) &&
+                 (profile->mFormats.size() < 2)) ||
+             ((profile->mChannelMasks[0] == 0) &&
+                 (profile->mChannelMasks.size() < 2))) {
+            ALOGW("applyProbes() direct output missing param for device %x", probe->device);
+            mProbeStats.failed++;
+        } else {
+            ALOGV("applyProbes() direct output for device %x probed in %lld us",
+                  probe->device, mProbeStats.lastProbeUs);
+            mProbeStats.completed++;
+        }
+        delete probe;
+    }
+}
+
+// Opens the direct output, reads its dynamic parameters and closes it
+// again. Runs on the probe thread and must not touch the profile.
+void AudioPolicyManager::runProbe(DirectProbe *probe)
+{
+    audio_devices_t device = probe->device;
+    uint32_t samplingRate = probe->samplingRate;
+    audio_format_t format = probe->format;
+    audio_channel_mask_t channelMask = probe->channelMask;
+    uint32_t latency = 0;
+
+    audio_io_handle_t output = mpClientInterface->openOutput(probe->module,
+                                                             &device,
+                                                             &samplingRate,
+                                                             &format,
+                                                             &channelMask,
+                                                             &latency,
+                                                             probe->flags);
+    if (output != 0) {
+        if (probe->wantRates) {
+            probe->rates = mpClientInterface->getParameters(output,
+                                        String8(AUDIO_PARAMETER_STREAM_SUP_SAMPLING_RATES));
+            ALOGV("runProbe() direct output sup sampling rates %s", probe->rates.string());
+        }
+        if (probe->wantFormats) {
+            probe->formats = mpClientInterface->getParameters(output,
+                                        String8(AUDIO_PARAMETER_STREAM_SUP_FORMATS));
+            ALOGV("runProbe() direct output sup formats %s", probe->formats.string());
+        }
+        if (probe->wantChannels) {
+            probe->channels = mpClientInterface->getParameters(output,
+                                        String8(AUDIO_PARAMETER_STREAM_SUP_CHANNELS));
+            ALOGV("runProbe() direct output sup channel masks %s", probe->channels.string());
+        }
+        mpClientInterface->closeOutput(output);
+    }
+    probe->opened = (output != 0);
+    probe->doneNs = systemTime();
+}
+
+void *AudioPolicyManager::probeThreadWrapper(void *me)
+{
+    static_cast<AudioPolicyManager *>(me)->probeThreadFunc();
+    return NULL;
+}
+
+void AudioPolicyManager::probeThreadFunc()
+{
+    prctl(PR_SET_NAME, (unsigned long)"DirectProbe", 0, 0, 0);
+
+    mProbeLock.lock();
+    while (!mKillProbe) {
+        DirectProbe *probe = NULL;
+        for (size_t i = 0; i < mProbes.size(); i++) {
+            if (!mProbes[i]->started && !mProbes[i]->cancelled) {
+                probe = mProbes[i];
+                break;
+            }
+        }
+        if (probe == NULL) {
+            mProbeCv.wait(mProbeLock);
+            continue;
+        }
+        probe->started = true;
+        mProbeLock.unlock();
+
+        runProbe(probe);
+
+        mProbeLock.lock();
+        probe->done = true;
+        mProbeDoneCv.broadcast();
+    }
+    mProbeLock.unlock();
+}
+
 audio_devices_t AudioPolicyManager::getNewDevice(audio_io_handle_t output, bool fromCache)
 {
     audio_devices_t device = AUDIO_DEVICE_NONE;
@@ -1547,6 +1786,25 @@ audio_devices_t AudioPolicyManager::getDeviceForStrategy(routing_strategy strate
         return mDeviceForStrategy[strategy];
     }
 
+    // the respectful sonification device follows recent music activity,
+    // everything else only changes with the connected devices, phone state,
+    // force use and A2DP suspend state, which invalidate the cache
+    if (strategy == STRATEGY_SONIFICATION_RESPECTFUL) {
+        return resolveDeviceForStrategy(strategy);
+    }
+
+    if (mStrategyCache.lookup(strategy, &device)) {
+        return device;
+    }
+    device = resolveDeviceForStrategy(strategy);
+    mStrategyCache.store(strategy, device);
+    return device;
+}
+
+audio_devices_t AudioPolicyManager::resolveDeviceForStrategy(routing_strategy strategy)
+{
+    uint32_t device = AUDIO_DEVICE_NONE;
+
     switch (strategy) {
 
     case STRATEGY_SONIFICATION_RESPECTFUL:
@@ -1791,7 +2049,7 @@ audio_devices_t AudioPolicyManager::getDeviceForStrategy(routing_strategy strate
         break;
     }
 
-    ALOGVV("getDeviceForStrategy() strategy %d, device %x", strategy, device);
+    ALOGVV("resolveDeviceForStrategy() strategy %d, device %x", strategy, device);
     return device;
 }
 
@@ -1852,6 +2110,8 @@ uint32_t AudioPolicyManager::setOutputDevice(audio_io_handle_t output,
         delayMs = 0;
     }
     ALOGV("setOutputDevice() changing device:%x",device);
+    // mutes queued above must reach the HAL ahead of the routing change
+    flushVolumes();
     // do the routing
     param.addInt(String8(AudioParameter::keyRouting), (int)device);
     mpClientInterface->setParameters(output, param.toString(), delayMs);
@@ -2048,7 +2308,7 @@ status_t AudioPolicyManager::checkAndSetVolume(int stream,
         // Force VOICE_CALL to track BLUETOOTH_SCO stream volume when bluetooth audio is
         // enabled
         if (stream == AudioSystem::BLUETOOTH_SCO) {
-            mpClientInterface->setStreamVolume(AudioSystem::VOICE_CALL, volume, output, delayMs);
+            sendStreamVolume(AudioSystem::VOICE_CALL, volume, output, delayMs);
 #ifdef QCOM_FM_ENABLED
         } else if (stream == AudioSystem::MUSIC) {
             float fmVolume = -1.0;
@@ -2062,14 +2322,14 @@ status_t AudioPolicyManager::checkAndSetVolume(int stream,
                     mpClientInterface->setParameters(mPrimaryOutput, param.toString(), delayMs*2);
                 }
                 else if(mHasA2dp && output == getA2dpOutput()) {
-                    mpClientInterface->setStreamVolume((AudioSystem::stream_type)stream, volume, output, delayMs);
+                    sendStreamVolume(stream, volume, output, delayMs);
                 }
             }
             //If you return here, only FM volume would be handled. To handle Music volume as well, this shouldn't return.
             //return NO_ERROR;
 #endif
         }
-        mpClientInterface->setStreamVolume((AudioSystem::stream_type)stream, volume, output, delayMs);
+        sendStreamVolume(stream, volume, output, delayMs);
     }
 
     if (stream == AudioSystem::VOICE_CALL ||
@@ -2085,19 +2345,13 @@ status_t AudioPolicyManager::checkAndSetVolume(int stream,
         voiceVolume = (float)index/(float)mStreams[stream].mIndexMax;
 
         // Force voice volume to max when Vgs is set for bluetooth SCO as volume is managed by the headset
-        if (stream == AudioSystem::BLUETOOTH_SCO) {
-            String8 key ("bt_headset_vgs");
-            mpClientInterface->getParameters(output,key);
-            AudioParameter result(mpClientInterface->getParameters(0,key));
-            int value;
-            if (result.getInt(String8("isVGS"),value) == NO_ERROR) {
-                ALOGV("Use BT-SCO Voice Volume");
-                voiceVolume = 1.0;
-            }
+        if (stream == AudioSystem::BLUETOOTH_SCO && isBtHeadsetVgs()) {
+            ALOGV("Use BT-SCO Voice Volume");
+            voiceVolume = 1.0;
         }
 
         if (voiceVolume != mLastVoiceVolume && (output == mPrimaryOutput || isDirectOutput(output))) {
-            mpClientInterface->setVoiceVolume(voiceVolume, delayMs);
+            sendVoiceVolume(voiceVolume, delayMs);
             mLastVoiceVolume = voiceVolume;
         }
     }
@@ -2105,6 +2359,88 @@ status_t AudioPolicyManager::checkAndSetVolume(int stream,
     return NO_ERROR;
 }
 
+bool AudioPolicyManager::isBtHeadsetVgs()
+{
+    nsecs_t now = systemTime();
+
+    // The answer only changes when the SCO link is set up again, so key
+    // repeats on the SCO volume do not each need a round trip to the HAL
+    if (!mBtVgsValid || now - mBtVgsTime > milliseconds(BT_VGS_CACHE_MS)) {
+        AudioParameter result(mpClientInterface->getParameters(0, String8("bt_headset_vgs")));
+        int value;
+        mBtVgs = (result.getInt(String8("isVGS"), value) == NO_ERROR);
+        mBtVgsTime = now;
+        mBtVgsValid = true;
+    }
+    return mBtVgs;
+}
+
+void AudioPolicyManager::sendStreamVolume(int stream,
+                                          float volume,
+                                          audio_io_handle_t output,
+                                          int delayMs)
+{
+    if (mVolumeBatchDepth == 0) {
+        mpClientInterface->setStreamVolume((AudioSystem::stream_type)stream, volume, output, delayMs);
+        return;
+    }
+
+    // a later change due at the same time supersedes the earlier one
+    for (size_t i = 0; i < mPendingVolumes.size(); i++) {
+        PendingVolume &pending = mPendingVolumes.editItemAt(i);
+        if (pending.output == output && pending.stream == stream &&
+                pending.delayMs == delayMs) {
+            ALOGVV("sendStreamVolume() output %d stream %d delay %d: %f replaces %f",
+                  output, stream, delayMs, volume, pending.volume);
+            pending.volume = volume;
+            return;
+        }
+    }
+    PendingVolume pending;
+    pending.output = output;
+    pending.stream = stream;
+    pending.delayMs = delayMs;
+    pending.volume = volume;
+    mPendingVolumes.add(pending);
+}
+
+void AudioPolicyManager::sendVoiceVolume(float volume, int delayMs)
+{
+    if (mVolumeBatchDepth == 0) {
+        mpClientInterface->setVoiceVolume(volume, delayMs);
+        return;
+    }
+    mVoiceVolumePending = true;
+    mPendingVoiceVolume = volume;
+    mPendingVoiceDelayMs = delayMs;
+}
+
+void AudioPolicyManager::flushVolumes()
+{
+    for (size_t i = 0; i < mPendingVolumes.size(); i++) {
+        const PendingVolume &pending = mPendingVolumes.itemAt(i);
+        // the output may have been closed since the change was queued
+        if (mOutputs.indexOfKey(pending.output) < 0) {
+            continue;
+        }
+        mpClientInterface->setStreamVolume((AudioSystem::stream_type)pending.stream,
+                                           pending.volume, pending.output, pending.delayMs);
+    }
+    mPendingVolumes.clear();
+
+    if (mVoiceVolumePending) {
+        mpClientInterface->setVoiceVolume(mPendingVoiceVolume, mPendingVoiceDelayMs);
+        mVoiceVolumePending = false;
+    }
+}
+
+void AudioPolicyManager::endVolumeBatch()
+{
+    if (mVolumeBatchDepth > 0 && --mVolumeBatchDepth == 0) {
+        flushVolumes();
+    }
+}
+
 
 void AudioPolicyManager::checkA2dpSuspend()
 {
@@ -2129,6 +2465,7 @@ void AudioPolicyManager::checkA2dpSuspend()
               (mPhoneState != AudioSystem::MODE_RINGTONE))) {
 
             mA2dpSuspended = false;
+            mStrategyCache.invalidate();
         }
     } else {
         if (((mScoDeviceAddress != "") &&
@@ -2138,6 +2475,7 @@ void AudioPolicyManager::checkA2dpSuspend()
               (mPhoneState == AudioSystem::MODE_RINGTONE))) {
 
             mA2dpSuspended = true;
+            mStrategyCache.invalidate();
         }
     }
 }
@@ -2167,6 +2505,9 @@ AudioPolicyManagerBase::IOProfile *AudioPolicyManager::getProfileForDirectOutput
                                                                uint32_t channelMask,
                                                                audio_output_flags_t flags)
 {
+    // direct output capabilities are still being probed right after a device connects
+    applyProbes(device);
+
 #ifdef QCOM_OUTPUT_FLAGS_ENABLED
     if( !((flags & AUDIO_OUTPUT_FLAG_LPA)   ||
           (flags & AUDIO_OUTPUT_FLAG_TUNNEL)||
@@ -2269,7 +2610,47 @@ float AudioPolicyManager::computeVolume(int stream,
          device == AUDIO_DEVICE_OUT_PROXY)) {
         return 1.0;
     }
-    return AudioPolicyManagerBase::computeVolume(stream, index, output, device);
+
+    // ring tones and notifications on a headset are attenuated depending on
+    // what else is playing, leave those to the base class
+    if (device & (AUDIO_DEVICE_OUT_BLUETOOTH_A2DP |
+                  AUDIO_DEVICE_OUT_BLUETOOTH_A2DP_HEADPHONES |
+                  AUDIO_DEVICE_OUT_WIRED_HEADSET |
+                  AUDIO_DEVICE_OUT_WIRED_HEADPHONE)) {
+        return AudioPolicyManagerBase::computeVolume(stream, index, output, device);
+    }
+    return lookupVolume(stream, index, device);
+}
+
+float AudioPolicyManager::lookupVolume(int stream, int index, audio_devices_t device)
+{
+    StreamDescriptor &streamDesc = mStreams[stream];
+    VolumeTable &table = mVolumeTable[stream];
+
+    if (table.indexMin != streamDesc.mIndexMin || table.indexMax != streamDesc.mIndexMax) {
+        table.indexMin = streamDesc.mIndexMin;
+        table.indexMax = streamDesc.mIndexMax;
+        memset(table.filled, 0, sizeof(table.filled));
+    }
+
+    int steps = streamDesc.mIndexMax - streamDesc.mIndexMin + 1;
+    if (index < streamDesc.mIndexMin || index > streamDesc.mIndexMax ||
+            steps > VOLUME_TABLE_MAX_STEPS) {
+        return volIndexToAmpl(device, streamDesc, index);
+    }
+
+    // key on the category the base class picks the curve by, so the table
+    // always matches volIndexToAmpl()
+    int category = AudioPolicyManagerBase::getDeviceCategory(device);
+    if (!table.filled[category]) {
+        for (int i = 0; i < steps; i++) {
+            table.ampl[category][i] =
+                    volIndexToAmpl(device, streamDesc, streamDesc.mIndexMin + i);
+        }
+        table.filled[category] = true;
+        ALOGV("lookupVolume() stream %d category %d: %d steps", stream, category, steps);
+    }
+    return table.ampl[category][index - streamDesc.mIndexMin];
 }
 
 bool AudioPolicyManager::platform_is_Fusion3()
@@ -2292,6 +2673,53 @@ bool AudioPolicyManager::isTunnelOutputEnabled()
     return false;
 }
 
+AudioPolicyManager::~AudioPolicyManager()
+{
+    if (mProbeThreadStarted) {
+        mProbeLock.lock();
+        mKillProbe = true;
+        mProbeCv.broadcast();
+        mProbeLock.unlock();
+        pthread_join(mProbeThread, NULL);
+    }
+    for (size_t i = 0; i < mProbes.size(); i++) {
+        delete mProbes[i];
+    }
+    mProbes.clear();
+}
+
+status_t AudioPolicyManager::dump(int fd)
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    String8 result;
+
+    AudioPolicyManagerBase::dump(fd);
+
+    Mutex::Autolock autoLock(mProbeLock);
+    snprintf(buffer, SIZE, "\nDirect output probes: %u queued, %u completed, %u failed, "
+             "%u cancelled, %u in flight\n", mProbeStats.queued, mProbeStats.completed,
+             mProbeStats.failed, mProbeStats.cancelled, (uint32_t)mProbes.size());
+    result.append(buffer);
+    snprintf(buffer, SIZE, " Probe time: last %lld us, max %lld us\n",
+             mProbeStats.lastProbeUs, mProbeStats.maxProbeUs);
+    result.append(buffer);
+    snprintf(buffer, SIZE, " getOutput() waits: %u, last %lld us, max %lld us\n",
+             mProbeStats.waits, mProbeStats.lastWaitUs, mProbeStats.maxWaitUs);
+    result.append(buffer);
+    snprintf(buffer, SIZE, " Output device connection: last %lld us, max %lld us\n",
+             mProbeStats.lastConnectUs, mProbeStats.maxConnectUs);
+    result.append(buffer);
+    snprintf(buffer, SIZE, " Connection to first start: last %lld ms, max %lld ms\n",
+             mProbeStats.lastFirstStartUs / 1000, mProbeStats.maxFirstStartUs / 1000);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "\nStrategy device cache: %u hits, %u misses, %u flushes\n",
+             mStrategyCache.hits(), mStrategyCache.misses(), mStrategyCache.flushes());
+    result.append(buffer);
+    write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
 extern "C" AudioPolicyInterface* createAudioPolicyManager(AudioPolicyClientInterface *clientInterface)
 {
     return new AudioPolicyManager(clientInterface);
@@ -17,26 +17,48 @@
  */
 
 
+#include <pthread.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <utils/Timers.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
 #include <hardware_legacy/AudioPolicyManagerBase.h>
+#include "AudioStrategyCache.h"
 
 
 namespace android_audio_legacy {
+using android::Mutex;
+using android::Condition;
 
 // ----------------------------------------------------------------------------
 
+// Volume steps a stream can have and still be served from the volume table
+#define VOLUME_TABLE_MAX_STEPS 32
+// How long an isVGS answer from the HAL is trusted while SCO state is stable
+#define BT_VGS_CACHE_MS 1000
+// How long getOutput() waits for a direct output probe still in flight
+#define DIRECT_PROBE_WAIT_MS 2000
+
 class AudioPolicyManager: public AudioPolicyManagerBase
 {
 
 public:
                 AudioPolicyManager(AudioPolicyClientInterface *clientInterface)
-                : AudioPolicyManagerBase(clientInterface) {mForceDeviceChange=false;}
+                : AudioPolicyManagerBase(clientInterface), mVolumeBatchDepth(0),
+                  mVoiceVolumePending(false), mBtVgsValid(false),
+                  mProbeThreadStarted(false), mKillProbe(false),
+                  mFirstStartDevice(AUDIO_DEVICE_NONE), mFirstStartConnectNs(0)
+                {
+                    mForceDeviceChange=false;
+                    memset(mVolumeTable, 0, sizeof(mVolumeTable));
+                    memset(&mProbeStats, 0, sizeof(mProbeStats));
+                }
 
-        virtual ~AudioPolicyManager() {}
+        virtual ~AudioPolicyManager();
 
         // AudioPolicyInterface
         virtual status_t setDeviceConnectionState(audio_devices_t device,
@@ -86,6 +108,7 @@ public:
         virtual status_t setStreamVolumeIndex(AudioSystem::stream_type stream,
                                               int index,
                                               audio_devices_t device);
+        virtual status_t dump(int fd);
 protected:
         // return the strategy corresponding to a given stream type
         static routing_strategy getStrategy(AudioSystem::stream_type stream);
@@ -173,6 +196,118 @@ private:
         void handleNotificationRoutingForStream(AudioSystem::stream_type stream);
         bool platform_is_Fusion3();
         bool isTunnelOutputEnabled();
+
+        // getDeviceForStrategy() without the cache, always walks the rules
+        audio_devices_t resolveDeviceForStrategy(routing_strategy strategy);
+
+        // curve lookup for devices computeVolume() does not attenuate
+        float lookupVolume(int stream, int index, audio_devices_t device);
+        // true if the SCO headset manages call volume itself
+        bool isBtHeadsetVgs();
+        void invalidateBtHeadsetVgs() { mBtVgsValid = false; }
+
+        // Volume changes made between beginVolumeBatch() and the matching
+        // endVolumeBatch() are held back and sent once per output, stream and
+        // delay. They are flushed early before anything that depends on their
+        // order: a routing change, a mute wait, or base class volume code.
+        void beginVolumeBatch() { mVolumeBatchDepth++; }
+        void endVolumeBatch();
+        void flushVolumes();
+        void sendStreamVolume(int stream, float volume, audio_io_handle_t output, int delayMs);
+        void sendVoiceVolume(float volume, int delayMs);
+
+        class VolumeBatch {
+        public:
+            VolumeBatch(AudioPolicyManager *apm) : mApm(apm) { mApm->beginVolumeBatch(); }
+            ~VolumeBatch() { mApm->endVolumeBatch(); }
+        private:
+            AudioPolicyManager *mApm;
+        };
+
+        struct VolumeTable {
+            int   indexMin;
+            int   indexMax;
+            bool  filled[DEVICE_CATEGORY_CNT];
+            float ampl[DEVICE_CATEGORY_CNT][VOLUME_TABLE_MAX_STEPS];
+        };
+
+        struct PendingVolume {
+            audio_io_handle_t output;
+            int stream;
+            int delayMs;
+            float volume;
+        };
+
+        // Direct outputs with dynamic parameters are probed on a worker
+        // thread when their device connects. The replies are loaded into
+        // the profile on the policy thread, at the latest when getOutput()
+        // first looks for a direct output on that device.
+        struct DirectProbe {
+            IOProfile *profile;
+            audio_module_handle_t module;
+            audio_devices_t device;
+            audio_output_flags_t flags;
+            uint32_t samplingRate;
+            audio_format_t format;
+            audio_channel_mask_t channelMask;
+            bool wantRates;
+            bool wantFormats;
+            bool wantChannels;
+            bool started;
+            bool done;
+            bool cancelled;
+            bool opened;
+            String8 rates;
+            String8 formats;
+            String8 channels;
+            nsecs_t queuedNs;
+            nsecs_t doneNs;
+        };
+
+        struct probe_stats {
+            uint32_t queued;
+            uint32_t completed;
+            uint32_t failed;
+            uint32_t cancelled;
+            uint32_t waits;
+            int64_t  lastProbeUs;
+            int64_t  maxProbeUs;
+            int64_t  lastWaitUs;
+            int64_t  maxWaitUs;
+            int64_t  lastConnectUs;       // connection request until the device is registered
+            int64_t  maxConnectUs;
+            int64_t  lastFirstStartUs;    // device connection to the first output start on it
+            int64_t  maxFirstStartUs;
+        };
+
+        void queueProbe(IOProfile *profile, audio_devices_t device);
+        void cancelProbes(audio_devices_t device);
+        void applyProbes(audio_devices_t device);
+        void runProbe(DirectProbe *probe);
+        void probeThreadFunc();
+        static void *probeThreadWrapper(void *me);
+
         bool mForceDeviceChange;
+        AudioStrategyCache mStrategyCache;
+        VolumeTable mVolumeTable[AudioSystem::NUM_STREAM_TYPES];
+        int mVolumeBatchDepth;
+        Vector<PendingVolume> mPendingVolumes;
+        bool mVoiceVolumePending;
+        float mPendingVoiceVolume;
+        int mPendingVoiceDelayMs;
+        bool mBtVgsValid;
+        bool mBtVgs;
+        nsecs_t mBtVgsTime;
+
+        Mutex mProbeLock;
+        Condition mProbeCv;
+        Condition mProbeDoneCv;
+        Vector<DirectProbe *> mProbes;
+        pthread_t mProbeThread;
+        bool mProbeThreadStarted;
+        bool mKillProbe;
+        probe_stats mProbeStats;
+        audio_devices_t mFirstStartDevice;
+        nsecs_t mFirstStartConnectNs;
 };
 };
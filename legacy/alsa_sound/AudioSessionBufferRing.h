@@ -0,0 +1,159 @@
+/* AudioSessionBufferRing.h
+
+  Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef ANDROID_AUDIO_SESSION_BUFFER_RING_H
+#define ANDROID_AUDIO_SESSION_BUFFER_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace android_audio_legacy
+{
+
+//Descriptor of one period of the mmap'ed LPA/tunnel buffer
+struct AudioSessionBuffer {
+    uint32_t index;
+    void*    memBuf;
+    int32_t  memBufsize;
+    uint32_t bytesToWrite;
+    uint64_t timestamp;
+    //false for an EOS buffer queued behind data, the driver does not
+    //raise a timer event for it
+    bool     expectEvent;
+};
+
+/* The compressed driver consumes periods strictly in ring order, so the
+ * empty and filled queues of AudioSessionOutALSA are the two halves of one
+ * descriptor ring: [consumed, queued) are filled, the rest are empty.
+ * queued only moves in publish(), called by the writer under the session
+ * lock. consumed moves in retire(), called by the event thread without the
+ * lock for every timer event, and in retireEventless() and reset(), which
+ * run under the session lock.
+ */
+template <int SLOTS>
+class AudioSessionBufferRing {
+public:
+    AudioSessionBufferRing() : mQueued(0), mConsumed(0), mBase(0)
+    {
+        memset(mBufs, 0, sizeof(mBufs));
+    }
+
+    AudioSessionBuffer &at(int index) { return mBufs[index]; }
+    int32_t filled() const { return mQueued - mConsumed; }
+    int32_t empty() const { return SLOTS - filled(); }
+    int32_t queued() const { return mQueued; }
+    int32_t consumed() const { return mConsumed; }
+    //The driver plays whatever is at appl_ptr, the next slot of the ring
+    AudioSessionBuffer &next() { return slot(mQueued); }
+
+    void publish() { __sync_fetch_and_add(&mQueued, 1); }
+
+    /* Whether an EOS buffer written to the driver just now gets a timer
+     * event of its own: only if no data buffer is left in front of it.
+     * The barrier pairs with the one in retire(), so once the caller set
+     * its EOS flag either this sees the buffer in front retired or the
+     * event thread retiring it sees the flag and calls retireEventless().
+     */
+    bool eosExpectsEvent()
+    {
+        __sync_synchronize();
+        return filled() == 0;
+    }
+
+    //Retires the buffer the driver finished and the EOS buffers queued
+    //behind it. Returns false if the ring was empty.
+    bool retire()
+    {
+        bool retired = false;
+
+        for (;;) {
+            int32_t seq = mConsumed;
+            int32_t queued = mQueued;
+            __sync_synchronize();
+            if (seq == queued || (retired && slot(seq).expectEvent))
+                break;
+            //Fails only if a flush emptied the ring meanwhile
+            if (!__sync_bool_compare_and_swap(&mConsumed, seq, seq + 1))
+                break;
+            retired = true;
+        }
+        return retired;
+    }
+
+    /* Retires EOS buffers without an event of their own that reached the
+     * head of the ring. That happens when retire() ran after
+     * eosExpectsEvent() but before the EOS buffer was published, so it had
+     * nothing behind to retire. Call under the session lock, which keeps
+     * the writer out of that window.
+     */
+    bool retireEventless()
+    {
+        bool retired = false;
+
+        for (;;) {
+            int32_t seq = mConsumed;
+            __sync_synchronize();
+            if (seq == mQueued || slot(seq).expectEvent)
+                break;
+            if (!__sync_bool_compare_and_swap(&mConsumed, seq, seq + 1))
+                break;
+            retired = true;
+        }
+        return retired;
+    }
+
+    //pcm_prepare restarts the driver at the first period, so the ring
+    //restarts at the first slot. Moving consumed up to queued also makes
+    //a retire in flight on the event thread fail its CAS.
+    void reset()
+    {
+        mBase = mQueued;
+        __sync_synchronize();
+        mConsumed = mQueued;
+        for (int i = 0; i < SLOTS; i++) {
+            mBufs[i].bytesToWrite = 0;
+            mBufs[i].timestamp = 0;
+            mBufs[i].expectEvent = true;
+        }
+    }
+
+private:
+    AudioSessionBuffer &slot(int32_t seq)
+    {
+        return mBufs[(uint32_t)(seq - mBase) % SLOTS];
+    }
+
+    AudioSessionBuffer  mBufs[SLOTS];
+    volatile int32_t    mQueued;
+    volatile int32_t    mConsumed;
+    int32_t             mBase;
+};
+
+};        // namespace android_audio_legacy
+#endif    // ANDROID_AUDIO_SESSION_BUFFER_RING_H
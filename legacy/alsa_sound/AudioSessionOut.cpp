@@ -57,11 +57,16 @@ namespace android_audio_legacy
 #define TUNNEL_MODE 1
 #define NUM_FDS 2
 #define KILL_EVENT_THREAD 1
-#define BUFFER_COUNT 4
 #define LPA_BUFFER_SIZE 256*1024
 #define TUNNEL_BUFFER_SIZE 240*1024
 #define TUNNEL_METADATA_SIZE 64
 #define MONO_CHANNEL_MODE 1
+//Gapless parameters, set on the tunnel session
+#define GAPLESS_KEY_DELAY      "delay_samples"
+#define GAPLESS_KEY_PADDING    "padding_samples"
+#define GAPLESS_KEY_NEXT_TRACK "next_track"
+#define GAPLESS_KEY_PARTIAL_DRAIN "partial_drain"
+#define GAPLESS_KEY_STATS      "gapless_stats"
 // ----------------------------------------------------------------------------
 
 AudioSessionOutALSA::AudioSessionOutALSA(AudioHardwareALSA *parent,
@@ -99,7 +104,8 @@ AudioSessionOutALSA::AudioSessionOutALSA(AudioHardwareALSA *parent,
     mUseCase            = AudioHardwareALSA::USECASE_NONE;
 
     mInputBufferSize    = type ? TUNNEL_BUFFER_SIZE : LPA_BUFFER_SIZE;
-    mInputBufferCount   = BUFFER_COUNT;
+    mInputBufferCount   = SESSION_BUFFER_COUNT;
+    mWriterWaiting      = 0;
     mEfd = -1;
     mEosEventReceived   = false;
     mEventThread        = NULL;
@@ -107,6 +113,19 @@ AudioSessionOutALSA::AudioSessionOutALSA(AudioHardwareALSA *parent,
     mKillEventThread    = false;
     mObserver           = NULL;
     mOutputMetadataLength = 0;
+    mBytesCopied        = 0;
+    mBytesInPlace       = 0;
+    mBuffersCopied      = 0;
+    mBuffersInPlace     = 0;
+    mEncoderDelay       = 0;
+    mEncoderPadding     = 0;
+    mMetadataPending    = false;
+    mPartialDrainPending = false;
+    mPartialDrainWaiting = 0;
+    mNextTrackFirstWrite = false;
+    mTrackBoundary      = 0;
+    mTransitionStart    = 0;
+    memset(&mGaplessStats, 0, sizeof(mGaplessStats));
     mSkipEOS            = false;
     mTunnelMode         = false;
 
@@ -138,7 +157,7 @@ AudioSessionOutALSA::AudioSessionOutALSA(AudioHardwareALSA *parent,
     //Creates the event thread to poll events from LPA/Compress Driver
     createEventThread();
 
-    mUseCase = mParent->useCaseStringToEnum(mAlsaHandle->useCase);
+    mUseCase = mParent->useCaseIdToEnum(mAlsaHandle->useCaseId);
     ALOGV("mParent->mRouteAudioToExtOut = %d", mParent->mRouteAudioToExtOut);
     if (mParent->mRouteAudioToExtOut) {
         status_t err = NO_ERROR;
@@ -188,19 +207,13 @@ status_t AudioSessionOutALSA::setVolume(float left, float right)
 
     ALOGV("Setting stream volume to %d (available range is 0 to 0x2000)\n", mStreamVol);
     if(mAlsaHandle && mAlsaHandle->handle) {
-        if(!strncmp(mAlsaHandle->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER,
-           sizeof(SND_USE_CASE_VERB_HIFI_LOW_POWER)) ||
-           !strncmp(mAlsaHandle->useCase, SND_USE_CASE_MOD_PLAY_LPA,
-           sizeof(SND_USE_CASE_MOD_PLAY_LPA))) {
+        if(isLpaUseCase(mAlsaHandle->useCaseId)) {
             ALOGV("setLpaVolume(%u)\n", mStreamVol);
             ALOGV("Setting LPA volume to %d (available range is 0 to 100)\n", mStreamVol);
             mAlsaHandle->module->setLpaVolume(mStreamVol);
             return status;
         }
-        else if(!strncmp(mAlsaHandle->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL,
-                sizeof(SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-                !strncmp(mAlsaHandle->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL,
-                sizeof(SND_USE_CASE_MOD_PLAY_TUNNEL))) {
+        else if(isTunnelUseCase(mAlsaHandle->useCaseId)) {
             ALOGV("setCompressedVolume(%u)\n", mStreamVol);
             ALOGV("Setting Compressed volume to %d (available range is 0 to 100)\n", mStreamVol);
             mAlsaHandle->module->setCompressedVolume(mStreamVol);
@@ -213,21 +226,19 @@ status_t AudioSessionOutALSA::setVolume(float left, float right)
 
 status_t AudioSessionOutALSA::openAudioSessionDevice(int type, int devices)
 {
-    char* use_case;
+    int verb_id;
     status_t status = NO_ERROR;
     //1.) Based on the current device and session type (LPA/Tunnel), open a device
     //    with verb or modifier
-    snd_use_case_get(mUcMgr, "_verb", (const char **)&use_case);
+    verb_id = snd_use_case_get_verb_id(mUcMgr);
     if (type == LPA_MODE) {
-        if ((use_case == NULL) || (!strncmp(use_case, SND_USE_CASE_VERB_INACTIVE,
-                                            strlen(SND_USE_CASE_VERB_INACTIVE)))) {
+        if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
             status = openDevice(SND_USE_CASE_VERB_HIFI_LOW_POWER, true, devices);
         } else {
             status = openDevice(SND_USE_CASE_MOD_PLAY_LPA, false, devices);
         }
     } else if (type == TUNNEL_MODE) {
-        if ((use_case == NULL) || (!strncmp(use_case, SND_USE_CASE_VERB_INACTIVE,
-                                            strlen(SND_USE_CASE_VERB_INACTIVE)))) {
+        if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
             status = openDevice(SND_USE_CASE_VERB_HIFI_TUNNEL, true, devices);
         } else {
             status = openDevice(SND_USE_CASE_MOD_PLAY_TUNNEL, false, devices);
@@ -238,10 +249,6 @@ status_t AudioSessionOutALSA::openAudioSessionDevice(int type, int devices)
     mOutputMetadataLength = sizeof(output_metadata_handle_t);
     ALOGD("openAudioSessionDevice - mOutputMetadataLength = %d", mOutputMetadataLength);
 
-    if(use_case) {
-        free(use_case);
-        use_case = NULL;
-    }
     if(status != NO_ERROR) {
         return status;
     }
@@ -283,11 +290,16 @@ status_t AudioSessionOutALSA::openAudioSessionDevice(int type, int devices)
 ssize_t AudioSessionOutALSA::write(const void *buffer, size_t bytes)
 {
     Mutex::Autolock autoLock(mLock);
+    return write_l(buffer, bytes);
+}
+
+ssize_t AudioSessionOutALSA::write_l(const void *buffer, size_t bytes)
+{
     int err = 0;
 
     ALOGV("write Empty Queue size() = %d, Filled Queue size() = %d "
           "mReached EOS %d, mEosEventReceived %d bytes %d",
-          mEmptyQueue.size(),mFilledQueue.size(), mReachedEOS, mEosEventReceived, bytes);
+          emptyCount(), filledCount(), mReachedEOS, mEosEventReceived, bytes);
 
     mEosEventReceived = false;
     mReachedEOS = false;
@@ -301,7 +313,7 @@ ssize_t AudioSessionOutALSA::write(const void *buffer, size_t bytes)
     //    buffer queue
 
     if (mSkipWrite) {
-        LOG_ALWAYS_FATAL_IF((mEmptyQueue.size() != BUFFER_COUNT),
+        LOG_ALWAYS_FATAL_IF((emptyCount() != mInputBufferCount),
                             "::write, mSkipwrite is true but empty queue isnt full");
         ALOGD("reset mSkipWrite in write");
         mSkipWrite = false;
@@ -316,42 +328,71 @@ ssize_t AudioSessionOutALSA::write(const void *buffer, size_t bytes)
     }
 
     ALOGV("not skipping buffer in write since mSkipWrite = %d, "
-              "mEmptyQueuesize %d ", mSkipWrite, mEmptyQueue.size());
-
-    List<BuffersAllocated>::iterator it = mEmptyQueue.begin();
-    BuffersAllocated buf = *it;
+              "mEmptyQueuesize %d ", mSkipWrite, emptyCount());
 
-    mEmptyQueue.erase(it);
+    if (!emptyCount()) {
+        ALOGE("write called without an empty buffer");
+        return INVALID_OPERATION;
+    }
+    AudioSessionBuffer &buf = mRing.next();
 
-    updateMetaData(bytes);
+    if (mMetadataPending && bytes) {
+        setGaplessMetadata_l();
+    }
+    if (mNextTrackFirstWrite && bytes) {
+        int64_t gapUs = ns2us(systemTime() - mTransitionStart);
+        mNextTrackFirstWrite = false;
+        mGaplessStats.transitions++;
+        mGaplessStats.lastGapUs = gapUs;
+        mGaplessStats.totalGapUs += gapUs;
+        if (gapUs > mGaplessStats.maxGapUs)
+            mGaplessStats.maxGapUs = gapUs;
+        ALOGD("Gapless transition: next track queued %lld us after the boundary",
+              (long long)gapUs);
+    }
 
-    memcpy(buf.memBuf, &mOutputMetadataTunnel, mOutputMetadataLength);
+    //The metadata header is filled in place at the start of the period
+    if (mOutputMetadataLength) {
+        updateMetaData((output_metadata_handle_t *)buf.memBuf, bytes);
+    }
+    buf.timestamp = 0;
     ALOGD("buf.memBuf  =%x , Copy Metadata = %d,  bytes = %d", buf.memBuf,mOutputMetadataLength, bytes);
 
     if (bytes == 0) {
         buf.bytesToWrite = 0;
+        /*
+         * The compressed driver does not interrupt the timer fd if the
+         * EOS buffer was queued after a buffer with valid data (full or
+         * partial), so the event thread retires such a buffer together
+         * with the one in front of it. Only when it is the first (only)
+         * buffer given to the driver does it get an event of its own.
+         * The driver decides when the buffer is written, so the ring is
+         * checked before pcm_write; if the buffer in front is retired
+         * before this one is published, the event thread retires it
+         * under mLock instead.
+         */
+        buf.expectEvent = mRing.eosExpectsEvent();
         err = pcm_write(mAlsaHandle->handle, buf.memBuf, mAlsaHandle->handle->period_size);
 
         //bad part is !err does not guarantee pcm_write succeeded!
         if (!err) { //mReachedEOS is already set
-             /*
-              * This workaround is needed to ensure EOS from the event thread
-              * is posted when the first (only) buffer given to the driver
-              * is a zero length buffer. Note that the compressed driver
-              * does not interrupt the timer fd if the EOS buffer was queued
-              * after a buffer with valid data (full or partial). So we
-              * only need to do this in this special case.
-              */
-            if (mFilledQueue.empty()) {
-                mFilledQueue.push_back(buf);
-            }
+            mRing.publish();
             return bytes;
         }
 
         return err;
     }
-    ALOGV("PCM write before memcpy start");
-    memcpy((buf.memBuf + mOutputMetadataLength), buffer, bytes);
+    //A decoder filling the getBufferInfo pointers in ring order hands
+    //back the payload of this very slot, only foreign buffers are copied
+    if (buffer != payload(buf)) {
+        ALOGV("PCM write before memcpy start");
+        memcpy(payload(buf), buffer, bytes);
+        mBytesCopied += bytes;
+        mBuffersCopied++;
+    } else {
+        mBytesInPlace += bytes;
+        mBuffersInPlace++;
+    }
 
     buf.bytesToWrite = bytes;
 
@@ -373,7 +414,9 @@ ssize_t AudioSessionOutALSA::write(const void *buffer, size_t bytes)
     }
     int32_t * Buf = (int32_t *) buf.memBuf;
     ALOGD(" buf.memBuf [0] = %x , buf.memBuf [1] = %x",  Buf[0], Buf[1]);
-    mFilledQueue.push_back(buf);
+    buf.expectEvent = true;
+    //Publishes the descriptor to the event thread, full barrier
+    mRing.publish();
     if(!err) {
        //return the bytes written to HAL if write is successful.
        return bytes;
@@ -393,21 +436,26 @@ void AudioSessionOutALSA::bufferAlloc(alsa_handle_t *handle) {
     for (i = 0; i < mInputBufferCount; i++) {
         mem_buf = (int32_t *)mAlsaHandle->handle->addr + (nSize * i/sizeof(int));
         ALOGV("Buffer pointer %p ", mem_buf);
-        BuffersAllocated buf(mem_buf, nSize);
-        memset(buf.memBuf, 0x0, nSize);
-        mEmptyQueue.push_back(buf);
-        mBufPool.push_back(buf);
+        mRing.at(i).index = i;
+        mRing.at(i).memBuf = mem_buf;
+        mRing.at(i).memBufsize = nSize;
         ALOGV("The MEM that is allocated - buffer is %x",\
             (unsigned int)mem_buf);
     }
+    resetBufferRing_l();
 }
 
 void AudioSessionOutALSA::bufferDeAlloc() {
-    while (!mBufPool.empty()) {
-        List<BuffersAllocated>::iterator it = mBufPool.begin();
-        ALOGV("Removing input buffer from Buffer Pool ");
-        mBufPool.erase(it);
-   }
+    //The descriptors only point into the mmap'ed buffer, nothing to free
+    ALOGV("Returning all the buffers to the empty queue");
+    mRing.reset();
+}
+
+void AudioSessionOutALSA::resetBufferRing_l() {
+    mRing.reset();
+    for (int i = 0; i < mInputBufferCount; i++) {
+        memset(mRing.at(i).memBuf, 0x0, mRing.at(i).memBufsize);
+    }
 }
 
 void AudioSessionOutALSA::requestAndWaitForEventThreadExit() {
@@ -421,6 +469,8 @@ void AudioSessionOutALSA::requestAndWaitForEventThreadExit() {
     }
     pthread_join(mEventThread,NULL);
     ALOGV("event thread killed");
+    //A partial drain waiting for the ring would never be woken now
+    mPartialDrainCv.signal();
 }
 
 void * AudioSessionOutALSA::eventThreadWrapper(void *me) {
@@ -500,26 +550,34 @@ void  AudioSessionOutALSA::eventThreadEntry() {
             pfd[0].revents = 0;
             ALOGV("After an event occurs");
 
-            {
-                Mutex::Autolock _l(mLock);
-                if (mFilledQueue.empty()) {
-                    ALOGV("Filled queue is empty"); //only time this would be valid is after a flush?
-                    continue;
-                }
-                // Transfer a buffer that was consumed by the driver from filled queue
-                // to empty queue
-
-                BuffersAllocated buf = *(mFilledQueue.begin());
-                mFilledQueue.erase(mFilledQueue.begin());
-                ALOGV("mFilledQueue %d", mFilledQueue.size());
+            // Transfer a buffer that was consumed by the driver from filled queue
+            // to empty queue
+            if (!mRing.retire()) {
+                ALOGV("Filled queue is empty"); //only time this would be valid is after a flush?
+                continue;
+            }
+            ALOGV("mFilledQueue %d", filledCount());
 
-                mEmptyQueue.push_back(buf);
+            //mLock is only needed to wake a blocked writer and for the
+            //EOS and skipped write handling; write() may hold it for a
+            //whole period copy. The CAS in retire() orders these reads
+            //after the buffer was returned.
+            if (mWriterWaiting || mSkipWrite || mReachedEOS || mPartialDrainWaiting) {
+                Mutex::Autolock _l(mLock);
                 mWriteCv.signal();
                 ALOGV("Reset mSkipwrite in eventthread entry");
                 mSkipWrite = false;
 
+                //An EOS buffer published after retire() ran has no event left
+                mRing.retireEventless();
+
+                //All buffers of the previous track reached the DSP
+                if (partialDrainDue()) {
+                    mPartialDrainCv.signal();
+                }
+
                 //Post EOS in case the filled queue is empty and EOS is reached.
-                if (mFilledQueue.empty() && mReachedEOS) {
+                if (!filledCount() && mReachedEOS) {
                     drainAndPostEOS_l();
                 }
             }
@@ -642,7 +700,7 @@ status_t AudioSessionOutALSA::drain()
     }
 
     ALOGV("drain Empty Queue size() = %d, Filled Queue size() = %d ",
-         mEmptyQueue.size(), mFilledQueue.size());
+         emptyCount(), filledCount());
 
     mAlsaHandle->handle->sync_ptr->flags =
         SNDRV_PCM_SYNC_PTR_APPL | SNDRV_PCM_SYNC_PTR_AVAIL_MIN;
@@ -656,18 +714,9 @@ status_t AudioSessionOutALSA::flush()
     Mutex::Autolock autoLock(mLock);
     ALOGV("AudioSessionOutALSA flush");
     int err;
-    {
-        // 1.) Clear the Empty and Filled buffer queue
-        mEmptyQueue.clear();
-        mFilledQueue.clear();
-
-        // 2.) Add all the available buffers to Request Queue (Maintain order)
-        List<BuffersAllocated>::iterator it = mBufPool.begin();
-        for (; it!=mBufPool.end(); ++it) {
-            memset(it->memBuf, 0x0, (*it).memBufsize);
-            mEmptyQueue.push_back(*it);
-        }
-    }
+    // 1.) & 2.) Clear the Filled buffer queue and return all the buffers
+    //           to the Empty queue (Maintain order)
+    resetBufferRing_l();
 
     ALOGV("Transferred all the buffers from Filled queue to "
           "Empty queue to handle seek paused %d, skipwrite %d", mPaused, mSkipWrite);
@@ -675,6 +724,10 @@ status_t AudioSessionOutALSA::flush()
     mReachedEOS = false;
     mEosEventReceived = false;
     mSkipEOS = false;
+    //A seek drops the track boundary together with the queued data
+    mPartialDrainPending = false;
+    mPartialDrainCv.signal();
+    mNextTrackFirstWrite = false;
     // 3.) If its in start state,
     //          Pause and flush the driver and Resume it again
     //    If its in paused state,
@@ -774,6 +827,25 @@ status_t AudioSessionOutALSA::setObserver(void *observer)
 
 status_t AudioSessionOutALSA::dump(int fd, const Vector<String16>& args)
 {
+    Mutex::Autolock autoLock(mLock);
+    char buffer[256];
+
+    snprintf(buffer, sizeof(buffer),
+             "%s session: %d/%d buffers filled, copied %u buffers (%llu bytes),"
+             " in place %u buffers (%llu bytes)\n",
+             mTunnelMode ? "Tunnel" : "LPA", filledCount(), mInputBufferCount,
+             mBuffersCopied, (unsigned long long)mBytesCopied,
+             mBuffersInPlace, (unsigned long long)mBytesInPlace);
+    sys_write::lib_write(fd, buffer, strlen(buffer));
+    if (mTunnelMode) {
+        snprintf(buffer, sizeof(buffer),
+                 "  gapless: %u transitions, gap last %lld us max %lld us,"
+                 " last partial drain %lld us\n",
+                 mGaplessStats.transitions, (long long)mGaplessStats.lastGapUs,
+                 (long long)mGaplessStats.maxGapUs,
+                 (long long)mGaplessStats.lastDrainUs);
+        sys_write::lib_write(fd, buffer, strlen(buffer));
+    }
     return NO_ERROR;
 }
 
@@ -801,6 +873,8 @@ status_t AudioSessionOutALSA::getRenderPosition(uint32_t *dspFrames)
     return NO_ERROR;
 }
 
+//Hands out the payload area of every period, after the metadata header.
+//write() from buffers[i] commits slot i in place, see write_l.
 status_t AudioSessionOutALSA::getBufferInfo(buf_info **buf) {
     if (!mAlsaHandle) {
         return NO_ERROR;
@@ -810,10 +884,8 @@ status_t AudioSessionOutALSA::getBufferInfo(buf_info **buf) {
     tempbuf->bufsize = (mAlsaHandle->handle->period_size - mOutputMetadataLength);
     tempbuf->nBufs = mInputBufferCount;
     tempbuf->buffers = (int **)((char*)tempbuf + sizeof(buf_info));
-    List<BuffersAllocated>::iterator it = mBufPool.begin();
     for (int i = 0; i < mInputBufferCount; i++) {
-        tempbuf->buffers[i] = (int *)(((char *)it->memBuf) + mOutputMetadataLength);
-        it++;
+        tempbuf->buffers[i] = (int *)(((char *)mRing.at(i).memBuf) + mOutputMetadataLength);
     }
     *buf = tempbuf;
     return NO_ERROR;
@@ -830,7 +902,7 @@ status_t AudioSessionOutALSA::isBufferAvailable(int *isAvail) {
     ALOGV("acquiring mDecoderLock in isBufferAvailable()");
     Mutex::Autolock autoDecoderLock(mDecoderLock);
     ALOGV("isBufferAvailable Empty Queue size() = %d, Filled Queue size() = %d ",
-          mEmptyQueue.size(),mFilledQueue.size());
+          emptyCount(), filledCount());
     *isAvail = false;
 
     /*
@@ -838,14 +910,23 @@ status_t AudioSessionOutALSA::isBufferAvailable(int *isAvail) {
      * immediately after a flush
      */
     if (mSkipWrite) {
-        LOG_ALWAYS_FATAL_IF((mEmptyQueue.size() != BUFFER_COUNT),
+        LOG_ALWAYS_FATAL_IF((emptyCount() != mInputBufferCount),
                             "::isBufferAvailable, mSkipwrite is true but empty queue isnt full");
         mSkipWrite = false;
     }
     // 1.) Wait till a empty buffer is available in the Empty buffer queue
-    while (mEmptyQueue.empty()) {
+    while (!emptyCount()) {
+        //Announce the wait before checking again, the event thread only
+        //takes mLock to signal when it sees the flag
+        mWriterWaiting = 1;
+        __sync_synchronize();
+        if (emptyCount()) {
+            mWriterWaiting = 0;
+            break;
+        }
         ALOGV("Write: waiting on mWriteCv");
         mWriteCv.wait(mLock);
+        mWriterWaiting = 0;
         if (mSkipWrite) {
             ALOGV("Write: Flushing the previous write buffer");
             mSkipWrite = false;
@@ -881,7 +962,7 @@ status_t AudioSessionOutALSA::openDevice(char *useCase, bool bIsUseCase, int dev
     alsa_handle.session     = this;
     if (useCase) {
         ALOGV("openDevice: usecase %s bIsUseCase:%d devices:%x", useCase, bIsUseCase, devices);
-        strlcpy(alsa_handle.useCase, useCase, sizeof(alsa_handle.useCase));
+        setHandleUseCase(&alsa_handle, useCase);
     } else {
         ALOGE("openDevice invalid useCase, return BAD_VALUE:%x",BAD_VALUE);
         return BAD_VALUE;
@@ -897,13 +978,11 @@ status_t AudioSessionOutALSA::openDevice(char *useCase, bool bIsUseCase, int dev
     //Set Tunnel or LPA bit if the playback over usb is tunnel or Lpa
     if((devices & AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET)||
         (devices & AudioSystem::DEVICE_OUT_DGTL_DOCK_HEADSET)){
-        if((!strcmp(useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER)) ||
-           (!strcmp(useCase, SND_USE_CASE_MOD_PLAY_LPA))) {
+        if(isLpaUseCase(alsa_handle.useCaseId)) {
             ALOGV("doRouting: LPA device switch to proxy");
             mParent->startUsbPlaybackIfNotStarted();
             mParent->musbPlaybackState |= USBPLAYBACKBIT_LPA;
-        } else if((!strcmp(useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-            (!strcmp(useCase, SND_USE_CASE_MOD_PLAY_TUNNEL))) {
+        } else if(isTunnelUseCase(alsa_handle.useCaseId)) {
             ALOGD("doRouting: Tunnel Player device switch to proxy");
             mParent->startUsbPlaybackIfNotStarted();
             mParent->musbPlaybackState |= USBPLAYBACKBIT_TUNNEL;
@@ -915,7 +994,7 @@ status_t AudioSessionOutALSA::openDevice(char *useCase, bool bIsUseCase, int dev
         ALOGE("Could not open the ALSA device for use case %s", alsa_handle.useCase);
         mAlsaDevice->close(&alsa_handle);
     } else{
-        mParent->mDeviceList.push_back(alsa_handle);
+        mParent->addHandle_l(alsa_handle);
     }
     return status;
 }
@@ -952,6 +1031,43 @@ status_t AudioSessionOutALSA::setParameters(const String8& keyValuePairs)
         }
         param.remove(key);
     }
+    if (mTunnelMode) {
+        int val;
+        bool metadata = false;
+
+        key = String8(GAPLESS_KEY_DELAY);
+        if (param.getInt(key, val) == NO_ERROR) {
+            mEncoderDelay = val;
+            metadata = true;
+            param.remove(key);
+        }
+        key = String8(GAPLESS_KEY_PADDING);
+        if (param.getInt(key, val) == NO_ERROR) {
+            mEncoderPadding = val;
+            metadata = true;
+            param.remove(key);
+        }
+        //Metadata is sent with the first write of the track it belongs to
+        if (metadata) {
+            mMetadataPending = true;
+        }
+        key = String8(GAPLESS_KEY_NEXT_TRACK);
+        if (param.getInt(key, val) == NO_ERROR) {
+            if (val) {
+                startNextTrack_l();
+            }
+            param.remove(key);
+        }
+        //Blocks the caller until the previous track is rendered, the next
+        //one can then be written without a gap
+        key = String8(GAPLESS_KEY_PARTIAL_DRAIN);
+        if (param.getInt(key, val) == NO_ERROR) {
+            if (val) {
+                partialDrain_l();
+            }
+            param.remove(key);
+        }
+    }
 #ifdef QCOM_ADSP_SSR_ENABLED
     key = String8(AudioParameter::keyADSPStatus);
     if (param.get(key, value) == NO_ERROR) {
@@ -986,6 +1102,18 @@ String8 AudioSessionOutALSA::getParameters(const String8& keys)
         param.addInt(key, (int)mAlsaHandle->devices);
     }
 
+    key = String8(GAPLESS_KEY_STATS);
+    if (param.get(key, value) == NO_ERROR) {
+        char stats[128];
+        snprintf(stats, sizeof(stats), "%u,%lld,%lld,%lld,%lld",
+                 mGaplessStats.transitions, (long long)mGaplessStats.lastGapUs,
+                 (long long)mGaplessStats.maxGapUs,
+                 (long long)(mGaplessStats.transitions ?
+                     mGaplessStats.totalGapUs / mGaplessStats.transitions : 0),
+                 (long long)mGaplessStats.lastDrainUs);
+        param.add(key, String8(stats));
+    }
+
     ALOGV("getParameters() %s", param.toString().string());
     return param.toString();
 }
@@ -996,12 +1124,10 @@ void AudioSessionOutALSA::reset() {
 
 #ifdef QCOM_USBAUDIO_ENABLED
     if (mParent->musbPlaybackState) {
-        if((!strcmp(mAlsaHandle->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER)) ||
-            (!strcmp(mAlsaHandle->useCase, SND_USE_CASE_MOD_PLAY_LPA))) {
+        if(isLpaUseCase(mAlsaHandle->useCaseId)) {
             ALOGV("Deregistering LPA bit: musbPlaybackState =%d",mParent->musbPlaybackState);
             mParent->musbPlaybackState &= ~USBPLAYBACKBIT_LPA;
-        } else if((!strcmp(mAlsaHandle->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL)) ||
-                 (!strcmp(mAlsaHandle->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL))) {
+        } else if(isTunnelUseCase(mAlsaHandle->useCaseId)) {
             ALOGV("Deregistering Tunnel Player bit: musbPlaybackState =%d",mParent->musbPlaybackState);
             mParent->musbPlaybackState &= ~USBPLAYBACKBIT_TUNNEL;
         }
@@ -1017,33 +1143,29 @@ void AudioSessionOutALSA::reset() {
     mParent->closeUsbPlaybackIfNothingActive();
 #endif
     ALOGV("Erase device list");
-    for(ALSAHandleList::iterator it = mParent->mDeviceList.begin();
-            it != mParent->mDeviceList.end(); ++it) {
-        if((!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL,
-                            strlen(SND_USE_CASE_VERB_HIFI_TUNNEL))) ||
-           (!strncmp(it->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL,
-                            strlen(SND_USE_CASE_MOD_PLAY_TUNNEL))) ||
-           (!strncmp(it->useCase, SND_USE_CASE_VERB_HIFI_LOW_POWER,
-                            strlen(SND_USE_CASE_VERB_HIFI_LOW_POWER))) ||
-           (!strncmp(it->useCase, SND_USE_CASE_MOD_PLAY_LPA,
-                            strlen(SND_USE_CASE_MOD_PLAY_LPA)))) {
-            mParent->mDeviceList.erase(it);
+    for (int i = 0; i < mParent->mHandleIndex.size(); i++) {
+        alsa_handle_t *handle = mParent->mHandleIndex.at(i);
+        if (mParent->useCaseIdToEnum(handle->useCaseId) &
+            (AudioHardwareALSA::USECASE_HIFI_TUNNEL |
+             AudioHardwareALSA::USECASE_HIFI_LOW_POWER)) {
+            mParent->removeHandle_l(handle);
             break;
         }
     }
     mParent->mLock.unlock();
 }
-void AudioSessionOutALSA::updateMetaData(size_t bytes) {
-    mOutputMetadataTunnel.metadataLength = sizeof(mOutputMetadataTunnel);
-    mOutputMetadataTunnel.timestamp = 0;
-    mOutputMetadataTunnel.bufferLength =  bytes;
+void AudioSessionOutALSA::updateMetaData(output_metadata_handle_t *metadata, size_t bytes) {
+    metadata->metadataLength = sizeof(*metadata);
+    metadata->timestamp = 0;
+    metadata->bufferLength =  bytes;
+    memset(metadata->reserved, 0x0, sizeof(metadata->reserved));
     ALOGD("bytes = %d , mAlsaHandle->handle->period_size = %d, metadata = %d ",
-            mOutputMetadataTunnel.bufferLength, mAlsaHandle->handle->period_size, mOutputMetadataTunnel.metadataLength);
+            metadata->bufferLength, mAlsaHandle->handle->period_size, metadata->metadataLength);
 }
 
 status_t AudioSessionOutALSA::drainAndPostEOS_l()
 {
-    if (!mFilledQueue.empty()) {
+    if (filledCount()) {
         ALOGD("drainAndPostEOS called without empty mFilledQueue");
         return INVALID_OPERATION;
     }
@@ -1059,10 +1181,7 @@ status_t AudioSessionOutALSA::drainAndPostEOS_l()
     }
 
     mSkipEOS = false;
-    if ((!strncmp(mAlsaHandle->useCase, SND_USE_CASE_VERB_HIFI_TUNNEL,
-                  strlen(SND_USE_CASE_VERB_HIFI_TUNNEL))) ||
-       (!strncmp(mAlsaHandle->useCase, SND_USE_CASE_MOD_PLAY_TUNNEL,
-                  strlen(SND_USE_CASE_MOD_PLAY_TUNNEL)))) {
+    if (isTunnelUseCase(mAlsaHandle->useCaseId)) {
         ALOGD("Audio Drain DONE ++");
         mLock.unlock(); //to allow flush()
         int ret = ioctl(mAlsaHandle->handle->fd, SNDRV_COMPRESS_DRAIN);
@@ -1104,6 +1223,105 @@ status_t AudioSessionOutALSA::drainAndPostEOS_l()
     return OK;
 }
 
+status_t AudioSessionOutALSA::setGaplessMetadata_l()
+{
+    status_t err = NO_ERROR;
+
+    mMetadataPending = false;
+    ALOGD("Gapless metadata: delay %u padding %u", mEncoderDelay, mEncoderPadding);
+#ifdef SNDRV_COMPRESS_SET_METADATA
+    struct snd_compr_metadata metadata;
+
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.key = SNDRV_COMPRESS_ENCODER_DELAY;
+    metadata.value[0] = mEncoderDelay;
+    if (ioctl(mAlsaHandle->handle->fd, SNDRV_COMPRESS_SET_METADATA, &metadata) < 0) {
+        ALOGE("Failed to set encoder delay, errno %d", errno);
+        err = -errno;
+    }
+    metadata.key = SNDRV_COMPRESS_ENCODER_PADDING;
+    metadata.value[0] = mEncoderPadding;
+    if (ioctl(mAlsaHandle->handle->fd, SNDRV_COMPRESS_SET_METADATA, &metadata) < 0) {
+        ALOGE("Failed to set encoder padding, errno %d", errno);
+        err = -errno;
+    }
+#else
+    ALOGW("Compressed driver has no gapless metadata, delay/padding not trimmed");
+#endif
+    return err;
+}
+
+status_t AudioSessionOutALSA::startNextTrack_l()
+{
+    if (!mAlsaHandle || !mAlsaHandle->handle) {
+        return NO_INIT;
+    }
+    if (mPartialDrainPending) {
+        ALOGW("next_track while the previous boundary is still draining");
+    }
+
+    //Everything queued so far belongs to the previous track
+    mTrackBoundary = mRing.queued();
+    mTransitionStart = systemTime();
+    mPartialDrainPending = true;
+    mNextTrackFirstWrite = true;
+    ALOGD("Gapless boundary after buffer %d", mTrackBoundary);
+#ifdef SNDRV_COMPRESS_NEXT_TRACK
+    if (ioctl(mAlsaHandle->handle->fd, SNDRV_COMPRESS_NEXT_TRACK) < 0) {
+        ALOGE("SNDRV_COMPRESS_NEXT_TRACK failed, errno %d", errno);
+        return -errno;
+    }
+#endif
+    return NO_ERROR;
+}
+
+status_t AudioSessionOutALSA::partialDrain_l()
+{
+    if (!mPartialDrainPending) {
+        ALOGV("Partial drain without a pending track boundary");
+        return NO_ERROR;
+    }
+#ifdef SNDRV_COMPRESS_PARTIAL_DRAIN
+    //Returns once the previous track is rendered and the DSP moved on to
+    //the next one, which is already queued behind it
+    mLock.unlock(); //to allow flush()
+    int ret = ioctl(mAlsaHandle->handle->fd, SNDRV_COMPRESS_PARTIAL_DRAIN);
+    int err = errno;
+    mLock.lock();
+    if (ret < 0 && err != EINTR) {
+        ALOGE("Partial drain failed with errno %s", strerror(err));
+        waitForTrackBoundary_l();
+    }
+#else
+    waitForTrackBoundary_l();
+#endif
+    if (!mPartialDrainPending) {
+        ALOGD("Partial drain interrupted by flush");
+        return NO_ERROR;
+    }
+    mPartialDrainPending = false;
+    mGaplessStats.lastDrainUs = ns2us(systemTime() - mTransitionStart);
+    ALOGD("Gapless partial drain done %lld us after the boundary",
+          (long long)mGaplessStats.lastDrainUs);
+    return NO_ERROR;
+}
+
+//Without the ioctl the previous track is done once the driver returned
+//every buffer queued before the boundary
+void AudioSessionOutALSA::waitForTrackBoundary_l()
+{
+    while (mPartialDrainPending && !partialDrainDue() && mEventThreadAlive) {
+        //Announce the wait before checking again, the event thread only
+        //takes mLock to signal when it sees the flag
+        mPartialDrainWaiting = 1;
+        __sync_synchronize();
+        if (partialDrainDue())
+            break;
+        mPartialDrainCv.wait(mLock);
+    }
+    mPartialDrainWaiting = 0;
+}
+
 status_t AudioSessionOutALSA::setMetaDataMode() {
 
     status_t err = NO_ERROR;
@@ -0,0 +1,95 @@
+/* AudioStrategyCache.h
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef ANDROID_AUDIO_STRATEGY_CACHE_H
+#define ANDROID_AUDIO_STRATEGY_CACHE_H
+
+#include <stdint.h>
+
+//Routing strategies a cache can hold, at least NUM_STRATEGIES
+#define AUDIO_STRATEGY_CACHE_SLOTS      16
+
+namespace android_audio_legacy
+{
+
+/* Memo of resolved strategy devices. The owner calls invalidate() whenever
+ * one of the inputs of the resolution changes, a lookup is then a bit test
+ * instead of a walk down the routing rules.
+ */
+class AudioStrategyCache {
+public:
+    AudioStrategyCache()
+    {
+        mValid = 0;
+        mHits = 0;
+        mMisses = 0;
+        mFlushes = 0;
+    }
+
+    void invalidate()
+    {
+        if (mValid)
+            mFlushes++;
+        mValid = 0;
+    }
+
+    bool lookup(int strategy, uint32_t *device)
+    {
+        if (strategy >= 0 && strategy < AUDIO_STRATEGY_CACHE_SLOTS &&
+            (mValid & (1u << strategy))) {
+            *device = mDevice[strategy];
+            mHits++;
+            return true;
+        }
+        mMisses++;
+        return false;
+    }
+
+    void store(int strategy, uint32_t device)
+    {
+        if (strategy < 0 || strategy >= AUDIO_STRATEGY_CACHE_SLOTS)
+            return;
+        mDevice[strategy] = device;
+        mValid |= 1u << strategy;
+    }
+
+    uint32_t hits() const { return mHits; }
+    uint32_t misses() const { return mMisses; }
+    uint32_t flushes() const { return mFlushes; }
+
+private:
+    uint32_t mValid;
+    uint32_t mDevice[AUDIO_STRATEGY_CACHE_SLOTS];
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mFlushes;
+};
+
+};        // namespace android_audio_legacy
+#endif    // ANDROID_AUDIO_STRATEGY_CACHE_H
@@ -61,6 +61,24 @@ namespace android_audio_legacy
 
 // Use AAC/DTS channel mapping as default channel mapping: C,FL,FR,Ls,Rs,LFE
 const int chanMap[] = { 1, 2, 4, 3, 0, 5 };
+
+// Real filters first, then imaginary, in the order the library expects them
+static const char * const surroundCoeffFiles[2 * COEFF_ARRAY_SIZE] = {
+    SURROUND_FILE_1R, SURROUND_FILE_2R, SURROUND_FILE_3R, SURROUND_FILE_4R,
+    SURROUND_FILE_1I, SURROUND_FILE_2I, SURROUND_FILE_3I, SURROUND_FILE_4I,
+};
+
+// The filter coefficients are the same for every SSR stream, so the files
+// are read once per process. The filter library is handed writable arrays
+// and nothing says it leaves them alone, so every stream works on a copy.
+static struct {
+    Mutex    lock;
+    bool     loaded;
+    Word16   *data;
+    uint32_t loads;
+    uint32_t hits;
+    int64_t  loadTimeUs;
+} sSurroundCoeffs;
 #endif
 
 AudioStreamInALSA::AudioStreamInALSA(AudioHardwareALSA *parent,
@@ -69,17 +87,20 @@ AudioStreamInALSA::AudioStreamInALSA(AudioHardwareALSA *parent,
     ALSAStreamOps(parent, handle),
     mFramesLost(0),
     mParent(parent),
-    mAcoustics(audio_acoustics)
+    mAcoustics(audio_acoustics),
+    mFramesPerRead(0)
 #ifdef QCOM_SSR_ENABLED
     , mFp_4ch(NULL),
     mFp_6ch(NULL),
     mRealCoeffs(NULL),
     mImagCoeffs(NULL),
+    mCoeffData(NULL),
     mSurroundObj(NULL),
     mSurroundOutputBuffer(NULL),
     mSurroundInputBuffer(NULL),
-    mSurroundOutputBufferIdx(0),
-    mSurroundInputBufferIdx(0)
+    mSurroundInputBufferIdx(0),
+    mSurroundOutputRead(0),
+    mSurroundOutputFill(0)
 #endif
 {
 #ifdef QCOM_SSR_ENABLED
@@ -88,10 +109,7 @@ AudioStreamInALSA::AudioStreamInALSA(AudioHardwareALSA *parent,
 
     // Call surround sound library init if device is Surround Sound
     if ( handle->channels == 6) {
-        if (!strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC, strlen(SND_USE_CASE_VERB_HIFI_REC))
-            || !strncmp(handle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, strlen(SND_USE_CASE_VERB_HIFI_REC_COMPRESSED))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC))
-            || !strncmp(handle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, strlen(SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED))) {
+        if (isHiFiRecUseCase(handle->useCaseId)) {
 
             err = initSurroundSoundLibrary(handle->bufferSize);
             if ( NO_ERROR != err) {
@@ -141,15 +159,14 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
     int n;
     status_t          err;
     size_t            read = 0;
-    char              *use_case;
+    int               verb_id;
     int newMode = mParent->mode();
 
     if((mHandle->handle == NULL) && (mHandle->rxHandle == NULL) &&
-        (strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) &&
-        (strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+        !isVoipUseCase(mHandle->useCaseId)) {
         mParent->mLock.lock();
-        snd_use_case_get(mHandle->ucMgr, "_verb", (const char **)&use_case);
-        if ((use_case != NULL) && (strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
+        verb_id = snd_use_case_get_verb_id(mHandle->ucMgr);
+        if ((verb_id != SND_UCM_ID_NONE) && (verb_id != SND_UCM_ID_VERB_INACTIVE)) {
             if ((mHandle->devices == AudioSystem::DEVICE_IN_VOICE_CALL) &&
                 (newMode == AUDIO_MODE_IN_CALL)) {
                 ALOGD("read:: mParent->mIncallMode=%d", mParent->mIncallMode);
@@ -158,8 +175,7 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 #ifdef QCOM_CSDCLIENT_ENABLED
                     if (mParent->mFusion3Platform) {
                         mParent->mALSADevice->setVocRecMode(INCALL_REC_STEREO);
-                        strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_VOICE,
-                                sizeof(mHandle->useCase));
+                        mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_VOICE);
                         if (csd_start_record == NULL) {
                             ALOGE("csd_start_record is NULL");
                         } else {
@@ -169,19 +185,16 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 #endif
                     {
                         if (mHandle->format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL);
                         } else {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_UL_DL,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_VOICE_UL_DL);
                         }
                     }
                 } else if (mParent->mIncallMode & AUDIO_CHANNEL_IN_VOICE_DNLINK) {
 #ifdef QCOM_CSDCLIENT_ENABLED
                     if (mParent->mFusion3Platform) {
                         mParent->mALSADevice->setVocRecMode(INCALL_REC_MONO);
-                        strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_VOICE,
-                                sizeof(mHandle->useCase));
+                        mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_VOICE);
                         if (csd_start_record == NULL) {
                             ALOGE("csd_start_record is NULL");
                         } else {
@@ -191,11 +204,9 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 #endif
                     {
                         if (mHandle->format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_DL,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_DL);
                         } else {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_DL,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_VOICE_DL);
                         }
                     }
                 } else if (mParent->mIncallMode & AUDIO_CHANNEL_IN_VOICE_UPLINK) {
@@ -203,30 +214,28 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
                         /* Use normal audio recording for Fusion3 target, this behavior
                            will be changed in Fusion4
                          */
-                        strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC,
-                                sizeof(SND_USE_CASE_MOD_CAPTURE_MUSIC));
+                        mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_MUSIC);
                     } else {
-                        strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_VOICE_UL,
-                                sizeof(SND_USE_CASE_MOD_CAPTURE_VOICE_UL));
+                        mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_VOICE_UL);
                     }
                 }
 #ifdef QCOM_FM_ENABLED
             } else if(mHandle->devices == AudioSystem::DEVICE_IN_FM_RX) {
-                strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_FM, sizeof(mHandle->useCase));
+                mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_FM);
             } else if (mHandle->devices == AudioSystem::DEVICE_IN_FM_RX_A2DP) {
-                strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_A2DP_FM, sizeof(mHandle->useCase));
+                mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_A2DP_FM);
 #endif
-            } else if(!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP)) {
-                strlcpy(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP, sizeof(mHandle->useCase));
+            } else if(mHandle->useCaseId == SND_UCM_ID_MOD_PLAY_VOIP) {
+                mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_PLAY_VOIP);
             } else {
                 char value[128];
                 property_get("persist.audio.lowlatency.rec",value,"0");
                 if (!strcmp("true", value)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_LOWLATENCY_MUSIC, sizeof(mHandle->useCase));
-                } else if(!strcmp(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED, sizeof(mHandle->useCase));
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_LOWLATENCY_MUSIC);
+                } else if(mHandle->useCaseId == SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED) {
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED);
                 } else {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_MUSIC, sizeof(mHandle->useCase));
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_CAPTURE_MUSIC);
                 }
             }
         } else {
@@ -239,8 +248,7 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
                     if (mParent->mFusion3Platform) {
                         ALOGD("AudioStreamInALSA: check useCase: %s", mHandle->useCase);
                         mParent->mALSADevice->setVocRecMode(INCALL_REC_STEREO);
-                        strlcpy(mHandle->useCase, SND_USE_CASE_VERB_INCALL_REC,
-                                sizeof(mHandle->useCase));
+                        mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_INCALL_REC);
                        if (csd_start_record == NULL) {
                            ALOGE("csd_start_record is NULL");
                        } else {
@@ -251,11 +259,9 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 #endif
                     {
                         if (mHandle->format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL);
                         } else {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_VERB_UL_DL_REC,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_UL_DL_REC);
                         }
                     }
                 } else if (mParent->mIncallMode & AUDIO_CHANNEL_IN_VOICE_DNLINK) {
@@ -263,8 +269,7 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
                    if (mParent->mFusion3Platform) {
                         ALOGD("AudioStreamInALSA: check useCase: %s", mHandle->useCase);
                        mParent->mALSADevice->setVocRecMode(INCALL_REC_MONO);
-                       strlcpy(mHandle->useCase, SND_USE_CASE_VERB_INCALL_REC,
-                               sizeof(mHandle->useCase));
+                       mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_INCALL_REC);
                        if (csd_start_record == NULL) {
                            ALOGE("csd_start_record is NULL");
                        } else {
@@ -274,46 +279,40 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 #endif
                    {
                         if (mHandle->format == AUDIO_FORMAT_AMR_WB) {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_DL,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_DL);
                         }
                         else {
-                            strlcpy(mHandle->useCase, SND_USE_CASE_VERB_DL_REC,
-                                    sizeof(mHandle->useCase));
+                            mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_DL_REC);
                         }
                    }
                 } else if (mParent->mIncallMode & AUDIO_CHANNEL_IN_VOICE_UPLINK) {
                     if (mParent->mFusion3Platform) {
-                        strlcpy(mHandle->useCase, SND_USE_CASE_VERB_HIFI_REC,
-                                sizeof(SND_USE_CASE_VERB_HIFI_REC));
+                        mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_HIFI_REC);
                     } else {
-                        strlcpy(mHandle->useCase, SND_USE_CASE_VERB_UL_REC,
-                                sizeof(SND_USE_CASE_VERB_UL_REC));
+                        mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_UL_REC);
                     }
                 }
 #ifdef QCOM_FM_ENABLED
             } else if(mHandle->devices == AudioSystem::DEVICE_IN_FM_RX) {
-                strlcpy(mHandle->useCase, SND_USE_CASE_VERB_FM_REC, sizeof(mHandle->useCase));
+                mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_FM_REC);
         } else if (mHandle->devices == AudioSystem::DEVICE_IN_FM_RX_A2DP) {
-                strlcpy(mHandle->useCase, SND_USE_CASE_VERB_FM_A2DP_REC, sizeof(mHandle->useCase));
+                mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_FM_A2DP_REC);
 #endif
-            } else if(!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)){
-                    strlcpy(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL, sizeof(mHandle->useCase));
-            } else if(!strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED)){
-                strlcpy(mHandle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED, sizeof(mHandle->useCase));
+            } else if(mHandle->useCaseId == SND_UCM_ID_VERB_IP_VOICECALL){
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_IP_VOICECALL);
+            } else if(mHandle->useCaseId == SND_UCM_ID_VERB_HIFI_REC_COMPRESSED){
+                mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_HIFI_REC_COMPRESSED);
             } else {
                 char value[128];
                 property_get("persist.audio.lowlatency.rec",value,"0");
                 if (!strcmp("true", value)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_REC, sizeof(mHandle->useCase));
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_HIFI_LOWLATENCY_REC);
                 } else {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_VERB_HIFI_REC, sizeof(mHandle->useCase));
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_HIFI_REC);
                 }
             }
         }
-        free(use_case);
-        if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-            (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+        if (isVoipUseCase(mHandle->useCaseId)) {
 #ifdef QCOM_USBAUDIO_ENABLED
             if((mDevices & AudioSystem::DEVICE_IN_ANLG_DOCK_HEADSET) ||
                (mDevices & AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET)) {
@@ -335,21 +334,12 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
                 mHandle->module->route(mHandle, mDevices , mParent->mode());
             }
         }
-        if (!strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI_REC) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_REC) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI_REC_COMPRESSED) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_FM_REC) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_FM_A2DP_REC) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_UL_DL_REC) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_DL_REC) ||
-            !strcmp(mHandle->useCase, SND_USE_CASE_VERB_INCALL_REC)) {
-            snd_use_case_set(mHandle->ucMgr, "_verb", mHandle->useCase);
+        if (SND_UCM_ID_IS_VERB(mHandle->useCaseId)) {
+            snd_use_case_set_id(mHandle->ucMgr, "_verb", mHandle->useCaseId);
         } else {
-            snd_use_case_set(mHandle->ucMgr, "_enamod", mHandle->useCase);
+            snd_use_case_set_id(mHandle->ucMgr, "_enamod", mHandle->useCaseId);
         }
-       if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-           (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+       if (isVoipUseCase(mHandle->useCaseId)) {
             err = mHandle->module->startVoipCall(mHandle);
         }
         else
@@ -363,8 +353,7 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 #ifdef QCOM_USBAUDIO_ENABLED
         if((mHandle->devices == AudioSystem::DEVICE_IN_ANLG_DOCK_HEADSET)||
            (mHandle->devices == AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET)){
-            if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-               (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+            if (isVoipUseCase(mHandle->useCaseId)) {
                 mParent->musbRecordingState |= USBRECBIT_VOIPCALL;
             } else {
                 mParent->startUsbRecordingIfNotStarted();
@@ -381,8 +370,7 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
         mParent->mLock.lock();
         ALOGD("Starting UsbRecording thread");
         mParent->startUsbRecordingIfNotStarted();
-        if(!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL) ||
-           !strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP)) {
+        if (isVoipUseCase(mHandle->useCaseId)) {
             ALOGD("Enabling voip recording bit");
             mParent->musbRecordingState |= USBRECBIT_VOIPCALL;
         }else{
@@ -397,126 +385,49 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 
 #ifdef QCOM_SSR_ENABLED
     if (mSurroundObj) {
-        int processed = 0;
-        int processed_pending;
-        int samples = bytes >> 1;
-        void *buffer_start = buffer;
-        int period_bytes = mHandle->handle->period_size;
-        int period_samples = period_bytes >> 1;
-
-        do {
-            if (mSurroundOutputBufferIdx > 0) {
-                ALOGV("AudioStreamInALSA::read() - copy processed output "
-                     "to buffer, mSurroundOutputBufferIdx = %d",
-                     mSurroundOutputBufferIdx);
-                // Copy processed output to buffer
-                processed_pending = mSurroundOutputBufferIdx;
-                if (processed_pending > (samples - processed)) {
-                    processed_pending = (samples - processed);
-                }
-                memcpy(buffer, mSurroundOutputBuffer, processed_pending * sizeof(Word16));
-                buffer += processed_pending * sizeof(Word16);
-                processed += processed_pending;
-                if (mSurroundOutputBufferIdx > processed_pending) {
-                    // Shift leftover samples to beginning of the buffer
-                    memcpy(&mSurroundOutputBuffer[0],
-                           &mSurroundOutputBuffer[processed_pending],
-                           (mSurroundOutputBufferIdx - processed_pending) * sizeof(Word16));
-                }
-                mSurroundOutputBufferIdx -= processed_pending;
-            }
-
-            if (processed >= samples) {
-                ALOGV("AudioStreamInALSA::read() - done processing buffer, "
-                     "processed = %d", processed);
-                // Done processing this buffer
-                break;
-            }
-
-            // Fill input buffer until there is enough to process
-            read_pending = SSR_INPUT_FRAME_SIZE - mSurroundInputBufferIdx;
-            read = mSurroundInputBufferIdx;
-            while (mHandle->handle && read_pending > 0) {
-                n = pcm_read(mHandle->handle, &mSurroundInputBuffer[read],
-                             period_bytes);
-                ALOGV("pcm_read() returned n = %d buffer:%p size:%d", n, &mSurroundInputBuffer[read], period_bytes);
-                if (n && n != -EAGAIN) {
-                    //Recovery part of pcm_read. TODO:split recovery.
-                    return static_cast<ssize_t>(n);
-                }
-                else if (n < 0) {
-                    // Recovery is part of pcm_write. TODO split is later.
-                    return static_cast<ssize_t>(n);
-                }
-                else {
-                    read_pending -= period_samples;
-                    read += period_samples;
-                }
-            }
-
-
-            if (mFp_4ch) {
-                fwrite( mSurroundInputBuffer, 1,
-                        SSR_INPUT_FRAME_SIZE * sizeof(Word16), mFp_4ch);
-            }
-
-            //apply ssr libs to conver 4ch to 6ch
-            surround_filters_intl_process(mSurroundObj,
-                &mSurroundOutputBuffer[mSurroundOutputBufferIdx],
-                (Word16 *)mSurroundInputBuffer);
-
-            // Shift leftover samples to beginning of input buffer
-            if (read_pending < 0) {
-                memcpy(&mSurroundInputBuffer[0],
-                       &mSurroundInputBuffer[SSR_INPUT_FRAME_SIZE],
-                       (-read_pending) * sizeof(Word16));
-            }
-            mSurroundInputBufferIdx = -read_pending;
-
-            if (mFp_6ch) {
-                fwrite( &mSurroundOutputBuffer[mSurroundOutputBufferIdx],
-                        1, SSR_OUTPUT_FRAME_SIZE * sizeof(Word16), mFp_6ch);
-            }
-
-            mSurroundOutputBufferIdx += SSR_OUTPUT_FRAME_SIZE;
-            ALOGV("do_while loop: processed=%d, samples=%d\n", processed, samples);
-        } while (mHandle->handle && processed < samples);
-        read = processed * sizeof(Word16);
-        buffer = buffer_start;
+        ssize_t ret = readSurround((char *)buffer, bytes);
+        if (ret < 0) {
+            return ret;
+        }
+        read = ret;
     } else
 #endif
     if (mHandle->format == AUDIO_FORMAT_AMR_WB &&
-        (strncmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL, strlen(SND_USE_CASE_VERB_IP_VOICECALL))) &&
-        (strncmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP, strlen(SND_USE_CASE_MOD_PLAY_VOIP)))) {
+        !isVoipUseCase(mHandle->useCaseId)) {
         ALOGV("AUDIO_FORMAT_AMR_WB");
-        do {
-            if (read_pending < 61) {
-                read_pending = 61;
-            }
-            //We should pcm_read period_size to get complete data from driver
-            n = pcm_read(mHandle->handle, buffer, period_size);
-            if (n < 0) {
-                ALOGE("pcm_read() returned failure: %d", n);
+        uint32_t frames = 0;
+
+        if (!mFrameReader.initialized() || mFrameReader.periodSize() != period_size) {
+            char value[PROPERTY_VALUE_MAX];
+            if (mFrameReader.init(period_size, sizeof(struct snd_compr_audio_info))) {
+                ALOGE("AMR WB frame reader init failed for period size %d", period_size);
                 return 0;
-            } else {
-                struct snd_compr_audio_info *header = (struct snd_compr_audio_info *) buffer;
-                if (header->frame_size > 0) {
-                    if (sizeof(*header) + header->reserved[0] + header->frame_size > period_size) {
-                        ALOGE("AMR WB read buffer overflow. Assign bigger buffer size");
-                        header->frame_size = period_size - sizeof(*header) - header->reserved[0];
-                    }
-                    read += header->frame_size;
-                    read_pending -= header->frame_size;
-                    ALOGV("buffer: %p, data offset: %p, header size: %u, reserved[0]: %u",
-                            buffer, ((uint8_t*)buffer) + sizeof(*header) + header->reserved[0],
-                            sizeof(*header), header->reserved[0]);
-                    memmove(buffer, ((uint8_t*)buffer) + sizeof(*header) + header->reserved[0], header->frame_size);
-                    buffer += header->frame_size;
-                } else {
+            }
+            property_get("audio.record.amrwb.frames", value, "0");
+            mFramesPerRead = atoi(value);
+        }
+        do {
+            //We should pcm_read period_size to get complete data from driver,
+            //a frame left over from the last read is returned first
+            if (!mFrameReader.pendingSize()) {
+                n = pcm_read(mHandle->handle, mFrameReader.periodBuffer(), period_size);
+                if (n < 0) {
+                    ALOGE("pcm_read() returned failure: %d", n);
+                    return 0;
+                }
+                if (!mFrameReader.parsePeriod(period_size)) {
                     ALOGW("pcm_read() with zero frame size");
+                    continue;
                 }
             }
-        } while (mHandle->handle && read < bytes);
+            //Only whole frames, unless a single frame exceeds the buffer
+            if (read && read + mFrameReader.pendingSize() > (size_t)bytes) {
+                break;
+            }
+            read += mFrameReader.emitFrame((uint8_t *)buffer + read, bytes - read);
+            frames++;
+        } while (mHandle->handle && read < (size_t)bytes &&
+                 (!mFramesPerRead || frames < mFramesPerRead));
     } else
     {
 
@@ -528,14 +439,18 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
             n = pcm_read(mHandle->handle, buffer,
                 period_size);
             ALOGV("pcm_read() returned n = %d", n);
-            if (n && (n == -EIO || n == -EAGAIN || n == -EPIPE || n == -EBADFD)) {
+            if (n && (n == -EIO || n == -EAGAIN || n == -EPIPE || n == -EBADFD ||
+                      n == -ESTRPIPE)) {
+                if (recoverXrun(mHandle->handle, n)) {
+                    continue;
+                }
+                nsecs_t reopenStart = systemTime();
                 mParent->mLock.lock();
                 if (mHandle->handle != NULL) {
                     ALOGW("pcm_read() returned error n %d, Recovering from error\n", n);
                     pcm_close(mHandle->handle);
                     mHandle->handle = NULL;
-                    if((!strncmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL, strlen(SND_USE_CASE_VERB_IP_VOICECALL))) ||
-                    (!strncmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP, strlen(SND_USE_CASE_MOD_PLAY_VOIP)))) {
+                    if (isVoipUseCase(mHandle->useCaseId)) {
                         if (mHandle->rxHandle) {
                             pcm_close(mHandle->rxHandle);
                             mHandle->rxHandle = NULL;
@@ -551,6 +466,7 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
                         }
                         mHandle->module->open(mHandle);
                     }
+                    reopenDone(reopenStart);
                     if(mHandle->handle == NULL) {
                        ALOGE("read:: PCM device re-open failed");
                        mParent->mLock.unlock();
@@ -565,6 +481,7 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
                 return static_cast<ssize_t>(n);
             }
             else {
+                transferDone();
                 read += static_cast<ssize_t>((period_size));
                 read_pending -= period_size;
                 buffer += period_size;
@@ -576,8 +493,110 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
     return read;
 }
 
+#ifdef QCOM_SSR_ENABLED
+ssize_t AudioStreamInALSA::readSurround(char *buffer, size_t bytes)
+{
+    int samples = bytes >> 1;
+    int processed = 0;
+    int period_samples = mHandle->handle->period_size >> 1;
+    int n;
+
+    while (mHandle->handle && processed < samples) {
+        // Copy processed output to buffer, leftovers stay in place and are
+        // consumed through the read offset on the next call
+        if (mSurroundOutputFill > 0) {
+            int pending = mSurroundOutputFill;
+            if (pending > (samples - processed)) {
+                pending = samples - processed;
+            }
+            memcpy(buffer + processed * sizeof(Word16),
+                   &mSurroundOutputBuffer[mSurroundOutputRead],
+                   pending * sizeof(Word16));
+            processed += pending;
+            mSurroundOutputRead += pending;
+            mSurroundOutputFill -= pending;
+            continue;
+        }
+
+        // Fill the input frame. Reads are sized to end exactly on the frame
+        // boundary, so there is never a remainder to move to the front.
+        while (mHandle->handle && mSurroundInputBufferIdx < SSR_INPUT_FRAME_SIZE) {
+            int chunk = SSR_INPUT_FRAME_SIZE - mSurroundInputBufferIdx;
+            if (chunk > period_samples) {
+                chunk = period_samples;
+            }
+            n = pcm_read(mHandle->handle, &mSurroundInputBuffer[mSurroundInputBufferIdx],
+                         chunk * sizeof(Word16));
+            ALOGV("pcm_read() returned n = %d size:%d", n, chunk * sizeof(Word16));
+            if (n && n != -EAGAIN) {
+                //Recovery part of pcm_read. TODO:split recovery.
+                return static_cast<ssize_t>(n);
+            }
+            mSurroundInputBufferIdx += chunk;
+        }
+        if (!mHandle->handle) {
+            break;
+        }
+
+        if (mFp_4ch) {
+            fwrite( mSurroundInputBuffer, 1,
+                    SSR_INPUT_FRAME_SIZE * sizeof(Word16), mFp_4ch);
+        }
+
+        // Filter straight into the caller's buffer when a whole frame fits,
+        // only the tail of a read goes through the output buffer
+        Word16 *out = mSurroundOutputBuffer;
+        if (samples - processed >= SSR_OUTPUT_FRAME_SIZE) {
+            out = (Word16 *)(buffer + processed * sizeof(Word16));
+        }
+
+        //apply ssr libs to conver 4ch to 6ch
+        surround_filters_intl_process(mSurroundObj, out, mSurroundInputBuffer);
+        mSurroundInputBufferIdx = 0;
+
+        if (mFp_6ch) {
+            fwrite( out, 1, SSR_OUTPUT_FRAME_SIZE * sizeof(Word16), mFp_6ch);
+        }
+
+        if (out == mSurroundOutputBuffer) {
+            mSurroundOutputRead = 0;
+            mSurroundOutputFill = SSR_OUTPUT_FRAME_SIZE;
+        } else {
+            processed += SSR_OUTPUT_FRAME_SIZE;
+        }
+        ALOGV("readSurround: processed=%d, samples=%d", processed, samples);
+    }
+
+    return processed * sizeof(Word16);
+}
+#endif
+
 status_t AudioStreamInALSA::dump(int fd, const Vector<String16>& args)
 {
+    char buffer[256];
+
+    dumpRecovery(fd);
+    if (mFrameReader.initialized()) {
+        AudioCompressFrameStats stats;
+        mFrameReader.getStats(&stats);
+        snprintf(buffer, sizeof(buffer),
+                 "Compressed capture: %llu periods, %llu frames (%llu bytes),"
+                 " %u empty, %u clipped, %u frames per read\n",
+                 (unsigned long long)stats.periods, (unsigned long long)stats.frames,
+                 (unsigned long long)stats.bytes, stats.emptyPeriods, stats.clipped,
+                 mFramesPerRead);
+        ::write(fd, buffer, strlen(buffer));
+    }
+#ifdef QCOM_SSR_ENABLED
+    Mutex::Autolock autoLock(sSurroundCoeffs.lock);
+
+    snprintf(buffer, sizeof(buffer),
+             "SSR co-efficients: %s, %u loads, %u shared uses, load time %lld us\n",
+             sSurroundCoeffs.loaded ? "loaded" : "not loaded",
+             sSurroundCoeffs.loads, sSurroundCoeffs.hits,
+             (long long)sSurroundCoeffs.loadTimeUs);
+    ::write(fd, buffer, strlen(buffer));
+#endif
     return NO_ERROR;
 }
 
@@ -595,8 +614,7 @@ status_t AudioStreamInALSA::close()
     Mutex::Autolock autoLock(mParent->mLock);
 
     ALOGD("close");
-    if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-        (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+    if (isVoipUseCase(mHandle->useCaseId)) {
         if(mParent->mVoipInStreamCount||mParent->mVoipOutStreamCount) {
 #ifdef QCOM_USBAUDIO_ENABLED
             ALOGV("musbRecordingState: %d, mVoipInStreamCount:%d, mVoipOutStreamCount:%d",mParent->musbRecordingState,
@@ -626,8 +644,8 @@ status_t AudioStreamInALSA::close()
      }
 #ifdef QCOM_CSDCLIENT_ENABLED
     if (mParent->mFusion3Platform) {
-       if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_INCALL_REC)) ||
-           (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_VOICE))) {
+       if((mHandle->useCaseId == SND_UCM_ID_VERB_INCALL_REC) ||
+           (mHandle->useCaseId == SND_UCM_ID_MOD_CAPTURE_VOICE)) {
            if (csd_stop_record == NULL) {
                ALOGE("csd_stop_record is NULL");
            } else {
@@ -642,6 +660,7 @@ status_t AudioStreamInALSA::close()
 #endif
 
     ALSAStreamOps::close();
+    mFrameReader.reset();
 
 #ifdef QCOM_SSR_ENABLED
     if (mSurroundObj) {
@@ -649,26 +668,10 @@ status_t AudioStreamInALSA::close()
         if (mSurroundObj)
             free(mSurroundObj);
         mSurroundObj = NULL;
-        if (mRealCoeffs){
-            for (int i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-                if (mRealCoeffs[i]) {
-                    free(mRealCoeffs[i]);
-                    mRealCoeffs[i] = NULL;
-                }
-            }
-            free(mRealCoeffs);
-            mRealCoeffs = NULL;
-        }
-        if (mImagCoeffs){
-            for (int i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-                if (mImagCoeffs[i]) {
-                    free(mImagCoeffs[i]);
-                    mImagCoeffs[i] = NULL;
-                }
-            }
-            free(mImagCoeffs);
-            mImagCoeffs = NULL;
-        }
+        free(mCoeffData);
+        mCoeffData = NULL;
+        mRealCoeffs = NULL;
+        mImagCoeffs = NULL;
         if (mSurroundOutputBuffer){
             free(mSurroundOutputBuffer);
             mSurroundOutputBuffer = NULL;
@@ -693,15 +696,14 @@ status_t AudioStreamInALSA::standby()
 
     ALOGD("standby");
 
-    if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-        (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+    if (isVoipUseCase(mHandle->useCaseId)) {
          return NO_ERROR;
     }
 #ifdef QCOM_CSDCLIENT_ENABLED
     ALOGD("standby");
     if (mParent->mFusion3Platform) {
-       if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_INCALL_REC)) ||
-           (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_CAPTURE_VOICE))) {
+       if((mHandle->useCaseId == SND_UCM_ID_VERB_INCALL_REC) ||
+           (mHandle->useCaseId == SND_UCM_ID_MOD_CAPTURE_VOICE)) {
            if (csd_stop_record == NULL) {
                ALOGE("csd_stop_record is NULL");
            } else {
@@ -711,6 +713,7 @@ status_t AudioStreamInALSA::standby()
     }
 #endif
     mHandle->module->standby(mHandle);
+    mFrameReader.reset();
 
 #ifdef QCOM_USBAUDIO_ENABLED
     ALOGD("Checking for musbRecordingState %d", mParent->musbRecordingState);
@@ -751,7 +754,8 @@ status_t AudioStreamInALSA::initSurroundSoundLibrary(unsigned long buffersize)
     int ret = 0;
 
     mSurroundInputBufferIdx = 0;
-    mSurroundOutputBufferIdx = 0;
+    mSurroundOutputRead = 0;
+    mSurroundOutputFill = 0;
 
     if ( mSurroundObj ) {
         ALOGE("ola filter library is already initialized");
@@ -759,7 +763,7 @@ status_t AudioStreamInALSA::initSurroundSoundLibrary(unsigned long buffersize)
     }
 
     // Allocate memory for input buffer
-    mSurroundInputBuffer = (Word16 *) calloc(2 * SSR_INPUT_FRAME_SIZE,
+    mSurroundInputBuffer = (Word16 *) calloc(SSR_INPUT_FRAME_SIZE,
                                               sizeof(Word16));
     if ( !mSurroundInputBuffer ) {
        ALOGE("Memory allocation failure. Not able to allocate memory for surroundInputBuffer");
@@ -767,26 +771,13 @@ status_t AudioStreamInALSA::initSurroundSoundLibrary(unsigned long buffersize)
     }
 
     // Allocate memory for output buffer
-    mSurroundOutputBuffer = (Word16 *) calloc(2 * SSR_OUTPUT_FRAME_SIZE,
+    mSurroundOutputBuffer = (Word16 *) calloc(SSR_OUTPUT_FRAME_SIZE,
                                                sizeof(Word16));
     if ( !mSurroundOutputBuffer ) {
        ALOGE("Memory allocation failure. Not able to allocate memory for surroundOutputBuffer");
        goto init_fail;
     }
 
-    // Allocate memory for real and imag coeffs array
-    mRealCoeffs = (Word16 **) calloc(COEFF_ARRAY_SIZE, sizeof(Word16 *));
-    if ( !mRealCoeffs ) {
-        ALOGE("Memory allocation failure during real Coefficient array");
-        goto init_fail;
-    }
-
-    mImagCoeffs = (Word16 **) calloc(COEFF_ARRAY_SIZE, sizeof(Word16 *));
-    if ( !mImagCoeffs ) {
-        ALOGE("Memory allocation failure during imaginary Coefficient array");
-        goto init_fail;
-    }
-
     if( readCoeffsFromFile() != NO_ERROR) {
         ALOGE("Error while loading coeffs from file");
         goto init_fail;
@@ -849,130 +840,98 @@ init_fail:
         free(mSurroundInputBuffer);
         mSurroundInputBuffer = NULL;
     }
-    if (mRealCoeffs){
-        for (int i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-            if (mRealCoeffs[i]) {
-                free(mRealCoeffs[i]);
-                mRealCoeffs[i] = NULL;
-            }
-        }
-        free(mRealCoeffs);
-        mRealCoeffs = NULL;
-    }
-    if (mImagCoeffs){
-        for (int i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-            if (mImagCoeffs[i]) {
-                free(mImagCoeffs[i]);
-                mImagCoeffs[i] = NULL;
-            }
-        }
-        free(mImagCoeffs);
-        mImagCoeffs = NULL;
-    }
+    free(mCoeffData);
+    mCoeffData = NULL;
+    mRealCoeffs = NULL;
+    mImagCoeffs = NULL;
 
     return NO_MEMORY;
 
 }
 
 
-// Helper function to read coeffs from File and updates real and imaginary
-// coeff array member variable
-status_t AudioStreamInALSA::readCoeffsFromFile()
+// Reads one filter from the start of a coefficient file
+static status_t loadSurroundCoeffFile(const char *path, Word16 *coeffs)
 {
-    FILE    *flt1r;
-    FILE    *flt2r;
-    FILE    *flt3r;
-    FILE    *flt4r;
-    FILE    *flt1i;
-    FILE    *flt2i;
-    FILE    *flt3i;
-    FILE    *flt4i;
-
-    if ( (flt1r = fopen(SURROUND_FILE_1R, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_1R);
-        return NAME_NOT_FOUND;
-    }
-
-    if ( (flt2r = fopen(SURROUND_FILE_2R, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_2R);
-        return NAME_NOT_FOUND;
-    }
-
-    if ( (flt3r = fopen(SURROUND_FILE_3R, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_3R);
-        return  NAME_NOT_FOUND;
-    }
-
-    if ( (flt4r = fopen(SURROUND_FILE_4R, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_4R);
-        return  NAME_NOT_FOUND;
-    }
-
-    if ( (flt1i = fopen(SURROUND_FILE_1I, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_1I);
-        return NAME_NOT_FOUND;
-    }
-
-    if ( (flt2i = fopen(SURROUND_FILE_2I, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_2I);
-        return NAME_NOT_FOUND;
-    }
-
-    if ( (flt3i = fopen(SURROUND_FILE_3I, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_3I);
-        return NAME_NOT_FOUND;
-    }
+    struct stat st;
+    size_t size = FILT_SIZE * sizeof(Word16);
+    size_t done = 0;
+    status_t err = NO_ERROR;
 
-    if ( (flt4i = fopen(SURROUND_FILE_4I, "rb")) == NULL ) {
-        ALOGE("Cannot open filter co-efficient file %s", SURROUND_FILE_4I);
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("Cannot open filter co-efficient file %s", path);
         return NAME_NOT_FOUND;
     }
-    ALOGV("readCoeffsFromFile all filter files opened");
-
-    for (int i=0; i<COEFF_ARRAY_SIZE; i++) {
-        mRealCoeffs[i] = (Word16 *)calloc(FILT_SIZE, sizeof(Word16));
-    }
-    for (int i=0; i<COEFF_ARRAY_SIZE; i++) {
-        mImagCoeffs[i] = (Word16 *)calloc(FILT_SIZE, sizeof(Word16));
+    if (fstat(fd, &st) || (size_t)st.st_size < size) {
+        ALOGE("Filter co-efficient file %s has size %ld, expected at least %u", path,
+              (long)st.st_size, size);
+        ::close(fd);
+        return BAD_VALUE;
+    }
+    while (done < size) {
+        ssize_t n = ::read(fd, (char *)coeffs + done, size - done);
+        if (n <= 0) {
+            ALOGE("Failed to read filter co-efficient file %s: %d", path, errno);
+            err = UNKNOWN_ERROR;
+            break;
+        }
+        done += n;
     }
+    ::close(fd);
+    return err;
+}
 
-    // Read real co-efficients
-    if (NULL != mRealCoeffs[0]) {
-        fread(mRealCoeffs[0], sizeof(int16), FILT_SIZE, flt1r);
-    }
-    if (NULL != mRealCoeffs[0]) {
-        fread(mRealCoeffs[1], sizeof(int16), FILT_SIZE, flt2r);
-    }
-    if (NULL != mRealCoeffs[0]) {
-        fread(mRealCoeffs[2], sizeof(int16), FILT_SIZE, flt3r);
-    }
-    if (NULL != mRealCoeffs[0]) {
-        fread(mRealCoeffs[3], sizeof(int16), FILT_SIZE, flt4r);
-    }
+// Fills the real and imaginary coeff array member variables with a copy of
+// the shared coefficient store, loading it on first use
+status_t AudioStreamInALSA::readCoeffsFromFile()
+{
+    Mutex::Autolock autoLock(sSurroundCoeffs.lock);
 
-    // read imaginary co-efficients
-    if (NULL != mImagCoeffs[0]) {
-        fread(mImagCoeffs[0], sizeof(int16), FILT_SIZE, flt1i);
-    }
-    if (NULL != mImagCoeffs[0]) {
-        fread(mImagCoeffs[1], sizeof(int16), FILT_SIZE, flt2i);
-    }
-    if (NULL != mImagCoeffs[0]) {
-        fread(mImagCoeffs[2], sizeof(int16), FILT_SIZE, flt3i);
+    if (sSurroundCoeffs.loaded) {
+        sSurroundCoeffs.hits++;
+    } else {
+        nsecs_t start = systemTime();
+        status_t err;
+
+        sSurroundCoeffs.loads++;
+        if (!sSurroundCoeffs.data) {
+            sSurroundCoeffs.data = (Word16 *)malloc(2 * COEFF_ARRAY_SIZE *
+                                                    FILT_SIZE * sizeof(Word16));
+            if (!sSurroundCoeffs.data) {
+                ALOGE("Memory allocation failure for the filter co-efficients");
+                return NO_MEMORY;
+            }
+        }
+        for (int i = 0; i < 2 * COEFF_ARRAY_SIZE; i++) {
+            err = loadSurroundCoeffFile(surroundCoeffFiles[i],
+                                        sSurroundCoeffs.data + i * FILT_SIZE);
+            if (err != NO_ERROR) {
+                //Not cached, the next stream tries again
+                return err;
+            }
+        }
+        sSurroundCoeffs.loaded = true;
+        sSurroundCoeffs.loadTimeUs = ns2us(systemTime() - start);
+        ALOGD("Loaded surround filter co-efficients in %lld us",
+              (long long)sSurroundCoeffs.loadTimeUs);
+    }
+
+    if (!mCoeffData) {
+        mCoeffData = (Word16 *)malloc(2 * COEFF_ARRAY_SIZE * FILT_SIZE *
+                                      sizeof(Word16));
+        if (!mCoeffData) {
+            ALOGE("Memory allocation failure for the filter co-efficients");
+            return NO_MEMORY;
+        }
     }
-    if (NULL != mImagCoeffs[0]) {
-        fread(mImagCoeffs[3], sizeof(int16), FILT_SIZE, flt4i);
+    memcpy(mCoeffData, sSurroundCoeffs.data,
+           2 * COEFF_ARRAY_SIZE * FILT_SIZE * sizeof(Word16));
+    for (int i = 0; i < 2 * COEFF_ARRAY_SIZE; i++) {
+        mCoeffs[i] = mCoeffData + i * FILT_SIZE;
     }
-
-    fclose(flt1r);
-    fclose(flt2r);
-    fclose(flt3r);
-    fclose(flt4r);
-    fclose(flt1i);
-    fclose(flt2i);
-    fclose(flt3i);
-    fclose(flt4i);
-
+    mRealCoeffs = mCoeffs;
+    mImagCoeffs = mCoeffs + COEFF_ARRAY_SIZE;
     return NO_ERROR;
 }
 #endif
@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <dlfcn.h>
 #include <math.h>
 
@@ -30,6 +31,7 @@
 #define LOG_NDDEBUG 0
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <sys/prctl.h>
 
 #include <cutils/properties.h>
 #include <media/AudioRecord.h>
@@ -54,8 +56,36 @@ AudioStreamOutALSA::AudioStreamOutALSA(AudioHardwareALSA *parent, alsa_handle_t
     ALSAStreamOps(parent, handle),
     mParent(parent),
     mFrameCount(0),
-    mUseCase(AudioHardwareALSA::USECASE_NONE)
+    mRenderedFrames(0),
+    mUseCase(AudioHardwareALSA::USECASE_NONE),
+    mJitter(NULL),
+    mKillPlayout(false),
+    mDspDelaySumUs(0),
+    mMaxDspDelayUs(0),
+    mDspDelayCount(0)
 {
+    char value[PROPERTY_VALUE_MAX];
+    bool pcm = mHandle->format == SNDRV_PCM_FORMAT_S16_LE;
+    uint32_t frameUs = VOIP_FRAME_DURATION_US;
+
+    if (isVoipUseCase(mHandle->useCaseId)) {
+        property_get("persist.audio.voip.jitterbuf", value, "0");
+        if (!strcmp(value, "1") || !strcmp(value, "true")) {
+            // Packet modes always carry 20ms, PCM frames are one write
+            if (pcm && mHandle->sampleRate && mHandle->channels) {
+                frameUs = (uint64_t)mHandle->periodSize * 1000000 /
+                          (mHandle->sampleRate * mHandle->channels * 2);
+            }
+            mJitter = new AudioVoipJitterBuffer();
+            if (mJitter->init(mHandle->periodSize, frameUs, pcm) ||
+                !startPlayout()) {
+                ALOGE("VoIP jitter buffer unavailable, period %d",
+                      (int)mHandle->periodSize);
+                delete mJitter;
+                mJitter = NULL;
+            }
+        }
+    }
 }
 
 AudioStreamOutALSA::~AudioStreamOutALSA()
@@ -91,9 +121,7 @@ status_t AudioStreamOutALSA::setVolume(float left, float right)
     }
     vol = lrint((volume * 0x2000)+0.5);
 
-    if(!strncmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL,
-            sizeof(mHandle->useCase)) || !strncmp(mHandle->useCase,
-            SND_USE_CASE_MOD_PLAY_VOIP, sizeof(mHandle->useCase))) {
+    if (isVoipUseCase(mHandle->useCaseId)) {
         ALOGV("Avoid Software volume by returning success\n");
         return status;
     }
@@ -103,7 +131,7 @@ status_t AudioStreamOutALSA::setVolume(float left, float right)
 ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
 {
     int period_size;
-    char *use_case;
+    int verb_id;
 
     ALOGV("write:: buffer %p, bytes %d", buffer, bytes);
 
@@ -113,8 +141,7 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
 
     int write_pending = bytes;
 
-    if((strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) &&
-       (strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+    if (!isVoipUseCase(mHandle->useCaseId)) {
         mParent->mLock.lock();
         /* PCM handle might be closed and reopened immediately to flush
          * the buffers, recheck and break if PCM handle is valid */
@@ -128,39 +155,43 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
                 }
             }
             ALOGV("write: mHandle->useCase: %s", mHandle->useCase);
-            snd_use_case_get(mHandle->ucMgr, "_verb", (const char **)&use_case);
-            if ((use_case == NULL) || (!strcmp(use_case, SND_USE_CASE_VERB_INACTIVE))) {
-                if(!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL,
-                            sizeof(SND_USE_CASE_VERB_IP_VOICECALL));
-                } else if(!strcmp(mHandle->useCase,SND_USE_CASE_MOD_PLAY_MUSIC2)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_VERB_HIFI2,
-                            sizeof(SND_USE_CASE_MOD_PLAY_MUSIC2));
-                } else if (!strcmp(mHandle->useCase,SND_USE_CASE_MOD_PLAY_MUSIC)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_VERB_HIFI,
-                            sizeof(SND_USE_CASE_MOD_PLAY_MUSIC));
-                } else if(!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC,
-                            sizeof(SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC));
+            verb_id = snd_use_case_get_verb_id(mHandle->ucMgr);
+            if ((verb_id == SND_UCM_ID_NONE) || (verb_id == SND_UCM_ID_VERB_INACTIVE)) {
+                switch (mHandle->useCaseId) {
+                case SND_UCM_ID_MOD_PLAY_VOIP:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_IP_VOICECALL);
+                    break;
+                case SND_UCM_ID_MOD_PLAY_MUSIC2:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_HIFI2);
+                    break;
+                case SND_UCM_ID_MOD_PLAY_MUSIC:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_HIFI);
+                    break;
+                case SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC);
+                    break;
+                default:
+                    break;
                 }
             } else {
-                if(!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP,
-                            sizeof(SND_USE_CASE_MOD_PLAY_VOIP));
-                } else if(!strcmp(mHandle->useCase,SND_USE_CASE_VERB_HIFI2)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_MOD_PLAY_MUSIC2,
-                            sizeof(SND_USE_CASE_MOD_PLAY_MUSIC2));
-                } else if (!strcmp(mHandle->useCase,SND_USE_CASE_VERB_HIFI)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_MOD_PLAY_MUSIC,
-                            sizeof(SND_USE_CASE_MOD_PLAY_MUSIC));
-                } else if(!strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC)) {
-                    strlcpy(mHandle->useCase, SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC,
-                            sizeof(SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC));
+                switch (mHandle->useCaseId) {
+                case SND_UCM_ID_VERB_IP_VOICECALL:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_PLAY_VOIP);
+                    break;
+                case SND_UCM_ID_VERB_HIFI2:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_PLAY_MUSIC2);
+                    break;
+                case SND_UCM_ID_VERB_HIFI:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_PLAY_MUSIC);
+                    break;
+                case SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC:
+                    mParent->setUseCase_l(mHandle, SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC);
+                    break;
+                default:
+                    break;
                 }
             }
-            free(use_case);
-            if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-               (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+            if (isVoipUseCase(mHandle->useCaseId)) {
 #ifdef QCOM_USBAUDIO_ENABLED
                 if((mParent->mCurRxDevice & AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET)||
                       (mParent->mCurRxDevice & AudioSystem::DEVICE_OUT_DGTL_DOCK_HEADSET)||
@@ -180,16 +211,12 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
             } else {
                   mHandle->module->route(mHandle, mParent->mCurRxDevice , mParent->mode());
             }
-            if (!strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI) ||
-                !strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI2) ||
-                !strcmp(mHandle->useCase, SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC) ||
-                !strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) {
-                snd_use_case_set(mHandle->ucMgr, "_verb", mHandle->useCase);
+            if (SND_UCM_ID_IS_VERB(mHandle->useCaseId)) {
+                snd_use_case_set_id(mHandle->ucMgr, "_verb", mHandle->useCaseId);
             } else {
-                snd_use_case_set(mHandle->ucMgr, "_enamod", mHandle->useCase);
+                snd_use_case_set_id(mHandle->ucMgr, "_enamod", mHandle->useCaseId);
             }
-            if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-              (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+            if (isVoipUseCase(mHandle->useCaseId)) {
                  err = mHandle->module->startVoipCall(mHandle);
             }
             else
@@ -202,8 +229,7 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
 #ifdef QCOM_USBAUDIO_ENABLED
             if((mParent->mCurRxDevice == AudioSystem::DEVICE_IN_ANLG_DOCK_HEADSET)||
                    (mParent->mCurRxDevice == AudioSystem::DEVICE_OUT_ANLG_DOCK_HEADSET)){
-                if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-                   (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+                if (isVoipUseCase(mHandle->useCaseId)) {
                     ALOGV("Setting VOIPCALL bit here, musbPlaybackState %d", mParent->musbPlaybackState);
                     mParent->musbPlaybackState |= USBPLAYBACKBIT_VOIPCALL;
                 } else {
@@ -215,7 +241,7 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
 #endif
         }
         if (mParent->mRouteAudioToExtOut) {
-            mUseCase = mParent->useCaseStringToEnum(mHandle->useCase);
+            mUseCase = mParent->useCaseIdToEnum(mHandle->useCaseId);
             if (! (mParent->getExtOutActiveUseCases_l() & mUseCase )){
                 ALOGD("startPlaybackOnExtOut_l from write :: useCase = %s", mHandle->useCase);
                 status_t err = NO_ERROR;
@@ -237,8 +263,7 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
         mParent->mLock.lock();
         mParent->startUsbPlaybackIfNotStarted();
         ALOGV("Starting playback on USB");
-        if(!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL) ||
-           !strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP)) {
+        if (isVoipUseCase(mHandle->useCaseId)) {
             ALOGV("Setting VOIPCALL bit here, musbPlaybackState %d", mParent->musbPlaybackState);
             mParent->musbPlaybackState |= USBPLAYBACKBIT_VOIPCALL;
         }else{
@@ -249,36 +274,42 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
     }
 #endif
 
+    if (mJitter) {
+        return writeVoip(buffer, bytes);
+    }
+
     period_size = mHandle->periodSize;
     do {
         if (write_pending < period_size) {
             write_pending = period_size;
         }
+        struct pcm *pcm = NULL;
         if((mParent->mVoipOutStreamCount) && (mHandle->rxHandle != 0)) {
+            pcm = mHandle->rxHandle;
             n = pcm_write(mHandle->rxHandle,
                      (char *)buffer + sent,
                       period_size);
         } else if (mHandle->handle != 0){
+            pcm = mHandle->handle;
             n = pcm_write(mHandle->handle,
                      (char *)buffer + sent,
                       period_size);
         }
         if (n < 0) {
+            if (recoverXrun(pcm, n)) {
+                continue;
+            }
+            nsecs_t reopenStart = systemTime();
             mParent->mLock.lock();
             if (mHandle->handle != NULL) {
                 ALOGE("pcm_write returned error %d, trying to recover\n", n);
-                pcm_close(mHandle->handle);
-                mHandle->handle = NULL;
-                if((!strncmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL, strlen(SND_USE_CASE_VERB_IP_VOICECALL))) ||
-                  (!strncmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP, strlen(SND_USE_CASE_MOD_PLAY_VOIP)))) {
-                     if (mHandle->rxHandle) {
-                         pcm_close(mHandle->rxHandle);
-                         mHandle->rxHandle = NULL;
-                         mHandle->module->startVoipCall(mHandle);
-                     }
+                if (isVoipUseCase(mHandle->useCaseId)) {
+                    restartVoip_l();
                 }
                 else
                 {
+                    pcm_close(mHandle->handle);
+                    mHandle->handle = NULL;
                     if (mParent->mALSADevice->mSSRComplete) {
                         ALOGD("SSR Case: Call device switch to apply AMIX controls.");
                         mHandle->module->route(mHandle, mParent->mCurRxDevice , mParent->mode());
@@ -291,6 +322,7 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
                     }
                     mHandle->module->open(mHandle);
                 }
+                reopenDone(reopenStart);
                 if(mHandle->handle == NULL) {
                    ALOGE("write:: device re-open failed");
                    mParent->mLock.unlock();
@@ -301,7 +333,9 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
             continue;
         }
         else {
-            mFrameCount += n;
+            transferDone();
+            // pcm_write returns 0 on success, count what was handed over
+            mFrameCount += period_size / (mHandle->channels * 2);
             sent += static_cast<ssize_t>((period_size));
             write_pending -= period_size;
         }
@@ -311,8 +345,158 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
     return sent;
 }
 
+ssize_t AudioStreamOutALSA::writeVoip(const void *buffer, size_t bytes)
+{
+    size_t frameBytes = mJitter->frameBytes();
+    size_t sent = 0, chunk;
+
+    Mutex::Autolock autoLock(mPlayoutLock);
+    while (sent < bytes && !mKillPlayout) {
+        // Pace the client on the playout clock
+        while (mJitter->depth() >= mJitter->target() && !mKillPlayout) {
+            mPlayoutCv.wait(mPlayoutLock);
+        }
+        chunk = bytes - sent < frameBytes ? bytes - sent : frameBytes;
+        mJitter->put((const char *)buffer + sent, chunk, systemTime() / 1000);
+        mPlayoutCv.broadcast();
+        sent += chunk;
+    }
+    return bytes;
+}
+
+bool AudioStreamOutALSA::startPlayout()
+{
+    mKillPlayout = false;
+    if (pthread_create(&mPlayoutThread, (const pthread_attr_t *) NULL,
+                       playoutThreadWrapper, this)) {
+        ALOGE("Failed to create the VoIP playout thread");
+        return false;
+    }
+    return true;
+}
+
+void AudioStreamOutALSA::stopPlayout()
+{
+    if (!mJitter) {
+        return;
+    }
+    mPlayoutLock.lock();
+    mKillPlayout = true;
+    mPlayoutCv.broadcast();
+    mPlayoutLock.unlock();
+    pthread_join(mPlayoutThread, NULL);
+    delete mJitter;
+    mJitter = NULL;
+}
+
+void *AudioStreamOutALSA::playoutThreadWrapper(void *me)
+{
+    static_cast<AudioStreamOutALSA *>(me)->playoutThreadFunc();
+    return NULL;
+}
+
+void AudioStreamOutALSA::playoutThreadFunc()
+{
+    uint8_t frame[VOIP_JB_MAX_FRAME_BYTES];
+    size_t frameBytes = mJitter->frameBytes();
+    struct timespec tstamp;
+    struct pcm *pcm;
+    long delay;
+    int64_t delayUs;
+    int n;
+
+    androidSetThreadPriority(gettid(), ANDROID_PRIORITY_URGENT_AUDIO);
+    prctl(PR_SET_NAME, (unsigned long)"VoipPlayout", 0, 0, 0);
+
+    mPlayoutLock.lock();
+    while (!mKillPlayout) {
+        // Once the client has stopped writing let the DSP run dry
+        // instead of concealing forever
+        if (mJitter->idle()) {
+            mPlayoutCv.wait(mPlayoutLock);
+            continue;
+        }
+        mJitter->get(frame, systemTime() / 1000);
+        mPlayoutCv.broadcast();
+        mPlayoutLock.unlock();
+
+        pcm = activePcm();
+        if (!pcm) {
+            usleep(mJitter->frameUs());
+        } else if ((n = pcm_write(pcm, frame, frameBytes)) < 0) {
+            if (!recoverXrun(pcm, n)) {
+                nsecs_t reopenStart = systemTime();
+                mParent->mLock.lock();
+                if (mHandle->handle != NULL) {
+                    ALOGE("pcm_write returned error %d, trying to recover\n", n);
+                    restartVoip_l();
+                    reopenDone(reopenStart);
+                }
+                mParent->mLock.unlock();
+            }
+        } else {
+            transferDone();
+            mFrameCount += frameBytes / (mHandle->channels * 2);
+            if (!pcm_get_delay(pcm, &delay, &tstamp) && delay >= 0) {
+                delayUs = (int64_t)delay * 1000000LL / mHandle->sampleRate;
+                mDspDelaySumUs += delayUs;
+                if (delayUs > mMaxDspDelayUs)
+                    mMaxDspDelayUs = delayUs;
+                mDspDelayCount++;
+            }
+        }
+        mPlayoutLock.lock();
+    }
+    mPlayoutLock.unlock();
+}
+
+// Reopens the VoIP PCMs after a write error that could not be recovered
+// in place, called with mParent->mLock held
+void AudioStreamOutALSA::restartVoip_l()
+{
+    if (mHandle->handle != NULL) {
+        pcm_close(mHandle->handle);
+        mHandle->handle = NULL;
+        if (mHandle->rxHandle) {
+            pcm_close(mHandle->rxHandle);
+            mHandle->rxHandle = NULL;
+            mHandle->module->startVoipCall(mHandle);
+        }
+    }
+}
+
+void AudioStreamOutALSA::dumpPlayout(int fd)
+{
+    AudioVoipJitterStats stats;
+    char buffer[512];
+
+    mPlayoutLock.lock();
+    mJitter->getStats(&stats);
+    mPlayoutLock.unlock();
+    // Latency added between the client and the speaker, by stage
+    snprintf(buffer, sizeof(buffer),
+             "VoIP playout: jitter %lld us, target %u frames, depth %u\n"
+             "  jitter buffer: avg %lld us, max %lld us\n"
+             "  DSP queue: avg %lld us, max %lld us\n"
+             "  device path: %u us\n"
+             "  frames: in %u, out %u, prebuffered %u, concealed %u\n"
+             "  underruns %u, compressed %u, overflows %u\n",
+             (long long)stats.jitterUs, stats.target, stats.depth,
+             (long long)stats.avgResidenceUs, (long long)stats.maxResidenceUs,
+             (long long)(mDspDelayCount ? mDspDelaySumUs / mDspDelayCount : 0),
+             (long long)mMaxDspDelayUs, mHandle->latency,
+             stats.framesIn, stats.framesOut, stats.prebuffered,
+             stats.concealed, stats.underruns, stats.compressed,
+             stats.overflows);
+    ::write(fd, buffer, strlen(buffer));
+}
+
 status_t AudioStreamOutALSA::dump(int fd, const Vector<String16>& args)
 {
+    dumpRecovery(fd);
+    if (mJitter) {
+        dumpPlayout(fd);
+    }
     return NO_ERROR;
 }
 
@@ -325,11 +509,13 @@ status_t AudioStreamOutALSA::open(int mode)
 
 status_t AudioStreamOutALSA::close()
 {
+    // The playout thread takes mParent->mLock to reopen the PCMs
+    stopPlayout();
+
     Mutex::Autolock autoLock(mParent->mLock);
 
     ALOGV("close");
-    if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-        (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+    if (isVoipUseCase(mHandle->useCaseId)) {
          if(mParent->mVoipInStreamCount||mParent->mVoipOutStreamCount) {
 #ifdef QCOM_USBAUDIO_ENABLED
              if(mParent->mVoipInStreamCount^mParent->mVoipOutStreamCount) {
@@ -381,8 +567,7 @@ status_t AudioStreamOutALSA::standby()
 
     ALOGV("standby");
 
-    if((!strcmp(mHandle->useCase, SND_USE_CASE_VERB_IP_VOICECALL)) ||
-      (!strcmp(mHandle->useCase, SND_USE_CASE_MOD_PLAY_VOIP))) {
+    if (isVoipUseCase(mHandle->useCaseId)) {
         return NO_ERROR;
     }
 
@@ -406,6 +591,7 @@ status_t AudioStreamOutALSA::standby()
 #endif
 
     mFrameCount = 0;
+    mRenderedFrames = 0;
 
     return NO_ERROR;
 }
@@ -416,6 +602,9 @@ uint32_t AudioStreamOutALSA::latency() const
 {
     // Android wants latency in milliseconds.
     uint32_t latency = mHandle->latency;
+    if (mJitter) {
+        latency += mJitter->target() * mJitter->frameUs();
+    }
     if ( ((mParent->mCurRxDevice & AudioSystem::DEVICE_OUT_ALL_A2DP) &&
          (mParent->mExtOutStream == mParent->mA2dpStream)) &&
          (mParent->mA2dpStream != NULL) ) {
@@ -432,8 +621,44 @@ uint32_t AudioStreamOutALSA::latency() const
 // the output has exited standby
 status_t AudioStreamOutALSA::getRenderPosition(uint32_t *dspFrames)
 {
-    *dspFrames = mFrameCount;
+    struct pcm *pcm = activePcm();
+    struct timespec tstamp;
+    long delay;
+
+    // Keep the last position while the stream is stopped or not yet started
+    if (pcm && !pcm_get_delay(pcm, &delay, &tstamp) &&
+        delay >= 0 && (uint64_t)delay <= mFrameCount) {
+        mRenderedFrames = mFrameCount - delay;
+    }
+    *dspFrames = (uint32_t)mRenderedFrames;
     return NO_ERROR;
 }
 
+status_t AudioStreamOutALSA::getNextWriteTimestamp(int64_t *timestamp)
+{
+    struct pcm *pcm = activePcm();
+    struct timespec tstamp;
+    long delay;
+
+    // A gettimeofday timestamp can not be compared with systemTime()
+    if (!pcm || !pcm->tstamp_monotonic || !mHandle->sampleRate ||
+        pcm_get_delay(pcm, &delay, &tstamp) ||
+        (!tstamp.tv_sec && !tstamp.tv_nsec)) {
+        return INVALID_OPERATION;
+    }
+    // The hw pointer was at the frame being rendered at tstamp, the next
+    // write lands behind everything still queued
+    *timestamp = (int64_t)tstamp.tv_sec * 1000000LL + tstamp.tv_nsec / 1000 +
+                 (int64_t)delay * 1000000LL / mHandle->sampleRate;
+    return NO_ERROR;
+}
+
+struct pcm *AudioStreamOutALSA::activePcm() const
+{
+    if (mParent->mVoipOutStreamCount && mHandle->rxHandle) {
+        return mHandle->rxHandle;
+    }
+    return mHandle->handle;
+}
+
 }       // namespace android_audio_legacy
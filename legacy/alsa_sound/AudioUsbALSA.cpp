@@ -59,6 +59,8 @@ struct pollfd pfdUsbRecording[2];
 #define PROXY_SUPPORTED_RATE_16000 16000
 #define PROXY_SUPPORTED_RATE_48000 48000
 #define AFE_PROXY_PERIOD_COUNT 32
+//Log the playback drift compensation state every ~10s of USB periods
+#define ASRC_STATS_INTERVAL 512
 //#define OUTPUT_PROXY_BUFFER_LOG
 //#define OUTPUT_RECORD_PROXY_BUFFER_LOG
 #ifdef OUTPUT_PROXY_BUFFER_LOG
@@ -90,6 +92,14 @@ AudioUsbALSA::AudioUsbALSA()
     musbPlaybackHandle  = NULL;
     mproxyPlaybackHandle = NULL;
     mProxySoundCard = 0;
+    memset(mCaps, 0, sizeof(mCaps));
+    mCapsValid = false;
+    mCapsIno = 0;
+    mCapsCtime = 0;
+    mCapsLoads = 0;
+    memset(mCapsHits, 0, sizeof(mCapsHits));
+    memset(mCapsMisses, 0, sizeof(mCapsMisses));
+    mCapsLoadTimeUs = 0;
 }
 
 AudioUsbALSA::~AudioUsbALSA()
@@ -99,191 +109,279 @@ AudioUsbALSA::~AudioUsbALSA()
 }
 
 
-int AudioUsbALSA::getnumOfRates(char *ratesStr){
-    int i, size = 0;
-    char *nextSRString, *temp_ptr;
-    nextSRString = strtok_r(ratesStr, " ,", &temp_ptr);
-    if (nextSRString == NULL) {
-        ALOGE("ERROR: getnumOfRates: could not find rates string");
-        return NULL;
+static int usbFormatFromString(const char *name)
+{
+    if (!strncmp(name, "S16_LE", 6))
+        return SNDRV_PCM_FORMAT_S16_LE;
+    if (!strncmp(name, "S24_3LE", 7))
+        return SNDRV_PCM_FORMAT_S24_3LE;
+    if (!strncmp(name, "S24_LE", 6))
+        return SNDRV_PCM_FORMAT_S24_LE;
+    if (!strncmp(name, "S32_LE", 6))
+        return SNDRV_PCM_FORMAT_S32_LE;
+    return -1;
+}
+
+/* Parses either a list ("44100, 48000") or a continuous range
+ * ("8000 - 96000 (continuous)") of rates.
+ */
+static void parseUsbRates(char *ratesStr, UsbAltSetting *alt)
+{
+    char *rateStr, *temp_ptr;
+    bool range = false;
+
+    alt->numRates = 0;
+    alt->minRate = 0;
+    alt->maxRate = 0;
+    for (rateStr = strtok_r(ratesStr, " ,\t\n", &temp_ptr); rateStr != NULL;
+         rateStr = strtok_r(NULL, " ,\t\n", &temp_ptr)) {
+        if (!strcmp(rateStr, "-")) {
+            range = true;
+            continue;
+        }
+        int rate = atoi(rateStr);
+        if (rate <= 0)
+            continue;
+        if (range)
+            alt->maxRate = rate;
+        else if (alt->numRates < USB_MAX_RATES)
+            alt->rates[alt->numRates++] = rate;
     }
-    for (i = 1; nextSRString != NULL; i++) {
-        size ++;
-        nextSRString = strtok_r(NULL, " ,.-", &temp_ptr);
+    if (range && alt->numRates) {
+        alt->minRate = alt->rates[0];
+        alt->numRates = 0;
     }
-    return size;
 }
 
+static bool usbAltSupportsRate(const UsbAltSetting *alt, int rate)
+{
+    if (!alt->numRates)
+        return rate >= alt->minRate && rate <= alt->maxRate;
+    for (int i = 0; i < alt->numRates; i++) {
+        if (alt->rates[i] == rate)
+            return true;
+    }
+    return false;
+}
 
-status_t AudioUsbALSA::getCap(char * type, int &channels, int &sampleRate)
+/* Reads every altsetting of both directions from the stream file. Called
+ * with mCapsLock held, once per attach.
+ */
+status_t AudioUsbALSA::loadCaps_l()
 {
-    ALOGD("getCap for %s",type);
-    long unsigned fileSize;
-    FILE *fp;
-    char *buffer;
-    int err = 1;
-    int size = 0;
-    int fd, i, lchannelsPlayback;
-    char *read_buf, *str_start, *channel_start, *ratesStr, *ratesStrForVal,
-    *ratesStrStart, *chString, *nextSRStr, *test, *nextSRString, *temp_ptr;
+    char line[256];
+    UsbStreamCaps *caps = NULL;
+    UsbAltSetting *alt = NULL;
     struct stat st;
-    memset(&st, 0x0, sizeof(struct stat));
-    sampleRate = 0;
+    FILE *fp;
+    nsecs_t start = systemTime();
 
-    fd = open(PATH, O_RDONLY);
-    if (fd <0) {
+    mCapsValid = false;
+    memset(mCaps, 0, sizeof(mCaps));
+
+    fp = fopen(PATH, "r");
+    if (fp == NULL) {
         ALOGE("ERROR: failed to open config file %s error: %d\n", PATH, errno);
-        close(fd);
         return UNKNOWN_ERROR;
     }
-
-    if (fstat(fd, &st) < 0) {
+    if (fstat(fileno(fp), &st) < 0) {
         ALOGE("ERROR: failed to stat %s error %d\n", PATH, errno);
-        close(fd);
+        fclose(fp);
         return UNKNOWN_ERROR;
     }
 
-    fileSize = st.st_size;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *str = line;
+        while (*str == ' ' || *str == '\t')
+            str++;
+
+        if (!strncmp(str, "Playback:", 9)) {
+            caps = &mCaps[USB_PLAYBACK];
+            alt = NULL;
+        } else if (!strncmp(str, "Capture:", 8)) {
+            caps = &mCaps[USB_RECORDING];
+            alt = NULL;
+        } else if (caps == NULL) {
+            continue;
+        } else if (!strncmp(str, "Altset", 6) ||
+                   (alt == NULL && !strncmp(str, "Format:", 7))) {
+            if (caps->numAltSettings == USB_MAX_ALTSETTINGS) {
+                ALOGW("Ignoring altsettings beyond %d", USB_MAX_ALTSETTINGS);
+                alt = NULL;
+                caps = NULL;
+                continue;
+            }
+            alt = &caps->altSettings[caps->numAltSettings++];
+            alt->format = -1;
+        }
 
-    if ((read_buf = (char *)malloc(BUFFSIZE)) == NULL) {
-        ALOGE("ERROR: Unable to allocate memory to hold stream caps");
-        close(fd);
-        return NO_MEMORY;
-    }
-    memset(read_buf, 0x0, BUFFSIZE);
-    err = read(fd, read_buf, BUFFSIZE);
-    str_start = strstr(read_buf, type);
-    if (str_start == NULL) {
-        ALOGE("ERROR:%s section not found in usb config file", type);
-        close(fd);
-        free(read_buf);
-        return UNKNOWN_ERROR;
+        if (alt == NULL)
+            continue;
+        if (!strncmp(str, "Format:", 7)) {
+            str += 7;
+            while (*str == ' ')
+                str++;
+            alt->format = usbFormatFromString(str);
+        } else if (!strncmp(str, "Channels:", 9)) {
+            alt->channels = atoi(str + 9);
+        } else if (!strncmp(str, "Rates:", 6)) {
+            parseUsbRates(str + 6, alt);
+        }
     }
+    fclose(fp);
+
+    chooseConfig_l(&mCaps[USB_PLAYBACK]);
+    chooseConfig_l(&mCaps[USB_RECORDING]);
+
+    mCapsIno = st.st_ino;
+    mCapsCtime = st.st_ctime;
+    mCapsValid = true;
+    mCapsLoads++;
+    mCapsLoadTimeUs = ns2us(systemTime() - start);
+    ALOGD("USB caps loaded in %lld us: %d playback, %d capture altsettings",
+          mCapsLoadTimeUs, mCaps[USB_PLAYBACK].numAltSettings,
+          mCaps[USB_RECORDING].numAltSettings);
+    return NO_ERROR;
+}
 
-    channel_start = strstr(str_start, "Channels:");
-    if (channel_start == NULL) {
-        ALOGE("ERROR: Could not find Channels information");
-        close(fd);
-        free(read_buf);
-        return UNKNOWN_ERROR;
-    }
-    channel_start = strstr(channel_start, " ");
-    if (channel_start == NULL) {
-        ALOGE("ERROR: Channel section not found in usb config file");
-        close(fd);
-        free(read_buf);
-        return UNKNOWN_ERROR;
-    }
+/* Picks the altsetting and rate to run the stream at. Only S16_LE
+ * altsettings are considered, since that is the only format the bridge
+ * threads move and setHardwareParams opens the card with. A rate the proxy
+ * port handles natively wins over everything else since it keeps the DSP
+ * path free of resampling, then stereo over mono.
+ */
+void AudioUsbALSA::chooseConfig_l(UsbStreamCaps *caps)
+{
+    static const int proxyRates[] = {
+        PROXY_SUPPORTED_RATE_48000,
+        PROXY_SUPPORTED_RATE_16000,
+        PROXY_SUPPORTED_RATE_8000,
+    };
+    int bestScore = -1;
+
+    caps->sampleRate = 0;
+    caps->channels = 0;
+    caps->format = -1;
+    caps->nativeRate = false;
+
+    for (int i = 0; i < caps->numAltSettings; i++) {
+        const UsbAltSetting *alt = &caps->altSettings[i];
+        int rate = 0;
+        bool native = false;
+        unsigned int j;
+
+        if (alt->channels <= 0 || alt->format != SNDRV_PCM_FORMAT_S16_LE)
+            continue;
+        for (j = 0; j < sizeof(proxyRates)/sizeof(proxyRates[0]); j++) {
+            if (usbAltSupportsRate(alt, proxyRates[j])) {
+                rate = proxyRates[j];
+                native = true;
+                break;
+            }
+        }
+        if (!native) {
+            //Highest rate the proxy can be resampled to, else the lowest one
+            if (!alt->numRates) {
+                rate = alt->minRate;
+                if (alt->maxRate >= PROXY_SUPPORTED_RATE_48000)
+                    rate = PROXY_SUPPORTED_RATE_48000;
+            } else {
+                for (int k = 0; k < alt->numRates; k++) {
+                    if (alt->rates[k] <= PROXY_SUPPORTED_RATE_48000 && alt->rates[k] > rate)
+                        rate = alt->rates[k];
+                }
+                if (!rate) {
+                    rate = alt->rates[0];
+                    for (int k = 1; k < alt->numRates; k++) {
+                        if (alt->rates[k] < rate)
+                            rate = alt->rates[k];
+                    }
+                }
+            }
+        }
+        if (rate <= 0)
+            continue;
 
-    lchannelsPlayback = atoi(channel_start);
-    if (lchannelsPlayback == 1) {
-        channels = 1;
-    } else {
-        channels = 2;
-    }
-    ALOGD("channels supported by device: %d", lchannelsPlayback);
-    ratesStrStart = strstr(str_start, "Rates:");
-    if (ratesStrStart == NULL) {
-        ALOGE("ERROR: Cant find rates information");
-        close(fd);
-        free(read_buf);
-        return UNKNOWN_ERROR;
+        int score = (native ? 1000 : 0) +
+                    (alt->channels <= 2 ? 10 + alt->channels : 0);
+        if (score > bestScore) {
+            bestScore = score;
+            caps->sampleRate = rate;
+            caps->channels = (alt->channels == 1) ? 1 : 2;
+            caps->format = alt->format;
+            caps->nativeRate = native;
+        }
     }
+}
 
-    ratesStrStart = strstr(ratesStrStart, " ");
-    if (ratesStrStart == NULL) {
-        ALOGE("ERROR: Channel section not found in usb config file");
-        close(fd);
-        free(read_buf);
-        return UNKNOWN_ERROR;
-    }
+void AudioUsbALSA::invalidateCaps()
+{
+    Mutex::Autolock autoLock(mCapsLock);
+    ALOGV("invalidateCaps");
+    mCapsValid = false;
+}
 
-    //copy to ratesStr, current line.
-    char *target = strchr(ratesStrStart, '\n');
-    if (target == NULL) {
-        ALOGE("ERROR: end of line not found");
-        close(fd);
-        free(read_buf);
-        return UNKNOWN_ERROR;
-    }
-    size = target - ratesStrStart;
-    if ((ratesStr = (char *)malloc(size + 1)) == NULL) {
-        ALOGE("ERROR: Unable to allocate memory to hold sample rate strings");
-        close(fd);
-        free(read_buf);
-        return NO_MEMORY;
-    }
-    if ((ratesStrForVal = (char *)malloc(size + 1)) == NULL) {
-        ALOGE("ERROR: Unable to allocate memory to hold sample rate string");
-        close(fd);
-        free(ratesStr);
-        free(read_buf);
-        return NO_MEMORY;
+status_t AudioUsbALSA::getCap(UsbAudioPCMModes usbAudioPCMModes, int &channels, int &sampleRate)
+{
+    Mutex::Autolock autoLock(mCapsLock);
+    UsbStreamCaps *caps = &mCaps[usbAudioPCMModes];
+    struct stat st;
+
+    ALOGD("getCap for %s", usbAudioPCMModes == USB_PLAYBACK ? "Playback" : "Capture");
+    sampleRate = 0;
+
+    /* The proc entry is recreated whenever a card registers, so a changed
+       inode also catches a replug that was not signalled to us */
+    if (mCapsValid &&
+        (stat(PATH, &st) < 0 || st.st_ino != mCapsIno || st.st_ctime != mCapsCtime)) {
+        mCapsValid = false;
     }
-    memcpy(ratesStr, ratesStrStart, size);
-    memcpy(ratesStrForVal, ratesStrStart, size);
-    ratesStr[size] = '\0';
-    ratesStrForVal[size] = '\0';
-
-    size = getnumOfRates(ratesStr);
-    if (!size) {
-        ALOGE("ERROR: Could not get rate size, returning");
-        close(fd);
-        free(ratesStrForVal);
-        free(ratesStr);
-        free(read_buf);
-        return UNKNOWN_ERROR;
+    if (!mCapsValid) {
+        mCapsMisses[usbAudioPCMModes]++;
+        if (loadCaps_l() != NO_ERROR) {
+            return UNKNOWN_ERROR;
+        }
+    } else {
+        mCapsHits[usbAudioPCMModes]++;
     }
 
-    //populate playback rates array
-    int ratesSupported[size];
-    nextSRString = strtok_r(ratesStrForVal, " ,", &temp_ptr);
-    if (nextSRString == NULL) {
-        ALOGE("ERROR: Could not get first rate val");
-        close(fd);
-        free(ratesStrForVal);
-        free(ratesStr);
-        free(read_buf);
+    if (!caps->sampleRate) {
+        ALOGE("ERROR: no usable %s altsetting in usb config file",
+              usbAudioPCMModes == USB_PLAYBACK ? "Playback" : "Capture");
         return UNKNOWN_ERROR;
     }
 
-    ratesSupported[0] = atoi(nextSRString);
-    ALOGV("ratesSupported[0] for playback: %d", ratesSupported[0]);
-    for (i = 1; i<size; i++) {
-        nextSRString = strtok_r(NULL, " ,.-", &temp_ptr);
-        ratesSupported[i] = atoi(nextSRString);
-        ALOGD("ratesSupported[%d] for playback: %d",i, ratesSupported[i]);
-    }
-
-    for (i = 0; i<size; i++) {
-        if ((ratesSupported[i] > sampleRate) && (ratesSupported[i] <= 48000)) {
-            // Sample Rate should be one of the proxy supported rates only
-            // This is because proxy port is used to read from/write to DSP .
-            if ((ratesSupported[i] == PROXY_SUPPORTED_RATE_8000) ||
-                (ratesSupported[i] == PROXY_SUPPORTED_RATE_16000) ||
-                (ratesSupported[i] == PROXY_SUPPORTED_RATE_48000)) {
-                sampleRate = ratesSupported[i];
-            }
-        }
-    }
-    ALOGD("sampleRate: %d", sampleRate);
-    if (sampleRate == 0 ) {
-        sampleRate = ratesSupported[0];
-        close(fd);
+    channels = caps->channels;
+    sampleRate = caps->sampleRate;
+    ALOGD("sampleRate: %d channels: %d format: %d", sampleRate, channels, caps->format);
+    if (!caps->nativeRate) {
         ALOGE("Device sampleRate:%d doesn't match with PROXY supported rate\n", sampleRate);
         return BAD_VALUE;
     }
-
-    close(fd);
-    free(ratesStrForVal);
-    free(ratesStr);
-    free(read_buf);
-    ratesStrForVal = NULL;
-    ratesStr = NULL;
-    read_buf = NULL;
     return NO_ERROR;
 }
 
+void AudioUsbALSA::dump(int fd)
+{
+    Mutex::Autolock autoLock(mCapsLock);
+    const char *names[] = { "Playback", "Capture" };
+    char buffer[256];
+
+    snprintf(buffer, sizeof(buffer), "USB caps: %s, %u loads, last load %lld us\n",
+             mCapsValid ? "valid" : "invalid", mCapsLoads, mCapsLoadTimeUs);
+    write(fd, buffer, strlen(buffer));
+    for (int i = USB_PLAYBACK; i <= USB_RECORDING; i++) {
+        const UsbStreamCaps *caps = &mCaps[i];
+        snprintf(buffer, sizeof(buffer),
+                 "  %s: %d altsettings, chosen rate %d channels %d format %d%s,"
+                 " %u hits, %u misses\n",
+                 names[i], caps->numAltSettings, caps->sampleRate, caps->channels,
+                 caps->format, caps->nativeRate ? "" : " (resampled)",
+                 mCapsHits[i], mCapsMisses[i]);
+        write(fd, buffer, strlen(buffer));
+    }
+}
+
 void AudioUsbALSA::exitPlaybackThread(uint64_t writeVal)
 {
 #ifdef OUTPUT_PROXY_BUFFER_LOG
@@ -510,7 +608,7 @@ void AudioUsbALSA::RecordingThreadEntry() {
 
     {
         Mutex::Autolock autoRecordLock(mRecordLock);
-        err = getCap((char *)"Capture:", mchannelsCapture, msampleRateCapture);
+        err = getCap(USB_RECORDING, mchannelsCapture, msampleRateCapture);
         if (err && (err != BAD_VALUE)) {
             ALOGE("ERROR: Could not get Capture capabilities from usb device");
             return;
@@ -1023,6 +1121,16 @@ void AudioUsbALSA::initPlaybackVolume() {
     }
 }
 
+void AudioUsbALSA::logPlaybackAsrcStats() {
+    AudioUsbAsrcStats stats;
+
+    mPlaybackAsrc.getStats(&stats);
+    ALOGD("USB playback drift %.1f ppm, correction %.1f ppm, latency %.0f/%.0f frames"
+          " (min %d max %d), %u updates, %u clamped",
+          stats.driftPpm, stats.correctionPpm, stats.filteredFill, stats.targetFill,
+          stats.minFill, stats.maxFill, stats.updates, stats.clamped);
+}
+
 void AudioUsbALSA::PlaybackThreadEntry() {
     ALOGD("PlaybackThreadEntry");
     mnfdsPlayback = 2;
@@ -1046,6 +1154,9 @@ void AudioUsbALSA::PlaybackThreadEntry() {
     int proxySizeRemaining = 0;
     int usbSizeFilled = 0;
     int usbframes = 0;
+    int frameSize = 0;
+    size_t asrcInFrames, asrcOutFrames;
+    uint32_t asrcUpdates = 0;
     u_int8_t *proxybuf = NULL;
     u_int8_t *usbbuf = NULL;
     int proxy_sample_rate = PROXY_SUPPORTED_RATE_48000;
@@ -1060,7 +1171,7 @@ void AudioUsbALSA::PlaybackThreadEntry() {
     {
         Mutex::Autolock autoLock(mLock);
 
-        err = getCap((char *)"Playback:", mchannelsPlayback, msampleRatePlayback);
+        err = getCap(USB_PLAYBACK, mchannelsPlayback, msampleRatePlayback);
         if (err && (err != BAD_VALUE)) {
             ALOGE("ERROR: Could not get playback capabilities from usb device");
             return;
@@ -1138,6 +1249,13 @@ void AudioUsbALSA::PlaybackThreadEntry() {
         proxybuf = ( u_int8_t *) malloc(PROXY_PERIOD_SIZE);
         usbbuf = ( u_int8_t *) malloc(USB_PERIOD_SIZE);
 
+        frameSize = mchannelsPlayback * 2;
+        if (mPlaybackAsrc.init(proxy_sample_rate, msampleRatePlayback, mchannelsPlayback)) {
+            ALOGE("ERROR: Unable to set up drift compensation, %d -> %d Hz, %d channels",
+                  proxy_sample_rate, msampleRatePlayback, mchannelsPlayback);
+            mkillPlayBackThread = true;
+        }
+
         if (proxybuf == NULL || usbbuf == NULL) {
             ALOGE("ERROR: Unable to allocate USB audio buffer(s): proxybuf=%p, usbbuf=%p",
                   proxybuf, usbbuf);
@@ -1243,14 +1361,15 @@ void AudioUsbALSA::PlaybackThreadEntry() {
             }
         }
         //ALOGV("usbSizeFilled %d, proxySizeRemaining %d ",usbSizeFilled,proxySizeRemaining);
-        if (usbPeriod - usbSizeFilled <= proxySizeRemaining) {
-            memcpy(usbbuf + usbSizeFilled, proxybuf + proxyPeriod - proxySizeRemaining, usbPeriod - usbSizeFilled);
-            proxySizeRemaining -= (usbPeriod - usbSizeFilled);
-            usbSizeFilled = usbPeriod;
-        }
-        else {
-            memcpy(usbbuf + usbSizeFilled, proxybuf + proxyPeriod - proxySizeRemaining,proxySizeRemaining);
-            usbSizeFilled += proxySizeRemaining;
+        /* Resample rather than copy, so the USB side is fed at its own
+           clock; the ASRC stops when either buffer runs out */
+        asrcInFrames = proxySizeRemaining / frameSize;
+        asrcOutFrames = (usbPeriod - usbSizeFilled) / frameSize;
+        mPlaybackAsrc.process((int16_t *)(proxybuf + proxyPeriod - proxySizeRemaining), &asrcInFrames,
+                              (int16_t *)(usbbuf + usbSizeFilled), &asrcOutFrames);
+        proxySizeRemaining -= asrcInFrames * frameSize;
+        usbSizeFilled += asrcOutFrames * frameSize;
+        if (proxySizeRemaining < frameSize) {
             proxySizeRemaining = 0;
         }
 
@@ -1326,8 +1445,20 @@ void AudioUsbALSA::PlaybackThreadEntry() {
                 ioctl(musbPlaybackHandle->fd, SNDRV_PCM_IOCTL_PAUSE,1);
                 pcm_prepare(musbPlaybackHandle);
                 musbPlaybackHandle->start = false;
+                //Latency restarts from scratch, keep only the drift estimate
+                mPlaybackAsrc.relock();
                 continue;
             }
+            if (musbPlaybackHandle->start) {
+                /* Everything queued between the two clocks: captured but
+                   unread proxy frames, the unconsumed part of proxybuf and
+                   the frames pending in the USB ring */
+                mPlaybackAsrc.update(pcm_avail(mproxyPlaybackHandle) + proxySizeRemaining / frameSize,
+                                     bytes_written);
+                if (++asrcUpdates % ASRC_STATS_INTERVAL == 0) {
+                    logPlaybackAsrcStats();
+                }
+            }
             if ((bytes_written >= musbPlaybackHandle->sw_p->start_threshold) && (!musbPlaybackHandle->start)) {
                 if (!mkillPlayBackThread) {
                     err = startDevice(musbPlaybackHandle, &mkillPlayBackThread);
@@ -1342,6 +1473,7 @@ void AudioUsbALSA::PlaybackThreadEntry() {
             /***************  End sync up after write -- USB *********************/
         }
     }
+    logPlaybackAsrcStats();
 #ifdef OUTPUT_PROXY_BUFFER_LOG
     ALOGV("close file output");
     if(outputBufferFile1)
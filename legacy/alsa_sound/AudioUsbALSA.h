@@ -38,6 +38,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 #include <system/audio.h>
 #include <hardware/audio.h>
 #include <utils/threads.h>
+#include <sys/types.h>
 
 #define DEFAULT_BUFFER_SIZE   2048
 #define POLL_TIMEOUT   3000
@@ -61,12 +62,37 @@ extern "C" {
 
 #include <hardware/hardware.h>
 
+#include "AudioUsbAsrc.h"
+
 namespace android_audio_legacy
 {
 using android::List;
 using android::Mutex;
 class AudioUsbALSA;
 
+#define USB_MAX_ALTSETTINGS 16
+#define USB_MAX_RATES 16
+
+//One altsetting of a USB stream, as listed in /proc/asound/cardX/streamY
+struct UsbAltSetting {
+    int format;                  //SNDRV_PCM_FORMAT_*, -1 if not recognised
+    int channels;
+    int numRates;                //0 when the rates are a continuous range
+    int rates[USB_MAX_RATES];
+    int minRate;
+    int maxRate;
+};
+
+struct UsbStreamCaps {
+    int numAltSettings;
+    UsbAltSetting altSettings[USB_MAX_ALTSETTINGS];
+    //configuration picked from the altsettings
+    int format;
+    int channels;
+    int sampleRate;
+    bool nativeRate;             //rate runs on the proxy without resampling
+};
+
 class AudioUsbALSA
 {
 private:
@@ -92,6 +118,8 @@ private:
     snd_use_case_mgr_t *mUcMgr;
     Mutex    mLock;
     Mutex mRecordLock;
+    //Drift compensation between the proxy and USB clocks on playback
+    AudioUsbAsrc mPlaybackAsrc;
 
     enum UsbAudioPCMModes {
         USB_PLAYBACK = 0,
@@ -121,6 +149,7 @@ private:
     static void *RecordingThreadWrapper(void *me);
 
     void initPlaybackVolume();
+    void logPlaybackAsrcStats();
 
     status_t setHardwareParams(pcm *local_handle, uint32_t sampleRate, uint32_t channels, int periodSize, UsbAudioPCMModes usbAudioPCMModes);
 
@@ -128,8 +157,21 @@ private:
 
     status_t closeDevice(pcm *handle);
 
-    status_t getCap(char * type, int &channels, int &sampleRate);
-    int         getnumOfRates(char *rateStr);
+    status_t getCap(UsbAudioPCMModes usbAudioPCMModes, int &channels, int &sampleRate);
+    status_t loadCaps_l();
+    void     chooseConfig_l(UsbStreamCaps *caps);
+    //Capabilities of the attached device, indexed by USB_PLAYBACK/USB_RECORDING
+    UsbStreamCaps mCaps[2];
+    bool        mCapsValid;
+    ino_t       mCapsIno;
+    time_t      mCapsCtime;
+    uint32_t    mCapsLoads;
+    //getCap() lookups served from mCaps and ones that had to reload it,
+    //kept apart from mCaps so a reload does not reset them
+    uint32_t    mCapsHits[2];
+    uint32_t    mCapsMisses[2];
+    int64_t     mCapsLoadTimeUs;
+    Mutex       mCapsLock;
     int         mchannelsPlayback;
     int         msampleRatePlayback;
     int         mchannelsCapture;
@@ -139,6 +181,8 @@ public:
     AudioUsbALSA();
     virtual            ~AudioUsbALSA();
 
+    void invalidateCaps();
+    void dump(int fd);
     void exitPlaybackThread(uint64_t writeVal);
     void exitRecordingThread(uint64_t writeVal);
     void setkillUsbRecordingThread(bool val);
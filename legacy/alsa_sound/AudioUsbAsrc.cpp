@@ -0,0 +1,201 @@
+/* AudioUsbAsrc.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "AudioUsbAsrc.h"
+
+/* Loop constants, per update (one USB period, ~21ms). The fill level
+ * measurement is a sawtooth of up to a period on either side, so it is
+ * smoothed heavily before it reaches the controller; the gains give a
+ * loop that settles in about a minute without audible pitch movement.
+ */
+#define ASRC_FILTER_ALPHA  (1.0 / 64.0)
+#define ASRC_KP            0.5
+#define ASRC_KI            0.0005
+
+namespace android_audio_legacy
+{
+
+static inline double clampPpm(double ppm)
+{
+    if (ppm > ASRC_MAX_CORRECTION_PPM)
+        return ASRC_MAX_CORRECTION_PPM;
+    if (ppm < -ASRC_MAX_CORRECTION_PPM)
+        return -ASRC_MAX_CORRECTION_PPM;
+    return ppm;
+}
+
+AudioUsbAsrc::AudioUsbAsrc()
+{
+    mChannels = 0;
+    mNominalStep = 1.0;
+    reset();
+}
+
+int AudioUsbAsrc::init(uint32_t inRate, uint32_t outRate, uint32_t channels)
+{
+    if (!inRate || !outRate || !channels || channels > ASRC_MAX_CHANNELS)
+        return -EINVAL;
+
+    mChannels = channels;
+    mNominalStep = (double)inRate / (double)outRate;
+    reset();
+    return 0;
+}
+
+void AudioUsbAsrc::reset()
+{
+    mStep = mNominalStep;
+    //Pull in a fresh frame before the first output sample
+    mPhase = 1.0;
+    memset(mHistory, 0, sizeof(mHistory));
+    mIntegral = 0;
+    mCorrection = 0;
+    mUpdates = 0;
+    mClamped = 0;
+    mFramesIn = 0;
+    mFramesOut = 0;
+    relock();
+}
+
+void AudioUsbAsrc::relock()
+{
+    mTarget = 0;
+    mFiltered = 0;
+    mWarmupSum = 0;
+    mWarmup = 0;
+    mMinFill = INT_MAX;
+    mMaxFill = INT_MIN;
+    //Run at the drift estimate until a new setpoint is known
+    mCorrection = mIntegral;
+    mStep = mNominalStep * (1.0 + mCorrection * 1e-6);
+}
+
+/* 4 point, 3rd order Hermite interpolation between h[1] and h[2]. */
+static inline float hermite(const float *h, uint32_t stride, float mu)
+{
+    float xm1 = h[0];
+    float x0  = h[stride];
+    float x1  = h[2 * stride];
+    float x2  = h[3 * stride];
+    float c1 = 0.5f * (x1 - xm1);
+    float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+    float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+    return ((c3 * mu + c2) * mu + c1) * mu + x0;
+}
+
+void AudioUsbAsrc::process(const int16_t *in, size_t *inFrames,
+                           int16_t *out, size_t *outFrames)
+{
+    size_t inUsed = 0, outUsed = 0;
+    uint32_t ch;
+
+    while (outUsed < *outFrames) {
+        while (mPhase >= 1.0) {
+            if (inUsed == *inFrames)
+                goto done;
+            //History is stored as 4 taps per channel, oldest first
+            for (ch = 0; ch < mChannels; ch++) {
+                float *h = &mHistory[ch];
+                h[0] = h[mChannels];
+                h[mChannels] = h[2 * mChannels];
+                h[2 * mChannels] = h[3 * mChannels];
+                h[3 * mChannels] = in[inUsed * mChannels + ch];
+            }
+            inUsed++;
+            mPhase -= 1.0;
+        }
+        for (ch = 0; ch < mChannels; ch++) {
+            float s = hermite(&mHistory[ch], mChannels, (float)mPhase);
+            if (s > 32767.0f)
+                s = 32767.0f;
+            else if (s < -32768.0f)
+                s = -32768.0f;
+            out[outUsed * mChannels + ch] = (int16_t)(s < 0 ? s - 0.5f : s + 0.5f);
+        }
+        outUsed++;
+        mPhase += mStep;
+    }
+done:
+    *inFrames = inUsed;
+    *outFrames = outUsed;
+    mFramesIn += inUsed;
+    mFramesOut += outUsed;
+}
+
+void AudioUsbAsrc::update(int32_t inRingFrames, int32_t outRingFrames)
+{
+    //Everything queued between the two clocks, in output frames
+    double fill = inRingFrames / mNominalStep + outRingFrames;
+
+    mUpdates++;
+    if ((int32_t)fill < mMinFill)
+        mMinFill = (int32_t)fill;
+    if ((int32_t)fill > mMaxFill)
+        mMaxFill = (int32_t)fill;
+
+    if (mWarmup < ASRC_WARMUP_UPDATES) {
+        mWarmupSum += fill;
+        if (++mWarmup == ASRC_WARMUP_UPDATES) {
+            mTarget = mWarmupSum / ASRC_WARMUP_UPDATES;
+            mFiltered = mTarget;
+        }
+        return;
+    }
+
+    mFiltered += (fill - mFiltered) * ASRC_FILTER_ALPHA;
+    //More queued than the setpoint means the input clock is ahead, so
+    //consume input faster
+    double error = mFiltered - mTarget;
+    mIntegral = clampPpm(mIntegral + error * ASRC_KI);
+    double correction = mIntegral + error * ASRC_KP;
+    mCorrection = clampPpm(correction);
+    if (mCorrection != correction)
+        mClamped++;
+    mStep = mNominalStep * (1.0 + mCorrection * 1e-6);
+}
+
+void AudioUsbAsrc::getStats(AudioUsbAsrcStats *stats) const
+{
+    stats->driftPpm = mIntegral;
+    stats->correctionPpm = mCorrection;
+    stats->targetFill = mTarget;
+    stats->filteredFill = mFiltered;
+    stats->minFill = mMinFill;
+    stats->maxFill = mMaxFill;
+    stats->updates = mUpdates;
+    stats->clamped = mClamped;
+    stats->framesIn = mFramesIn;
+    stats->framesOut = mFramesOut;
+}
+
+};        // namespace android_audio_legacy
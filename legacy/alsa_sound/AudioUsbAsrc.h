@@ -0,0 +1,109 @@
+/* AudioUsbAsrc.h
+
+  Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef ANDROID_AUDIO_USB_ASRC_H
+#define ANDROID_AUDIO_USB_ASRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ASRC_MAX_CHANNELS       8
+//Number of fill level updates averaged to pick the latency setpoint
+#define ASRC_WARMUP_UPDATES     32
+//Largest correction ever applied to the nominal ratio
+#define ASRC_MAX_CORRECTION_PPM 1000.0
+
+namespace android_audio_legacy
+{
+
+struct AudioUsbAsrcStats {
+    double   driftPpm;        //estimated proxy clock offset relative to USB
+    double   correctionPpm;   //correction currently applied to the ratio
+    double   targetFill;      //latency setpoint, in output frames
+    double   filteredFill;    //smoothed measured latency, in output frames
+    int32_t  minFill;         //lowest raw latency seen since the last lock
+    int32_t  maxFill;         //highest raw latency seen since the last lock
+    uint32_t updates;         //number of control loop updates
+    uint32_t clamped;         //updates where the correction hit the limit
+    uint64_t framesIn;
+    uint64_t framesOut;
+};
+
+/* Asynchronous sample rate converter bridging two independently clocked
+ * PCM rings. The conversion ratio starts at inRate/outRate and is steered
+ * by a PI loop on the total number of frames buffered between the two
+ * devices, so the latency settles at whatever it was once playback
+ * started and stays there regardless of clock drift.
+ */
+class AudioUsbAsrc {
+public:
+    AudioUsbAsrc();
+
+    int  init(uint32_t inRate, uint32_t outRate, uint32_t channels);
+    void reset();
+
+    //Converts interleaved 16 bit samples. On return inFrames and outFrames
+    //hold the number of frames consumed and produced; processing stops as
+    //soon as either buffer is exhausted.
+    void process(const int16_t *in, size_t *inFrames,
+                 int16_t *out, size_t *outFrames);
+
+    //Feeds the control loop with the fill levels of both rings, in frames
+    //of the respective device. Called once per output period.
+    void update(int32_t inRingFrames, int32_t outRingFrames);
+
+    //Re-captures the latency setpoint after a discontinuity such as an
+    //xrun, keeping the drift estimate.
+    void relock();
+
+    void getStats(AudioUsbAsrcStats *stats) const;
+
+private:
+    uint32_t mChannels;
+    double   mNominalStep;
+    double   mStep;
+    double   mPhase;
+    float    mHistory[4 * ASRC_MAX_CHANNELS];
+
+    double   mTarget;
+    double   mFiltered;
+    double   mIntegral;
+    double   mCorrection;
+    double   mWarmupSum;
+    uint32_t mWarmup;
+    int32_t  mMinFill;
+    int32_t  mMaxFill;
+    uint32_t mUpdates;
+    uint32_t mClamped;
+    uint64_t mFramesIn;
+    uint64_t mFramesOut;
+};
+
+};        // namespace android_audio_legacy
+#endif    // ANDROID_AUDIO_USB_ASRC_H
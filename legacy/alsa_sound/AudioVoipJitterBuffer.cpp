@@ -0,0 +1,263 @@
+/* AudioVoipJitterBuffer.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#include <errno.h>
+#include <string.h>
+
+#include "AudioVoipJitterBuffer.h"
+
+//Expand frames that still carry a faded copy of the last frame
+#define VOIP_JB_FADE_RUN  4
+
+namespace android_audio_legacy
+{
+
+AudioVoipJitterBuffer::AudioVoipJitterBuffer()
+{
+    mFrameBytes = 0;
+    mFrameUs = 0;
+    mPcm = false;
+    setHooks(NULL);
+    reset();
+}
+
+int AudioVoipJitterBuffer::init(size_t frameBytes, uint32_t frameUs, bool pcm)
+{
+    if (!frameBytes || frameBytes > VOIP_JB_MAX_FRAME_BYTES || !frameUs)
+        return -EINVAL;
+
+    mFrameBytes = frameBytes;
+    mFrameUs = frameUs;
+    mPcm = pcm;
+    reset();
+    return 0;
+}
+
+void AudioVoipJitterBuffer::reset()
+{
+    mHead = 0;
+    mCount = 0;
+    mHaveLast = false;
+    mPlaying = false;
+    mTarget = VOIP_JB_MIN_DEPTH;
+    mAboveTarget = 0;
+    mExpandRun = 0;
+    mIdle = 0;
+    mGridSet = false;
+    mExpectedUs = 0;
+    mDelayCount = 0;
+    mDelayNext = 0;
+    mJitterUs = 0;
+    mResidenceSumUs = 0;
+    mMaxResidenceUs = 0;
+    mFramesIn = 0;
+    mFramesOut = 0;
+    mPlayed = 0;
+    mPrebuffered = 0;
+    mConcealed = 0;
+    mUnderruns = 0;
+    mCompressed = 0;
+    mOverflows = 0;
+}
+
+void AudioVoipJitterBuffer::setHooks(const AudioVoipJitterHooks *hooks)
+{
+    if (hooks) {
+        mHooks = *hooks;
+    } else {
+        memset(&mHooks, 0, sizeof(mHooks));
+    }
+}
+
+void AudioVoipJitterBuffer::updateTarget(int64_t delayUs)
+{
+    int64_t minDelay, maxDelay;
+    uint32_t i, target;
+
+    mDelay[mDelayNext] = delayUs;
+    mDelayNext = (mDelayNext + 1) % VOIP_JB_WINDOW;
+    if (mDelayCount < VOIP_JB_WINDOW)
+        mDelayCount++;
+
+    minDelay = maxDelay = mDelay[0];
+    for (i = 1; i < mDelayCount; i++) {
+        if (mDelay[i] < minDelay)
+            minDelay = mDelay[i];
+        if (mDelay[i] > maxDelay)
+            maxDelay = mDelay[i];
+    }
+    mJitterUs = maxDelay - minDelay;
+
+    //Enough queued to ride out the latest arrival seen, plus the frame
+    //being played
+    target = (uint32_t)((mJitterUs + mFrameUs - 1) / mFrameUs) + VOIP_JB_MIN_DEPTH;
+    if (target > VOIP_JB_MAX_DEPTH)
+        target = VOIP_JB_MAX_DEPTH;
+    mTarget = target;
+}
+
+void AudioVoipJitterBuffer::put(const void *data, size_t bytes, int64_t nowUs)
+{
+    uint32_t slot;
+
+    if (idle()) {
+        //The client paused, start over as a new talk spurt
+        mPlaying = false;
+        mGridSet = false;
+        mDelayCount = 0;
+        mDelayNext = 0;
+        mExpandRun = 0;
+    }
+    mIdle = 0;
+
+    if (!mGridSet) {
+        mExpectedUs = nowUs;
+        mGridSet = true;
+    }
+    updateTarget(nowUs - mExpectedUs);
+    mExpectedUs += mFrameUs;
+
+    if (mCount == VOIP_JB_MAX_FRAMES) {
+        mHead = (mHead + 1) % VOIP_JB_MAX_FRAMES;
+        mCount--;
+        mOverflows++;
+    }
+    slot = (mHead + mCount) % VOIP_JB_MAX_FRAMES;
+    if (bytes > mFrameBytes)
+        bytes = mFrameBytes;
+    memcpy(mFrames[slot], data, bytes);
+    memset(mFrames[slot] + bytes, 0, mFrameBytes - bytes);
+    mArrival[slot] = nowUs;
+    mCount++;
+    mFramesIn++;
+}
+
+void AudioVoipJitterBuffer::expand(void *out)
+{
+    const void *last = mHaveLast ? mLast : NULL;
+
+    mExpandRun++;
+    mConcealed++;
+    if (mHooks.expand) {
+        mHooks.expand(mHooks.cookie, out, mFrameBytes, last, mExpandRun);
+        return;
+    }
+    if (!mPcm || !last || mExpandRun > VOIP_JB_FADE_RUN) {
+        memset(out, 0, mFrameBytes);
+        return;
+    }
+    //Repeat the last frame, 6dB quieter on every run
+    const int16_t *in = (const int16_t *)last;
+    int16_t *pcm = (int16_t *)out;
+    for (size_t i = 0; i < mFrameBytes / sizeof(int16_t); i++)
+        pcm[i] = in[i] >> mExpandRun;
+}
+
+void AudioVoipJitterBuffer::pop(void *out)
+{
+    memcpy(out, mFrames[mHead], mFrameBytes);
+    mHead = (mHead + 1) % VOIP_JB_MAX_FRAMES;
+    mCount--;
+}
+
+int AudioVoipJitterBuffer::get(void *out, int64_t nowUs)
+{
+    int64_t residence;
+
+    mFramesOut++;
+    mIdle++;
+    if (!mPlaying) {
+        if (!mCount || mCount < mTarget) {
+            memset(out, 0, mFrameBytes);
+            mPrebuffered++;
+            return VOIP_JB_PREBUFFER;
+        }
+        mPlaying = true;
+    }
+
+    //After running dry, keep expanding until the target depth is back
+    if (!mCount || (mExpandRun && mCount < mTarget)) {
+        if (!mExpandRun)
+            mUnderruns++;
+        expand(out);
+        return VOIP_JB_CONCEAL;
+    }
+    mExpandRun = 0;
+
+    if (mCount > mTarget && mCount >= 2) {
+        if (++mAboveTarget >= VOIP_JB_SHRINK_HOLD) {
+            uint8_t first[VOIP_JB_MAX_FRAME_BYTES];
+
+            mAboveTarget = 0;
+            mCompressed++;
+            pop(first);
+            if (!mHooks.compress ||
+                !mHooks.compress(mHooks.cookie, out, mFrameBytes, first,
+                                 mFrames[mHead])) {
+                memcpy(out, mFrames[mHead], mFrameBytes);
+            }
+            residence = nowUs - mArrival[mHead];
+            mHead = (mHead + 1) % VOIP_JB_MAX_FRAMES;
+            mCount--;
+            goto played;
+        }
+    } else {
+        mAboveTarget = 0;
+    }
+
+    residence = nowUs - mArrival[mHead];
+    pop(out);
+
+played:
+    memcpy(mLast, out, mFrameBytes);
+    mHaveLast = true;
+    mPlayed++;
+    mResidenceSumUs += residence;
+    if (residence > mMaxResidenceUs)
+        mMaxResidenceUs = residence;
+    return VOIP_JB_FRAME;
+}
+
+void AudioVoipJitterBuffer::getStats(AudioVoipJitterStats *stats) const
+{
+    stats->depth = mCount;
+    stats->target = mTarget;
+    stats->jitterUs = mJitterUs;
+    stats->avgResidenceUs = mPlayed ? mResidenceSumUs / mPlayed : 0;
+    stats->maxResidenceUs = mMaxResidenceUs;
+    stats->framesIn = mFramesIn;
+    stats->framesOut = mFramesOut;
+    stats->prebuffered = mPrebuffered;
+    stats->concealed = mConcealed;
+    stats->underruns = mUnderruns;
+    stats->compressed = mCompressed;
+    stats->overflows = mOverflows;
+}
+
+};        // namespace android_audio_legacy
@@ -0,0 +1,163 @@
+/* AudioVoipJitterBuffer.h
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifndef ANDROID_AUDIO_VOIP_JITTER_BUFFER_H
+#define ANDROID_AUDIO_VOIP_JITTER_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define VOIP_JB_MAX_FRAMES      16
+//Largest VoIP frame, 20ms of 16kHz mono PCM
+#define VOIP_JB_MAX_FRAME_BYTES 640
+#define VOIP_JB_MIN_DEPTH       1
+#define VOIP_JB_MAX_DEPTH       8
+//Arrivals the jitter estimate is taken over, ~1.3s of 20ms frames
+#define VOIP_JB_WINDOW          64
+//Frames above the target tolerated before two are merged into one
+#define VOIP_JB_SHRINK_HOLD     25
+//Frames played without any input before the buffer counts as idle
+#define VOIP_JB_IDLE_FRAMES     50
+
+namespace android_audio_legacy
+{
+
+//What get() filled the output frame with
+enum {
+    VOIP_JB_FRAME,          //the oldest queued frame
+    VOIP_JB_PREBUFFER,      //silence, not playing yet
+    VOIP_JB_CONCEAL,        //an expand frame, the buffer ran dry
+};
+
+/* Time-scale hooks. expand() fills a frame the stream does not have,
+ * last being the previous frame played (NULL if none) and run the number
+ * of consecutive expand frames including this one. compress() replaces
+ * two queued frames by one to cut latency; returning false drops the
+ * older frame instead. Either may be NULL to use the defaults: a fading
+ * repeat of the last frame for PCM, silence otherwise, and dropping.
+ */
+struct AudioVoipJitterHooks {
+    void (*expand)(void *cookie, void *out, size_t bytes,
+                   const void *last, uint32_t run);
+    bool (*compress)(void *cookie, void *out, size_t bytes,
+                     const void *first, const void *second);
+    void *cookie;
+};
+
+struct AudioVoipJitterStats {
+    uint32_t depth;           //frames queued
+    uint32_t target;          //depth playout is held at
+    int64_t  jitterUs;        //spread of arrival delays over the window
+    int64_t  avgResidenceUs;  //arrival to playout, played frames only
+    int64_t  maxResidenceUs;
+    uint32_t framesIn;
+    uint32_t framesOut;       //frames handed out, any kind
+    uint32_t prebuffered;
+    uint32_t concealed;
+    uint32_t underruns;       //times the buffer ran dry while playing
+    uint32_t compressed;
+    uint32_t overflows;       //frames dropped because the buffer was full
+};
+
+/* Adaptive jitter buffer between the VoIP client and the DSP. Frames
+ * are timestamped on arrival; the spread of their lateness against a
+ * regular frame grid sets the depth playout is held at, rising as soon
+ * as the jitter grows and falling once it has aged out of the window.
+ * The caller supplies the clocks, so it runs the same on the host.
+ */
+class AudioVoipJitterBuffer {
+public:
+    AudioVoipJitterBuffer();
+
+    int  init(size_t frameBytes, uint32_t frameUs, bool pcm);
+    void reset();
+    void setHooks(const AudioVoipJitterHooks *hooks);
+
+    //Queues one frame received at nowUs, a short frame is padded with
+    //silence. The oldest frame is dropped if the buffer is full.
+    void put(const void *data, size_t bytes, int64_t nowUs);
+
+    //Fills out with frameBytes of the frame to play at nowUs.
+    //Returns one of the VOIP_JB_* kinds.
+    int  get(void *out, int64_t nowUs);
+
+    size_t   frameBytes() const { return mFrameBytes; }
+    uint32_t frameUs() const { return mFrameUs; }
+    uint32_t depth() const { return mCount; }
+    uint32_t target() const { return mTarget; }
+    //True once nothing has been queued for VOIP_JB_IDLE_FRAMES gets
+    bool     idle() const { return mIdle >= VOIP_JB_IDLE_FRAMES; }
+
+    void getStats(AudioVoipJitterStats *stats) const;
+
+private:
+    void updateTarget(int64_t delayUs);
+    void expand(void *out);
+    void pop(void *out);
+
+    size_t   mFrameBytes;
+    uint32_t mFrameUs;
+    bool     mPcm;
+    AudioVoipJitterHooks mHooks;
+
+    uint8_t  mFrames[VOIP_JB_MAX_FRAMES][VOIP_JB_MAX_FRAME_BYTES];
+    int64_t  mArrival[VOIP_JB_MAX_FRAMES];
+    uint32_t mHead;
+    uint32_t mCount;
+    uint8_t  mLast[VOIP_JB_MAX_FRAME_BYTES];
+    bool     mHaveLast;
+
+    bool     mPlaying;
+    uint32_t mTarget;
+    uint32_t mAboveTarget;
+    uint32_t mExpandRun;
+    uint32_t mIdle;
+
+    //Arrival lateness against the frame grid
+    bool     mGridSet;
+    int64_t  mExpectedUs;
+    int64_t  mDelay[VOIP_JB_WINDOW];
+    uint32_t mDelayCount;
+    uint32_t mDelayNext;
+    int64_t  mJitterUs;
+
+    int64_t  mResidenceSumUs;
+    int64_t  mMaxResidenceUs;
+    uint32_t mFramesIn;
+    uint32_t mFramesOut;
+    uint32_t mPlayed;
+    uint32_t mPrebuffered;
+    uint32_t mConcealed;
+    uint32_t mUnderruns;
+    uint32_t mCompressed;
+    uint32_t mOverflows;
+};
+
+};        // namespace android_audio_legacy
+#endif    // ANDROID_AUDIO_VOIP_JITTER_BUFFER_H
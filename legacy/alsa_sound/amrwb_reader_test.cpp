@@ -0,0 +1,267 @@
+/* amrwb_reader_test.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/* Validates and benchmarks the compressed capture frame parser used for
+ * AMR-WB recording. Without arguments it synthesizes a capture stream and
+ * checks the parser against the expected frames for a range of read sizes
+ * and batch limits, then times it against the previous read-in-place and
+ * memmove scheme. Given a recorded stream of raw capture periods it checks
+ * every frame against its AMR-WB TOC and, with an .amr file recorded from
+ * the same session, compares the payload. Builds on the host as well:
+ *
+ *   g++ -O2 -o amrwb_reader_test amrwb_reader_test.cpp AudioCompressFrameReader.cpp
+ *
+ * usage: amrwb_reader_test [periods.raw [expected.amr] [period_size]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "AudioCompressFrameReader.h"
+
+using android_audio_legacy::AudioCompressFrameReader;
+using android_audio_legacy::AudioCompressFrameStats;
+
+#define PERIOD_SIZE     2048
+//struct snd_compr_audio_info: frame size and 15 reserved words
+#define HEADER_SIZE     64
+#define SYNTH_PERIODS   100000
+#define AMR_WB_MAGIC    "#!AMR-WB\n"
+
+//Storage size including the TOC byte, by frame type
+static const int frameSizes[16] = {
+    18, 24, 33, 37, 41, 47, 51, 59, 61, 6, 1, 1, 1, 1, 1, 1
+};
+
+static double nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+//One capture period as the driver delivers it
+static size_t makePeriod(uint8_t *period, int frameType, uint32_t offset,
+                         uint32_t seed, uint8_t *expected)
+{
+    uint32_t *header = (uint32_t *)period;
+    size_t size = frameSizes[frameType];
+    uint8_t *frame = period + HEADER_SIZE + offset;
+
+    memset(period, 0xa5, PERIOD_SIZE);
+    memset(header, 0, HEADER_SIZE);
+    header[0] = size;
+    header[1] = offset;
+    frame[0] = (frameType << 3) | 0x04;
+    for (size_t i = 1; i < size; i++)
+        frame[i] = (uint8_t)(seed * 31 + i);
+    memcpy(expected, frame, size);
+    return size;
+}
+
+//Reads like AudioStreamInALSA does: whole frames until the buffer is full
+//or the batch limit is reached
+static size_t readFrames(AudioCompressFrameReader *reader, const uint8_t *stream,
+                         size_t periods, size_t *next, uint8_t *out, size_t bytes,
+                         unsigned batch)
+{
+    size_t read = 0;
+    unsigned frames = 0;
+
+    while (read < bytes && (!batch || frames < batch)) {
+        if (!reader->pendingSize()) {
+            if (*next == periods)
+                break;
+            memcpy(reader->periodBuffer(), stream + *next * PERIOD_SIZE, PERIOD_SIZE);
+            (*next)++;
+            if (!reader->parsePeriod(PERIOD_SIZE))
+                continue;
+        }
+        if (read && read + reader->pendingSize() > bytes)
+            break;
+        read += reader->emitFrame(out + read, bytes - read);
+        frames++;
+    }
+    return read;
+}
+
+//The previous scheme: capture each period at the write position of the
+//caller's buffer and move the payload down over the header
+static size_t readInPlace(const uint8_t *stream, size_t periods, size_t *next,
+                          uint8_t *out, size_t bytes)
+{
+    size_t read = 0;
+
+    while (read < bytes && *next < periods) {
+        uint8_t *buffer = out + read;
+        memcpy(buffer, stream + *next * PERIOD_SIZE, PERIOD_SIZE);
+        (*next)++;
+        uint32_t size = ((uint32_t *)buffer)[0];
+        uint32_t offset = ((uint32_t *)buffer)[1];
+        if (size) {
+            memmove(buffer, buffer + HEADER_SIZE + offset, size);
+            read += size;
+        }
+    }
+    return read;
+}
+
+static int synthetic()
+{
+    uint8_t *stream = (uint8_t *)malloc((size_t)SYNTH_PERIODS * PERIOD_SIZE);
+    uint8_t *expected = (uint8_t *)malloc((size_t)SYNTH_PERIODS * 61);
+    uint8_t *out = (uint8_t *)malloc((size_t)SYNTH_PERIODS * 61 + 2 * PERIOD_SIZE);
+    size_t expectedSize = 0;
+    static const size_t readSizes[] = { 61, 320, 640, 1280, 4096 };
+    static const unsigned batches[] = { 0, 1, 4, 10 };
+    int failures = 0;
+
+    srand(1);
+    for (size_t i = 0; i < SYNTH_PERIODS; i++) {
+        int frameType = rand() % 10;
+        //Every 97th period carries no frame
+        if (i % 97 == 96) {
+            memset(stream + i * PERIOD_SIZE, 0, PERIOD_SIZE);
+            continue;
+        }
+        expectedSize += makePeriod(stream + i * PERIOD_SIZE, frameType,
+                                   (i % 5) * 4, i, expected + expectedSize);
+    }
+
+    for (size_t r = 0; r < sizeof(readSizes) / sizeof(readSizes[0]); r++) {
+        for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+            AudioCompressFrameReader reader;
+            size_t next = 0, total = 0, n;
+
+            reader.init(PERIOD_SIZE, HEADER_SIZE);
+            while ((n = readFrames(&reader, stream, SYNTH_PERIODS, &next,
+                                   out + total, readSizes[r], batches[b])) > 0)
+                total += n;
+            bool ok = total == expectedSize && !memcmp(out, expected, total);
+            AudioCompressFrameStats stats;
+            reader.getStats(&stats);
+            printf("read %5zu batch %2u: %s, %llu frames, %u empty, %u clipped\n",
+                   readSizes[r], batches[b], ok ? "ok" : "MISMATCH",
+                   (unsigned long long)stats.frames, stats.emptyPeriods,
+                   stats.clipped);
+            if (!ok)
+                failures++;
+        }
+    }
+
+    //Benchmark at the read size AudioRecord uses for AMR-WB
+    for (int pass = 0; pass < 2; pass++) {
+        size_t next = 0, total = 0, n;
+        double start = nowMs();
+        if (pass) {
+            AudioCompressFrameReader reader;
+            reader.init(PERIOD_SIZE, HEADER_SIZE);
+            while ((n = readFrames(&reader, stream, SYNTH_PERIODS, &next,
+                                   out + total, 320, 0)) > 0)
+                total += n;
+        } else {
+            while ((n = readInPlace(stream, SYNTH_PERIODS, &next,
+                                    out + total, 320)) > 0)
+                total += n;
+        }
+        double ms = nowMs() - start;
+        printf("%-10s %8.2f ms for %d periods, %.1f ns per period\n",
+               pass ? "parser" : "in place", ms, SYNTH_PERIODS,
+               ms * 1e6 / SYNTH_PERIODS);
+    }
+
+    free(stream);
+    free(expected);
+    free(out);
+    return failures ? 1 : 0;
+}
+
+static int recorded(const char *periodsPath, const char *amrPath, size_t periodSize)
+{
+    FILE *fp = fopen(periodsPath, "rb");
+    FILE *amr = amrPath ? fopen(amrPath, "rb") : NULL;
+    AudioCompressFrameReader reader;
+    uint8_t frame[PERIOD_SIZE * 4];
+    uint8_t ref[64];
+    unsigned long frames = 0, badToc = 0, mismatches = 0;
+
+    if (!fp || (amrPath && !amr) || periodSize > sizeof(frame)) {
+        fprintf(stderr, "cannot open %s\n", !fp ? periodsPath : amrPath);
+        return 2;
+    }
+    if (amr) {
+        char magic[sizeof(AMR_WB_MAGIC) - 1];
+        if (fread(magic, 1, sizeof(magic), amr) != sizeof(magic) ||
+            memcmp(magic, AMR_WB_MAGIC, sizeof(magic))) {
+            fprintf(stderr, "%s is not an AMR-WB file\n", amrPath);
+            return 2;
+        }
+    }
+
+    reader.init(periodSize, HEADER_SIZE);
+    while (fread(reader.periodBuffer(), 1, periodSize, fp) == periodSize) {
+        if (!reader.parsePeriod(periodSize))
+            continue;
+        size_t size = reader.emitFrame(frame, sizeof(frame));
+        if ((int)size != frameSizes[(frame[0] >> 3) & 0x0f]) {
+            printf("frame %lu: size %zu does not match TOC 0x%02x\n",
+                   frames, size, frame[0]);
+            badToc++;
+        }
+        if (amr) {
+            if (size > sizeof(ref) || fread(ref, 1, size, amr) != size ||
+                memcmp(ref, frame, size)) {
+                printf("frame %lu differs from %s\n", frames, amrPath);
+                mismatches++;
+            }
+        }
+        frames++;
+    }
+
+    AudioCompressFrameStats stats;
+    reader.getStats(&stats);
+    printf("%lu frames from %llu periods, %u empty, %u clipped, "
+           "%lu bad TOC, %lu mismatches\n", frames,
+           (unsigned long long)stats.periods, stats.emptyPeriods,
+           stats.clipped, badToc, mismatches);
+    fclose(fp);
+    if (amr)
+        fclose(amr);
+    return (badToc || mismatches || stats.clipped) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        return synthetic();
+    return recorded(argv[1], argc > 2 && strcmp(argv[2], "-") ? argv[2] : NULL,
+                    argc > 3 ? atoi(argv[3]) : PERIOD_SIZE);
+}
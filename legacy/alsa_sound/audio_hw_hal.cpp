@@ -20,6 +20,7 @@
 //#define LOG_NDEBUG 0
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include <hardware/hardware.h>
 #include <system/audio.h>
@@ -28,6 +29,8 @@
 #include <hardware_legacy/AudioHardwareInterface.h>
 #include <hardware_legacy/AudioSystemLegacy.h>
 
+#include "AudioParamDispatch.h"
+
 namespace android_audio_legacy {
 
 extern "C" {
@@ -149,6 +152,25 @@ static uint32_t convert_audio_device(uint32_t from_device, int from_rev, int to_
     return to_device;
 }
 
+// Rewrites the routing value of a parameter set between HAL revisions.
+// Returns a malloc'ed copy of the set, or NULL if it carries no routing
+// or is too long to be rewritten without dropping pairs.
+static char *convert_routing_param(const char *kvpairs, int from_rev, int to_rev)
+{
+    AudioParamList parms(kvpairs);
+    int i = parms.find(AUDIO_PARAMETER_STREAM_ROUTING);
+    char buf[16];
+    int val;
+
+    if (i < 0 || !AudioParamList::parseInt(parms.value(i), &val))
+        return NULL;
+
+    val = convert_audio_device(val, from_rev, to_rev);
+    snprintf(buf, sizeof(buf), "%d", val);
+    parms.setValue(i, buf);
+    return parms.toString();
+}
+
 /** audio_stream_out implementation **/
 static uint32_t out_get_sample_rate(const struct audio_stream *stream)
 {
@@ -216,18 +238,12 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
 {
     struct qcom_stream_out *out =
         reinterpret_cast<struct qcom_stream_out *>(stream);
-    int val;
-    String8 s8 = String8(kvpairs);
-    AudioParameter parms = AudioParameter(String8(kvpairs));
-
-    if (parms.getInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val) == NO_ERROR) {
-        val = convert_audio_device(val, HAL_API_REV_2_0, HAL_API_REV_1_0);
-        parms.remove(String8(AUDIO_PARAMETER_STREAM_ROUTING));
-        parms.addInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val);
-        s8 = parms.toString();
-    }
+    char *converted = convert_routing_param(kvpairs, HAL_API_REV_2_0, HAL_API_REV_1_0);
+    int ret;
 
-    return out->qcom_out->setParameters(s8);
+    ret = out->qcom_out->setParameters(String8(converted ? converted : kvpairs));
+    free(converted);
+    return ret;
 }
 
 static char * out_get_parameters(const struct audio_stream *stream, const char *keys)
@@ -235,19 +251,12 @@ static char * out_get_parameters(const struct audio_stream *stream, const char *
     const struct qcom_stream_out *out =
         reinterpret_cast<const struct qcom_stream_out *>(stream);
     String8 s8;
-    int val;
+    char *converted;
 
     s8 = out->qcom_out->getParameters(String8(keys));
 
-    AudioParameter parms = AudioParameter(s8);
-    if (parms.getInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val) == NO_ERROR) {
-        val = convert_audio_device(val, HAL_API_REV_1_0, HAL_API_REV_2_0);
-        parms.remove(String8(AUDIO_PARAMETER_STREAM_ROUTING));
-        parms.addInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val);
-        s8 = parms.toString();
-    }
-
-    return strdup(s8.string());
+    converted = convert_routing_param(s8.string(), HAL_API_REV_1_0, HAL_API_REV_2_0);
+    return converted ? converted : strdup(s8.string());
 }
 
 static uint32_t out_get_latency(const struct audio_stream_out *stream)
@@ -418,18 +427,12 @@ static int in_set_parameters(struct audio_stream *stream, const char *kvpairs)
 {
     struct qcom_stream_in *in =
         reinterpret_cast<struct qcom_stream_in *>(stream);
-    int val;
-    AudioParameter parms = AudioParameter(String8(kvpairs));
-    String8 s8 = String8(kvpairs);
-
-    if (parms.getInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val) == NO_ERROR) {
-        val = convert_audio_device(val, HAL_API_REV_2_0, HAL_API_REV_1_0);
-        parms.remove(String8(AUDIO_PARAMETER_STREAM_ROUTING));
-        parms.addInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val);
-        s8 = parms.toString();
-    }
+    char *converted = convert_routing_param(kvpairs, HAL_API_REV_2_0, HAL_API_REV_1_0);
+    int ret;
 
-    return in->qcom_in->setParameters(s8);
+    ret = in->qcom_in->setParameters(String8(converted ? converted : kvpairs));
+    free(converted);
+    return ret;
 }
 
 static char * in_get_parameters(const struct audio_stream *stream,
@@ -438,19 +441,12 @@ static char * in_get_parameters(const struct audio_stream *stream,
     const struct qcom_stream_in *in =
         reinterpret_cast<const struct qcom_stream_in *>(stream);
     String8 s8;
-    int val;
+    char *converted;
 
     s8 = in->qcom_in->getParameters(String8(keys));
 
-    AudioParameter parms = AudioParameter(s8);
-    if (parms.getInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val) == NO_ERROR) {
-        val = convert_audio_device(val, HAL_API_REV_1_0, HAL_API_REV_2_0);
-        parms.remove(String8(AUDIO_PARAMETER_STREAM_ROUTING));
-        parms.addInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), val);
-        s8 = parms.toString();
-    }
-
-    return strdup(s8.string());
+    converted = convert_routing_param(s8.string(), HAL_API_REV_1_0, HAL_API_REV_2_0);
+    return converted ? converted : strdup(s8.string());
 }
 
 static int in_set_gain(struct audio_stream_in *stream, float gain)
@@ -0,0 +1,263 @@
+/* handle_index_test.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/* Checks ALSAHandleIndex against a plain walk of the handle list under
+ * random opens, closes and use case switches, with more handles open than
+ * the index starts out with, then times the lookups of one routing pass
+ * through the index against the strcmp walks they replace, for a growing
+ * number of open streams. Builds on the host as well:
+ *
+ *   g++ -O2 -o handle_index_test handle_index_test.cpp
+ *
+ * usage: handle_index_test [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ALSAHandleIndex.h"
+
+using android_audio_legacy::ALSAHandleIndex;
+
+#define MAX_STR_LEN     50
+#define CHECK_STEPS     200000
+#define CHECK_HANDLES   (ALSA_INDEX_HANDLES * 2)
+
+//A slice of the UCM use case table, interned in table order
+static const char *useCases[] = {
+    "HiFi", "HiFi Low Power", "Voice Call", "Voice Call IP", "Digital Radio",
+    "HiFi Rec", "HiFi Tunnel", "HiFi Lowlatency", "HiFi2", "VoLTE",
+    "Play Music", "Play Voice", "Play FM", "Play LPA", "Play VOIP",
+    "Play Tunnel", "Capture Music", "Capture Voice",
+};
+#define NUM_IDS (int)(sizeof(useCases) / sizeof(useCases[0]))
+
+enum {
+    ID_HIFI_LOW_POWER = 1, ID_IP_VOICECALL = 3, ID_HIFI_REC = 5,
+    ID_HIFI_TUNNEL = 6, ID_PLAY_LPA = 13, ID_PLAY_VOIP = 14,
+    ID_PLAY_TUNNEL = 15, ID_CAPTURE_MUSIC = 16,
+};
+
+//Stand in for alsa_handle_t in an android List node
+struct handle {
+    char useCase[MAX_STR_LEN];
+    int useCaseId;
+    handle *prev;
+    handle *next;
+};
+
+struct handleList {
+    handle head;
+
+    handleList() { head.prev = head.next = &head; }
+    void push_back(handle *h)
+    {
+        h->prev = head.prev;
+        h->next = &head;
+        head.prev->next = h;
+        head.prev = h;
+    }
+    void erase(handle *h)
+    {
+        h->prev->next = h->next;
+        h->next->prev = h->prev;
+    }
+};
+
+typedef ALSAHandleIndex<handle, NUM_IDS> handleIndex;
+
+static void setUseCase(handle *h, int id)
+{
+    strncpy(h->useCase, useCases[id], MAX_STR_LEN - 1);
+    h->useCase[MAX_STR_LEN - 1] = 0;
+    h->useCaseId = id;
+}
+
+static handle *scanFind(handleList &list, const char *useCase)
+{
+    for (handle *h = list.head.next; h != &list.head; h = h->next) {
+        if (!strcmp(h->useCase, useCase))
+            return h;
+    }
+    return NULL;
+}
+
+static double nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int check()
+{
+    static handle pool[CHECK_HANDLES];
+    bool used[CHECK_HANDLES] = { false };
+    handleList list;
+    handleIndex index;
+    int mismatches = 0;
+
+    srand(1);
+    for (int step = 0; step < CHECK_STEPS; step++) {
+        int slot = rand() % CHECK_HANDLES;
+        int id = rand() % NUM_IDS;
+        handle *h = &pool[slot];
+
+        switch (rand() % 3) {
+        case 0:
+            if (!used[slot]) {
+                setUseCase(h, id);
+                list.push_back(h);
+                if (index.add(h))
+                    mismatches++;
+                used[slot] = true;
+            }
+            break;
+        case 1:
+            if (used[slot]) {
+                index.remove(h);
+                list.erase(h);
+                used[slot] = false;
+            }
+            break;
+        default:
+            if (used[slot]) {
+                int oldId = h->useCaseId;
+                setUseCase(h, id);
+                index.rekey(h, oldId);
+            }
+            break;
+        }
+        for (int i = 0; i < NUM_IDS; i++) {
+            if (index.find(i) != scanFind(list, useCases[i]))
+                mismatches++;
+        }
+    }
+    printf("consistency: %d steps, %d mismatches\n", CHECK_STEPS, mismatches);
+    return mismatches;
+}
+
+//The lookups of one doRouting pass with a tunnel session and a recording:
+//the required use case, the VoIP check of the stream open path, the
+//tunnel/LPA walk of pause and resume, and the capture walk of setInChannels
+static int scanPass(handleList &list, const char *required)
+{
+    int found = 0;
+    handle *h;
+
+    found += scanFind(list, required) != NULL;
+    for (h = list.head.next; h != &list.head; h = h->next) {
+        if (!strcmp(h->useCase, "Voice Call IP") || !strcmp(h->useCase, "Play VOIP")) {
+            found++;
+            break;
+        }
+    }
+    for (h = list.head.next; h != &list.head; h = h->next) {
+        if (!strncmp(h->useCase, "HiFi Tunnel", strlen("HiFi Tunnel")) ||
+            !strncmp(h->useCase, "Play Tunnel", strlen("Play Tunnel")) ||
+            !strncmp(h->useCase, "HiFi Low Power", strlen("HiFi Low Power")) ||
+            !strncmp(h->useCase, "Play LPA", strlen("Play LPA")))
+            found++;
+    }
+    for (h = list.head.next; h != &list.head; h = h->next) {
+        if (!strncmp(h->useCase, "HiFi Rec", strlen("HiFi Rec")) ||
+            !strncmp(h->useCase, "Capture Music", strlen("Capture Music"))) {
+            found++;
+            break;
+        }
+    }
+    return found;
+}
+
+static int indexPass(handleIndex &index, int required)
+{
+    static const int voipIds[] = { ID_IP_VOICECALL, ID_PLAY_VOIP };
+    int found = 0;
+
+    found += index.find(required) != NULL;
+    found += index.findAny(voipIds, 2) != NULL;
+    for (int i = 0; i < index.size(); i++) {
+        int id = index.at(i)->useCaseId;
+        if (id == ID_HIFI_TUNNEL || id == ID_PLAY_TUNNEL ||
+            id == ID_HIFI_LOW_POWER || id == ID_PLAY_LPA)
+            found++;
+    }
+    for (int i = 0; i < index.size(); i++) {
+        int id = index.at(i)->useCaseId;
+        if (id == ID_HIFI_REC || id == ID_CAPTURE_MUSIC) {
+            found++;
+            break;
+        }
+    }
+    return found;
+}
+
+static void bench(int streams, int passes)
+{
+    static handle pool[ALSA_INDEX_HANDLES];
+    //Typical mix: music, low latency, tunnel, recording, then extra music
+    static const int mix[] = { 10, 7, 15, 16, 0, 8, 1, 4 };
+    handleList list;
+    handleIndex index;
+    volatile long sink = 0;
+
+    for (int i = 0; i < streams; i++) {
+        setUseCase(&pool[i], mix[i % 8]);
+        list.push_back(&pool[i]);
+        index.add(&pool[i]);
+    }
+    //The required use case is the one opened last
+    int required = pool[streams - 1].useCaseId;
+
+    double start = nowNs();
+    for (int i = 0; i < passes; i++)
+        sink += scanPass(list, useCases[required]);
+    double scanNs = (nowNs() - start) / passes;
+
+    start = nowNs();
+    for (int i = 0; i < passes; i++)
+        sink += indexPass(index, required);
+    double indexNs = (nowNs() - start) / passes;
+
+    printf("%7d %11.1f %11.1f %8.1fx\n", streams, scanNs, indexNs,
+           scanNs / indexNs);
+}
+
+int main(int argc, char **argv)
+{
+    int passes = argc > 1 ? atoi(argv[1]) : 1000000;
+    int errors = check();
+
+    printf("%7s %11s %11s %9s\n", "streams", "scan ns", "index ns", "speedup");
+    for (int streams = 2; streams <= 16; streams *= 2)
+        bench(streams, passes);
+    return errors ? 1 : 0;
+}
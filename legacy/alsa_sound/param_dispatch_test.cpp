@@ -0,0 +1,283 @@
+/* param_dispatch_test.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/* Checks AudioParamList and AudioParamDispatch against a model of
+ * AudioParameter on random parameter sets, then times a routing, FM volume
+ * and FM device storm through the dispatch table against the sequential
+ * probing of a keyed string map that it replaces. Builds on the host as
+ * well:
+ *
+ *   g++ -O2 -o param_dispatch_test param_dispatch_test.cpp
+ *
+ * usage: param_dispatch_test [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+
+#include "AudioParamDispatch.h"
+
+using namespace android_audio_legacy;
+
+#define CHECK_STEPS     100000
+
+//The keys of AudioHardwareALSA::setParameters() in table order, plus some
+//the HAL does not know
+static const char *keys[] = {
+    "ADSP_STATUS", "tty_mode", "fluence", "incall_music_enabled",
+    "anc_enabled", "routing", "bt_samplerate", "bt_headset_vgs",
+    "wide_voice_enable", "a2dp_connected", "A2dpSuspended", "fm_volume",
+    "a2dp_sink_address", "usb_connected", "card", "voip_rate",
+    "fens_enable", "handle_fm", "st_enable", "vsid",
+    "call_state", "screen_state", "bt_headset_nrec", "",
+};
+#define NUM_KEYS        (int)(sizeof(keys) / sizeof(keys[0]))
+#define NUM_HANDLED     20
+#define KEY_ROUTING     5
+#define KEY_FM_VOLUME   11
+#define KEY_HANDLE_FM   17
+
+static const char *values[] = {
+    "true", "false", "2", "0x40000", "0.5", "-1", "", "on", "abc", "12x",
+};
+#define NUM_VALUES      (int)(sizeof(values) / sizeof(values[0]))
+
+typedef std::map<std::string, std::string> paramMap;
+
+//AudioParameter: strtok_r on ';', split at the first '=', last key wins
+static void modelParse(const char *kvpairs, paramMap &map)
+{
+    char *copy = strdup(kvpairs);
+    char *last;
+
+    for (char *pair = strtok_r(copy, ";", &last); pair;
+         pair = strtok_r(NULL, ";", &last)) {
+        size_t eq = strcspn(pair, "=");
+        map[std::string(pair, eq)] = pair[eq] ? pair + eq + 1 : "";
+    }
+    free(copy);
+}
+
+struct target {
+    int calls;
+
+    target() : calls(0) {}
+
+    int onString(const AudioParamValue &/*value*/, AudioParamList &/*params*/)
+    {
+        calls++;
+        return AUDIO_PARAM_HANDLED;
+    }
+    int onInt(const AudioParamValue &/*value*/, AudioParamList &/*params*/)
+    {
+        calls++;
+        return AUDIO_PARAM_HANDLED;
+    }
+    int onFloat(const AudioParamValue &/*value*/, AudioParamList &/*params*/)
+    {
+        calls++;
+        return AUDIO_PARAM_HANDLED;
+    }
+};
+
+typedef AudioParamDispatch<target> targetDispatch;
+
+static int typeOf(int key)
+{
+    if (key == KEY_ROUTING || key == 6 || key == KEY_HANDLE_FM || key == 19)
+        return AUDIO_PARAM_INT;
+    if (key == KEY_FM_VOLUME)
+        return AUDIO_PARAM_FLOAT;
+    return AUDIO_PARAM_STRING;
+}
+
+static targetDispatch::Entry entries[NUM_HANDLED];
+
+static void buildEntries()
+{
+    for (int i = 0; i < NUM_HANDLED; i++) {
+        entries[i].key = keys[i];
+        entries[i].type = typeOf(i);
+        entries[i].handler = entries[i].type == AUDIO_PARAM_INT ? &target::onInt :
+                entries[i].type == AUDIO_PARAM_FLOAT ? &target::onFloat : &target::onString;
+    }
+}
+
+static void randomSet(char *buf, size_t len)
+{
+    int pairs = rand() % 6;
+    size_t n = 0;
+
+    buf[0] = '\0';
+    for (int i = 0; i < pairs && n < len - 64; i++) {
+        const char *key = keys[rand() % NUM_KEYS];
+        switch (rand() % 4) {
+        case 0:
+            n += snprintf(buf + n, len - n, "%s%s", i ? ";" : "", key);
+            break;
+        case 1:
+            n += snprintf(buf + n, len - n, "%s;", key);
+            break;
+        default:
+            n += snprintf(buf + n, len - n, "%s%s=%s", i ? ";" : "", key,
+                          values[rand() % NUM_VALUES]);
+            break;
+        }
+    }
+}
+
+static int check(const targetDispatch &dispatch)
+{
+    int mismatches = 0;
+    char set[512];
+
+    srand(1);
+    for (int step = 0; step < CHECK_STEPS; step++) {
+        paramMap map;
+        randomSet(set, sizeof(set));
+        modelParse(set, map);
+
+        AudioParamList params(set);
+        //Same value for every key the model holds
+        for (paramMap::iterator it = map.begin(); it != map.end(); ++it) {
+            int i = params.find(it->first.c_str());
+            if (i < 0 || it->second != params.value(i))
+                mismatches++;
+        }
+
+        //Keys left over once every known key had its typed get
+        int expected = 0;
+        for (paramMap::iterator it = map.begin(); it != map.end(); ++it) {
+            int key, val;
+            float f;
+            for (key = 0; key < NUM_HANDLED; key++) {
+                if (it->first == keys[key])
+                    break;
+            }
+            if (key == NUM_HANDLED ||
+                (typeOf(key) == AUDIO_PARAM_INT &&
+                 !AudioParamList::parseInt(it->second.c_str(), &val)) ||
+                (typeOf(key) == AUDIO_PARAM_FLOAT &&
+                 !AudioParamList::parseFloat(it->second.c_str(), &f)))
+                expected++;
+        }
+        target t;
+        if (dispatch.dispatch(&t, params) != expected)
+            mismatches++;
+
+        //Rewriting keeps the set equal for the model
+        char *str = params.toString();
+        paramMap again;
+        modelParse(str, again);
+        if (again != map)
+            mismatches++;
+        free(str);
+    }
+    //A set with more pairs than fit is never rewritten with pairs missing
+    int n = 0;
+    for (int i = 0; i <= AUDIO_PARAM_MAX_PAIRS; i++)
+        n += snprintf(set + n, sizeof(set) - n, "%sk%d=%d", i ? ";" : "", i, i);
+    AudioParamList full(set);
+    char *str = full.toString();
+    if (!full.truncated() || str)
+        mismatches++;
+    free(str);
+
+    printf("consistency: %d sets, %d mismatches\n", CHECK_STEPS, mismatches);
+    return mismatches;
+}
+
+static double nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//What setParameters() did before: parse into a keyed string map, then
+//build a key string and probe for every key the HAL knows
+static int probePass(const char *set)
+{
+    paramMap map;
+    int found = 0;
+
+    modelParse(set, map);
+    for (int i = 0; i < NUM_HANDLED; i++) {
+        paramMap::iterator it = map.find(std::string(keys[i]));
+        if (it != map.end()) {
+            std::string value = it->second;
+            found += value.length() > 0;
+            map.erase(it);
+        }
+    }
+    return found + (int)map.size();
+}
+
+static void bench(const targetDispatch &dispatch, const char *set, int passes)
+{
+    volatile long sink = 0;
+    target t;
+
+    double start = nowNs();
+    for (int i = 0; i < passes; i++)
+        sink += probePass(set);
+    double probeNs = (nowNs() - start) / passes;
+
+    start = nowNs();
+    for (int i = 0; i < passes; i++) {
+        AudioParamList params(set);
+        sink += dispatch.dispatch(&t, params);
+    }
+    double dispatchNs = (nowNs() - start) / passes;
+
+    printf("%-40s %9.1f %11.1f %8.1fx\n", set, probeNs, dispatchNs,
+           probeNs / dispatchNs);
+}
+
+int main(int argc, char **argv)
+{
+    int passes = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    buildEntries();
+    targetDispatch dispatch(entries, NUM_HANDLED);
+
+    int errors = check(dispatch);
+
+    printf("%-40s %9s %11s %9s\n", "set", "probe ns", "dispatch ns", "speedup");
+    bench(dispatch, "routing=2", passes);
+    bench(dispatch, "routing=2;fm_volume=0.5", passes);
+    bench(dispatch, "routing=2;fm_volume=0.5;handle_fm=1048576", passes);
+    bench(dispatch, "vsid=297816064;call_state=2", passes);
+    return errors ? 1 : 0;
+}
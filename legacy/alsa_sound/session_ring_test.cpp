@@ -0,0 +1,340 @@
+/* session_ring_test.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/* Checks the LPA/tunnel buffer ring of AudioSessionOutALSA at end of
+ * stream. The EOS buffer queued behind data gets no timer event of its
+ * own, so the event thread has to retire it together with the buffer in
+ * front, also when that buffer was retired between the writer reading the
+ * ring and publishing the EOS buffer. The interleavings are first stepped
+ * through one by one, then a writer, the event thread and a driver that
+ * raises events the way the compressed driver does run against each other
+ * until end of stream, with a window opened in write_l between the two.
+ * The same run without retireEventless() has to hang at least once.
+ * Builds on the host as well:
+ *
+ *   g++ -O2 -o session_ring_test session_ring_test.cpp -lpthread
+ *
+ * usage: session_ring_test [streams]
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "AudioSessionBufferRing.h"
+
+using android_audio_legacy::AudioSessionBufferRing;
+
+#define SLOTS           4
+#define STREAM_BUFFERS  6
+#define MAX_WRITTEN     (1 << 20)
+#define EOS_TIMEOUT_MS  100
+
+typedef AudioSessionBufferRing<SLOTS> ring_t;
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("line %d: %s failed\n", __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static void queueData(ring_t *ring)
+{
+    ring->next().expectEvent = true;
+    ring->publish();
+}
+
+static void stepped()
+{
+    ring_t ring;
+
+    //EOS as the only buffer waits for its own event
+    ring.reset();
+    ring.next().expectEvent = ring.eosExpectsEvent();
+    ring.publish();
+    CHECK(!ring.retireEventless());
+    CHECK(ring.retire() && !ring.filled());
+
+    //EOS behind data is retired with the data buffer's event
+    ring.reset();
+    queueData(&ring);
+    ring.next().expectEvent = ring.eosExpectsEvent();
+    ring.publish();
+    CHECK(ring.retire() && !ring.filled());
+
+    //The data buffer is retired between the check and the publish
+    ring.reset();
+    queueData(&ring);
+    ring.next().expectEvent = ring.eosExpectsEvent();
+    CHECK(ring.retire());
+    ring.publish();
+    CHECK(ring.filled() == 1);
+    CHECK(ring.retireEventless() && !ring.filled());
+
+    //retireEventless never takes a buffer still waiting for its event
+    ring.reset();
+    queueData(&ring);
+    queueData(&ring);
+    CHECK(!ring.retireEventless() && ring.filled() == 2);
+
+    //A flush in between drops everything
+    ring.reset();
+    queueData(&ring);
+    ring.next().expectEvent = ring.eosExpectsEvent();
+    ring.publish();
+    ring.reset();
+    CHECK(!ring.retire() && !ring.retireEventless() && !ring.filled());
+}
+
+//AudioSessionOutALSA state shared by the writer and the event thread
+static struct {
+    ring_t ring;
+    pthread_mutex_t lock;               //mLock
+    pthread_cond_t writeCv;
+    volatile int32_t writerWaiting;
+    volatile bool reachedEos;
+    bool eosPosted;
+    bool skipEventless;
+    bool stop;
+} session;
+
+/* The compressed driver: plays the written buffers in order and raises a
+ * timer event for each, except for an EOS buffer written behind data. A
+ * period takes far longer to render than write_l takes to publish it after
+ * pcm_write, so a buffer is only played once it is published.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    int written;
+    int played;
+    int raised;
+    int handled;
+    bool eventless[MAX_WRITTEN];
+} driver;
+
+static void pcmWrite(bool eos)
+{
+    pthread_mutex_lock(&driver.lock);
+    driver.eventless[driver.written] = eos && driver.written != driver.played;
+    driver.written++;
+    pthread_cond_broadcast(&driver.cv);
+    pthread_mutex_unlock(&driver.lock);
+}
+
+static void *driverThread(void *)
+{
+    unsigned seed = 1;
+
+    pthread_mutex_lock(&driver.lock);
+    while (!session.stop) {
+        if (driver.played == driver.written) {
+            pthread_cond_wait(&driver.cv, &driver.lock);
+            continue;
+        }
+        if (driver.played - session.ring.queued() >= 0) {
+            pthread_mutex_unlock(&driver.lock);
+            usleep(1);
+            pthread_mutex_lock(&driver.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&driver.lock);
+        usleep(rand_r(&seed) % 40);
+        pthread_mutex_lock(&driver.lock);
+        if (!driver.eventless[driver.played])
+            driver.raised++;
+        driver.played++;
+        pthread_cond_broadcast(&driver.cv);
+    }
+    pthread_mutex_unlock(&driver.lock);
+    return NULL;
+}
+
+//AudioSessionOutALSA::eventThreadEntry
+static void *eventThread(void *)
+{
+    for (;;) {
+        pthread_mutex_lock(&driver.lock);
+        while (!session.stop && driver.handled == driver.raised)
+            pthread_cond_wait(&driver.cv, &driver.lock);
+        if (session.stop) {
+            pthread_mutex_unlock(&driver.lock);
+            break;
+        }
+        pthread_mutex_unlock(&driver.lock);
+
+        bool retired = session.ring.retire();
+        if (retired && (session.writerWaiting || session.reachedEos)) {
+            pthread_mutex_lock(&session.lock);
+            pthread_cond_broadcast(&session.writeCv);
+            if (!session.skipEventless)
+                session.ring.retireEventless();
+            if (!session.ring.filled() && session.reachedEos && !session.eosPosted) {
+                session.eosPosted = true;
+                pthread_cond_broadcast(&session.writeCv);
+            }
+            pthread_mutex_unlock(&session.lock);
+        }
+
+        pthread_mutex_lock(&driver.lock);
+        driver.handled++;
+        pthread_cond_broadcast(&driver.cv);
+        pthread_mutex_unlock(&driver.lock);
+    }
+    return NULL;
+}
+
+//AudioSessionOutALSA::isBufferAvailable, called with the lock held
+static void waitForEmpty()
+{
+    while (!session.ring.empty()) {
+        session.writerWaiting = 1;
+        __sync_synchronize();
+        if (session.ring.empty())
+            break;
+        pthread_cond_wait(&session.writeCv, &session.lock);
+    }
+    session.writerWaiting = 0;
+}
+
+//Plays one stream to its EOS, returns false if the EOS never came
+static bool playStream(unsigned *seed)
+{
+    struct timeval now;
+    struct timespec deadline;
+    bool posted;
+
+    for (int i = 0; i < STREAM_BUFFERS; i++) {
+        pthread_mutex_lock(&session.lock);
+        waitForEmpty();
+        pcmWrite(false);
+        queueData(&session.ring);
+        pthread_mutex_unlock(&session.lock);
+        if (rand_r(seed) % 2)
+            usleep(rand_r(seed) % 40);
+    }
+
+    //write_l(buffer, 0)
+    pthread_mutex_lock(&session.lock);
+    session.reachedEos = true;
+    waitForEmpty();
+    session.ring.next().expectEvent = session.ring.eosExpectsEvent();
+    pcmWrite(true);
+    if (rand_r(seed) % 2)
+        usleep(rand_r(seed) % 40);
+    session.ring.publish();
+
+    gettimeofday(&now, NULL);
+    deadline.tv_sec = now.tv_sec;
+    deadline.tv_nsec = now.tv_usec * 1000 + EOS_TIMEOUT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    while (!session.eosPosted &&
+           pthread_cond_timedwait(&session.writeCv, &session.lock, &deadline) != ETIMEDOUT)
+        ;
+    posted = session.eosPosted;
+    pthread_mutex_unlock(&session.lock);
+
+    //Let the driver and the event thread go idle, then start over as a
+    //flush would
+    pthread_mutex_lock(&driver.lock);
+    while (driver.played != driver.written || driver.handled != driver.raised)
+        pthread_cond_wait(&driver.cv, &driver.lock);
+    pthread_mutex_unlock(&driver.lock);
+    pthread_mutex_lock(&session.lock);
+    session.ring.reset();
+    session.reachedEos = false;
+    session.eosPosted = false;
+    pthread_mutex_unlock(&session.lock);
+    return posted;
+}
+
+static int playStreams(int streams, bool skipEventless, bool stopOnHang)
+{
+    pthread_t threads[2];
+    unsigned seed = 7;
+    int hangs = 0;
+
+    pthread_mutex_init(&session.lock, NULL);
+    pthread_cond_init(&session.writeCv, NULL);
+    pthread_mutex_init(&driver.lock, NULL);
+    pthread_cond_init(&driver.cv, NULL);
+    session.ring.reset();
+    session.skipEventless = skipEventless;
+    session.stop = false;
+    driver.written = driver.played = driver.raised = driver.handled = 0;
+    pthread_create(&threads[0], NULL, driverThread, NULL);
+    pthread_create(&threads[1], NULL, eventThread, NULL);
+
+    for (int i = 0; i < streams; i++) {
+        if (driver.written + STREAM_BUFFERS + 1 > MAX_WRITTEN)
+            break;
+        if (!playStream(&seed)) {
+            hangs++;
+            if (stopOnHang)
+                break;
+        }
+    }
+
+    pthread_mutex_lock(&driver.lock);
+    session.stop = true;
+    pthread_cond_broadcast(&driver.cv);
+    pthread_mutex_unlock(&driver.lock);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    return hangs;
+}
+
+int main(int argc, char **argv)
+{
+    int streams = argc > 1 ? atoi(argv[1]) : 20000;
+    int hangs;
+
+    stepped();
+
+    hangs = playStreams(streams, false, false);
+    printf("%d streams, %d without EOS\n", streams, hangs);
+    if (hangs)
+        failures++;
+
+    hangs = playStreams(streams, true, true);
+    printf("without retireEventless: %s\n", hangs ? "hangs at EOS" : "no hang, check is blind");
+    if (!hangs)
+        failures++;
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
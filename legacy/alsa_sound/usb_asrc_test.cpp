@@ -0,0 +1,188 @@
+/* usb_asrc_test.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/* Simulates the proxy to USB playback bridge of AudioUsbALSA with two
+ * free running clocks, to check the drift compensation without hardware.
+ * Builds on the host as well:
+ *
+ *   g++ -O2 -o usb_asrc_test usb_asrc_test.cpp AudioUsbAsrc.cpp
+ *
+ * usage: usb_asrc_test [proxy_ppm] [usb_ppm] [minutes] [bypass]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AudioUsbAsrc.h"
+
+using android_audio_legacy::AudioUsbAsrc;
+using android_audio_legacy::AudioUsbAsrcStats;
+
+#define RATE            48000
+#define CHANNELS        2
+//Same geometry as AudioUsbALSA: 3072 byte proxy and 4096 byte USB periods
+#define PROXY_PERIOD    768
+#define PROXY_PERIODS   32
+#define USB_PERIOD      1024
+#define USB_PERIODS     8
+#define USB_START       (4 * USB_PERIOD)
+#define TONE_HZ         1000.0
+#define TONE_AMPLITUDE  8000.0
+
+struct ring {
+    long fill;
+    long capacity;
+    double clock;
+    unsigned long xruns;
+};
+
+int main(int argc, char **argv)
+{
+    double proxyPpm = argc > 1 ? atof(argv[1]) : 150.0;
+    double usbPpm = argc > 2 ? atof(argv[2]) : -150.0;
+    int minutes = argc > 3 ? atoi(argv[3]) : 30;
+    bool bypass = argc > 4 && !strcmp(argv[4], "bypass");
+
+    struct ring proxy = { 0, PROXY_PERIOD * PROXY_PERIODS, 0, 0 };
+    struct ring usb = { 0, USB_PERIOD * USB_PERIODS, 0, 0 };
+    bool usbStarted = false;
+
+    static int16_t inBuf[PROXY_PERIOD * CHANNELS];
+    static int16_t outBuf[USB_PERIOD * CHANNELS];
+    size_t inLeft = 0, outFilled = 0;
+    long toneIndex = 0;
+
+    //Discontinuity detector: a pure tone satisfies
+    //y[n] = 2cos(w)y[n-1] - y[n-2] almost exactly, any dropped or
+    //repeated sample shows up as a large residual
+    double k = 2.0 * cos(2.0 * M_PI * TONE_HZ / RATE);
+    double y1 = 0, y2 = 0, maxResidual = 0;
+    unsigned long outSamples = 0;
+
+    AudioUsbAsrc asrc;
+    asrc.init(RATE, RATE, CHANNELS);
+
+    printf("proxy %+.1f ppm, usb %+.1f ppm, %d minutes%s\n",
+           proxyPpm, usbPpm, minutes, bypass ? ", bypass" : "");
+    printf("%6s %9s %9s %9s %9s %7s %7s %6s %6s %9s\n", "time", "drift",
+           "corr", "target", "filtered", "proxy", "usb", "oruns", "uruns",
+           "residual");
+
+    for (long ms = 1; ms <= (long)minutes * 60 * 1000; ms++) {
+        //DSP side: whole proxy periods at the proxy clock
+        proxy.clock += RATE * (1.0 + proxyPpm * 1e-6) / 1000.0;
+        while (proxy.clock >= PROXY_PERIOD) {
+            proxy.clock -= PROXY_PERIOD;
+            if (proxy.fill + PROXY_PERIOD > proxy.capacity)
+                proxy.xruns++;
+            else
+                proxy.fill += PROXY_PERIOD;
+        }
+
+        //USB side: one packet per millisecond at the USB clock
+        if (usbStarted) {
+            usb.clock += RATE * (1.0 + usbPpm * 1e-6) / 1000.0;
+            long packet = (long)usb.clock;
+            usb.clock -= packet;
+            if (usb.fill < packet) {
+                usb.xruns++;
+                usb.fill = 0;
+                usbStarted = false;
+                asrc.relock();
+            } else {
+                usb.fill -= packet;
+            }
+        }
+
+        //Bridge thread: move whatever both rings allow
+        for (;;) {
+            if (outFilled == USB_PERIOD) {
+                if (usb.capacity - usb.fill < USB_PERIOD)
+                    break;
+                usb.fill += USB_PERIOD;
+                outFilled = 0;
+                if (!usbStarted && usb.fill >= USB_START) {
+                    usbStarted = true;
+                    usb.clock = 0;
+                }
+                if (usbStarted && !bypass)
+                    asrc.update(proxy.fill, usb.fill);
+                continue;
+            }
+            if (!inLeft) {
+                if (proxy.fill < PROXY_PERIOD)
+                    break;
+                proxy.fill -= PROXY_PERIOD;
+                for (int i = 0; i < PROXY_PERIOD; i++, toneIndex++) {
+                    int16_t s = (int16_t)(TONE_AMPLITUDE *
+                            sin(2.0 * M_PI * TONE_HZ * toneIndex / RATE));
+                    inBuf[i * CHANNELS] = s;
+                    inBuf[i * CHANNELS + 1] = s;
+                }
+                inLeft = PROXY_PERIOD;
+            }
+            size_t inFrames = inLeft;
+            size_t outFrames = USB_PERIOD - outFilled;
+            asrc.process(inBuf + (PROXY_PERIOD - inLeft) * CHANNELS, &inFrames,
+                         outBuf + outFilled * CHANNELS, &outFrames);
+            for (size_t i = 0; i < outFrames; i++, outSamples++) {
+                double y = outBuf[(outFilled + i) * CHANNELS];
+                //Skip the silence primed into the interpolator
+                if (outSamples > 4) {
+                    double residual = fabs(y - k * y1 + y2);
+                    if (residual > maxResidual)
+                        maxResidual = residual;
+                }
+                y2 = y1;
+                y1 = y;
+            }
+            inLeft -= inFrames;
+            outFilled += outFrames;
+        }
+
+        if (ms % 60000 == 0) {
+            AudioUsbAsrcStats stats;
+            asrc.getStats(&stats);
+            printf("%5ldm %+9.2f %+9.2f %9.1f %9.1f %7ld %7ld %6lu %6lu %9.1f\n",
+                   ms / 60000, stats.driftPpm, stats.correctionPpm,
+                   stats.targetFill, stats.filteredFill, proxy.fill, usb.fill,
+                   proxy.xruns, usb.xruns, maxResidual);
+        }
+    }
+
+    AudioUsbAsrcStats stats;
+    asrc.getStats(&stats);
+    printf("expected drift %+.2f ppm, estimated %+.2f ppm, "
+           "fill range %d..%d, %u updates, %u clamped\n",
+           (proxyPpm - usbPpm) / (1.0 + usbPpm * 1e-6), stats.driftPpm,
+           stats.minFill, stats.maxFill, stats.updates, stats.clamped);
+    return (proxy.xruns || usb.xruns) ? 1 : 0;
+}
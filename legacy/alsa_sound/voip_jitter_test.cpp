@@ -0,0 +1,143 @@
+/* voip_jitter_test.cpp
+
+Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/* Feeds AudioVoipJitterBuffer from a synthetic VoIP client whose frames
+ * arrive late by a random amount, with occasional long stalls, and plays
+ * it out on a DSP clock that drifts against the client. Every frame
+ * carries its sequence number, so reordering or repeats are caught.
+ * Builds on the host as well:
+ *
+ *   g++ -O2 -o voip_jitter_test voip_jitter_test.cpp AudioVoipJitterBuffer.cpp
+ *
+ * usage: voip_jitter_test [jitter_ms] [stall_ms] [dsp_ppm] [minutes] [unpaced]
+ *
+ * By default the client is paced like AudioStreamOutALSA paces
+ * AudioFlinger: a write blocks while the buffer holds the target depth.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AudioVoipJitterBuffer.h"
+
+using android_audio_legacy::AudioVoipJitterBuffer;
+using android_audio_legacy::AudioVoipJitterStats;
+
+#define FRAME_US        20000
+#define FRAME_BYTES     320
+//One stall every STALL_PERIOD frames on average
+#define STALL_PERIOD    500
+
+static int64_t lateUs(double jitterMs, double stallMs)
+{
+    //Mostly small lateness, exponential tail up to a few times the mean
+    double late = 0;
+    for (int i = 0; i < 3; i++)
+        late -= jitterMs * 1000.0 / 3.0 * log((rand() + 1.0) / (RAND_MAX + 2.0));
+    if (stallMs > 0 && rand() % STALL_PERIOD == 0)
+        late += stallMs * 1000.0;
+    return (int64_t)late;
+}
+
+int main(int argc, char **argv)
+{
+    double jitterMs = argc > 1 ? atof(argv[1]) : 10.0;
+    double stallMs = argc > 2 ? atof(argv[2]) : 60.0;
+    double dspPpm = argc > 3 ? atof(argv[3]) : 100.0;
+    int minutes = argc > 4 ? atoi(argv[4]) : 10;
+    bool paced = !(argc > 5 && !strcmp(argv[5], "unpaced"));
+
+    AudioVoipJitterBuffer jb;
+    AudioVoipJitterStats stats;
+    uint8_t frame[FRAME_BYTES], out[FRAME_BYTES];
+    uint32_t seq = 0, lastPlayed = 0, misordered = 0, skipped = 0;
+    int64_t readyUs, lastReadyUs = 0, nextPlayUs = 0;
+    int64_t end = (int64_t)minutes * 60 * 1000000;
+    double dspStep = FRAME_US * (1.0 - dspPpm * 1e-6);
+    double dspClock = 0;
+    bool havePlayed = false;
+
+    srand(1);
+    jb.init(FRAME_BYTES, FRAME_US, true);
+
+    printf("jitter %.1f ms, stalls %.1f ms, dsp %+.1f ppm, %d minutes, %s\n",
+           jitterMs, stallMs, dspPpm, minutes, paced ? "paced" : "unpaced");
+    printf("%6s %9s %6s %6s %9s %9s %8s %8s %8s %8s\n", "time", "jitter_ms",
+           "target", "depth", "resid_ms", "max_ms", "conceal", "underrun",
+           "compress", "overflow");
+
+    readyUs = lateUs(jitterMs, stallMs);
+    for (int64_t now = 0; now <= end; now += 1000) {
+        //Client: frames become ready on its own grid, in order
+        while (readyUs <= now && (!paced || jb.depth() < jb.target())) {
+            memset(frame, 0, sizeof(frame));
+            memcpy(frame, &seq, sizeof(seq));
+            jb.put(frame, sizeof(frame), now);
+            seq++;
+            lastReadyUs = readyUs;
+            readyUs = (int64_t)seq * FRAME_US + lateUs(jitterMs, stallMs);
+            if (readyUs < lastReadyUs)
+                readyUs = lastReadyUs;
+        }
+
+        //DSP: one frame per period of its own clock
+        if (now >= nextPlayUs) {
+            if (jb.get(out, now) == android_audio_legacy::VOIP_JB_FRAME) {
+                uint32_t played;
+                memcpy(&played, out, sizeof(played));
+                if (havePlayed && played <= lastPlayed)
+                    misordered++;
+                else if (havePlayed)
+                    skipped += played - lastPlayed - 1;
+                lastPlayed = played;
+                havePlayed = true;
+            }
+            dspClock += dspStep;
+            nextPlayUs = (int64_t)dspClock;
+        }
+
+        if (now && now % 60000000 == 0) {
+            jb.getStats(&stats);
+            printf("%5lldm %9.1f %6u %6u %9.1f %9.1f %8u %8u %8u %8u\n",
+                   (long long)(now / 60000000), stats.jitterUs / 1000.0,
+                   stats.target, stats.depth, stats.avgResidenceUs / 1000.0,
+                   stats.maxResidenceUs / 1000.0, stats.concealed,
+                   stats.underruns, stats.compressed, stats.overflows);
+        }
+    }
+
+    jb.getStats(&stats);
+    printf("%u in, %u out, %.2f%% concealed, %u skipped, %u misordered\n",
+           stats.framesIn, stats.framesOut,
+           100.0 * stats.concealed / (stats.framesOut ? stats.framesOut : 1),
+           skipped, misordered);
+    return misordered ? 1 : 0;
+}
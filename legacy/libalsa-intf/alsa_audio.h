@@ -29,6 +29,7 @@ struct pcm {
     unsigned flags;
     unsigned format;
     unsigned running:1;
+    unsigned tstamp_monotonic:1;
     int underruns;
     unsigned buffer_size;
     unsigned period_size;
@@ -147,6 +148,19 @@ int param_set_sw_params(struct pcm *pcm, struct snd_pcm_sw_params *sparams);
 int get_compressed_format(const char *format);
 void param_dump(struct snd_pcm_hw_params *p);
 int pcm_prepare(struct pcm *pcm);
+/* Recovers a stream from an xrun (-EPIPE), a bad state (-EBADFD) or a
+ * suspend (-ESTRPIPE) without reopening it. Returns 0 when the transfer
+ * can be retried, otherwise a negative errno and the stream must be
+ * closed and reopened.
+ */
+int pcm_recover(struct pcm *pcm, int err);
+/* Frames queued ahead of the one being rendered and the time the hardware
+ * pointer was last updated, which needs SNDRV_PCM_TSTAMP_ENABLE in the sw
+ * params. The time is CLOCK_MONOTONIC only when tstamp_monotonic is set,
+ * otherwise the kernel reports gettimeofday. Returns -EAGAIN while the
+ * stream is not running.
+ */
+int pcm_get_delay(struct pcm *pcm, long *delay, struct timespec *tstamp);
 long pcm_avail(struct pcm *pcm);
 int pcm_set_channel_map(struct pcm *pcm, struct mixer *mixer,
                         int max_channels, char *chmap);
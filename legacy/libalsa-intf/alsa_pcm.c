@@ -391,6 +391,18 @@ int param_set_sw_params(struct pcm *pcm, struct snd_pcm_sw_params *sparams)
     if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_SW_PARAMS, sparams)) {
         return -EPERM;
     }
+    pcm->tstamp_monotonic = 0;
+#ifdef SNDRV_PCM_IOCTL_TTSTAMP
+    /* Timestamps on the same clock as systemTime(), older kernels only
+     * have gettimeofday and keep it */
+    if (sparams->tstamp_mode == SNDRV_PCM_TSTAMP_ENABLE) {
+        int type = SNDRV_PCM_TSTAMP_TYPE_MONOTONIC;
+        if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_TTSTAMP, &type))
+            ALOGV("monotonic timestamps not supported errno %d\n", errno);
+        else
+            pcm->tstamp_monotonic = 1;
+    }
+#endif
     pcm->sw_p = sparams;
     return 0;
 }
@@ -640,6 +652,62 @@ int pcm_prepare(struct pcm *pcm)
     return 0;
 }
 
+int pcm_get_delay(struct pcm *pcm, long *delay, struct timespec *tstamp)
+{
+    struct snd_pcm_status status;
+
+    if (pcm == NULL || pcm->fd < 0)
+        return -EINVAL;
+    memset(&status, 0, sizeof(status));
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_STATUS, &status))
+        return -errno;
+    /* The delay is only reported while the hardware pointer moves */
+    if (status.state != SNDRV_PCM_STATE_RUNNING &&
+        status.state != SNDRV_PCM_STATE_DRAINING)
+        return -EAGAIN;
+    *delay = status.delay;
+    tstamp->tv_sec = status.tstamp.tv_sec;
+    tstamp->tv_nsec = status.tstamp.tv_nsec;
+    return 0;
+}
+
+/* Resume may be refused with EAGAIN while the device is still powering up */
+#define PCM_RESUME_RETRIES  10
+#define PCM_RESUME_WAIT_US  5000
+
+int pcm_recover(struct pcm *pcm, int err)
+{
+    int retries;
+
+    if (pcm == NULL || pcm->fd < 0)
+        return -EINVAL;
+    if (err > 0)
+        err = -err;
+
+    if (err == -ESTRPIPE) {
+        for (retries = 0; retries < PCM_RESUME_RETRIES; retries++) {
+            if (!ioctl(pcm->fd, SNDRV_PCM_IOCTL_RESUME))
+                return 0;
+            if (errno != EAGAIN)
+                break;
+            usleep(PCM_RESUME_WAIT_US);
+        }
+        /* Resume is optional for drivers, restart the stream instead */
+        ALOGV("resume failed errno %d, preparing\n", errno);
+    } else if (err == -EPIPE) {
+        pcm->underruns++;
+    } else if (err != -EBADFD) {
+        return err;
+    }
+
+    pcm->running = 0;
+    pcm->start = 0;
+    /* pcm_read prepares and starts a stopped capture stream by itself */
+    if (pcm->flags & PCM_IN)
+        return 0;
+    return pcm_prepare(pcm);
+}
+
 static int pcm_write_mmap(struct pcm *pcm, void *data, unsigned count)
 {
     long frames;
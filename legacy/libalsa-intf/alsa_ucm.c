@@ -51,11 +51,13 @@
 #include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <ctype.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/poll.h>
 #include <stdint.h>
 
@@ -70,6 +72,179 @@
 #endif
 #define PARSE_DEBUG 0
 
+/* List utility functions for maintaining enabled devices and modifiers */
+static unsigned int snd_ucm_hash_ident(const char *ident);
+static int snd_ucm_intern_ident(snd_ucm_ident_table_t *table, const char *ident);
+static int snd_ucm_lookup_ident(const snd_ucm_ident_table_t *table, const char *ident);
+static int snd_ucm_add_ident_to_list(snd_ucm_ident_set_t *set, const char *value);
+static const char *snd_ucm_get_value_at_index(snd_ucm_ident_set_t *set, int index);
+static int snd_ucm_get_size_of_list(snd_ucm_ident_set_t *set);
+static int snd_ucm_del_ident_from_list(snd_ucm_ident_set_t *set, const char *value);
+static void snd_ucm_print_list(snd_ucm_ident_set_t *set);
+static void snd_ucm_set_status_at_index(snd_ucm_ident_set_t *set, const char *ident, int status, int capability);
+static int snd_ucm_get_status_at_index(snd_ucm_ident_set_t *set, const char *ident);
+static int snd_ucm_get_capability_at_index(snd_ucm_ident_set_t *set, int index);
+static int snd_ucm_get_active_at_index(snd_ucm_ident_set_t *set, int index);
+static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name, int index);
+static int get_verb_count(const char *nxt_str);
+static int get_usecase_type(snd_use_case_mgr_t *uc_mgr, const char *usecase);
+static int parse_single_config_format(snd_use_case_mgr_t **uc_mgr, char *current_str, int num_verbs);
+static int get_num_verbs_config_format(const char *nxt_str);
+static int get_num_device_config_format(const char *nxt_str);
+static int get_num_mod_config_format(const char *nxt_str);
+static int is_single_config_format(const char *nxt_str);
+/* Parse functions */
+static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr);
+static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str, char **nxt_str, int verb_index, int ctrl_list_type);
+static int snd_ucm_extract_name(char *buf, char **case_name);
+static int snd_ucm_extract_acdb(char *buf, int *id, int *cap);
+static int snd_ucm_extract_effects_mixer_ctl(char *buf, char **mixer_name);
+static int snd_ucm_extract_ec_ref_rx_mixer_ctl(char *buf, char **mixer_name);
+static int snd_ucm_extract_dev_name(char *buf, char **dev_name);
+static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int count);
+static int snd_ucm_extract_volume_mixer_ctl(char *buf, char **mixer_name);
+static int snd_ucm_print(snd_use_case_mgr_t *uc_mgr);
+static void snd_ucm_free_mixer_list(snd_use_case_mgr_t **uc_mgr);
+/* Reload functions */
+static int snd_ucm_reload_verb(snd_use_case_mgr_t *uc_mgr, const char *verb_name, const char *file_name);
+
+/* Returns 1 if bit id is set in the identifier bitset, 0 otherwise */
+static inline int snd_ucm_bitset_test(const uint32_t *bits, int id)
+{
+    if ((id < 0) || (id >= SND_UCM_MAX_IDENTS))
+        return 0;
+    return (bits[id >> 5] >> (id & 31)) & 1;
+}
+
+static inline void snd_ucm_bitset_set(uint32_t *bits, int id)
+{
+    bits[id >> 5] |= (1U << (id & 31));
+}
+
+static inline void snd_ucm_bitset_clear(uint32_t *bits, int id)
+{
+    bits[id >> 5] &= ~(1U << (id & 31));
+}
+
+/* Publish a snapshot of the query-visible card state, card_lock must be
+ * held. A slot is reused only once no reader holds it, readers that pin
+ * a slot after it was retired see the pointer change and retry.
+ */
+static void snd_ucm_state_publish(card_ctxt_t *card)
+{
+    snd_ucm_state_t *next = NULL;
+    int index;
+
+    while (next == NULL) {
+        for (index = 0; index < SND_UCM_STATE_SLOTS; index++) {
+            if ((&card->state_pool[index] != card->state) &&
+                !__sync_fetch_and_add(&card->state_pool[index].readers, 0)) {
+                next = &card->state_pool[index];
+                break;
+            }
+        }
+        if (next == NULL)
+            sched_yield();
+    }
+    next->generation = card->state ? card->state->generation + 1 : 0;
+    strlcpy(next->current_verb, card->current_verb, MAX_STR_LEN);
+    memcpy(next->dev_enabled, card->dev_set.enabled,
+        sizeof(next->dev_enabled));
+    memcpy(next->mod_enabled, card->mod_set.enabled,
+        sizeof(next->mod_enabled));
+    __sync_synchronize();
+    card->state = next;
+}
+
+/* Pin the published state snapshot, release with snd_ucm_state_release */
+static snd_ucm_state_t *snd_ucm_state_acquire(card_ctxt_t *card)
+{
+    snd_ucm_state_t *state;
+
+    for (;;) {
+        state = __sync_fetch_and_add(&card->state, 0);
+        __sync_fetch_and_add(&state->readers, 1);
+        if (state == __sync_fetch_and_add(&card->state, 0))
+            return state;
+        __sync_fetch_and_sub(&state->readers, 1);
+    }
+}
+
+static inline void snd_ucm_state_release(snd_ucm_state_t *state)
+{
+    __sync_fetch_and_sub(&state->readers, 1);
+}
+
+static inline uint64_t snd_ucm_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/* Account a mixer control lookup to the transition being profiled */
+static inline void snd_ucm_profile_lookup(card_ctxt_t *card)
+{
+    if (card->profile.in_progress)
+        card->profile.current.ctls_looked_up++;
+}
+
+/* Returns start time of a mixer control write if profiling, 0 otherwise */
+static inline uint64_t snd_ucm_profile_write_begin(card_ctxt_t *card)
+{
+    return card->profile.in_progress ? snd_ucm_now_us() : 0;
+}
+
+static inline void snd_ucm_profile_write_end(card_ctxt_t *card,
+uint64_t begin)
+{
+    if (card->profile.in_progress) {
+        card->profile.current.ctls_written++;
+        card->profile.current.ioctl_us += snd_ucm_now_us() - begin;
+    }
+}
+
+/* Take card_lock for a transition and open a profile record if enabled */
+static void snd_ucm_transition_lock(snd_use_case_mgr_t *uc_mgr,
+const char *identifier, const char *value)
+{
+    snd_ucm_profile_t *prof = &uc_mgr->card_ctxt_ptr->profile;
+    /* enabled is only read under card_lock, so the lock wait is timed
+     * whether or not this transition ends up being recorded */
+    uint64_t start = snd_ucm_now_us();
+
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    if (!prof->enabled)
+        return;
+    memset(&prof->current, 0, sizeof(prof->current));
+    strlcpy(prof->current.identifier, identifier ? identifier : "",
+        MAX_STR_LEN);
+    strlcpy(prof->current.value, value ? value : "", MAX_STR_LEN);
+    prof->current.start_us = start;
+    prof->current.lock_wait_us = snd_ucm_now_us() - start;
+    prof->in_progress = 1;
+}
+
+/* Close the open profile record, if any, publish the new query state and
+ * release card_lock */
+static void snd_ucm_transition_unlock(snd_use_case_mgr_t *uc_mgr, int ret)
+{
+    snd_ucm_profile_t *prof = &uc_mgr->card_ctxt_ptr->profile;
+
+    if (prof->in_progress) {
+        prof->current.ret = ret;
+        prof->current.total_us = snd_ucm_now_us() - prof->current.start_us;
+        prof->ring[prof->head] = prof->current;
+        prof->head = (prof->head + 1) % SND_UCM_PROFILE_RING_SIZE;
+        if (prof->count < SND_UCM_PROFILE_RING_SIZE)
+            prof->count++;
+        prof->in_progress = 0;
+    }
+    snd_ucm_state_publish(uc_mgr->card_ctxt_ptr);
+    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+}
+
 /**
  * Create an identifier
  * fmt - sprintf like format,
@@ -183,63 +358,23 @@ int snd_use_case_get_list(snd_use_case_mgr_t *uc_mgr,
         pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return index;
     } else  if (!strncmp(identifier, "_enadevs", 8)) {
-        if (uc_mgr->device_list_count) {
-            for (index = 0; index < uc_mgr->device_list_count; index++) {
-                free(uc_mgr->current_device_list[index]);
-                uc_mgr->current_device_list[index] = NULL;
-            }
-            free(uc_mgr->current_device_list);
-            uc_mgr->current_device_list = NULL;
-            uc_mgr->device_list_count = 0;
+        list_size = snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
+        for (index = 0; index < list_size; index++) {
+            uc_mgr->current_device_list[index] =
+            snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->dev_set, index);
         }
-        list_size =
-            snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
         uc_mgr->device_list_count = list_size;
-    if (list_size > 0) {
-            uc_mgr->current_device_list =
-                (char **)malloc(sizeof(char *)*list_size);
-            if (uc_mgr->current_device_list == NULL) {
-                *list = NULL;
-                pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-                return -ENOMEM;
-            }
-            for (index = 0; index < list_size; index++) {
-                uc_mgr->current_device_list[index] =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
-                index);
-            }
-        }
-        *list = (const char **)uc_mgr->current_device_list;
+        *list = uc_mgr->current_device_list;
         pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return (list_size);
     } else  if (!strncmp(identifier, "_enamods", 8)) {
-        if (uc_mgr->modifier_list_count) {
-            for (index = 0; index < uc_mgr->modifier_list_count; index++) {
-                free(uc_mgr->current_modifier_list[index]);
-                uc_mgr->current_modifier_list[index] = NULL;
-            }
-            free(uc_mgr->current_modifier_list);
-            uc_mgr->current_modifier_list = NULL;
-            uc_mgr->modifier_list_count = 0;
+        list_size = snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->mod_set);
+        for (index = 0; index < list_size; index++) {
+            uc_mgr->current_modifier_list[index] =
+            snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->mod_set, index);
         }
-        list_size =
-            snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
         uc_mgr->modifier_list_count = list_size;
-    if (list_size > 0) {
-            uc_mgr->current_modifier_list =
-                (char **)malloc(sizeof(char *) * list_size);
-            if (uc_mgr->current_modifier_list == NULL) {
-                *list = NULL;
-                pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-                return -ENOMEM;
-            }
-            for (index = 0; index < list_size; index++) {
-                uc_mgr->current_modifier_list[index] =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head,
-                index);
-            }
-        }
-        *list = (const char **)uc_mgr->current_modifier_list;
+        *list = uc_mgr->current_modifier_list;
         pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return (list_size);
     } else {
@@ -268,6 +403,7 @@ int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
 {
     card_mctrl_t *ctrl_list;
     use_case_verb_t *verb_list;
+    snd_ucm_state_t *state;
     char ident[MAX_STR_LEN], *ident1, *ident2, *temp_ptr;
     int index, verb_index = 0, ret = 0;
 
@@ -275,11 +411,9 @@ int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
         *value = NULL;
     }
 
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
     if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
         (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
         ALOGE("snd_use_case_get(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return -EINVAL;
     }
 
@@ -289,20 +423,17 @@ int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
         } else {
             *value = NULL;
         }
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return 0;
     }
 
     if (!strncmp(identifier, "_verb", 5)) {
-        if (uc_mgr->card_ctxt_ptr->current_verb != NULL) {
-            *value = strdup(uc_mgr->card_ctxt_ptr->current_verb);
-        } else {
-            *value = NULL;
-        }
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        state = snd_ucm_state_acquire(uc_mgr->card_ctxt_ptr);
+        *value = strdup(state->current_verb);
+        snd_ucm_state_release(state);
         return 0;
     }
 
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
     strlcpy(ident, identifier, sizeof(ident));
     if(!(ident1 = strtok_r(ident, "/", &temp_ptr))) {
         ALOGE("No valid identifier found: %s", ident);
@@ -586,14 +717,13 @@ int snd_use_case_geti(snd_use_case_mgr_t *uc_mgr,
               const char *identifier,
               long *value)
 {
-    char ident[MAX_STR_LEN], *ident1, *ident2, *ident_value, *temp_ptr;
-    int index, list_size, ret = -EINVAL;
+    snd_ucm_state_t *state;
+    char ident[MAX_STR_LEN], *ident1, *ident2, *temp_ptr;
+    int id, ret = -EINVAL;
 
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
     if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
         (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
         ALOGE("snd_use_case_geti(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return -EINVAL;
     }
 
@@ -601,66 +731,330 @@ int snd_use_case_geti(snd_use_case_mgr_t *uc_mgr,
     strlcpy(ident, identifier, sizeof(ident));
     if(!(ident1 = strtok_r(ident, "/", &temp_ptr))) {
         ALOGE("No valid identifier found: %s", ident);
-        ret = -EINVAL;
+        return -EINVAL;
+    }
+    ident2 = strtok_r(NULL, "/", &temp_ptr);
+    if (ident2 == NULL)
+        return -EINVAL;
+    id = snd_ucm_lookup_ident(&uc_mgr->card_ctxt_ptr->ident_table, ident2);
+    state = snd_ucm_state_acquire(uc_mgr->card_ctxt_ptr);
+    if (!strncmp(ident1, "_devstatus", 10)) {
+        *value = snd_ucm_bitset_test(state->dev_enabled, id);
+        ret = 0;
+    } else if (!strncmp(ident1, "_modstatus", 10)) {
+        *value = snd_ucm_bitset_test(state->mod_enabled, id);
+        ret = 0;
     } else {
-        if (!strncmp(ident1, "_devstatus", 10)) {
-            ident2 = strtok_r(NULL, "/", &temp_ptr);
-            if (ident2 != NULL) {
-                list_size =
-                snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
-                for (index = 0; index < list_size; index++) {
-                if ((ident_value =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
-                index))) {
-                        if (!strncmp(ident2, ident_value,
-                            (strlen(ident_value)+1))) {
-                            *value = 1;
-                            free(ident_value);
-                            ident_value = NULL;
-                            break;
-                        } else {
-                            free(ident_value);
-                            ident_value = NULL;
-                        }
-                    }
-                }
-                ret = 0;
-            }
-        } else if (!strncmp(ident1, "_modstatus", 10)) {
-            ident2 = strtok_r(NULL, "/", &temp_ptr);
-            if (ident2 != NULL) {
-                list_size =
-                snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
-                for (index = 0; index < list_size; index++) {
-                if((ident_value =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head,
-                index))) {
-                        if (!strncmp(ident2, ident_value,
-                            (strlen(ident_value)+1))) {
-                            *value = 1;
-                            free(ident_value);
-                            ident_value = NULL;
-                            break;
-                        } else {
-                            free(ident_value);
-                            ident_value = NULL;
-                        }
-                    }
-                }
-                ret = 0;
-            }
-        } else {
-            ALOGE("Unknown identifier: %s", ident1);
-        }
+        ALOGE("Unknown identifier: %s", ident1);
     }
-    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    snd_ucm_state_release(state);
     return ret;
 }
 
+/**
+ * Get interned id of a device or modifier identifier
+ * uc_mgr - UCM structure
+ * ident - device or modifier name
+ * returns id on success, -ENOENT if the identifier was never enabled
+ */
+int snd_use_case_get_ident_id(snd_use_case_mgr_t *uc_mgr, const char *ident)
+{
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        (ident == NULL))
+        return -EINVAL;
+
+    return snd_ucm_lookup_ident(&uc_mgr->card_ctxt_ptr->ident_table, ident);
+}
+
+/**
+ * Get enabled status of a device without allocating
+ * uc_mgr - UCM structure
+ * ident_id - id returned by snd_use_case_get_ident_id
+ * returns 1 if the device is enabled, 0 otherwise
+ */
+int snd_use_case_get_dev_status(snd_use_case_mgr_t *uc_mgr, int ident_id)
+{
+    snd_ucm_state_t *state;
+    int status;
+
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL))
+        return 0;
+
+    state = snd_ucm_state_acquire(uc_mgr->card_ctxt_ptr);
+    status = snd_ucm_bitset_test(state->dev_enabled, ident_id);
+    snd_ucm_state_release(state);
+    return status;
+}
+
+/**
+ * Get enabled status of a modifier without allocating
+ * uc_mgr - UCM structure
+ * ident_id - id returned by snd_use_case_get_ident_id
+ * returns 1 if the modifier is enabled, 0 otherwise
+ */
+int snd_use_case_get_mod_status(snd_use_case_mgr_t *uc_mgr, int ident_id)
+{
+    snd_ucm_state_t *state;
+    int status;
+
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL))
+        return 0;
+
+    state = snd_ucm_state_acquire(uc_mgr->card_ctxt_ptr);
+    status = snd_ucm_bitset_test(state->mod_enabled, ident_id);
+    snd_ucm_state_release(state);
+    return status;
+}
+
+/* Names of the interned use case ids, indexed by snd_use_case_id_t */
+static const char *snd_ucm_id_names[SND_UCM_ID_MAX] = {
+    [SND_UCM_ID_VERB_INACTIVE] = SND_USE_CASE_VERB_INACTIVE,
+    [SND_UCM_ID_VERB_HIFI] = SND_USE_CASE_VERB_HIFI,
+    [SND_UCM_ID_VERB_HIFI_LOW_POWER] = SND_USE_CASE_VERB_HIFI_LOW_POWER,
+    [SND_UCM_ID_VERB_VOICE] = SND_USE_CASE_VERB_VOICE,
+    [SND_UCM_ID_VERB_VOICE_LOW_POWER] = SND_USE_CASE_VERB_VOICE_LOW_POWER,
+    [SND_UCM_ID_VERB_VOICECALL] = SND_USE_CASE_VERB_VOICECALL,
+    [SND_UCM_ID_VERB_IP_VOICECALL] = SND_USE_CASE_VERB_IP_VOICECALL,
+    [SND_UCM_ID_VERB_ANALOG_RADIO] = SND_USE_CASE_VERB_ANALOG_RADIO,
+    [SND_UCM_ID_VERB_DIGITAL_RADIO] = SND_USE_CASE_VERB_DIGITAL_RADIO,
+    [SND_UCM_ID_VERB_FM_REC] = SND_USE_CASE_VERB_FM_REC,
+    [SND_UCM_ID_VERB_FM_A2DP_REC] = SND_USE_CASE_VERB_FM_A2DP_REC,
+    [SND_UCM_ID_VERB_HIFI_REC] = SND_USE_CASE_VERB_HIFI_REC,
+    [SND_UCM_ID_VERB_HIFI_LOWLATENCY_REC] = SND_USE_CASE_VERB_HIFI_LOWLATENCY_REC,
+    [SND_UCM_ID_VERB_UL_REC] = SND_USE_CASE_VERB_UL_REC,
+    [SND_UCM_ID_VERB_DL_REC] = SND_USE_CASE_VERB_DL_REC,
+    [SND_UCM_ID_VERB_UL_DL_REC] = SND_USE_CASE_VERB_UL_DL_REC,
+    [SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_DL] = SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_DL,
+    [SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL] = SND_USE_CASE_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL,
+    [SND_UCM_ID_VERB_HIFI_TUNNEL] = SND_USE_CASE_VERB_HIFI_TUNNEL,
+    [SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC] = SND_USE_CASE_VERB_HIFI_LOWLATENCY_MUSIC,
+    [SND_UCM_ID_VERB_HIFI2] = SND_USE_CASE_VERB_HIFI2,
+    [SND_UCM_ID_VERB_INCALL_REC] = SND_USE_CASE_VERB_INCALL_REC,
+    [SND_UCM_ID_VERB_MI2S] = SND_USE_CASE_VERB_MI2S,
+    [SND_UCM_ID_VERB_VOLTE] = SND_USE_CASE_VERB_VOLTE,
+    [SND_UCM_ID_VERB_ADSP_TESTFWK] = SND_USE_CASE_VERB_ADSP_TESTFWK,
+    [SND_UCM_ID_VERB_HIFI_REC2] = SND_USE_CASE_VERB_HIFI_REC2,
+    [SND_UCM_ID_VERB_HIFI_REC_COMPRESSED] = SND_USE_CASE_VERB_HIFI_REC_COMPRESSED,
+    [SND_UCM_ID_VERB_HIFI3] = SND_USE_CASE_VERB_HIFI3,
+    [SND_UCM_ID_VERB_HIFI_TUNNEL2] = SND_USE_CASE_VERB_HIFI_TUNNEL2,
+    [SND_UCM_ID_VERB_HIFI_PSEUDO_TUNNEL] = SND_USE_CASE_VERB_HIFI_PSEUDO_TUNNEL,
+    [SND_UCM_ID_VERB_VOICE2] = SND_USE_CASE_VERB_VOICE2,
+    [SND_UCM_ID_MOD_CAPTURE_VOICE] = SND_USE_CASE_MOD_CAPTURE_VOICE,
+    [SND_UCM_ID_MOD_CAPTURE_MUSIC] = SND_USE_CASE_MOD_CAPTURE_MUSIC,
+    [SND_UCM_ID_MOD_PLAY_MUSIC] = SND_USE_CASE_MOD_PLAY_MUSIC,
+    [SND_UCM_ID_MOD_PLAY_VOICE] = SND_USE_CASE_MOD_PLAY_VOICE,
+    [SND_UCM_ID_MOD_PLAY_TONE] = SND_USE_CASE_MOD_PLAY_TONE,
+    [SND_UCM_ID_MOD_ECHO_REF] = SND_USE_CASE_MOD_ECHO_REF,
+    [SND_UCM_ID_MOD_PLAY_FM] = SND_USE_CASE_MOD_PLAY_FM,
+    [SND_UCM_ID_MOD_CAPTURE_FM] = SND_USE_CASE_MOD_CAPTURE_FM,
+    [SND_UCM_ID_MOD_CAPTURE_LOWLATENCY_MUSIC] = SND_USE_CASE_MOD_CAPTURE_LOWLATENCY_MUSIC,
+    [SND_UCM_ID_MOD_CAPTURE_A2DP_FM] = SND_USE_CASE_MOD_CAPTURE_A2DP_FM,
+    [SND_UCM_ID_MOD_PLAY_LPA] = SND_USE_CASE_MOD_PLAY_LPA,
+    [SND_UCM_ID_MOD_PLAY_VOIP] = SND_USE_CASE_MOD_PLAY_VOIP,
+    [SND_UCM_ID_MOD_CAPTURE_VOIP] = SND_USE_CASE_MOD_CAPTURE_VOIP,
+    [SND_UCM_ID_MOD_CAPTURE_VOICE_UL] = SND_USE_CASE_MOD_CAPTURE_VOICE_UL,
+    [SND_UCM_ID_MOD_CAPTURE_VOICE_DL] = SND_USE_CASE_MOD_CAPTURE_VOICE_DL,
+    [SND_UCM_ID_MOD_CAPTURE_VOICE_UL_DL] = SND_USE_CASE_MOD_CAPTURE_VOICE_UL_DL,
+    [SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_DL] = SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_DL,
+    [SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL] = SND_USE_CASE_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL,
+    [SND_UCM_ID_MOD_PLAY_TUNNEL] = SND_USE_CASE_MOD_PLAY_TUNNEL,
+    [SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC] = SND_USE_CASE_MOD_PLAY_LOWLATENCY_MUSIC,
+    [SND_UCM_ID_MOD_PLAY_MUSIC2] = SND_USE_CASE_MOD_PLAY_MUSIC2,
+    [SND_UCM_ID_MOD_PLAY_MI2S] = SND_USE_CASE_MOD_PLAY_MI2S,
+    [SND_UCM_ID_MOD_PLAY_VOLTE] = SND_USE_CASE_MOD_PLAY_VOLTE,
+    [SND_UCM_ID_MOD_CAPTURE_MUSIC2] = SND_USE_CASE_MOD_CAPTURE_MUSIC2,
+    [SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED] = SND_USE_CASE_MOD_CAPTURE_MUSIC_COMPRESSED,
+    [SND_UCM_ID_MOD_PLAY_MUSIC3] = SND_USE_CASE_MOD_PLAY_MUSIC3,
+    [SND_UCM_ID_MOD_PLAY_TUNNEL1] = SND_USE_CASE_MOD_PLAY_TUNNEL1,
+    [SND_UCM_ID_MOD_PLAY_TUNNEL2] = SND_USE_CASE_MOD_PLAY_TUNNEL2,
+    [SND_UCM_ID_MOD_PSEUDO_TUNNEL] = SND_USE_CASE_MOD_PSEUDO_TUNNEL,
+    [SND_UCM_ID_MOD_PLAY_VOICE2] = SND_USE_CASE_MOD_PLAY_VOICE2,
+};
+
+/* Open addressing hash of (use case id + 1), built once on first lookup */
+static int16_t snd_ucm_id_hash[SND_UCM_IDENT_HASH_SIZE];
+static pthread_once_t snd_ucm_id_hash_once = PTHREAD_ONCE_INIT;
+
+static void snd_ucm_build_id_hash(void)
+{
+    unsigned int slot;
+    int id;
+
+    for (id = 0; id < SND_UCM_ID_MAX; id++) {
+        slot = snd_ucm_hash_ident(snd_ucm_id_names[id]);
+        while (snd_ucm_id_hash[slot])
+            slot = (slot + 1) & (SND_UCM_IDENT_HASH_SIZE - 1);
+        snd_ucm_id_hash[slot] = id + 1;
+    }
+}
+
+/**
+ * Get interned id of a use case verb or modifier name
+ * name - verb or modifier name (SND_USE_CASE_VERB_* or SND_USE_CASE_MOD_*)
+ * returns snd_use_case_id_t value, SND_UCM_ID_NONE if name is unknown
+ */
+int snd_use_case_name_to_id(const char *name)
+{
+    unsigned int slot;
+    int id;
+
+    if (name == NULL)
+        return SND_UCM_ID_NONE;
+    pthread_once(&snd_ucm_id_hash_once, snd_ucm_build_id_hash);
+    slot = snd_ucm_hash_ident(name);
+    while (snd_ucm_id_hash[slot]) {
+        id = snd_ucm_id_hash[slot] - 1;
+        if (!strncmp(snd_ucm_id_names[id], name, MAX_STR_LEN))
+            return id;
+        slot = (slot + 1) & (SND_UCM_IDENT_HASH_SIZE - 1);
+    }
+    return SND_UCM_ID_NONE;
+}
+
+/**
+ * Get name of an interned use case id
+ * id - snd_use_case_id_t value
+ * returns constant verb or modifier name, NULL if id is invalid
+ */
+const char *snd_use_case_id_to_name(int id)
+{
+    if ((id < 0) || (id >= SND_UCM_ID_MAX))
+        return NULL;
+    return snd_ucm_id_names[id];
+}
+
+/**
+ * Set a verb or enable/disable a modifier by interned id
+ * uc_mgr - UCM structure
+ * identifier - "_verb", "_enamod" or "_dismod"
+ * id - snd_use_case_id_t value
+ * returns 0 on success, negative error code otherwise
+ */
+int snd_use_case_set_id(snd_use_case_mgr_t *uc_mgr, const char *identifier,
+int id)
+{
+    const char *name = snd_use_case_id_to_name(id);
+
+    if ((name == NULL) || (identifier == NULL))
+        return -EINVAL;
+    if (!strncmp(identifier, "_verb", 5) ? !SND_UCM_ID_IS_VERB(id) :
+        !SND_UCM_ID_IS_MOD(id)) {
+        ALOGE("Use case id %d (%s) not valid for %s", id, name, identifier);
+        return -EINVAL;
+    }
+    return snd_use_case_set(uc_mgr, identifier, name);
+}
+
+/**
+ * Get interned id of the current verb without allocating
+ * uc_mgr - UCM structure
+ * returns snd_use_case_id_t value of current verb, SND_UCM_ID_NONE on error
+ */
+int snd_use_case_get_verb_id(snd_use_case_mgr_t *uc_mgr)
+{
+    snd_ucm_state_t *state;
+    int id;
+
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL))
+        return SND_UCM_ID_NONE;
+
+    state = snd_ucm_state_acquire(uc_mgr->card_ctxt_ptr);
+    id = snd_use_case_name_to_id(state->current_verb);
+    snd_ucm_state_release(state);
+    return id;
+}
+
+/**
+ * Get enabled status of a modifier by interned use case id
+ * uc_mgr - UCM structure
+ * id - snd_use_case_id_t value of the modifier
+ * returns 1 if the modifier is enabled, 0 otherwise
+ */
+int snd_use_case_get_mod_status_id(snd_use_case_mgr_t *uc_mgr, int id)
+{
+    snd_ucm_state_t *state;
+    int status, ident_id;
+
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        !SND_UCM_ID_IS_MOD(id))
+        return 0;
+
+    ident_id = snd_ucm_lookup_ident(&uc_mgr->card_ctxt_ptr->ident_table,
+                   snd_ucm_id_names[id]);
+    state = snd_ucm_state_acquire(uc_mgr->card_ctxt_ptr);
+    status = snd_ucm_bitset_test(state->mod_enabled, ident_id);
+    snd_ucm_state_release(state);
+    return status;
+}
+
+/**
+ * Enable or disable recording of use case transition timings
+ * uc_mgr - UCM structure
+ * enable - 1 to start recording, 0 to stop
+ * returns 0 on success, otherwise a negative error code
+ */
+int snd_use_case_profile_enable(snd_use_case_mgr_t *uc_mgr, int enable)
+{
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL))
+        return -EINVAL;
+
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    uc_mgr->card_ctxt_ptr->profile.enabled = enable ? 1 : 0;
+    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    return 0;
+}
+
+/**
+ * Drop all recorded use case transitions
+ * uc_mgr - UCM structure
+ * returns 0 on success, otherwise a negative error code
+ */
+int snd_use_case_profile_reset(snd_use_case_mgr_t *uc_mgr)
+{
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL))
+        return -EINVAL;
+
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    uc_mgr->card_ctxt_ptr->profile.head = 0;
+    uc_mgr->card_ctxt_ptr->profile.count = 0;
+    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    return 0;
+}
+
+/**
+ * Copy recorded use case transitions, oldest first
+ * uc_mgr - UCM structure
+ * records - caller buffer to fill
+ * max - number of entries available in records
+ * returns number of records copied, otherwise a negative error code
+ */
+int snd_use_case_get_profile(snd_use_case_mgr_t *uc_mgr,
+snd_ucm_transition_record_t *records, int max)
+{
+    snd_ucm_profile_t *prof;
+    unsigned int first, index;
+    int count;
+
+    if ((uc_mgr == NULL) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        (records == NULL) || (max < 0))
+        return -EINVAL;
+
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    prof = &uc_mgr->card_ctxt_ptr->profile;
+    count = ((unsigned int)max < prof->count) ? max : (int)prof->count;
+    first = (prof->head + SND_UCM_PROFILE_RING_SIZE - count) %
+                SND_UCM_PROFILE_RING_SIZE;
+    for (index = 0; index < (unsigned int)count; index++) {
+        records[index] =
+            prof->ring[(first + index) % SND_UCM_PROFILE_RING_SIZE];
+    }
+    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    return count;
+}
+
 static int check_devices_for_voice_call(snd_use_case_mgr_t *uc_mgr,
 const char *use_case)
 {
-    struct snd_ucm_ident_node *dev_node = NULL;
     int index = 0, list_size = 0, rx_dev_status = 0, tx_dev_status = 0;
 
     if ((!strncmp(use_case, SND_USE_CASE_VERB_VOICECALL,
@@ -681,16 +1075,17 @@ const char *use_case)
         strlen(SND_USE_CASE_MOD_PLAY_VOIP)))) {
         ALOGV("check_devices_for_voice_call(): voice cap detected\n");
         list_size =
-        snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+        snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
         for (index = 0; index < list_size; index++) {
-            if ((dev_node =
-                snd_ucm_get_device_node(uc_mgr->card_ctxt_ptr->dev_list_head,
-                index))) {
-                if (dev_node->capability == CAP_RX && dev_node->active == 1) {
-                    rx_dev_status = 1;
-                } else if (dev_node->capability == CAP_TX && dev_node->active == 1) {
-                    tx_dev_status = 1;
-                }
+            if (!snd_ucm_get_active_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
+                index))
+                continue;
+            if (snd_ucm_get_capability_at_index(
+                &uc_mgr->card_ctxt_ptr->dev_set, index) == CAP_RX) {
+                rx_dev_status = 1;
+            } else if (snd_ucm_get_capability_at_index(
+                &uc_mgr->card_ctxt_ptr->dev_set, index) == CAP_TX) {
+                tx_dev_status = 1;
             }
         }
         if (rx_dev_status == 1 && tx_dev_status == 1) {
@@ -710,7 +1105,7 @@ int use_case_index)
 {
     card_mctrl_t *ctrl_list;
     int list_size, index, verb_index, ret = 0, voice_acdb = 0, rx_id, tx_id;
-    char *ident_value = NULL;
+    const char *ident_value = NULL;
     char current_mod[MAX_STR_LEN];
 
     /* Check if voice call use case/modifier exists */
@@ -728,10 +1123,10 @@ int use_case_index)
 //The ident_value should store latest/current modifier
     if (voice_acdb != 1) {
         list_size =
-        snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
+        snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->mod_set);
         for (index = 0; index < list_size; index++) {
             if ((ident_value =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head,
+                snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->mod_set,
                 index))) {
                 if ((!strncmp(ident_value, SND_USE_CASE_MOD_PLAY_VOLTE,
                     strlen(SND_USE_CASE_MOD_PLAY_VOLTE))) ||
@@ -744,7 +1139,6 @@ int use_case_index)
                     voice_acdb = 1;
                     strlcpy(current_mod, ident_value, MAX_STR_LEN);
                 }
-                free(ident_value);
                 ident_value = NULL;
             }
         }
@@ -762,16 +1156,15 @@ int use_case_index)
         ctrl_list =
         uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].device_ctrls;
         list_size =
-        snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+        snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
         for (index = 0; index < list_size; index++) {
             if ((ident_value =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+                snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                 index))) {
                 if (strncmp(ident_value, ctrl_list[use_case_index].case_name,
                     (strlen(ctrl_list[use_case_index].case_name)+1))) {
                     break;
                 }
-                free(ident_value);
                 ident_value = NULL;
             }
         }
@@ -820,7 +1213,6 @@ This happens when the modifier changes*/
                            acdb_loader_send_voice_cal(uc_mgr->current_rx_device,
                                                     uc_mgr->current_tx_device);
              }
-            free(ident_value);
             ident_value = NULL;
         }
     } else {
@@ -897,6 +1289,7 @@ const char *use_case, int enable, int ctrl_list_type, int uc_index)
     mixer_control_t *mixer_list;
     struct mixer_ctl *ctl;
     int i, ret = 0, index = 0, verb_index, mixer_count;
+    uint64_t write_start;
 
     verb_index = uc_mgr->card_ctxt_ptr->current_verb_index;
     if (ctrl_list_type == CTRL_LIST_VERB) {
@@ -955,26 +1348,37 @@ const char *use_case, int enable, int ctrl_list_type, int uc_index)
                 }
                 ctl = mixer_get_control(uc_mgr->card_ctxt_ptr->mixer_handle,
                           mixer_list[index].control_name, 0);
+                snd_ucm_profile_lookup(uc_mgr->card_ctxt_ptr);
                 if (ctl) {
+                    /* Only the control write is timed, not the logging */
                     if (mixer_list[index].type == TYPE_INT) {
                         ALOGD("Setting mixer control: %s, value: %d",
                              mixer_list[index].control_name,
                              mixer_list[index].value);
+                        write_start =
+                            snd_ucm_profile_write_begin(uc_mgr->card_ctxt_ptr);
                         ret = mixer_ctl_set(ctl, mixer_list[index].value);
                     } else if (mixer_list[index].type == TYPE_MULTI_VAL) {
                         ALOGD("Setting multi value: %s",
                             mixer_list[index].control_name);
+                        write_start =
+                            snd_ucm_profile_write_begin(uc_mgr->card_ctxt_ptr);
                         ret = mixer_ctl_set_value(ctl, mixer_list[index].value,
                                 mixer_list[index].mulval);
-                        if (ret < 0)
-                            ALOGE("Failed to set multi value control %s\n",
-                                mixer_list[index].control_name);
                     } else {
                         ALOGD("Setting mixer control: %s, value: %s",
                             mixer_list[index].control_name,
                             mixer_list[index].string);
+                        write_start =
+                            snd_ucm_profile_write_begin(uc_mgr->card_ctxt_ptr);
                         ret = mixer_ctl_select(ctl, mixer_list[index].string);
                     }
+                    snd_ucm_profile_write_end(uc_mgr->card_ctxt_ptr,
+                        write_start);
+                    if ((ret < 0) &&
+                        (mixer_list[index].type == TYPE_MULTI_VAL))
+                        ALOGE("Failed to set multi value control %s\n",
+                            mixer_list[index].control_name);
                     if ((ret != 0) && enable) {
                        /* Disable all the mixer controls which are
                         * already enabled before failure */
@@ -984,7 +1388,10 @@ const char *use_case, int enable, int ctrl_list_type, int uc_index)
                            ctl = mixer_get_control(
                                      uc_mgr->card_ctxt_ptr->mixer_handle,
                                      mixer_list[i].control_name, 0);
+                           snd_ucm_profile_lookup(uc_mgr->card_ctxt_ptr);
                            if (ctl) {
+                               write_start = snd_ucm_profile_write_begin(
+                                                 uc_mgr->card_ctxt_ptr);
                                if (mixer_list[i].type == TYPE_INT) {
                                    ret = mixer_ctl_set(ctl,
                                              mixer_list[i].value);
@@ -992,6 +1399,8 @@ const char *use_case, int enable, int ctrl_list_type, int uc_index)
                                    ret = mixer_ctl_select(ctl,
                                              mixer_list[i].string);
                                }
+                               snd_ucm_profile_write_end(
+                                   uc_mgr->card_ctxt_ptr, write_start);
                            }
                        }
                        ALOGE("Failed to enable the mixer controls for %s",
@@ -1125,7 +1534,8 @@ static int set_controls_of_usecase_for_all_devices(snd_use_case_mgr_t *uc_mgr,
 const char *ident, int enable, int ctrl_list_type)
 {
     card_mctrl_t *dev_list, *uc_list;
-    char *current_device, use_case[MAX_UC_LEN];
+    const char *current_device;
+    char use_case[MAX_UC_LEN];
     int list_size, index, uc_index, ret = 0, intdev_flag = 0;
     int verb_index, capability = 0, ident_cap = 0, dev_cap = 0;
 
@@ -1144,15 +1554,14 @@ const char *ident, int enable, int ctrl_list_type)
         uc_list = NULL;
     }
     ident_cap = getUseCaseType(ident);
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+    list_size = snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
     for (index = 0; index < list_size; index++) {
         current_device =
-        snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, index);
+        snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->dev_set, index);
         if (current_device != NULL) {
             if ((uc_index = get_use_case_index(uc_mgr, current_device,
                        CTRL_LIST_DEVICE)) < 0) {
                 ALOGE("No valid device found: %s", current_device);
-                free(current_device);
                 continue;
             }
             dev_cap = dev_list[uc_index].capability;
@@ -1164,7 +1573,7 @@ const char *ident, int enable, int ctrl_list_type)
             if (ident_cap == CAP_VOICE || dev_cap == ident_cap) {
                 if (enable) {
                     if (!snd_ucm_get_status_at_index(
-                        uc_mgr->card_ctxt_ptr->dev_list_head, current_device)) {
+                        &uc_mgr->card_ctxt_ptr->dev_set, current_device)) {
                         if (uc_index >= 0) {
                             ALOGV("Applying mixer controls for device: %s",
                                 current_device);
@@ -1173,7 +1582,7 @@ const char *ident, int enable, int ctrl_list_type)
                                   uc_index);
                             if (!ret)
                                 snd_ucm_set_status_at_index(
-                                  uc_mgr->card_ctxt_ptr->dev_list_head,
+                                  &uc_mgr->card_ctxt_ptr->dev_set,
                                   current_device, enable, dev_cap);
                         }
                     } else if (ident_cap == CAP_VOICE) {
@@ -1193,7 +1602,6 @@ const char *ident, int enable, int ctrl_list_type)
                 }
                 use_case[0] = 0;
             }
-            free(current_device);
         }
     }
     if (intdev_flag) {
@@ -1240,12 +1648,12 @@ const char *ident, const char *device, int enable, int ctrl_list_type)
             }
             capability = dev_list[dev_index].capability;
             if (!snd_ucm_get_status_at_index(
-                uc_mgr->card_ctxt_ptr->dev_list_head, device)) {
+                &uc_mgr->card_ctxt_ptr->dev_set, device)) {
                 ret = snd_use_case_apply_mixer_controls(uc_mgr, device,
                          enable, CTRL_LIST_DEVICE, dev_index);
                 if (!ret)
                     snd_ucm_set_status_at_index(
-                    uc_mgr->card_ctxt_ptr->dev_list_head, device, enable,
+                    &uc_mgr->card_ctxt_ptr->dev_set, device, enable,
                     capability);
             }
         }
@@ -1293,7 +1701,8 @@ static int set_controls_of_device_for_all_usecases(snd_use_case_mgr_t *uc_mgr,
 const char *device, int enable)
 {
     card_mctrl_t *dev_list, *uc_list;
-    char *ident_value, use_case[MAX_UC_LEN];
+    const char *ident_value;
+    char use_case[MAX_UC_LEN];
     int verb_index, uc_index, dev_index, capability = 0;
     int list_size, index = 0, ret = -ENODEV, flag = 0, intdev_flag = 0;
 
@@ -1326,12 +1735,12 @@ const char *device, int enable)
             } else {
                 if (enable) {
                     if (!snd_ucm_get_status_at_index(
-                        uc_mgr->card_ctxt_ptr->dev_list_head, device)) {
+                        &uc_mgr->card_ctxt_ptr->dev_set, device)) {
                         ret = snd_use_case_apply_mixer_controls(uc_mgr, device,
                                   enable, CTRL_LIST_DEVICE, dev_index);
                         if (!ret)
                             snd_ucm_set_status_at_index(
-                            uc_mgr->card_ctxt_ptr->dev_list_head, device,
+                            &uc_mgr->card_ctxt_ptr->dev_set, device,
                             enable, capability);
                             flag = 1;
                     }
@@ -1347,12 +1756,12 @@ const char *device, int enable)
         if (intdev_flag) {
             if (enable && !flag) {
                 if (!snd_ucm_get_status_at_index(
-                    uc_mgr->card_ctxt_ptr->dev_list_head, device)) {
+                    &uc_mgr->card_ctxt_ptr->dev_set, device)) {
                     ret = snd_use_case_apply_mixer_controls(uc_mgr,
                               device, enable, CTRL_LIST_DEVICE, dev_index);
                     if (!ret)
                         snd_ucm_set_status_at_index(
-                        uc_mgr->card_ctxt_ptr->dev_list_head, device, enable,
+                        &uc_mgr->card_ctxt_ptr->dev_set, device, enable,
                         capability);
                     flag = 1;
                 }
@@ -1379,13 +1788,13 @@ const char *device, int enable)
         }
         use_case[0] = 0;
     }
-    snd_ucm_print_list(uc_mgr->card_ctxt_ptr->mod_list_head);
+    snd_ucm_print_list(&uc_mgr->card_ctxt_ptr->mod_set);
     uc_list =
         uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].mod_ctrls;
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
+    list_size = snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->mod_set);
     for (index = 0; index < list_size; index++) {
         if ((ident_value =
-            snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head,
+            snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->mod_set,
             index))) {
             if (capability == CAP_VOICE ||
                 getUseCaseType(ident_value) == CAP_VOICE ||
@@ -1399,13 +1808,13 @@ const char *device, int enable)
                 } else {
                     if (enable && !flag) {
                         if (!snd_ucm_get_status_at_index(
-                            uc_mgr->card_ctxt_ptr->dev_list_head, device)) {
+                            &uc_mgr->card_ctxt_ptr->dev_set, device)) {
                             ret = snd_use_case_apply_mixer_controls(uc_mgr,
                                       device, enable, CTRL_LIST_DEVICE,
                                       dev_index);
                             if (!ret)
                                 snd_ucm_set_status_at_index(
-                                    uc_mgr->card_ctxt_ptr->dev_list_head,
+                                    &uc_mgr->card_ctxt_ptr->dev_set,
                                     device, enable, capability);
                             flag = 1;
                         }
@@ -1421,12 +1830,12 @@ const char *device, int enable)
             if (intdev_flag) {
                 if (enable && !flag) {
                     if (!snd_ucm_get_status_at_index(
-                         uc_mgr->card_ctxt_ptr->dev_list_head, device)) {
+                         &uc_mgr->card_ctxt_ptr->dev_set, device)) {
                         ret = snd_use_case_apply_mixer_controls(uc_mgr,
                                   device, enable, CTRL_LIST_DEVICE, dev_index);
                         if (!ret)
                             snd_ucm_set_status_at_index(
-                            uc_mgr->card_ctxt_ptr->dev_list_head, device,
+                            &uc_mgr->card_ctxt_ptr->dev_set, device,
                             enable, capability);
                         flag = 1;
                     }
@@ -1450,14 +1859,13 @@ const char *device, int enable)
                 intdev_flag = 0;
             }
             use_case[0] = 0;
-            free(ident_value);
         }
     }
     if (!enable) {
         ret = snd_use_case_apply_mixer_controls(uc_mgr, device, enable,
                   CTRL_LIST_DEVICE, dev_index);
         if (!ret)
-            snd_ucm_set_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_set_status_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                 device, enable, capability);
     }
     return ret;
@@ -1533,12 +1941,12 @@ static int set_controls_of_device_for_usecase(snd_use_case_mgr_t *uc_mgr,
         } else {
             if (enable) {
                 if (!snd_ucm_get_status_at_index(
-                    uc_mgr->card_ctxt_ptr->dev_list_head, device)) {
+                    &uc_mgr->card_ctxt_ptr->dev_set, device)) {
                     ret = snd_use_case_apply_mixer_controls(uc_mgr, device,
                           enable, CTRL_LIST_DEVICE, dev_index);
                     if (!ret)
                         snd_ucm_set_status_at_index
-                        (uc_mgr->card_ctxt_ptr->dev_list_head, device, enable,
+                        (&uc_mgr->card_ctxt_ptr->dev_set, device, enable,
                         capability);
                 }
             }
@@ -1553,12 +1961,12 @@ static int set_controls_of_device_for_usecase(snd_use_case_mgr_t *uc_mgr,
     } else {
         if (enable) {
             if (!snd_ucm_get_status_at_index(
-                 uc_mgr->card_ctxt_ptr->dev_list_head, device)) {
+                 &uc_mgr->card_ctxt_ptr->dev_set, device)) {
                 ret = snd_use_case_apply_mixer_controls(uc_mgr, device, enable,
                           CTRL_LIST_DEVICE, dev_index);
                 if (!ret)
                     snd_ucm_set_status_at_index(
-                        uc_mgr->card_ctxt_ptr->dev_list_head, device, enable,
+                        &uc_mgr->card_ctxt_ptr->dev_set, device, enable,
                         capability);
             }
         }
@@ -1567,34 +1975,24 @@ static int set_controls_of_device_for_usecase(snd_use_case_mgr_t *uc_mgr,
         ret = snd_use_case_apply_mixer_controls(uc_mgr, device, enable,
                   CTRL_LIST_DEVICE, dev_index);
         if (!ret)
-            snd_ucm_set_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_set_status_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                 device, enable, capability);
     }
     return ret;
 }
 
-/**
- * Set new value for an identifier
- * uc_mgr - UCM structure
- * identifier - _verb, _enadev, _disdev, _enamod, _dismod
- *        _swdev, _swmod
- * value - Value to be set
- * returns 0 on success, otherwise a negative error code
- */
-int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
-                     const char *identifier,
-                     const char *value)
+/* Applies one snd_use_case_set() change, card_lock must be held */
+static int snd_use_case_set_l(snd_use_case_mgr_t *uc_mgr,
+                              const char *identifier,
+                              const char *value)
 {
     use_case_verb_t *verb_list;
     char ident[MAX_STR_LEN], *ident1, *ident2, *temp_ptr;
+    const char *dev_ident;
     int verb_index, list_size, index = 0, ret = -EINVAL;
 
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
-    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) || (value == NULL) ||
-        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
-        (identifier == NULL)) {
+    if ((value == NULL) || (identifier == NULL)) {
         ALOGE("snd_use_case_set(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return -EINVAL;
     }
 
@@ -1611,7 +2009,7 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
                      device", ident2);
             } else {
                 ret = snd_ucm_del_ident_from_list(
-                          &uc_mgr->card_ctxt_ptr->dev_list_head, ident2);
+                          &uc_mgr->card_ctxt_ptr->dev_set, ident2);
                 if (ret < 0) {
                     ALOGV("Ignore device %s disable, device not part of \
                          enabled list", ident2);
@@ -1627,26 +2025,24 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
                     }
                 }
             }
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-            ret = snd_use_case_set(uc_mgr, "_enadev", value);
+            ret = snd_use_case_set_l(uc_mgr, "_enadev", value);
             if (ret < 0) {
                 ALOGV("Device %s not enabled, no valid use case found: %d",
                     value, errno);
             }
             return ret;
         } else if (!strncmp(ident1, "_swmod", 6)) {
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
             if(!(ident2 = strtok_r(NULL, "/", &temp_ptr))) {
                 ALOGD("Invalid modifier value: %s, but enabling new modifier",
                     ident2);
             } else {
-                ret = snd_use_case_set(uc_mgr, "_dismod", ident2);
+                ret = snd_use_case_set_l(uc_mgr, "_dismod", ident2);
                 if (ret < 0) {
                     ALOGV("Modifier %s not disabled, no valid use case \
                          found: %d", ident2, errno);
                 }
             }
-            ret = snd_use_case_set(uc_mgr, "_enamod", value);
+            ret = snd_use_case_set_l(uc_mgr, "_enamod", value);
             if (ret < 0) {
                 ALOGV("Modifier %s not enabled, no valid use case found: %d",
                     value, errno);
@@ -1700,44 +2096,42 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
     } else if (!strncmp(identifier, "_enadev", 7)) {
         index = 0; ret = 0;
         list_size =
-            snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+            snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
         for (index = 0; index < list_size; index++) {
-            if ((ident1 =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+            if ((dev_ident =
+                snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                 index))) {
-                if (!strncmp(ident1, value, (strlen(value)+1))) {
+                if (!strncmp(dev_ident, value, (strlen(value)+1))) {
                     ALOGV("Ignore enable as %s device is already part of \
                          enabled list", value);
-                    free(ident1);
                     break;
                 }
-                free(ident1);
             }
         }
         if (index == list_size) {
             ALOGV("enadev: device value to be enabled: %s", value);
-            snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_set,
                 value);
         }
-        snd_ucm_print_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+        snd_ucm_print_list(&uc_mgr->card_ctxt_ptr->dev_set);
         /* Apply Mixer controls of all verb and modifiers for this device*/
         ret = set_controls_of_device_for_all_usecases(uc_mgr, value, 1);
     } else if (!strncmp(identifier, "_disdev", 7)) {
-        ret = snd_ucm_get_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+        ret = snd_ucm_get_status_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                   value);
         if (ret < 0) {
             ALOGD("disdev: device %s not enabled, no need to disable", value);
         } else if (ret == 0) {
             ALOGV("disdev: device %s not active, remove from the list", value);
             ret =
-            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_set,
             value);
             if (ret < 0) {
                 ALOGE("Invalid device: Device not part of enabled device list");
             }
         } else {
             ret =
-            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_set,
             value);
             if (ret < 0) {
                 ALOGE("Invalid device: Device not part of enabled device list");
@@ -1775,7 +2169,7 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
             if (ret < 0) {
                 ALOGE("Invalid modifier identifier value");
             } else {
-                snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->mod_list_head,
+                snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->mod_set,
                     value);
                 /* Enable the mixer controls for the new use case
                  * for all the enabled devices */
@@ -1784,7 +2178,7 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
             }
         }
     } else if (!strncmp(identifier, "_dismod", 7)) {
-        ret = snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_list_head,
+        ret = snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_set,
                   value);
         if (ret < 0) {
             ALOGE("Modifier not enabled currently, invalid modifier");
@@ -1798,7 +2192,70 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
     } else {
         ALOGE("Unknown identifier value: %s", identifier);
     }
-    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    return ret;
+}
+
+/**
+ * Set new value for an identifier
+ * uc_mgr - UCM structure
+ * identifier - _verb, _enadev, _disdev, _enamod, _dismod
+ *        _swdev, _swmod
+ * value - Value to be set
+ * returns 0 on success, otherwise a negative error code
+ */
+int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
+                     const char *identifier,
+                     const char *value)
+{
+    int ret;
+
+    snd_ucm_transition_lock(uc_mgr, identifier, value);
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        ALOGE("snd_use_case_set(): failed, invalid arguments");
+        snd_ucm_transition_unlock(uc_mgr, -EINVAL);
+        return -EINVAL;
+    }
+    ret = snd_use_case_set_l(uc_mgr, identifier, value);
+    snd_ucm_transition_unlock(uc_mgr, ret);
+    return ret;
+}
+
+/**
+ * Apply a list of snd_use_case_set() changes as one transition
+ * uc_mgr - UCM structure
+ * ops - identifier/value pairs, applied in order
+ * count - number of entries in ops
+ * All changes are made under a single card_lock hold and the query state
+ * is published once at the end, so no other user of the card sees the
+ * intermediate states. A failing change does not stop the ones after it,
+ * same as issuing the calls one by one.
+ * returns 0 on success, otherwise the first negative error code
+ */
+int snd_use_case_set_batch(snd_use_case_mgr_t *uc_mgr,
+                           const snd_use_case_op_t *ops, int count)
+{
+    char value[MAX_STR_LEN];
+    int index, err, ret = 0;
+
+    if ((ops == NULL) || (count <= 0))
+        return -EINVAL;
+
+    snprintf(value, sizeof(value), "%d changes", count);
+    snd_ucm_transition_lock(uc_mgr, "_batch", value);
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        ALOGE("snd_use_case_set_batch(): failed, invalid arguments");
+        snd_ucm_transition_unlock(uc_mgr, -EINVAL);
+        return -EINVAL;
+    }
+    for (index = 0; index < count; index++) {
+        err = snd_use_case_set_l(uc_mgr, ops[index].identifier,
+                  ops[index].value);
+        if ((err < 0) && !ret)
+            ret = err;
+    }
+    snd_ucm_transition_unlock(uc_mgr, ret);
     return ret;
 }
 
@@ -1817,14 +2274,15 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
 {
     use_case_verb_t *verb_list;
     char ident[MAX_STR_LEN], *ident1, *ident2, *temp_ptr;
+    const char *dev_ident;
     int verb_index, list_size, index = 0, ret = -EINVAL;
 
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    snd_ucm_transition_lock(uc_mgr, identifier, value);
     if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) || (value == NULL) ||
         (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
         (identifier == NULL)) {
         ALOGE("snd_use_case_set_case(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        snd_ucm_transition_unlock(uc_mgr, -EINVAL);
         return -EINVAL;
     }
 
@@ -1841,7 +2299,7 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
                      device", ident2);
             } else {
                 ret = snd_ucm_del_ident_from_list(
-                          &uc_mgr->card_ctxt_ptr->dev_list_head, ident2);
+                          &uc_mgr->card_ctxt_ptr->dev_set, ident2);
                 if (ret < 0) {
                     ALOGV("Ignore device %s disable, device not part of \
                          enabled list", ident2);
@@ -1857,7 +2315,7 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
                     }
                 }
             }
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+            snd_ucm_transition_unlock(uc_mgr, ret);
             ret = snd_use_case_set_case(uc_mgr, "_enadev", value, usecase);
             if (ret < 0) {
                 ALOGV("Device %s not enabled, no valid use case found: %d",
@@ -1865,7 +2323,7 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
             }
             return ret;
         } else if (!strncmp(ident1, "_swmod", 6)) {
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+            snd_ucm_transition_unlock(uc_mgr, ret);
             if(!(ident2 = strtok_r(NULL, "/", &temp_ptr))) {
                 ALOGD("Invalid modifier value: %s, but enabling new modifier",
                     ident2);
@@ -1924,22 +2382,20 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
                uc_mgr->card_ctxt_ptr->current_verb_index = index;
                index = 0;
                list_size =
-               snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+               snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
                for (index = 0; index < list_size; index++) {
-                   if ((ident1 = snd_ucm_get_value_at_index(
-                       uc_mgr->card_ctxt_ptr->dev_list_head, index))) {
-                       if (!strncmp(ident1, usecase, MAX_STR_LEN)) {
+                   if ((dev_ident = snd_ucm_get_value_at_index(
+                       &uc_mgr->card_ctxt_ptr->dev_set, index))) {
+                       if (!strncmp(dev_ident, usecase, MAX_STR_LEN)) {
                            ALOGV("Device already part of enabled list: %s",
                                usecase);
-                           free(ident1);
                            break;
                        }
-                       free(ident1);
                    }
                }
                if (index == list_size) {
                    ALOGV("enadev: device value to be enabled: %s", usecase);
-                   snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+                   snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_set,
                         usecase);
                }
                ret = set_controls_of_usecase_for_device(uc_mgr,
@@ -1950,43 +2406,41 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
     } else if (!strncmp(identifier, "_enadev", 7)) {
         index = 0; ret = 0;
         list_size =
-            snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+            snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
         for (index = 0; index < list_size; index++) {
-            if ((ident1 =
-                snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+            if ((dev_ident =
+                snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                 index))) {
-                if (!strncmp(ident1, value, MAX_STR_LEN)) {
+                if (!strncmp(dev_ident, value, MAX_STR_LEN)) {
                     ALOGV("Device already part of enabled list: %s", value);
-                    free(ident1);
                     break;
                 }
-                free(ident1);
             }
         }
         if (index == list_size) {
             ALOGV("enadev: device value to be enabled: %s", value);
-            snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_set,
                 value);
         }
-        snd_ucm_print_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+        snd_ucm_print_list(&uc_mgr->card_ctxt_ptr->dev_set);
         /* Apply Mixer controls of usecase for this device*/
         ret = set_controls_of_device_for_usecase(uc_mgr, value, usecase, 1);
     } else if (!strncmp(identifier, "_disdev", 7)) {
-        ret = snd_ucm_get_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+        ret = snd_ucm_get_status_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                   value);
         if (ret < 0) {
             ALOGD("disdev: device %s not enabled, no need to disable", value);
         } else if (ret == 0) {
             ALOGV("disdev: device %s not active, remove from the list", value);
             ret =
-            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_set,
             value);
             if (ret < 0) {
                 ALOGE("Invalid device: Device not part of enabled device list");
             }
         } else {
             ret =
-            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_set,
             value);
             if (ret < 0) {
                 ALOGE("Invalid device: Device not part of enabled device list");
@@ -2035,25 +2489,23 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
             } else {
                 index = 0;
                 list_size =
-                snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+                snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
                 for (index = 0; index < list_size; index++) {
-                    if ((ident1 = snd_ucm_get_value_at_index(
-                        uc_mgr->card_ctxt_ptr->dev_list_head, index))) {
-                        if (!strncmp(ident1, usecase, MAX_STR_LEN)) {
+                    if ((dev_ident = snd_ucm_get_value_at_index(
+                        &uc_mgr->card_ctxt_ptr->dev_set, index))) {
+                        if (!strncmp(dev_ident, usecase, MAX_STR_LEN)) {
                             ALOGV("Device already part of enabled list: %s",
                                 usecase);
-                            free(ident1);
                             break;
                         }
-                        free(ident1);
                     }
                 }
                 if (index == list_size) {
                     ALOGV("enadev: device value to be enabled: %s", usecase);
-                    snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+                    snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_set,
                          usecase);
                 }
-                snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->mod_list_head,
+                snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->mod_set,
                     value);
                 /* Enable the mixer controls for the new use case
                  * for all the enabled devices */
@@ -2062,7 +2514,7 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
             }
         }
     } else if (!strncmp(identifier, "_dismod", 7)) {
-        ret = snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_list_head,
+        ret = snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_set,
               value);
         if (ret < 0) {
             ALOGE("Modifier not enabled currently, invalid modifier");
@@ -2076,7 +2528,7 @@ int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr,
     } else {
         ALOGE("Unknown identifier value: %s", identifier);
     }
-    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    snd_ucm_transition_unlock(uc_mgr, ret);
     return ret;
 }
 
@@ -2156,8 +2608,10 @@ int snd_use_case_mgr_open(snd_use_case_mgr_t **uc_mgr, const char *card_name)
             (strlen("/dev/snd/controlC")+2)*sizeof(char));
         uc_mgr_ptr->device_list_count = 0;
         uc_mgr_ptr->modifier_list_count = 0;
-        uc_mgr_ptr->current_device_list = NULL;
-        uc_mgr_ptr->current_modifier_list = NULL;
+        uc_mgr_ptr->card_ctxt_ptr->dev_set.table =
+            &uc_mgr_ptr->card_ctxt_ptr->ident_table;
+        uc_mgr_ptr->card_ctxt_ptr->mod_set.table =
+            &uc_mgr_ptr->card_ctxt_ptr->ident_table;
         uc_mgr_ptr->current_tx_device = -1;
         uc_mgr_ptr->current_rx_device = -1;
         pthread_mutexattr_init(&uc_mgr_ptr->card_ctxt_ptr->card_lock_attr);
@@ -2165,6 +2619,8 @@ int snd_use_case_mgr_open(snd_use_case_mgr_t **uc_mgr, const char *card_name)
             &uc_mgr_ptr->card_ctxt_ptr->card_lock_attr);
         strlcpy(uc_mgr_ptr->card_ctxt_ptr->current_verb,
                 SND_USE_CASE_VERB_INACTIVE, MAX_STR_LEN);
+        uc_mgr_ptr->card_ctxt_ptr->state =
+            &uc_mgr_ptr->card_ctxt_ptr->state_pool[0];
         /* Reset all mixer controls if any applied
          * previously for the same card */
     snd_use_case_mgr_reset(uc_mgr_ptr);
@@ -2192,9 +2648,90 @@ int snd_use_case_mgr_open(snd_use_case_mgr_t **uc_mgr, const char *card_name)
  * \param uc_mgr Use case manager
  * \return zero if success, otherwise a negative error code
  */
-int snd_use_case_mgr_reload(snd_use_case_mgr_t *uc_mgr) {
-    ALOGE("Reload is not implemented for now as there is no use case currently");
-    return 0;
+int snd_use_case_mgr_reload(snd_use_case_mgr_t *uc_mgr)
+{
+    struct stat st;
+    int fd, ret = 0, rc;
+    char *read_buf, *next_str, *current_str, *buf, *p, *temp_ptr;
+    char *verb_name = NULL, *file_name = NULL;
+    char path[200];
+
+    if ((uc_mgr == NULL) || (uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        ALOGE("snd_use_case_mgr_reload(): failed, invalid arguments");
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    rc = uc_mgr->card_ctxt_ptr->parse_complete;
+    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    if (!rc) {
+        ALOGE("snd_use_case_mgr_reload(): config parsing still in progress");
+        return -EBUSY;
+    }
+
+    strlcpy(path, CONFIG_DIR, (strlen(CONFIG_DIR)+1));
+    strlcat(path, uc_mgr->card_ctxt_ptr->card_name, sizeof(path));
+    ALOGV("reload master config file path:%s", path);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("failed to open config file %s error %d\n", path, errno);
+        return -EINVAL;
+    }
+    if (fstat(fd, &st) < 0) {
+        ALOGE("failed to stat %s error %d\n", path, errno);
+        close(fd);
+        return -EINVAL;
+    }
+    read_buf = (char *) mmap(0, st.st_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE, fd, 0);
+    if (read_buf == MAP_FAILED) {
+        ALOGE("failed to mmap file error %d\n", errno);
+        close(fd);
+        return -EINVAL;
+    }
+    current_str = read_buf;
+    if (is_single_config_format(current_str)) {
+        ALOGE("Reload is not supported for single config file format");
+        munmap(read_buf, st.st_size);
+        close(fd);
+        return -ENOSYS;
+    }
+    /* Walk SectionUseCase/File pairs of the master config file and reload
+     * every verb whose config file changed since it was parsed */
+    while (*current_str != (char)EOF)  {
+        next_str = strchr(current_str, '\n');
+        if (!next_str)
+            break;
+        *next_str++ = '\0';
+        if (verb_name == NULL) {
+            if ((buf = strstr(current_str, "SectionUseCase")) != NULL) {
+                p = strtok_r(buf, ".", &temp_ptr);
+                if ((p != NULL) && ((p = strtok_r(NULL, "\"", &temp_ptr))))
+                    verb_name = strdup(p);
+            }
+        } else if ((buf = strstr(current_str, "File")) != NULL) {
+            p = strtok_r(buf, "\"", &temp_ptr);
+            if ((p != NULL) && ((p = strtok_r(NULL, "\"", &temp_ptr))))
+                file_name = strdup(p);
+            if (file_name != NULL) {
+                rc = snd_ucm_reload_verb(uc_mgr, verb_name, file_name);
+                if (rc < 0)
+                    ret = rc;
+                free(file_name);
+                file_name = NULL;
+            }
+            free(verb_name);
+            verb_name = NULL;
+        }
+        if((current_str = next_str) == NULL)
+            break;
+    }
+    if (verb_name != NULL)
+        free(verb_name);
+    munmap(read_buf, st.st_size);
+    close(fd);
+    return ret;
 }
 
 /**
@@ -2243,7 +2780,7 @@ int snd_use_case_mgr_close(snd_use_case_mgr_t *uc_mgr)
  */
 int snd_use_case_mgr_reset(snd_use_case_mgr_t *uc_mgr)
 {
-    char *ident_value;
+    const char *ident_value;
     int index, list_size, ret = 0;
 
     ALOGV("snd_use_case_reset(): instance %p", uc_mgr);
@@ -2256,30 +2793,21 @@ int snd_use_case_mgr_reset(snd_use_case_mgr_t *uc_mgr)
     }
 
     /* Disable mixer controls of all the enabled modifiers */
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
+    list_size = snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->mod_set);
     for (index = (list_size-1); index >= 0; index--) {
         if ((ident_value =
-            snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head,
+            snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->mod_set,
                 index))) {
-            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_list_head,
+            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_set,
                 ident_value);
             ret = set_controls_of_usecase_for_all_devices(uc_mgr,
                       ident_value, 0, CTRL_LIST_MODIFIER);
         if (ret != 0)
                 ALOGE("Failed to disable mixer controls for %s", ident_value);
-            free(ident_value);
         }
     }
     /* Clear the enabled modifiers list */
-    if (uc_mgr->modifier_list_count) {
-        for (index = 0; index < uc_mgr->modifier_list_count; index++) {
-            free(uc_mgr->current_modifier_list[index]);
-            uc_mgr->current_modifier_list[index] = NULL;
-        }
-        free(uc_mgr->current_modifier_list);
-        uc_mgr->current_modifier_list = NULL;
-        uc_mgr->modifier_list_count = 0;
-    }
+    uc_mgr->modifier_list_count = 0;
     /* Disable mixer controls of current use case verb */
     if(strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE,
        strlen(SND_USE_CASE_VERB_INACTIVE))) {
@@ -2292,33 +2820,25 @@ int snd_use_case_mgr_reset(snd_use_case_mgr_t *uc_mgr)
             MAX_STR_LEN);
     }
     /* Disable mixer controls of all the enabled devices */
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+    list_size = snd_ucm_get_size_of_list(&uc_mgr->card_ctxt_ptr->dev_set);
     for (index = (list_size-1); index >= 0; index--) {
         if ((ident_value =
-            snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_get_value_at_index(&uc_mgr->card_ctxt_ptr->dev_set,
                 index))) {
-            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head,
+            snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_set,
                 ident_value);
             ret = set_controls_of_device_for_all_usecases(uc_mgr,
                       ident_value, 0);
         if (ret != 0)
                 ALOGE("Failed to disable or no mixer controls set for %s",
                     ident_value);
-        free(ident_value);
         }
     }
     /* Clear the enabled devices list */
-    if (uc_mgr->device_list_count) {
-        for (index = 0; index < uc_mgr->device_list_count; index++) {
-            free(uc_mgr->current_device_list[index]);
-            uc_mgr->current_device_list[index] = NULL;
-        }
-        free(uc_mgr->current_device_list);
-        uc_mgr->current_device_list = NULL;
-        uc_mgr->device_list_count = 0;
-    }
+    uc_mgr->device_list_count = 0;
     uc_mgr->current_tx_device = -1;
     uc_mgr->current_rx_device = -1;
+    snd_ucm_state_publish(uc_mgr->card_ctxt_ptr);
     pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
     return ret;
 }
@@ -2463,6 +2983,9 @@ void *second_stage_parsing_thread(void *uc_mgr_ptr)
 #endif
     if(ret < 0)
         ALOGE("Failed to parse config files: %d", ret);
+    pthread_mutex_lock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
+    (*uc_mgr)->card_ctxt_ptr->parse_complete = 1;
+    pthread_mutex_unlock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
     ALOGE("Exiting parsing thread uc_mgr %p\n", uc_mgr);
     return NULL;
 }
@@ -2535,6 +3058,7 @@ static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr)
     if ((ret = is_single_config_format(current_str))) {
         ALOGD("Single config file format detected\n");
         ret = parse_single_config_format(uc_mgr, current_str, verb_count);
+        (*uc_mgr)->card_ctxt_ptr->parse_complete = 1;
         munmap(read_buf, st.st_size);
         close(fd);
         return ret;
@@ -3114,6 +3638,8 @@ const char *file_name, int index)
             close(fd);
             return -EINVAL;
         }
+        verb_list[index].file_mtime = st.st_mtime;
+        verb_list[index].file_size = st.st_size;
         read_buf = (char *) mmap(0, st.st_size, PROT_READ | PROT_WRITE,
                    MAP_PRIVATE, fd, 0);
         if (read_buf == MAP_FAILED) {
@@ -3195,16 +3721,16 @@ const char *file_name, int index)
             return ret;
         if (parse_count == 0) {
             verb_list[index].device_list =
-                (char **)malloc((device_count+1)*sizeof(char *));
+                (char **)calloc((device_count+1), sizeof(char *));
             if (verb_list[index].device_list == NULL)
                 return -ENOMEM;
             verb_list[index].modifier_list =
-                (char **)malloc((modifier_count+1)*sizeof(char *));
+                (char **)calloc((modifier_count+1), sizeof(char *));
             if (verb_list[index].modifier_list == NULL)
                 return -ENOMEM;
             parse_count += verb_list[index].verb_count;
             verb_list[index].verb_ctrls = (card_mctrl_t *)
-                malloc((verb_list[index].verb_count+1)*sizeof(card_mctrl_t));
+                calloc((verb_list[index].verb_count+1), sizeof(card_mctrl_t));
             if (verb_list[index].verb_ctrls == NULL) {
                ret = -ENOMEM;
                break;
@@ -3212,7 +3738,7 @@ const char *file_name, int index)
             verb_list[index].verb_count = 0;
             parse_count += verb_list[index].device_count;
             verb_list[index].device_ctrls = (card_mctrl_t *)
-                malloc((verb_list[index].device_count+1)*sizeof(card_mctrl_t));
+                calloc((verb_list[index].device_count+1), sizeof(card_mctrl_t));
             if (verb_list[index].device_ctrls == NULL) {
                ret = -ENOMEM;
                break;
@@ -3220,7 +3746,7 @@ const char *file_name, int index)
             verb_list[index].device_count = 0;
             parse_count += verb_list[index].mod_count;
             verb_list[index].mod_ctrls = (card_mctrl_t *)
-                malloc((verb_list[index].mod_count+1)*sizeof(card_mctrl_t));
+                calloc((verb_list[index].mod_count+1), sizeof(card_mctrl_t));
             if (verb_list[index].mod_ctrls == NULL) {
                ret = -ENOMEM;
                break;
@@ -3984,215 +4510,585 @@ void snd_ucm_free_mixer_list(snd_use_case_mgr_t **uc_mgr)
     pthread_mutex_unlock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
 }
 
-/* Add an identifier to the respective list
- * head - list head
- * value - node value that needs to be added
- * Returns 0 on sucess, negative error code otherwise
+/* Free mixer control lists of a single verb, use case name is kept.
+ * All lists are calloc'ed by snd_ucm_parse_verb so a partially parsed
+ * verb can be released as well.
  */
-static int snd_ucm_add_ident_to_list(struct snd_ucm_ident_node **head,
-const char *value)
+static void snd_ucm_free_verb_ctrls(use_case_verb_t *verb)
 {
-    struct snd_ucm_ident_node *temp, *node;
+    int index;
+
+    if (verb->verb_ctrls)
+        free_list(verb->verb_ctrls, 0, verb->verb_count + 1);
+    if (verb->device_ctrls)
+        free_list(verb->device_ctrls, 0, verb->device_count + 1);
+    if (verb->mod_ctrls)
+        free_list(verb->mod_ctrls, 0, verb->mod_count + 1);
+    free(verb->verb_ctrls);
+    free(verb->device_ctrls);
+    free(verb->mod_ctrls);
+    if (verb->device_list) {
+        for (index = 0; index <= verb->device_count; index++)
+            free(verb->device_list[index]);
+        free(verb->device_list);
+    }
+    if (verb->modifier_list) {
+        for (index = 0; index <= verb->mod_count; index++)
+            free(verb->modifier_list[index]);
+        free(verb->modifier_list);
+    }
+    verb->verb_ctrls = verb->device_ctrls = verb->mod_ctrls = NULL;
+    verb->device_list = verb->modifier_list = NULL;
+}
 
-    node =
-        (struct snd_ucm_ident_node *)malloc(sizeof(struct snd_ucm_ident_node));
-    if (node == NULL) {
-        ALOGE("Failed to allocate memory for new node");
-        return -ENOMEM;
-    } else {
-        node->next = NULL;
-        strlcpy(node->ident, value, MAX_STR_LEN);
-        node->active = 0;
-        node->capability = 0;
+/* Find a case by name in a mixer control list
+ * Returns the case on success, NULL if it does not exist
+ */
+static const card_mctrl_t *snd_ucm_find_case(const card_mctrl_t *list,
+int count, const char *case_name)
+{
+    int index;
+
+    for (index = 0; index < count; index++) {
+        if (list[index].case_name &&
+            !strcmp(list[index].case_name, case_name))
+            return &list[index];
+    }
+    return NULL;
+}
+
+/* Returns 1 if both mixer controls write the same value, 0 otherwise */
+static int snd_ucm_mixer_ctl_equal(const mixer_control_t *a,
+const mixer_control_t *b)
+{
+    unsigned int index;
+
+    if (a->type != b->type)
+        return 0;
+    if (a->type == TYPE_INT)
+        return (a->value == b->value);
+    if (a->type == TYPE_MULTI_VAL) {
+        if (a->value != b->value)
+            return 0;
+        for (index = 0; index < a->value; index++) {
+            if (strcmp(a->mulval[index], b->mulval[index]))
+                return 0;
+        }
+        return 1;
+    }
+    return !strcmp(a->string, b->string);
+}
+
+/* Returns 1 if the controls of case_name are currently applied: the case
+ * is an active device, or the current verb or an enabled modifier alone
+ * or combined with an active device.
+ */
+static int snd_ucm_reload_case_active(card_ctxt_t *card,
+const char *case_name, int ctrl_list_type)
+{
+    const char *base;
+    size_t len;
+    int index, list_size;
+
+    if (ctrl_list_type == CTRL_LIST_DEVICE)
+        return (snd_ucm_get_status_at_index(&card->dev_set, case_name) > 0);
+
+    list_size = (ctrl_list_type == CTRL_LIST_VERB) ? 1 :
+                    snd_ucm_get_size_of_list(&card->mod_set);
+    for (index = 0; index < list_size; index++) {
+        base = (ctrl_list_type == CTRL_LIST_VERB) ? card->current_verb :
+                   snd_ucm_get_value_at_index(&card->mod_set, index);
+        if (base == NULL)
+            continue;
+        len = strlen(base);
+        if (strncmp(case_name, base, len))
+            continue;
+        if ((case_name[len] == '\0') ||
+            (snd_ucm_get_status_at_index(&card->dev_set,
+                 case_name + len) > 0))
+            return 1;
+    }
+    return 0;
+}
+
+/* Find a control by name in a mixer control list, the last entry wins as
+ * it is the value the sequence leaves behind
+ * Returns the control on success, NULL if the list does not set it
+ */
+static const mixer_control_t *snd_ucm_find_mixer_ctl(
+const mixer_control_t *list, int count, const char *control_name)
+{
+    int index;
+
+    for (index = count - 1; index >= 0; index--) {
+        if (!strcmp(list[index].control_name, control_name))
+            return &list[index];
+    }
+    return NULL;
+}
+
+/* Write one mixer control during a reload
+ * Returns 1 if the control was written, 0 otherwise
+ */
+static int snd_ucm_reload_write_ctl(snd_use_case_mgr_t *uc_mgr,
+const mixer_control_t *mctl)
+{
+    struct mixer_ctl *ctl;
+    int ret;
+
+    ctl = mixer_get_control(uc_mgr->card_ctxt_ptr->mixer_handle,
+              mctl->control_name, 0);
+    if (!ctl) {
+        ALOGE("Reload: mixer control %s not found", mctl->control_name);
+        return 0;
     }
-    if (*head == NULL) {
-        *head = node;
+    if (mctl->type == TYPE_INT) {
+        ALOGD("Reload: setting %s to %d", mctl->control_name,
+            mctl->value);
+        ret = mixer_ctl_set(ctl, mctl->value);
+    } else if (mctl->type == TYPE_MULTI_VAL) {
+        ALOGD("Reload: setting multi value %s", mctl->control_name);
+        ret = mixer_ctl_set_value(ctl, mctl->value, mctl->mulval);
     } else {
-        temp = *head;
-        while (temp->next != NULL) {
-            temp = temp->next;
+        ALOGD("Reload: setting %s to %s", mctl->control_name,
+            mctl->string);
+        ret = mixer_ctl_select(ctl, mctl->string);
+    }
+    if (ret < 0) {
+        ALOGE("Reload: failed to set %s: %d", mctl->control_name, ret);
+        return 0;
+    }
+    return 1;
+}
+
+/* Write the enable sequence controls of new_case whose value differs from
+ * the last value old_case wrote to the same control, then reset controls
+ * old_case enabled that new_case no longer sets to their disable value,
+ * taken from new_case or else from old_case.
+ * Returns number of controls written
+ */
+static int snd_ucm_reload_apply_changed(snd_use_case_mgr_t *uc_mgr,
+const card_mctrl_t *old_case, const card_mctrl_t *new_case)
+{
+    const mixer_control_t *mctl, *old_mctl, *reset;
+    int index, written = 0;
+
+    for (index = 0; index < new_case->ena_mixer_count; index++) {
+        mctl = &new_case->ena_mixer_list[index];
+        old_mctl = old_case ? snd_ucm_find_mixer_ctl(old_case->ena_mixer_list,
+                       old_case->ena_mixer_count, mctl->control_name) : NULL;
+        if (old_mctl && snd_ucm_mixer_ctl_equal(old_mctl, mctl))
+            continue;
+        written += snd_ucm_reload_write_ctl(uc_mgr, mctl);
+    }
+    for (index = 0; old_case && (index < old_case->ena_mixer_count); index++) {
+        mctl = &old_case->ena_mixer_list[index];
+        if (snd_ucm_find_mixer_ctl(new_case->ena_mixer_list,
+                new_case->ena_mixer_count, mctl->control_name))
+            continue;
+        /* Reset each dropped control once, at its last enable entry */
+        if (snd_ucm_find_mixer_ctl(old_case->ena_mixer_list,
+                old_case->ena_mixer_count, mctl->control_name) != mctl)
+            continue;
+        reset = snd_ucm_find_mixer_ctl(new_case->dis_mixer_list,
+                    new_case->dis_mixer_count, mctl->control_name);
+        if (reset == NULL)
+            reset = snd_ucm_find_mixer_ctl(old_case->dis_mixer_list,
+                        old_case->dis_mixer_count, mctl->control_name);
+        if (reset == NULL) {
+            ALOGE("Reload: %s dropped from %s has no disable value, "
+                "keeping it", mctl->control_name, new_case->case_name);
+            continue;
+        }
+        written += snd_ucm_reload_write_ctl(uc_mgr, reset);
+    }
+    return written;
+}
+
+/* Write the disable sequence of a case the new config no longer has
+ * Returns number of controls written
+ */
+static int snd_ucm_reload_apply_removed(snd_use_case_mgr_t *uc_mgr,
+const card_mctrl_t *old_case)
+{
+    int index, written = 0;
+
+    ALOGD("Reload: %s removed, applying its disable sequence",
+        old_case->case_name);
+    for (index = 0; index < old_case->dis_mixer_count; index++)
+        written += snd_ucm_reload_write_ctl(uc_mgr,
+                       &old_case->dis_mixer_list[index]);
+    return written;
+}
+
+/* Re-apply controls of the active cases of the current verb which changed
+ * between old_verb and new_verb, so the mixer ends up as if the active
+ * cases had been enabled under new_verb. Devices go first as in
+ * snd_use_case_set. Must be called with card_lock held.
+ */
+static void snd_ucm_reload_apply_verb(snd_use_case_mgr_t *uc_mgr,
+const use_case_verb_t *old_verb, const use_case_verb_t *new_verb)
+{
+    const card_mctrl_t *old_lists[3] = { old_verb->device_ctrls,
+        old_verb->verb_ctrls, old_verb->mod_ctrls };
+    const card_mctrl_t *new_lists[3] = { new_verb->device_ctrls,
+        new_verb->verb_ctrls, new_verb->mod_ctrls };
+    const int old_counts[3] = { old_verb->device_count,
+        old_verb->verb_count, old_verb->mod_count };
+    const int new_counts[3] = { new_verb->device_count,
+        new_verb->verb_count, new_verb->mod_count };
+    const int types[3] = { CTRL_LIST_DEVICE, CTRL_LIST_VERB,
+        CTRL_LIST_MODIFIER };
+    const char *case_name;
+    int list, index, written = 0;
+
+    if (!uc_mgr->card_ctxt_ptr->mixer_handle) {
+        ALOGE("Reload: control device not initialized");
+        return;
+    }
+    for (list = 0; list < 3; list++) {
+        for (index = 0; index < new_counts[list]; index++) {
+            case_name = new_lists[list][index].case_name;
+            if ((case_name == NULL) ||
+                !snd_ucm_reload_case_active(uc_mgr->card_ctxt_ptr,
+                    case_name, types[list]))
+                continue;
+            written += snd_ucm_reload_apply_changed(uc_mgr,
+                           snd_ucm_find_case(old_lists[list],
+                               old_counts[list], case_name),
+                           &new_lists[list][index]);
         }
-        temp->next = node;
+        for (index = 0; index < old_counts[list]; index++) {
+            case_name = old_lists[list][index].case_name;
+            if ((case_name == NULL) ||
+                snd_ucm_find_case(new_lists[list], new_counts[list],
+                    case_name) ||
+                !snd_ucm_reload_case_active(uc_mgr->card_ctxt_ptr,
+                    case_name, types[list]))
+                continue;
+            written += snd_ucm_reload_apply_removed(uc_mgr,
+                           &old_lists[list][index]);
+        }
+    }
+    ALOGD("Reload: %d mixer controls re-applied for %s", written,
+        uc_mgr->card_ctxt_ptr->current_verb);
+}
+
+/* Reparse the config file of a verb if it changed since it was parsed and
+ * swap in the new mixer control lists. Lists previously returned by
+ * snd_use_case_get_list() for this verb become invalid.
+ * Returns 0 on success, negative error code otherwise
+ */
+static int snd_ucm_reload_verb(snd_use_case_mgr_t *uc_mgr,
+const char *verb_name, const char *file_name)
+{
+    card_ctxt_t *card = uc_mgr->card_ctxt_ptr, *scratch_card;
+    snd_use_case_mgr_t scratch_mgr, *scratch_ptr = &scratch_mgr;
+    use_case_verb_t new_verb, old_verb;
+    struct stat st;
+    char path[200];
+    int index = 0, ret;
+
+    while (strncmp(card->verb_list[index], SND_UCM_END_OF_LIST,
+           strlen(SND_UCM_END_OF_LIST))) {
+        if (!strcmp(card->verb_list[index], verb_name))
+            break;
+        index++;
+    }
+    if (!strncmp(card->verb_list[index], SND_UCM_END_OF_LIST,
+        strlen(SND_UCM_END_OF_LIST))) {
+        ALOGE("Reload: new verb %s needs the use case manager reopened",
+            verb_name);
+        return 0;
+    }
+
+    strlcpy(path, CONFIG_DIR, (strlen(CONFIG_DIR)+1));
+    strlcat(path, file_name, sizeof(path));
+    if (stat(path, &st) < 0) {
+        ALOGE("failed to stat %s error %d\n", path, errno);
+        return -EINVAL;
+    }
+    if ((st.st_mtime == card->use_case_verb_list[index].file_mtime) &&
+        (st.st_size == card->use_case_verb_list[index].file_size))
+        return 0;
+
+    /* snd_ucm_parse_verb only needs the verb list of the card context */
+    scratch_card = (card_ctxt_t *)calloc(1, sizeof(card_ctxt_t));
+    if (scratch_card == NULL)
+        return -ENOMEM;
+    memset(&scratch_mgr, 0, sizeof(scratch_mgr));
+    memset(&new_verb, 0, sizeof(new_verb));
+    scratch_mgr.card_ctxt_ptr = scratch_card;
+    scratch_card->use_case_verb_list = &new_verb;
+    ALOGD("Reload: config file %s of verb %s changed", file_name, verb_name);
+    ret = snd_ucm_parse_verb(&scratch_ptr, file_name, 0);
+    free(scratch_card);
+    if (ret < 0) {
+        ALOGE("Reload: failed to parse %s: %d, keeping old controls",
+            file_name, ret);
+        snd_ucm_free_verb_ctrls(&new_verb);
+        return ret;
     }
-    ALOGV("add_to_list: head %p, value %s", *head, node->ident);
+
+    pthread_mutex_lock(&card->card_lock);
+    old_verb = card->use_case_verb_list[index];
+    new_verb.use_case_name = old_verb.use_case_name;
+    card->use_case_verb_list[index] = new_verb;
+    if (index == card->current_verb_index)
+        snd_ucm_reload_apply_verb(uc_mgr, &old_verb, &new_verb);
+    pthread_mutex_unlock(&card->card_lock);
+    snd_ucm_free_verb_ctrls(&old_verb);
     return 0;
 }
 
-/* Get the status of identifier at particulare index of the list
- * head - list head
- * ident - identifier value for which status needs to be get
- * status - status to be set (1 - active, 0 - inactive)
+/* Hash an identifier string into the interned identifier table */
+static unsigned int snd_ucm_hash_ident(const char *ident)
+{
+    unsigned int hash = 5381;
+
+    while (*ident)
+        hash = ((hash << 5) + hash) + (unsigned char)*ident++;
+    return (hash & (SND_UCM_IDENT_HASH_SIZE - 1));
+}
+
+/* Look up the id of an interned identifier
+ * table - interned identifier table
+ * ident - identifier value
+ * Returns id on sucess, negative error code if ident was never interned
  */
-static int snd_ucm_get_status_at_index(struct snd_ucm_ident_node *head,
+static int snd_ucm_lookup_ident(const snd_ucm_ident_table_t *table,
 const char *ident)
 {
-    while (head != NULL) {
-        if(!strncmp(ident, head->ident, (strlen(head->ident)+1))) {
+    unsigned int slot;
+    int id, probe;
+
+    if ((table == NULL) || (ident == NULL))
+        return -EINVAL;
+    slot = snd_ucm_hash_ident(ident);
+    for (probe = 0; probe < SND_UCM_IDENT_HASH_SIZE; probe++) {
+        /* may run without card_lock, pairs with snd_ucm_intern_ident */
+        id = __sync_fetch_and_add((int16_t *)&table->hash[slot], 0) - 1;
+        if (id < 0)
             break;
-        }
-        head = head->next;
+        if (!strncmp(table->ident[id], ident, MAX_STR_LEN))
+            return id;
+        slot = (slot + 1) & (SND_UCM_IDENT_HASH_SIZE - 1);
     }
-    if (head == NULL) {
-        ALOGV("Element not found in the list");
-    } else {
-        return(head->active);
-    }
-    return -EINVAL;
+    return -ENOENT;
 }
 
-/* Get the node at particular index
- * head - list head
- * index - index value
+/* Intern an identifier, ids are never released for the card lifetime
+ * table - interned identifier table
+ * ident - identifier value
+ * Returns id on sucess, negative error code otherwise
  */
-struct snd_ucm_ident_node *snd_ucm_get_device_node(struct snd_ucm_ident_node *head,
-int index)
+static int snd_ucm_intern_ident(snd_ucm_ident_table_t *table,
+const char *ident)
 {
-    if (head == NULL) {
-        ALOGV("Empty list");
-        return NULL;
+    unsigned int slot;
+    int id, probe;
+
+    if ((table == NULL) || (ident == NULL))
+        return -EINVAL;
+    slot = snd_ucm_hash_ident(ident);
+    for (probe = 0; probe < SND_UCM_IDENT_HASH_SIZE; probe++) {
+        if (!table->hash[slot])
+            break;
+        id = table->hash[slot] - 1;
+        if (!strncmp(table->ident[id], ident, MAX_STR_LEN))
+            return id;
+        slot = (slot + 1) & (SND_UCM_IDENT_HASH_SIZE - 1);
+    }
+    if (table->count >= SND_UCM_MAX_IDENTS) {
+        ALOGE("Identifier table full, failed to intern %s", ident);
+        return -ENOMEM;
     }
+    id = table->count++;
+    strlcpy(table->ident[id], ident, MAX_STR_LEN);
+    /* Lookups run without card_lock, the name must be visible first */
+    __sync_synchronize();
+    (void)__sync_lock_test_and_set(&table->hash[slot], id + 1);
+    return id;
+}
 
-    if ((index < 0) || (index >= (snd_ucm_get_size_of_list(head)))) {
-        ALOGE("Element with given index %d doesn't exist in the list", index);
-        return NULL;
+/* Add an identifier to the respective list
+ * set - enabled identifier set
+ * value - identifier value that needs to be added
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_add_ident_to_list(snd_ucm_ident_set_t *set,
+const char *value)
+{
+    int id;
+
+    if ((id = snd_ucm_intern_ident(set->table, value)) < 0)
+        return id;
+    if (set->count >= SND_UCM_MAX_IDENTS) {
+        ALOGE("Enabled list full, failed to add %s", value);
+        return -ENOMEM;
+    }
+    if (set->refcount[id] == UINT16_MAX) {
+        ALOGE("%s enabled too many times", value);
+        return -EOVERFLOW;
     }
+    /* A new entry starts inactive, earlier entries keep their state */
+    set->order_active[set->count] = 0;
+    set->order_capability[set->count] = 0;
+    set->order[set->count++] = id;
+    set->refcount[id]++;
+    snd_ucm_bitset_set(set->enabled, id);
+    ALOGV("add_to_list: set %p, value %s, id %d", set, value, id);
+    return 0;
+}
+
+/* Index of the first entry of an identifier at or after from, -1 if none */
+static int snd_ucm_first_index(snd_ucm_ident_set_t *set, int id, int from)
+{
+    int index;
 
-    while (index) {
-        head = head->next;
-        index--;
+    for (index = from; index < set->count; index++) {
+        if (set->order[index] == id)
+            return index;
     }
+    return -1;
+}
+
+/* Get the status of identifier in the list
+ * set - enabled identifier set
+ * ident - identifier value for which status needs to be get
+ * Returns 1 if active, 0 if inactive, negative error code if not enabled
+ */
+static int snd_ucm_get_status_at_index(snd_ucm_ident_set_t *set,
+const char *ident)
+{
+    int id = snd_ucm_lookup_ident(set->table, ident);
 
-    return head;
+    if (!snd_ucm_bitset_test(set->enabled, id)) {
+        ALOGV("Element not found in the list");
+        return -EINVAL;
+    }
+    return snd_ucm_bitset_test(set->active, id);
 }
 
-/* Set the status of identifier at particulare index of the list
- * head - list head
+/* Set the status of identifier in the list
+ * set - enabled identifier set
  * ident - identifier value for which status needs to be set
  * status - status to be set (1 - active, 0 - inactive)
  */
-static void snd_ucm_set_status_at_index(struct snd_ucm_ident_node *head,
+static void snd_ucm_set_status_at_index(snd_ucm_ident_set_t *set,
 const char *ident, int status, int capability)
 {
-    while (head != NULL) {
-        if(!strncmp(ident, head->ident, (strlen(head->ident)+1))) {
-            break;
-        }
-        head = head->next;
-    }
-    if (head == NULL) {
+    int id = snd_ucm_lookup_ident(set->table, ident);
+
+    int index;
+
+    if (!snd_ucm_bitset_test(set->enabled, id) ||
+        (index = snd_ucm_first_index(set, id, 0)) < 0) {
         ALOGE("Element not found to set the status");
-    } else {
-        head->active = status;
-        head->capability = capability;
+        return;
     }
+    set->order_active[index] = status ? 1 : 0;
+    set->order_capability[index] = capability;
+    if (status)
+        snd_ucm_bitset_set(set->active, id);
+    else
+        snd_ucm_bitset_clear(set->active, id);
+    set->capability[id] = capability;
 }
 
 /* Get the identifier value at particulare index of the list
- * head - list head
- * index - node index value
- * Returns node idetifier value at index on sucess, NULL otherwise
+ * set - enabled identifier set
+ * index - index value
+ * Returns interned identifier value at index on sucess, NULL otherwise.
+ * The returned string is owned by the identifier table, do not free it.
  */
-static char *snd_ucm_get_value_at_index(struct snd_ucm_ident_node *head,
+static const char *snd_ucm_get_value_at_index(snd_ucm_ident_set_t *set,
 int index)
 {
-    if (head == NULL) {
-        ALOGV("Empty list");
-        return NULL;
-    }
-
-    if ((index < 0) || (index >= (snd_ucm_get_size_of_list(head)))) {
+    if ((index < 0) || (index >= set->count)) {
         ALOGE("Element with given index %d doesn't exist in the list", index);
         return NULL;
     }
+    return set->table->ident[set->order[index]];
+}
 
-    while (index) {
-        head = head->next;
-        index--;
-    }
+/* Get the capability of identifier at particulare index of the list */
+static int snd_ucm_get_capability_at_index(snd_ucm_ident_set_t *set,
+int index)
+{
+    if ((index < 0) || (index >= set->count))
+        return -EINVAL;
+    return set->order_capability[index];
+}
 
-    return (strdup(head->ident));
+/* Get the status of identifier at particulare index of the list */
+static int snd_ucm_get_active_at_index(snd_ucm_ident_set_t *set,
+int index)
+{
+    if ((index < 0) || (index >= set->count))
+        return -EINVAL;
+    return set->order_active[index];
 }
 
 /* Get the size of the list
- * head - list head
- * Returns size of list on sucess, negative error code otherwise
+ * set - enabled identifier set
+ * Returns size of list
  */
-static int snd_ucm_get_size_of_list(struct snd_ucm_ident_node *head)
+static int snd_ucm_get_size_of_list(snd_ucm_ident_set_t *set)
 {
-    int index = 0;
-
-    if (head == NULL) {
-        ALOGV("Empty list");
-        return 0;
-    }
-
-    while (head->next != NULL) {
-        index++;
-        head = head->next;
-    }
-
-    return (index+1);
+    return set->count;
 }
 
-static void snd_ucm_print_list(struct snd_ucm_ident_node *head)
+static void snd_ucm_print_list(snd_ucm_ident_set_t *set)
 {
-    int index = 0;
+    int index;
 
-    ALOGV("print_list: head %p", head);
-    if (head == NULL) {
+    ALOGV("print_list: set %p", set);
+    if (!set->count) {
         ALOGV("Empty list");
         return;
     }
-
-    while (head->next != NULL) {
-        ALOGV("index: %d, value: %s", index, head->ident);
-        index++;
-        head = head->next;
-    }
-    ALOGV("index: %d, value: %s", index, head->ident);
+    for (index = 0; index < set->count; index++)
+        ALOGV("index: %d, value: %s", index,
+            set->table->ident[set->order[index]]);
 }
 
 /* Delete an identifier from respective list
- * head - list head
- * value - node value that needs to be deleted
+ * set - enabled identifier set
+ * value - identifier value that needs to be deleted
  * Returns 0 on sucess, negative error code otherwise
  *
  */
-static int snd_ucm_del_ident_from_list(struct snd_ucm_ident_node **head,
+static int snd_ucm_del_ident_from_list(snd_ucm_ident_set_t *set,
 const char *value)
 {
-    struct snd_ucm_ident_node *temp1, *temp2;
-    int ret = -EINVAL;
+    int id, index;
 
-    if (*head == NULL) {
-        ALOGE("del_from_list: Empty list");
+    id = snd_ucm_lookup_ident(set->table, value);
+    if (!snd_ucm_bitset_test(set->enabled, id)) {
+        ALOGE("Element not found in enabled list");
         return -EINVAL;
-    } else if (!strncmp((*head)->ident, value, (strlen(value)+1))) {
-            temp2 = *head;
-            *head = temp2->next;
-            ret = 0;
-    } else {
-        temp1 = *head;
-        temp2 = temp1->next;
-        while (temp2 != NULL) {
-            if (!strncmp(temp2->ident, value, (strlen(value)+1))) {
-                temp1->next = temp2->next;
-                ret = 0;
-                break;
-            }
-            temp1 = temp1->next;
-            temp2 = temp1->next;
-        }
     }
-    if (ret < 0) {
-        ALOGE("Element not found in enabled list");
-    } else {
-        temp2->next = NULL;
-        temp2->ident[0] = 0;
-        temp2->active = 0;
-        temp2->capability = 0;
-        free(temp2);
-        temp2 = NULL;
+    index = snd_ucm_first_index(set, id, 0);
+    memmove(&set->order[index], &set->order[index + 1],
+        (set->count - index - 1) * sizeof(set->order[0]));
+    memmove(&set->order_active[index], &set->order_active[index + 1],
+        (set->count - index - 1) * sizeof(set->order_active[0]));
+    memmove(&set->order_capability[index], &set->order_capability[index + 1],
+        (set->count - index - 1) * sizeof(set->order_capability[0]));
+    set->count--;
+    if (--set->refcount[id] == 0) {
+        snd_ucm_bitset_clear(set->enabled, id);
+        snd_ucm_bitset_clear(set->active, id);
+        set->capability[id] = 0;
+        return 0;
     }
-    return ret;
+    /* The next entry of the identifier becomes the first one */
+    index = snd_ucm_first_index(set, id, index);
+    if (set->order_active[index])
+        snd_ucm_bitset_set(set->active, id);
+    else
+        snd_ucm_bitset_clear(set->active, id);
+    set->capability[id] = set->order_capability[index];
+    return 0;
 }
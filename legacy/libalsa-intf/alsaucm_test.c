@@ -35,6 +35,9 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
 #ifndef ANDROID
 #include <stdint.h>
@@ -48,6 +51,8 @@
 static void print_help_menu(void);
 static void alsaucm_test_cmd_svr(void);
 static int process_cmd(char *cmdStr);
+static int print_profile_report(void);
+static int run_contention_bench(const char *device, int seconds);
 
 /* Global data */
 snd_use_case_mgr_t *uc_mgr;
@@ -62,6 +67,8 @@ enum ucm_cmd_id {
     UCM_GETI,
     UCM_RESET,
     UCM_RELOAD,
+    UCM_PROFILE,
+    UCM_BENCH,
     UCM_HELP,
     UCM_QUIT,
     UCM_UNKNOWN
@@ -81,6 +88,8 @@ static struct cmd cmds[] = {
     { UCM_GETI,  "geti" },
     { UCM_RESET,  "reset" },
     { UCM_RELOAD,  "reload" },
+    { UCM_PROFILE,  "profile" },
+    { UCM_BENCH,  "bench" },
     { UCM_HELP,  "help" },
     { UCM_QUIT,  "quit" },
     { UCM_UNKNOWN, NULL }
@@ -143,10 +152,170 @@ static void print_help_menu(void)
            "  get IDENTIFIER             get string value\n"
            "  geti IDENTIFIER            get integer value\n"
            "  set IDENTIFIER VALUE       set string value\n"
+           "  profile on|off|clear|report  record use case transition timings\n"
+           "  bench DEVICE [SECONDS]     toggle DEVICE while querying its status\n"
            "  help                     help\n"
            "  quit                     quit\n");
 }
 
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_record_total(const void *a, const void *b)
+{
+    const snd_ucm_transition_record_t *x = a, *y = b;
+
+    return (y->total_us > x->total_us) - (y->total_us < x->total_us);
+}
+
+/* Sort samples and print their p50/p90/p99/max */
+static void print_percentiles(const char *name, uint64_t *samples, int count)
+{
+    qsort(samples, count, sizeof(uint64_t), cmp_u64);
+    printf("  %-14s p50 %8llu  p90 %8llu  p99 %8llu  max %8llu\n", name,
+           (unsigned long long)samples[(count - 1) * 50 / 100],
+           (unsigned long long)samples[(count - 1) * 90 / 100],
+           (unsigned long long)samples[(count - 1) * 99 / 100],
+           (unsigned long long)samples[count - 1]);
+}
+
+static int print_profile_report(void)
+{
+    snd_ucm_transition_record_t records[SND_UCM_PROFILE_RING_SIZE];
+    uint64_t samples[SND_UCM_PROFILE_RING_SIZE];
+    int count, i;
+
+    count = snd_use_case_get_profile(uc_mgr, records,
+                SND_UCM_PROFILE_RING_SIZE);
+    if (count < 0)
+        return count;
+    if (count == 0) {
+        printf("no transitions recorded\n");
+        return 0;
+    }
+
+    printf("%d transitions (times in usec):\n", count);
+    for (i = 0; i < count; i++)
+        samples[i] = records[i].total_us;
+    print_percentiles("total", samples, count);
+    for (i = 0; i < count; i++)
+        samples[i] = records[i].lock_wait_us;
+    print_percentiles("lock wait", samples, count);
+    for (i = 0; i < count; i++)
+        samples[i] = records[i].ioctl_us;
+    print_percentiles("ioctl", samples, count);
+    for (i = 0; i < count; i++)
+        samples[i] = records[i].ctls_written;
+    print_percentiles("ctls written", samples, count);
+
+    qsort(records, count, sizeof(records[0]), cmp_record_total);
+    printf("slowest transitions:\n");
+    for (i = 0; i < count && i < 10; i++) {
+        printf("  %8llu us  %s=%s  lookups %u writes %u ioctl %llu us ret %d\n",
+               (unsigned long long)records[i].total_us,
+               records[i].identifier, records[i].value,
+               records[i].ctls_looked_up, records[i].ctls_written,
+               (unsigned long long)records[i].ioctl_us, records[i].ret);
+    }
+    return 0;
+}
+
+#define BENCH_GETTERS 4
+#define BENCH_SAMPLES 65536
+
+struct bench_ctx {
+    const char *device;
+    volatile int stop;
+    unsigned long count;
+    int samples;
+    uint64_t latency_us[BENCH_SAMPLES];
+};
+
+static uint64_t bench_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/* Enable and disable the device back to back */
+static void *bench_setter(void *arg)
+{
+    struct bench_ctx *ctx = arg;
+
+    while (!ctx->stop) {
+        snd_use_case_set(uc_mgr, "_enadev", ctx->device);
+        snd_use_case_set(uc_mgr, "_disdev", ctx->device);
+        ctx->count += 2;
+    }
+    return NULL;
+}
+
+/* Query device status as a stream write path would, recording latency */
+static void *bench_getter(void *arg)
+{
+    struct bench_ctx *ctx = arg;
+    char ident[128];
+    uint64_t start;
+    long status;
+
+    snprintf(ident, sizeof(ident), "_devstatus/%s", ctx->device);
+    while (!ctx->stop) {
+        start = bench_now_us();
+        snd_use_case_geti(uc_mgr, ident, &status);
+        ctx->latency_us[ctx->count % BENCH_SAMPLES] = bench_now_us() - start;
+        ctx->count++;
+    }
+    ctx->samples = (ctx->count < BENCH_SAMPLES) ? ctx->count : BENCH_SAMPLES;
+    return NULL;
+}
+
+static int run_contention_bench(const char *device, int seconds)
+{
+    struct bench_ctx *ctx;
+    pthread_t threads[BENCH_GETTERS + 1];
+    uint64_t *samples;
+    unsigned long queries = 0;
+    int i, count = 0;
+
+    ctx = calloc(BENCH_GETTERS + 1, sizeof(*ctx));
+    samples = malloc(BENCH_GETTERS * BENCH_SAMPLES * sizeof(uint64_t));
+    if (!ctx || !samples) {
+        free(ctx);
+        free(samples);
+        return -ENOMEM;
+    }
+    for (i = 0; i <= BENCH_GETTERS; i++) {
+        ctx[i].device = device;
+        pthread_create(&threads[i], NULL,
+            (i == 0) ? bench_setter : bench_getter, &ctx[i]);
+    }
+    sleep(seconds);
+    for (i = 0; i <= BENCH_GETTERS; i++)
+        ctx[i].stop = 1;
+    for (i = 0; i <= BENCH_GETTERS; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 1; i <= BENCH_GETTERS; i++) {
+        memcpy(samples + count, ctx[i].latency_us,
+            ctx[i].samples * sizeof(uint64_t));
+        count += ctx[i].samples;
+        queries += ctx[i].count;
+    }
+    printf("%lu transitions, %lu queries from %d threads in %d s\n",
+           ctx[0].count, queries, BENCH_GETTERS, seconds);
+    if (count)
+        print_percentiles("query usec", samples, count);
+    free(samples);
+    free(ctx);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     char *help_str = "help";
@@ -320,6 +489,42 @@ static int process_cmd(char *cmdStr)
         printf("  %s=%li\n", identifier, lval);
         break;
 
+    case UCM_PROFILE:
+        if (!uc_mgr) {
+            fprintf(stderr, "No card is opened before. %s command can't be executed\n", cmd->cmd_str);
+            return -EINVAL;
+        }
+
+        if (!strcmp(identifier, "on") || !strcmp(identifier, "off")) {
+            err = snd_use_case_profile_enable(uc_mgr,
+                      !strcmp(identifier, "on"));
+        } else if (!strcmp(identifier, "clear")) {
+            err = snd_use_case_profile_reset(uc_mgr);
+        } else if (!strcmp(identifier, "report")) {
+            err = print_profile_report();
+        } else {
+            fprintf(stderr, "%s: unknown option %s\n", cmd->cmd_str, identifier);
+            return -EINVAL;
+        }
+        if (err < 0) {
+            fprintf(stderr, "%s: error failed to %s profile: %d\n", cmd->cmd_str, identifier, err);
+            return err;
+        }
+        break;
+
+    case UCM_BENCH:
+        if (!uc_mgr) {
+            fprintf(stderr, "No card is opened before. %s command can't be executed\n", cmd->cmd_str);
+            return -EINVAL;
+        }
+
+        err = run_contention_bench(identifier, (value && *value) ? atoi(value) : 5);
+        if (err < 0) {
+            fprintf(stderr, "%s: error failed to run benchmark: %d\n", cmd->cmd_str, err);
+            return err;
+        }
+        break;
+
     default:
         break;
     }
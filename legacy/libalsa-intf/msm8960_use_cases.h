@@ -37,6 +37,8 @@ extern "C" {
 #include "alsa_audio.h"
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
 #define SND_UCM_END_OF_LIST "end"
 
 /* ACDB Device ID macros */
@@ -125,13 +127,37 @@ typedef struct card_mctrl {
     char *ec_ref_rx_mixer_ctl;
 }card_mctrl_t;
 
-/* identifier node structure for identifier list*/
-struct snd_ucm_ident_node {
-    int active;
-    int capability;
-    char ident[MAX_STR_LEN];
-    struct snd_ucm_ident_node *next;
-};
+/* Maximum number of distinct device/modifier identifiers per card */
+#define SND_UCM_MAX_IDENTS 256
+/* Size of the identifier hash table, must be a power of 2 */
+#define SND_UCM_IDENT_HASH_SIZE 512
+/* Number of 32 bit words in an identifier bitset */
+#define SND_UCM_BITSET_WORDS (SND_UCM_MAX_IDENTS / 32)
+
+/* Interned identifier table, ids remain valid for the card lifetime */
+typedef struct snd_ucm_ident_table {
+    int count;
+    char ident[SND_UCM_MAX_IDENTS][MAX_STR_LEN];
+    /* open addressing hash table of (id + 1), 0 marks an empty slot */
+    int16_t hash[SND_UCM_IDENT_HASH_SIZE];
+}snd_ucm_ident_table_t;
+
+/* Enabled devices or modifiers, kept as bitsets over interned ids.
+ * order[] preserves the enable order for list queries, an identifier
+ * enabled more than once appears once per enable call and each entry
+ * keeps its own active state and capability. active[] and capability[]
+ * mirror the first entry of an identifier, which lookups by name use. */
+typedef struct snd_ucm_ident_set {
+    uint32_t enabled[SND_UCM_BITSET_WORDS];
+    uint32_t active[SND_UCM_BITSET_WORDS];
+    uint16_t refcount[SND_UCM_MAX_IDENTS];
+    uint8_t capability[SND_UCM_MAX_IDENTS];
+    int16_t order[SND_UCM_MAX_IDENTS];
+    uint8_t order_active[SND_UCM_MAX_IDENTS];
+    uint8_t order_capability[SND_UCM_MAX_IDENTS];
+    int count;
+    snd_ucm_ident_table_t *table;
+}snd_ucm_ident_set_t;
 
 /* Structure to maintain the valid devices and
  * modifiers list per each use case */
@@ -145,8 +171,58 @@ typedef struct use_case_verb {
     card_mctrl_t *verb_ctrls;
     card_mctrl_t *device_ctrls;
     card_mctrl_t *mod_ctrls;
+    /* verb config file state at parse time, used to detect changes on reload */
+    time_t file_mtime;
+    off_t file_size;
 }use_case_verb_t;
 
+/* Number of snd_use_case_set transitions kept by the profiler */
+#define SND_UCM_PROFILE_RING_SIZE 128
+
+/* Timing record of a single snd_use_case_set/snd_use_case_set_case call */
+typedef struct snd_ucm_transition_record {
+    char identifier[MAX_STR_LEN];
+    char value[MAX_STR_LEN];
+    int ret;
+    uint32_t ctls_looked_up;    /* mixer_get_control calls */
+    uint32_t ctls_written;      /* mixer_ctl_set/select/set_value calls */
+    uint64_t start_us;          /* CLOCK_MONOTONIC at entry */
+    uint64_t lock_wait_us;      /* time spent waiting for card_lock */
+    uint64_t ioctl_us;          /* time spent in mixer control writes */
+    uint64_t total_us;          /* entry to card_lock release */
+}snd_ucm_transition_record_t;
+
+/* Transition profiler state, only touched with card_lock held */
+typedef struct snd_ucm_profile {
+    int enabled;
+    int in_progress;
+    snd_ucm_transition_record_t current;
+    snd_ucm_transition_record_t ring[SND_UCM_PROFILE_RING_SIZE];
+    unsigned int head;
+    unsigned int count;
+}snd_ucm_profile_t;
+
+/* One identifier/value change of a snd_use_case_set_batch() call */
+typedef struct snd_use_case_op {
+    const char *identifier;
+    const char *value;
+}snd_use_case_op_t;
+
+/* Number of query state snapshots: the published one, the one being
+ * filled by the writer and spares for readers still on older ones */
+#define SND_UCM_STATE_SLOTS 4
+
+/* Card state read by status queries. A new snapshot is published by a
+ * pointer swap at the end of every transition so queries never wait on
+ * card_lock while mixer controls are being written. */
+typedef struct snd_ucm_state {
+    volatile int readers;
+    unsigned int generation;
+    char current_verb[MAX_STR_LEN];
+    uint32_t dev_enabled[SND_UCM_BITSET_WORDS];
+    uint32_t mod_enabled[SND_UCM_BITSET_WORDS];
+}snd_ucm_state_t;
+
 /* SND card context structure */
 typedef struct card_ctxt {
     char *card_name;
@@ -154,13 +230,19 @@ typedef struct card_ctxt {
     char *control_device;
     struct mixer *mixer_handle;
     char current_verb[MAX_STR_LEN];
-    struct snd_ucm_ident_node *dev_list_head;
-    struct snd_ucm_ident_node *mod_list_head;
+    snd_ucm_ident_table_t ident_table;
+    snd_ucm_ident_set_t dev_set;
+    snd_ucm_ident_set_t mod_set;
     pthread_mutex_t card_lock;
     pthread_mutexattr_t card_lock_attr;
     int current_verb_index;
     use_case_verb_t *use_case_verb_list;
     char **verb_list;
+    snd_ucm_profile_t profile;
+    /* set once all verb config files are parsed, reload is refused before */
+    int parse_complete;
+    snd_ucm_state_t state_pool[SND_UCM_STATE_SLOTS];
+    snd_ucm_state_t *volatile state;
 }card_ctxt_t;
 
 /** use case manager structure */
@@ -168,8 +250,8 @@ struct snd_use_case_mgr {
     int snd_card_index;
     int device_list_count;
     int modifier_list_count;
-    char **current_device_list;
-    char **current_modifier_list;
+    const char *current_device_list[SND_UCM_MAX_IDENTS];
+    const char *current_modifier_list[SND_UCM_MAX_IDENTS];
     int current_tx_device;
     int current_rx_device;
     card_ctxt_t *card_ctxt_ptr;
@@ -331,40 +413,96 @@ static card_mapping_t card_mapping_list[] = {
 #define SND_USE_CASE_MOD_PSEUDO_TUNNEL     "Pseudo Tunnel"
 #define SND_USE_CASE_MOD_PLAY_VOICE2             "Play Voice2"
 
+/* Interned ids of the known use case verbs and modifiers.
+ * Verb ids sort before SND_UCM_ID_MOD_FIRST, modifier ids after it.
+ */
+typedef enum snd_use_case_id {
+    SND_UCM_ID_NONE = -1,
+    SND_UCM_ID_VERB_INACTIVE = 0,
+    SND_UCM_ID_VERB_HIFI,
+    SND_UCM_ID_VERB_HIFI_LOW_POWER,
+    SND_UCM_ID_VERB_VOICE,
+    SND_UCM_ID_VERB_VOICE_LOW_POWER,
+    SND_UCM_ID_VERB_VOICECALL,
+    SND_UCM_ID_VERB_IP_VOICECALL,
+    SND_UCM_ID_VERB_ANALOG_RADIO,
+    SND_UCM_ID_VERB_DIGITAL_RADIO,
+    SND_UCM_ID_VERB_FM_REC,
+    SND_UCM_ID_VERB_FM_A2DP_REC,
+    SND_UCM_ID_VERB_HIFI_REC,
+    SND_UCM_ID_VERB_HIFI_LOWLATENCY_REC,
+    SND_UCM_ID_VERB_UL_REC,
+    SND_UCM_ID_VERB_DL_REC,
+    SND_UCM_ID_VERB_UL_DL_REC,
+    SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_DL,
+    SND_UCM_ID_VERB_CAPTURE_COMPRESSED_VOICE_UL_DL,
+    SND_UCM_ID_VERB_HIFI_TUNNEL,
+    SND_UCM_ID_VERB_HIFI_LOWLATENCY_MUSIC,
+    SND_UCM_ID_VERB_HIFI2,
+    SND_UCM_ID_VERB_INCALL_REC,
+    SND_UCM_ID_VERB_MI2S,
+    SND_UCM_ID_VERB_VOLTE,
+    SND_UCM_ID_VERB_ADSP_TESTFWK,
+    SND_UCM_ID_VERB_HIFI_REC2,
+    SND_UCM_ID_VERB_HIFI_REC_COMPRESSED,
+    SND_UCM_ID_VERB_HIFI3,
+    SND_UCM_ID_VERB_HIFI_TUNNEL2,
+    SND_UCM_ID_VERB_HIFI_PSEUDO_TUNNEL,
+    SND_UCM_ID_VERB_VOICE2,
+    SND_UCM_ID_MOD_CAPTURE_VOICE,
+    SND_UCM_ID_MOD_CAPTURE_MUSIC,
+    SND_UCM_ID_MOD_PLAY_MUSIC,
+    SND_UCM_ID_MOD_PLAY_VOICE,
+    SND_UCM_ID_MOD_PLAY_TONE,
+    SND_UCM_ID_MOD_ECHO_REF,
+    SND_UCM_ID_MOD_PLAY_FM,
+    SND_UCM_ID_MOD_CAPTURE_FM,
+    SND_UCM_ID_MOD_CAPTURE_LOWLATENCY_MUSIC,
+    SND_UCM_ID_MOD_CAPTURE_A2DP_FM,
+    SND_UCM_ID_MOD_PLAY_LPA,
+    SND_UCM_ID_MOD_PLAY_VOIP,
+    SND_UCM_ID_MOD_CAPTURE_VOIP,
+    SND_UCM_ID_MOD_CAPTURE_VOICE_UL,
+    SND_UCM_ID_MOD_CAPTURE_VOICE_DL,
+    SND_UCM_ID_MOD_CAPTURE_VOICE_UL_DL,
+    SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_DL,
+    SND_UCM_ID_MOD_CAPTURE_COMPRESSED_VOICE_UL_DL,
+    SND_UCM_ID_MOD_PLAY_TUNNEL,
+    SND_UCM_ID_MOD_PLAY_LOWLATENCY_MUSIC,
+    SND_UCM_ID_MOD_PLAY_MUSIC2,
+    SND_UCM_ID_MOD_PLAY_MI2S,
+    SND_UCM_ID_MOD_PLAY_VOLTE,
+    SND_UCM_ID_MOD_CAPTURE_MUSIC2,
+    SND_UCM_ID_MOD_CAPTURE_MUSIC_COMPRESSED,
+    SND_UCM_ID_MOD_PLAY_MUSIC3,
+    SND_UCM_ID_MOD_PLAY_TUNNEL1,
+    SND_UCM_ID_MOD_PLAY_TUNNEL2,
+    SND_UCM_ID_MOD_PSEUDO_TUNNEL,
+    SND_UCM_ID_MOD_PLAY_VOICE2,
+    SND_UCM_ID_MAX
+} snd_use_case_id_t;
+
+#define SND_UCM_ID_MOD_FIRST SND_UCM_ID_MOD_CAPTURE_VOICE
+#define SND_UCM_ID_IS_VERB(id) ((id) >= 0 && (id) < SND_UCM_ID_MOD_FIRST)
+#define SND_UCM_ID_IS_MOD(id) ((id) >= SND_UCM_ID_MOD_FIRST && (id) < SND_UCM_ID_MAX)
 
-/* List utility functions for maintaining enabled devices and modifiers */
-static int snd_ucm_add_ident_to_list(struct snd_ucm_ident_node **head, const char *value);
-static char *snd_ucm_get_value_at_index(struct snd_ucm_ident_node *head, int index);
-static int snd_ucm_get_size_of_list(struct snd_ucm_ident_node *head);
-static int snd_ucm_del_ident_from_list(struct snd_ucm_ident_node **head, const char *value);
-static int snd_ucm_free_list(struct snd_ucm_ident_node **head);
-static void snd_ucm_print_list(struct snd_ucm_ident_node *head);
-static void snd_ucm_set_status_at_index(struct snd_ucm_ident_node *head, const char *ident, int status, int capability);
-static int snd_ucm_get_status_at_index(struct snd_ucm_ident_node *head, const char *ident);
-struct snd_ucm_ident_node *snd_ucm_get_device_node(struct snd_ucm_ident_node *head, int index);
-static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name, int index);
-static int get_verb_count(const char *nxt_str);
 int snd_use_case_mgr_wait_for_parsing(snd_use_case_mgr_t *uc_mgr);
 int snd_use_case_set_case(snd_use_case_mgr_t *uc_mgr, const char *identifier,
                           const char *value, const char *usecase);
-static int get_usecase_type(snd_use_case_mgr_t *uc_mgr, const char *usecase);
-static int parse_single_config_format(snd_use_case_mgr_t **uc_mgr, char *current_str, int num_verbs);
-static int get_num_verbs_config_format(const char *nxt_str);
-static int get_num_device_config_format(const char *nxt_str);
-static int get_num_mod_config_format(const char *nxt_str);
-static int is_single_config_format(const char *nxt_str);
-/* Parse functions */
-static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr);
-static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str, char **nxt_str, int verb_index, int ctrl_list_type);
-static int snd_ucm_extract_name(char *buf, char **case_name);
-static int snd_ucm_extract_acdb(char *buf, int *id, int *cap);
-static int snd_ucm_extract_effects_mixer_ctl(char *buf, char **mixer_name);
-static int snd_ucm_extract_ec_ref_rx_mixer_ctl(char *buf, char **mixer_name);
-static int snd_ucm_extract_dev_name(char *buf, char **dev_name);
-static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int count);
-static int snd_ucm_extract_volume_mixer_ctl(char *buf, char **mixer_name);
-static int snd_ucm_print(snd_use_case_mgr_t *uc_mgr);
-static void snd_ucm_free_mixer_list(snd_use_case_mgr_t **uc_mgr);
+int snd_use_case_get_ident_id(snd_use_case_mgr_t *uc_mgr, const char *ident);
+int snd_use_case_get_dev_status(snd_use_case_mgr_t *uc_mgr, int ident_id);
+int snd_use_case_get_mod_status(snd_use_case_mgr_t *uc_mgr, int ident_id);
+int snd_use_case_name_to_id(const char *name);
+const char *snd_use_case_id_to_name(int id);
+int snd_use_case_set_id(snd_use_case_mgr_t *uc_mgr, const char *identifier, int id);
+int snd_use_case_set_batch(snd_use_case_mgr_t *uc_mgr, const snd_use_case_op_t *ops, int count);
+int snd_use_case_get_verb_id(snd_use_case_mgr_t *uc_mgr);
+int snd_use_case_get_mod_status_id(snd_use_case_mgr_t *uc_mgr, int id);
+int snd_use_case_profile_enable(snd_use_case_mgr_t *uc_mgr, int enable);
+int snd_use_case_profile_reset(snd_use_case_mgr_t *uc_mgr);
+int snd_use_case_get_profile(snd_use_case_mgr_t *uc_mgr,
+                             snd_ucm_transition_record_t *records, int max);
+
 #ifdef __cplusplus
 }
 #endif